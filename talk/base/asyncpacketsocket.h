@@ -59,6 +59,22 @@ class AsyncPacketSocket : public sigslot::has_slots<> {
   virtual int Send(const void *pv, size_t cb) = 0;
   virtual int SendTo(const void *pv, size_t cb, const SocketAddress& addr) = 0;
 
+  // Sends several packets at once. Returns the number of packets sent, or -1
+  // if the first one failed.
+  virtual int SendToBatch(const Datagram* packets, size_t count) {
+    size_t i = 0;
+    for (; i < count; ++i) {
+      if (SendTo(packets[i].data, packets[i].size, packets[i].addr) < 0)
+        break;
+    }
+    return (i == 0 && count != 0) ? -1 : static_cast<int>(i);
+  }
+
+  // Sets the maximum number of packets read each time the socket becomes
+  // readable. Returns false if the socket can't read in batches; all sockets
+  // support a batch size of 1, which is the default.
+  virtual bool SetReceiveBatchSize(size_t count) { return count == 1; }
+
   // Close the socket.
   virtual int Close() = 0;
 
@@ -79,6 +95,12 @@ class AsyncPacketSocket : public sigslot::has_slots<> {
   sigslot::signal4<AsyncPacketSocket*, const char*, size_t,
                    const SocketAddress&> SignalReadPacket;
 
+  // Emitted with all the packets read in one go when the receive batch size
+  // is greater than 1. While anything is connected to this signal, batched
+  // packets are delivered only through it rather than SignalReadPacket.
+  sigslot::signal3<AsyncPacketSocket*, const Datagram*, size_t>
+      SignalReadPacketBatch;
+
   // Emitted after address for the socket is allocated, i.e. binding
   // is finished. State of the socket is changed from BINDING to BOUND
   // (for UDP and server TCP sockets) or CONNECTING (for client TCP
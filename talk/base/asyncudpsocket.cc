@@ -31,6 +31,10 @@
 namespace talk_base {
 
 static const int BUF_SIZE = 64 * 1024;
+// Size of each slot of the receive buffer when reading in batches. Packets
+// larger than this are dropped, as are packets of exactly this size where
+// the socket can't detect truncation, so it must exceed the path MTU.
+static const size_t kBatchSlotSize = 2048;
 
 AsyncUDPSocket* AsyncUDPSocket::Create(
     AsyncSocket* socket,
@@ -83,6 +87,24 @@ int AsyncUDPSocket::SendTo(
   return socket_->SendTo(pv, cb, addr);
 }
 
+int AsyncUDPSocket::SendToBatch(const Datagram* packets, size_t count) {
+  return socket_->SendToBatch(packets, count);
+}
+
+bool AsyncUDPSocket::SetReceiveBatchSize(size_t count) {
+  if (count < 1 || count > size_ / kBatchSlotSize) {
+    return false;
+  }
+  batch_.clear();
+  if (count > 1) {
+    for (size_t i = 0; i < count; ++i) {
+      batch_.push_back(Datagram(buf_ + i * kBatchSlotSize,
+                                kBatchSlotSize, SocketAddress()));
+    }
+  }
+  return true;
+}
+
 int AsyncUDPSocket::Close() {
   return socket_->Close();
 }
@@ -109,6 +131,10 @@ void AsyncUDPSocket::SetError(int error) {
 
 void AsyncUDPSocket::OnReadEvent(AsyncSocket* socket) {
   ASSERT(socket_.get() == socket);
+  if (!batch_.empty()) {
+    ReadBatch();
+    return;
+  }
 
   SocketAddress remote_addr;
   int len = socket_->RecvFrom(buf_, size_, &remote_addr);
@@ -128,4 +154,31 @@ void AsyncUDPSocket::OnReadEvent(AsyncSocket* socket) {
   SignalReadPacket(this, buf_, (size_t)len, remote_addr);
 }
 
+void AsyncUDPSocket::ReadBatch() {
+  // The previous batch left the received lengths in the slots.
+  for (size_t i = 0; i < batch_.size(); ++i) {
+    batch_[i].size = kBatchSlotSize;
+  }
+  int count = socket_->RecvFromBatch(&batch_[0], batch_.size());
+  if (count < 0) {
+    // See OnReadEvent().
+    SocketAddress local_addr = socket_->GetLocalAddress();
+    LOG(LS_INFO) << "AsyncUDPSocket[" << local_addr.ToString() << "] "
+                 << "batch receive failed with error " << socket_->GetError();
+    return;
+  }
+  if (count == 0) {
+    // Everything read was dropped as too large.
+    return;
+  }
+
+  if (!SignalReadPacketBatch.is_empty()) {
+    SignalReadPacketBatch(this, &batch_[0], static_cast<size_t>(count));
+  } else {
+    for (int i = 0; i < count; ++i) {
+      SignalReadPacket(this, batch_[i].data, batch_[i].size, batch_[i].addr);
+    }
+  }
+}
+
 }  // namespace talk_base
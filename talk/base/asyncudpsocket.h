@@ -28,6 +28,8 @@
 #ifndef TALK_BASE_ASYNCUDPSOCKET_H_
 #define TALK_BASE_ASYNCUDPSOCKET_H_
 
+#include <vector>
+
 #include "talk/base/asyncpacketsocket.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketfactory.h"
@@ -54,6 +56,8 @@ class AsyncUDPSocket : public AsyncPacketSocket {
   virtual SocketAddress GetRemoteAddress() const;
   virtual int Send(const void *pv, size_t cb);
   virtual int SendTo(const void *pv, size_t cb, const SocketAddress& addr);
+  virtual int SendToBatch(const Datagram* packets, size_t count);
+  virtual bool SetReceiveBatchSize(size_t count);
   virtual int Close();
 
   virtual State GetState() const;
@@ -65,10 +69,13 @@ class AsyncUDPSocket : public AsyncPacketSocket {
  private:
   // Called when the underlying socket is ready to be read from.
   void OnReadEvent(AsyncSocket* socket);
+  void ReadBatch();
 
   scoped_ptr<AsyncSocket> socket_;
   char* buf_;
   size_t size_;
+  // When reading in batches, buf_ is split into one slot per packet.
+  std::vector<Datagram> batch_;
 };
 
 }  // namespace talk_base
@@ -30,29 +30,35 @@
 
 #include <cstring>
 
-#include "talk/base/scoped_ptr.h"
+#include "talk/base/basictypes.h"
+#include "talk/base/common.h"
+#include "talk/base/packetpool.h"
 
 namespace talk_base {
 
 // Basic buffer class, can be grown and shrunk dynamically.
 // Unlike std::string/vector, does not initialize data when expanding capacity.
+// The memory comes from the calling thread's PacketPool.
 class Buffer {
  public:
-  Buffer() {
+  Buffer() : data_(NULL) {
     Construct(NULL, 0, 0);
   }
-  Buffer(const void* data, size_t length) {
+  Buffer(const void* data, size_t length) : data_(NULL) {
     Construct(data, length, length);
   }
-  Buffer(const void* data, size_t length, size_t capacity) {
+  Buffer(const void* data, size_t length, size_t capacity) : data_(NULL) {
     Construct(data, length, capacity);
   }
-  Buffer(const Buffer& buf) {
+  Buffer(const Buffer& buf) : data_(NULL) {
     Construct(buf.data(), buf.length(), buf.length());
   }
+  ~Buffer() {
+    PacketPool::Free(data_);
+  }
 
-  const char* data() const { return data_.get(); }
-  char* data() { return data_.get(); }
+  const char* data() const { return data_; }
+  char* data() { return data_; }
   // TODO: should this be size(), like STL?
   size_t length() const { return length_; }
   size_t capacity() const { return capacity_; }
@@ -65,7 +71,7 @@ class Buffer {
   }
   bool operator==(const Buffer& buf) const {
     return (length_ == buf.length() &&
-            memcmp(data_.get(), buf.data(), length_) == 0);
+            (length_ == 0 || memcmp(data_, buf.data(), length_) == 0));
   }
   bool operator!=(const Buffer& buf) const {
     return !operator==(buf);
@@ -74,13 +80,15 @@ class Buffer {
   void SetData(const void* data, size_t length) {
     ASSERT(data != NULL || length == 0);
     SetLength(length);
-    memcpy(data_.get(), data, length);
+    if (length)
+      memcpy(data_, data, length);
   }
   void AppendData(const void* data, size_t length) {
     ASSERT(data != NULL || length == 0);
     size_t old_length = length_;
     SetLength(length_ + length);
-    memcpy(data_.get() + old_length, data, length);
+    if (length)
+      memcpy(data_ + old_length, data, length);
   }
   void SetLength(size_t length) {
     SetCapacity(length);
@@ -88,28 +96,42 @@ class Buffer {
   }
   void SetCapacity(size_t capacity) {
     if (capacity > capacity_) {
-      talk_base::scoped_array<char> data(new char[capacity]);
-      memcpy(data.get(), data_.get(), length_);
-      data_.swap(data);
+      char* data = Allocate(capacity);
+      if (length_)
+        memcpy(data, data_, length_);
+      PacketPool::Free(data_);
+      data_ = data;
       capacity_ = capacity;
     }
   }
 
   void TransferTo(Buffer* buf) {
     ASSERT(buf != NULL);
-    buf->data_.reset(data_.release());
+    if (buf == this)
+      return;
+    PacketPool::Free(buf->data_);
+    buf->data_ = data_;
     buf->length_ = length_;
     buf->capacity_ = capacity_;
+    data_ = NULL;
     Construct(NULL, 0, 0);
   }
 
  protected:
+  static char* Allocate(size_t capacity) {
+    if (capacity == 0)
+      return NULL;
+    return static_cast<char*>(PacketPool::Allocate(capacity));
+  }
+
   void Construct(const void* data, size_t length, size_t capacity) {
-    data_.reset(new char[capacity_ = capacity]);
+    PacketPool::Free(data_);
+    data_ = Allocate(capacity_ = capacity);
+    length_ = 0;
     SetData(data, length);
   }
 
-  scoped_array<char> data_;
+  char* data_;
   size_t length_;
   size_t capacity_;
 };
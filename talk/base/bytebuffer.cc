@@ -33,6 +33,7 @@
 
 #include "talk/base/basictypes.h"
 #include "talk/base/byteorder.h"
+#include "talk/base/packetpool.h"
 
 namespace talk_base {
 
@@ -64,7 +65,7 @@ void ByteBuffer::Construct(const char* bytes, size_t len,
   start_ = 0;
   size_ = len;
   byte_order_ = byte_order;
-  bytes_ = new char[size_];
+  bytes_ = static_cast<char*>(PacketPool::Allocate(size_));
 
   if (bytes) {
     end_ = len;
@@ -75,7 +76,7 @@ void ByteBuffer::Construct(const char* bytes, size_t len,
 }
 
 ByteBuffer::~ByteBuffer() {
-  delete[] bytes_;
+  PacketPool::Free(bytes_);
 }
 
 bool ByteBuffer::ReadUInt8(uint8* val) {
@@ -212,9 +213,9 @@ void ByteBuffer::Resize(size_t size) {
   } else {
     // Reallocate a larger buffer.
     size_ = _max(size, 3 * size_ / 2);
-    char* new_bytes = new char[size_];
+    char* new_bytes = static_cast<char*>(PacketPool::Allocate(size_));
     memcpy(new_bytes, bytes_ + start_, len);
-    delete [] bytes_;
+    PacketPool::Free(bytes_);
     bytes_ = new_bytes;
   }
   start_ = 0;
@@ -28,6 +28,29 @@
 #include "talk/base/crc32.h"
 
 #include "talk/base/basicdefs.h"
+#include "talk/base/common.h"
+#include "talk/base/systeminfo.h"
+
+// Carry-less multiplication needs no compiler flags; the kernel is compiled
+// for it with a target attribute (or freely, on MSVC), and only called once
+// cpuid says it's there.
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(_MSC_VER))
+#define CRC32_HAS_PCLMUL 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#if defined(__GNUC__)
+#define CRC32_TARGET_PCLMUL __attribute__((target("sse2,pclmul")))
+#else
+#define CRC32_TARGET_PCLMUL
+#endif
+#endif
+
+// The ARMv8 CRC32 instructions are only used when building for a CPU that
+// has them.
+#if defined(__ARM_FEATURE_CRC32)
+#define CRC32_HAS_ARM 1
+#include <arm_acle.h>
+#endif
 
 namespace talk_base {
 
@@ -36,12 +59,14 @@ namespace talk_base {
 // CRC32 polynomial, in reversed form.
 // See RFC 1952, or http://en.wikipedia.org/wiki/Cyclic_redundancy_check
 static const uint32 kCrc32Polynomial = 0xEDB88320;
-static uint32 kCrc32Table[256] = { 0 };
+// kCrc32Tables[0] is the usual byte-at-a-time table; kCrc32Tables[k][i] is
+// the CRC of byte i followed by k zero bytes, for slicing-by-8.
+static uint32 kCrc32Tables[8][256] = { { 0 } };
 
 static void EnsureCrc32TableInited() {
-  if (kCrc32Table[ARRAY_SIZE(kCrc32Table) - 1])
+  if (kCrc32Tables[7][ARRAY_SIZE(kCrc32Tables[7]) - 1])
     return;  // already inited
-  for (uint32 i = 0; i < ARRAY_SIZE(kCrc32Table); ++i) {
+  for (uint32 i = 0; i < ARRAY_SIZE(kCrc32Tables[0]); ++i) {
     uint32 c = i;
     for (size_t j = 0; j < 8; ++j) {
       if (c & 1) {
@@ -50,20 +75,193 @@ static void EnsureCrc32TableInited() {
         c >>= 1;
       }
     }
-    kCrc32Table[i] = c;
+    kCrc32Tables[0][i] = c;
+  }
+  for (size_t k = 1; k < ARRAY_SIZE(kCrc32Tables); ++k) {
+    for (uint32 i = 0; i < ARRAY_SIZE(kCrc32Tables[k]); ++i) {
+      uint32 c = kCrc32Tables[k - 1][i];
+      kCrc32Tables[k][i] = kCrc32Tables[0][c & 0xFF] ^ (c >> 8);
+    }
   }
 }
 
-uint32 UpdateCrc32(uint32 start, const void* buf, size_t len) {
-  EnsureCrc32TableInited();
+static inline uint32 GetLE32(const uint8* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32>(p[3]) << 24);
+}
 
-  uint32 c = start ^ 0xFFFFFFFF;
-  const uint8* u = static_cast<const uint8*>(buf);
+// The kernels below take and return the CRC register, i.e. the checksum
+// with its bits inverted.
+
+static uint32 Crc32Bytewise(uint32 c, const uint8* u, size_t len) {
   for (size_t i = 0; i < len; ++i) {
-    c = kCrc32Table[(c ^ u[i]) & 0xFF] ^ (c >> 8);
+    c = kCrc32Tables[0][(c ^ u[i]) & 0xFF] ^ (c >> 8);
+  }
+  return c;
+}
+
+static uint32 Crc32Slice8(uint32 c, const uint8* u, size_t len) {
+  for (; len >= 8; u += 8, len -= 8) {
+    uint32 lo = GetLE32(u) ^ c;
+    uint32 hi = GetLE32(u + 4);
+    c = kCrc32Tables[7][lo & 0xFF] ^
+        kCrc32Tables[6][(lo >> 8) & 0xFF] ^
+        kCrc32Tables[5][(lo >> 16) & 0xFF] ^
+        kCrc32Tables[4][lo >> 24] ^
+        kCrc32Tables[3][hi & 0xFF] ^
+        kCrc32Tables[2][(hi >> 8) & 0xFF] ^
+        kCrc32Tables[1][(hi >> 16) & 0xFF] ^
+        kCrc32Tables[0][hi >> 24];
   }
+  return Crc32Bytewise(c, u, len);
+}
+
+#if defined(CRC32_HAS_PCLMUL)
+// Folds |len| bytes, a multiple of 16 and at least 64, into the CRC with
+// carry-less multiplication, following Intel's "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ Instruction". The constants are
+// x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32) and x^64 mod P(x),
+// then floor(x^64 / P(x)) and P(x) itself, all bit-reflected.
+CRC32_TARGET_PCLMUL
+static uint32 Crc32PclmulFold(uint32 c, const uint8* u, size_t len) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  const __m128i* p = reinterpret_cast<const __m128i*>(u);
+  __m128i x1 = _mm_loadu_si128(p);
+  __m128i x2 = _mm_loadu_si128(p + 1);
+  __m128i x3 = _mm_loadu_si128(p + 2);
+  __m128i x4 = _mm_loadu_si128(p + 3);
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(c)));
+  p += 4;
+  len -= 64;
+
+  // Fold four blocks at a time.
+  for (; len >= 64; p += 4, len -= 64) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(p));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(p + 1));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(p + 2));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(p + 3));
+  }
+
+  // Fold the four blocks into one, then fold in any remaining blocks.
+  __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+  for (; len >= 16; ++p, len -= 16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(p)), x5);
+  }
+
+  // Fold 128 bits down to 64.
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits.
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return static_cast<uint32>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+static uint32 Crc32Pclmul(uint32 c, const uint8* u, size_t len) {
+  if (len >= 64) {
+    size_t folded = len & ~static_cast<size_t>(15);
+    c = Crc32PclmulFold(c, u, folded);
+    u += folded;
+    len -= folded;
+  }
+  return Crc32Slice8(c, u, len);
+}
+#endif  // CRC32_HAS_PCLMUL
+
+#if defined(CRC32_HAS_ARM)
+static uint32 Crc32Arm(uint32 c, const uint8* u, size_t len) {
+  for (; len >= 4; u += 4, len -= 4) {
+    c = __crc32w(c, GetLE32(u));
+  }
+  for (; len > 0; ++u, --len) {
+    c = __crc32b(c, *u);
+  }
+  return c;
+}
+#endif  // CRC32_HAS_ARM
+
+typedef uint32 (*Crc32Function)(uint32 c, const uint8* u, size_t len);
+
+// The kernels this CPU can run, indexed by Crc32Kernel, and the fastest one.
+static Crc32Function g_crc32_kernels[CRC32_KERNEL_ARM + 1] = { NULL };
+static Crc32Function g_crc32_best = NULL;
+
+static void EnsureCrc32Inited() {
+  if (g_crc32_best)
+    return;  // already inited
+  EnsureCrc32TableInited();
+  g_crc32_kernels[CRC32_KERNEL_BYTEWISE] = Crc32Bytewise;
+  g_crc32_kernels[CRC32_KERNEL_SLICE8] = Crc32Slice8;
+  Crc32Function best = Crc32Slice8;
+#if defined(CRC32_HAS_PCLMUL)
+  if (SystemInfo::HasCpuFeature(SystemInfo::SI_FEATURE_PCLMULQDQ)) {
+    g_crc32_kernels[CRC32_KERNEL_PCLMUL] = Crc32Pclmul;
+    best = Crc32Pclmul;
+  }
+#endif
+#if defined(CRC32_HAS_ARM)
+  if (SystemInfo::HasCpuFeature(SystemInfo::SI_FEATURE_ARM_CRC32)) {
+    g_crc32_kernels[CRC32_KERNEL_ARM] = Crc32Arm;
+    best = Crc32Arm;
+  }
+#endif
+  g_crc32_best = best;
+}
+
+uint32 UpdateCrc32(uint32 start, const void* buf, size_t len) {
+  EnsureCrc32Inited();
+
+  uint32 c = start ^ 0xFFFFFFFF;
+  c = g_crc32_best(c, static_cast<const uint8*>(buf), len);
   return c ^ 0xFFFFFFFF;
 }
 
-}  // namespace talk_base
+bool IsCrc32KernelSupported(Crc32Kernel kernel) {
+  EnsureCrc32Inited();
+  return kernel >= 0 &&
+      kernel < static_cast<int>(ARRAY_SIZE(g_crc32_kernels)) &&
+      g_crc32_kernels[kernel] != NULL;
+}
 
+uint32 UpdateCrc32WithKernel(Crc32Kernel kernel, uint32 start,
+                             const void* buf, size_t len) {
+  ASSERT(IsCrc32KernelSupported(kernel));
+  if (!IsCrc32KernelSupported(kernel))
+    return UpdateCrc32(start, buf, len);
+
+  uint32 c = start ^ 0xFFFFFFFF;
+  c = g_crc32_kernels[kernel](c, static_cast<const uint8*>(buf), len);
+  return c ^ 0xFFFFFFFF;
+}
+
+}  // namespace talk_base
@@ -46,6 +46,22 @@ inline uint32 ComputeCrc32(const std::string& str) {
   return ComputeCrc32(str.c_str(), str.size());
 }
 
+// The ways a CRC32 can be computed. UpdateCrc32 uses the fastest one that the
+// CPU supports; the others remain available for tests and benchmarks.
+enum Crc32Kernel {
+  CRC32_KERNEL_BYTEWISE = 0,  // one table lookup per byte
+  CRC32_KERNEL_SLICE8 = 1,    // eight table lookups per 8 bytes
+  CRC32_KERNEL_PCLMUL = 2,    // x86 carry-less multiplication folding
+  CRC32_KERNEL_ARM = 3        // ARMv8 CRC32 instructions
+};
+
+// Returns true if |kernel| is built in and supported by this CPU.
+bool IsCrc32KernelSupported(Crc32Kernel kernel);
+
+// Like UpdateCrc32, using |kernel|, which must be supported.
+uint32 UpdateCrc32WithKernel(Crc32Kernel kernel, uint32 initial,
+                             const void* buf, size_t len);
+
 }  // namespace talk_base
 
 #endif  // TALK_BASE_CRC32_H_
@@ -27,6 +27,8 @@
 
 #include "talk/base/crc32.h"
 #include "talk/base/gunit.h"
+#include "talk/base/logging.h"
+#include "talk/base/timeutils.h"
 
 #include <string>
 
@@ -49,4 +51,74 @@ TEST(Crc32Test, TestMultipleUpdates) {
   EXPECT_EQ(0x171A3F5FU, c);
 }
 
+static const Crc32Kernel kKernels[] = {
+  CRC32_KERNEL_BYTEWISE,
+  CRC32_KERNEL_SLICE8,
+  CRC32_KERNEL_PCLMUL,
+  CRC32_KERNEL_ARM,
+};
+
+static const char* const kKernelNames[] = {
+  "bytewise", "slice8", "pclmul", "arm",
+};
+
+// Test that every supported kernel agrees with the bytewise one, for all
+// lengths around the block sizes they use and at every alignment.
+TEST(Crc32Test, TestKernelsMatch) {
+  EXPECT_TRUE(IsCrc32KernelSupported(CRC32_KERNEL_BYTEWISE));
+  EXPECT_TRUE(IsCrc32KernelSupported(CRC32_KERNEL_SLICE8));
+
+  std::string input;
+  for (int i = 0; i < 1100; ++i) {
+    input.push_back(static_cast<char>(i * 167 + (i >> 3)));
+  }
+  for (size_t k = 0; k < ARRAY_SIZE(kKernels); ++k) {
+    if (!IsCrc32KernelSupported(kKernels[k])) {
+      LOG(LS_INFO) << "CRC32 kernel " << kKernelNames[k] << " not supported";
+      continue;
+    }
+    for (size_t offset = 0; offset < 16; ++offset) {
+      for (size_t len = 0; len <= 300; ++len) {
+        uint32 start = static_cast<uint32>(len * 0x9E3779B9U);
+        EXPECT_EQ(UpdateCrc32WithKernel(CRC32_KERNEL_BYTEWISE, start,
+                                        input.data() + offset, len),
+                  UpdateCrc32WithKernel(kKernels[k], start,
+                                        input.data() + offset, len))
+            << kKernelNames[k] << " offset " << offset << " len " << len;
+      }
+    }
+    EXPECT_EQ(UpdateCrc32WithKernel(CRC32_KERNEL_BYTEWISE, 0,
+                                    input.data(), input.size()),
+              UpdateCrc32WithKernel(kKernels[k], 0,
+                                    input.data(), input.size()))
+        << kKernelNames[k];
+    EXPECT_EQ(0x171A3F5FU, UpdateCrc32WithKernel(kKernels[k], 0,
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56))
+        << kKernelNames[k];
+  }
+}
+
+// Measures each supported kernel on STUN-sized and larger buffers.
+TEST(Crc32Test, TestKernelThroughput) {
+  const size_t kSizes[] = { 92, 1200 };
+  const size_t kTotal = 16 * 1024 * 1024;
+  std::string input(kSizes[ARRAY_SIZE(kSizes) - 1], 'x');
+  for (size_t k = 0; k < ARRAY_SIZE(kKernels); ++k) {
+    if (!IsCrc32KernelSupported(kKernels[k]))
+      continue;
+    for (size_t s = 0; s < ARRAY_SIZE(kSizes); ++s) {
+      uint32 c = 0;
+      uint32 start = Time();
+      for (size_t done = 0; done < kTotal; done += kSizes[s]) {
+        c = UpdateCrc32WithKernel(kKernels[k], c, input.data(), kSizes[s]);
+      }
+      int elapsed = TimeSince(start);
+      LOG(LS_INFO) << "CRC32 " << kKernelNames[k] << ", " << kSizes[s]
+                   << "-byte buffers: "
+                   << (kTotal / 1000.0 / (elapsed > 0 ? elapsed : 1))
+                   << " MB/s (crc " << c << ")";
+    }
+  }
+}
+
 }  // namespace talk_base
@@ -183,6 +183,79 @@ class AtomicOps {
   static int Decrement(int* i) {
     return ::InterlockedDecrement(reinterpret_cast<LONG*>(i));
   }
+
+  // Atomically stores |value| in |*ptr| and returns the previous value. Acts
+  // as a full memory barrier.
+  static void* ExchangePtr(void* volatile* ptr, void* value) {
+    return ::InterlockedExchangePointer(ptr, value);
+  }
+  // Loads |*ptr|; later memory accesses can't be reordered before it.
+  static void* AcquireLoadPtr(void* volatile* ptr) {
+    void* value = *ptr;
+    ::MemoryBarrier();
+    return value;
+  }
+  // Stores |value| in |*ptr|; earlier memory accesses can't be reordered
+  // after it.
+  static void ReleaseStorePtr(void* volatile* ptr, void* value) {
+    ::MemoryBarrier();
+    *ptr = value;
+  }
+  // Integer versions of the above.
+  static int AcquireLoad(const volatile int* i) {
+    int value = *i;
+    ::MemoryBarrier();
+    return value;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    ::MemoryBarrier();
+    *i = value;
+  }
+  // Stores |new_value| in |*i| if it holds |old_value|. Returns the previous
+  // value either way. Acts as a full memory barrier.
+  static int CompareAndSwap(volatile int* i, int old_value, int new_value) {
+    return ::InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(i),
+                                        new_value, old_value);
+  }
+#elif defined(__GNUC__)
+  static int Increment(int* i) {
+    return __sync_add_and_fetch(i, 1);
+  }
+  static int Decrement(int* i) {
+    return __sync_sub_and_fetch(i, 1);
+  }
+
+  // See the WIN32 versions above.
+  static void* ExchangePtr(void* volatile* ptr, void* value) {
+    // __sync_lock_test_and_set() is only an acquire barrier, so use a
+    // compare-and-swap loop, which is a full barrier.
+    void* old_value;
+    do {
+      old_value = *ptr;
+    } while (__sync_val_compare_and_swap(ptr, old_value, value) != old_value);
+    return old_value;
+  }
+  static void* AcquireLoadPtr(void* volatile* ptr) {
+    void* value = *ptr;
+    __sync_synchronize();
+    return value;
+  }
+  static void ReleaseStorePtr(void* volatile* ptr, void* value) {
+    __sync_synchronize();
+    *ptr = value;
+  }
+  static int AcquireLoad(const volatile int* i) {
+    int value = *i;
+    __sync_synchronize();
+    return value;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    __sync_synchronize();
+    *i = value;
+  }
+  static int CompareAndSwap(volatile int* i, int old_value, int new_value) {
+    return __sync_val_compare_and_swap(i, old_value, new_value);
+  }
 #else
   static int Increment(int* i) {
     // Could be faster, and less readable:
@@ -200,6 +273,37 @@ class AtomicOps {
     return --(*i);
   }
 
+  static void* ExchangePtr(void* volatile* ptr, void* value) {
+    CritScope scope(StaticCrit());
+    void* old_value = *ptr;
+    *ptr = value;
+    return old_value;
+  }
+  static void* AcquireLoadPtr(void* volatile* ptr) {
+    CritScope scope(StaticCrit());
+    return *ptr;
+  }
+  static void ReleaseStorePtr(void* volatile* ptr, void* value) {
+    CritScope scope(StaticCrit());
+    *ptr = value;
+  }
+  static int AcquireLoad(const volatile int* i) {
+    CritScope scope(StaticCrit());
+    return *i;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    CritScope scope(StaticCrit());
+    *i = value;
+  }
+  static int CompareAndSwap(volatile int* i, int old_value, int new_value) {
+    CritScope scope(StaticCrit());
+    int value = *i;
+    if (value == old_value) {
+      *i = new_value;
+    }
+    return value;
+  }
+
  private:
   static CriticalSection* StaticCrit() {
     static CriticalSection* crit = new CriticalSection();
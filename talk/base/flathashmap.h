@@ -0,0 +1,183 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_FLATHASHMAP_H_
+#define TALK_BASE_FLATHASHMAP_H_
+
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/common.h"
+
+namespace talk_base {
+
+// Hasher for integer keys, such as SSRCs or channel numbers.
+struct IntegerHasher {
+  size_t operator()(uint32 key) const { return key; }
+};
+
+// Hash map for small keys and values that are looked up on every packet.
+// The entries live in one power-of-two array (linear probing), which is kept
+// at most half full so probe runs stay short. Erase() shifts back the entries
+// that follow in the probe run, so that lookups never need tombstones.
+//
+// Key needs operator==. Hasher is a functor taking a Key and returning a
+// size_t; its result is mixed again here, so it need not spread its bits.
+// Key and Value must be cheap to copy; the table moves them when it grows.
+template <class Key, class Value, class Hasher>
+class FlatHashMap {
+ public:
+  FlatHashMap() : size_(0) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns the value stored for |key|, or NULL if there is none.
+  Value* Find(const Key& key) {
+    size_t i = Lookup(key, Mix(hasher_(key)));
+    return (i != kNotFound) ? &slots_[i].value : NULL;
+  }
+  const Value* Find(const Key& key) const {
+    size_t i = Lookup(key, Mix(hasher_(key)));
+    return (i != kNotFound) ? &slots_[i].value : NULL;
+  }
+
+  // Adds |key| with |value|. Returns false, and changes nothing, if |key| is
+  // already there.
+  bool Insert(const Key& key, const Value& value) {
+    uint32 hash = Mix(hasher_(key));
+    if (Lookup(key, hash) != kNotFound)
+      return false;
+    if ((size_ + 1) * 2 > slots_.size())
+      Grow();
+    Place(key, value, hash);
+    return true;
+  }
+
+  // Returns false if |key| wasn't there.
+  bool Erase(const Key& key) {
+    size_t i = Lookup(key, Mix(hasher_(key)));
+    if (i == kNotFound)
+      return false;
+    size_t mask = slots_.size() - 1;
+    for (size_t j = (i + 1) & mask; slots_[j].used; j = (j + 1) & mask) {
+      // Move the entry at j back to i unless its home lies after i.
+      size_t home = slots_[j].hash & mask;
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+        slots_[i] = slots_[j];
+        i = j;
+      }
+    }
+    slots_[i] = Slot();
+    --size_;
+    return true;
+  }
+
+  void Clear() {
+    slots_.clear();
+    size_ = 0;
+  }
+
+  // Appends every value to |values|, in no particular order.
+  void GetValues(std::vector<Value>* values) const {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i].used)
+        values->push_back(slots_[i].value);
+    }
+  }
+
+ private:
+  struct Slot {
+    Slot() : key(), value(), hash(0), used(false) {}
+    Key key;
+    Value value;
+    uint32 hash;
+    bool used;
+  };
+
+  static const size_t kNotFound = static_cast<size_t>(-1);
+  static const size_t kMinSize = 8;
+
+  // Keys such as small sequential SSRCs or IPv4 addresses in network order
+  // differ in only a few bits, at either end; every bit of the hash must
+  // reach the low bits that pick the slot, or they pile into one probe run.
+  // This is the MurmurHash3 finalizer.
+  static uint32 Mix(size_t hash) {
+    uint64 wide = hash;
+    uint32 h = static_cast<uint32>(wide ^ (wide >> 32));
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    return h ^ (h >> 16);
+  }
+
+  size_t Lookup(const Key& key, uint32 hash) const {
+    if (slots_.empty())
+      return kNotFound;
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask; slots_[i].used; i = (i + 1) & mask) {
+      if (slots_[i].hash == hash && slots_[i].key == key)
+        return i;
+    }
+    return kNotFound;
+  }
+
+  void Place(const Key& key, const Value& value, uint32 hash) {
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i].used)
+      i = (i + 1) & mask;
+    slots_[i].key = key;
+    slots_[i].value = value;
+    slots_[i].hash = hash;
+    slots_[i].used = true;
+    ++size_;
+  }
+
+  void Grow() {
+    std::vector<Slot> old;
+    old.swap(slots_);
+    size_t new_size = old.size() * 2;
+    if (new_size < kMinSize)
+      new_size = kMinSize;
+    slots_.resize(new_size);
+    size_ = 0;
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].used)
+        Place(old[i].key, old[i].value, old[i].hash);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_;
+  Hasher hasher_;
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_FLATHASHMAP_H_
@@ -0,0 +1,167 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "talk/base/flathashmap.h"
+#include "talk/base/gunit.h"
+#include "talk/base/logging.h"
+#include "talk/base/socketaddress.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+
+// Sends every key to the same slot, so that all entries share a probe run.
+struct CollidingHasher {
+  size_t operator()(int key) const { return 0; }
+};
+
+typedef FlatHashMap<int, int, IntegerHasher> IntMap;
+
+TEST(FlatHashMapTest, InsertFindErase) {
+  IntMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.Find(1) == NULL);
+  EXPECT_FALSE(map.Erase(1));
+
+  EXPECT_TRUE(map.Insert(1, 10));
+  EXPECT_TRUE(map.Insert(2, 20));
+  EXPECT_FALSE(map.Insert(1, 11));
+  EXPECT_EQ(2U, map.size());
+  ASSERT_TRUE(map.Find(1) != NULL);
+  EXPECT_EQ(10, *map.Find(1));
+  EXPECT_EQ(20, *map.Find(2));
+
+  *map.Find(2) = 21;
+  EXPECT_EQ(21, *map.Find(2));
+
+  EXPECT_TRUE(map.Erase(1));
+  EXPECT_FALSE(map.Erase(1));
+  EXPECT_TRUE(map.Find(1) == NULL);
+  EXPECT_EQ(1U, map.size());
+
+  map.Clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.Find(2) == NULL);
+}
+
+TEST(FlatHashMapTest, GrowKeepsEntries) {
+  IntMap map;
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(map.Insert(i, i * 2));
+  }
+  EXPECT_EQ(1000U, map.size());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(map.Find(i) != NULL);
+    EXPECT_EQ(i * 2, *map.Find(i));
+  }
+  std::vector<int> values;
+  map.GetValues(&values);
+  ASSERT_EQ(1000U, values.size());
+  std::sort(values.begin(), values.end());
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(i * 2, values[i]);
+  }
+}
+
+// Erasing from the middle of a probe run must leave the rest reachable.
+TEST(FlatHashMapTest, EraseInProbeRun) {
+  FlatHashMap<int, int, CollidingHasher> map;
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_TRUE(map.Insert(i, i));
+  }
+  EXPECT_TRUE(map.Erase(2));
+  EXPECT_TRUE(map.Erase(0));
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(i != 0 && i != 2, map.Find(i) != NULL);
+  }
+  EXPECT_TRUE(map.Insert(2, 2));
+  EXPECT_EQ(5U, map.size());
+}
+
+// Random inserts and erases, checked against std::set.
+TEST(FlatHashMapTest, MatchesSet) {
+  IntMap map;
+  std::set<int> set;
+  unsigned int seed = 1;
+  for (int n = 0; n < 20000; ++n) {
+    seed = seed * 1103515245 + 12345;
+    int key = (seed >> 16) % 512;
+    if (seed & 0x8000) {
+      EXPECT_EQ(set.insert(key).second, map.Insert(key, key));
+    } else {
+      EXPECT_EQ(set.erase(key) == 1, map.Erase(key));
+    }
+  }
+  EXPECT_EQ(set.size(), map.size());
+  for (int key = 0; key < 512; ++key) {
+    EXPECT_EQ(set.count(key) == 1, map.Find(key) != NULL);
+  }
+}
+
+struct SocketAddressHasher {
+  size_t operator()(const SocketAddress& addr) const { return addr.Hash(); }
+};
+
+// Looks up peer addresses the way TurnServer does for each relayed packet,
+// against std::map for comparison.
+TEST(FlatHashMapTest, LookupPerf) {
+  static const int kLookups = 200000;
+  static const int kSizes[] = { 1, 100, 1000 };
+  for (size_t n = 0; n < ARRAY_SIZE(kSizes); ++n) {
+    FlatHashMap<SocketAddress, int, SocketAddressHasher> hash_map;
+    std::map<SocketAddress, int> tree_map;
+    std::vector<SocketAddress> addrs;
+    for (int i = 0; i < kSizes[n]; ++i) {
+      addrs.push_back(SocketAddress(IPAddress(0x16160000 + i), 6000));
+      hash_map.Insert(addrs.back(), i);
+      tree_map[addrs.back()] = i;
+    }
+
+    int found = 0;
+    uint64 start = TimeNanos();
+    for (int i = 0; i < kLookups; ++i) {
+      found += *hash_map.Find(addrs[i % addrs.size()]);
+    }
+    uint64 hash_time = TimeNanos() - start;
+    int tree_found = 0;
+    start = TimeNanos();
+    for (int i = 0; i < kLookups; ++i) {
+      tree_found += tree_map.find(addrs[i % addrs.size()])->second;
+    }
+    uint64 tree_time = TimeNanos() - start;
+    EXPECT_EQ(found, tree_found);
+    LOG(LS_INFO) << kSizes[n] << " entries: "
+                 << hash_time / kLookups << " ns per hashed lookup, "
+                 << tree_time / kLookups << " ns per std::map lookup";
+  }
+}
+
+}  // namespace talk_base
@@ -0,0 +1,94 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "talk/base/hmacsha1key.h"
+
+#include <string.h>
+
+namespace talk_base {
+
+static const size_t kBlockSize = 64;
+
+HmacSha1Key::HmacSha1Key() {
+  SetKey(NULL, 0);
+}
+
+HmacSha1Key::HmacSha1Key(const void* key, size_t key_len) {
+  SetKey(key, key_len);
+}
+
+HmacSha1Key::HmacSha1Key(const std::string& key) {
+  SetKey(key.data(), key.size());
+}
+
+void HmacSha1Key::SetKey(const void* key, size_t key_len) {
+  // Copy the key to a block-sized buffer to simplify padding.
+  // If the key is longer than a block, hash it and use the result instead.
+  uint8 block[kBlockSize];
+  memset(block, 0, sizeof(block));
+  if (key_len > kBlockSize) {
+    SHA1_CTX ctx;
+    SHA1Init(&ctx);
+    SHA1Update(&ctx, static_cast<const uint8*>(key), key_len);
+    SHA1Final(&ctx, block);
+  } else if (key_len > 0) {
+    memcpy(block, key, key_len);
+  }
+
+  uint8 pad[kBlockSize];
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    pad[i] = 0x36 ^ block[i];
+  }
+  SHA1Init(&inner_);
+  SHA1Update(&inner_, pad, kBlockSize);
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    pad[i] = 0x5c ^ block[i];
+  }
+  SHA1Init(&outer_);
+  SHA1Update(&outer_, pad, kBlockSize);
+}
+
+size_t HmacSha1Key::Compute(const void* input, size_t in_len,
+                            void* output, size_t out_len) const {
+  if (out_len < kSize) {
+    return 0;
+  }
+  // Inner hash: continue from the inner pad with the input.
+  uint8 inner[kSize];
+  SHA1_CTX ctx = inner_;
+  SHA1Update(&ctx, static_cast<const uint8*>(input), in_len);
+  SHA1Final(&ctx, inner);
+  // Outer hash: continue from the outer pad with the inner digest.
+  ctx = outer_;
+  SHA1Update(&ctx, inner, kSize);
+  SHA1Final(&ctx, static_cast<uint8*>(output));
+  return kSize;
+}
+
+}  // namespace talk_base
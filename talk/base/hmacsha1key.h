@@ -0,0 +1,68 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef TALK_BASE_HMACSHA1KEY_H_
+#define TALK_BASE_HMACSHA1KEY_H_
+
+#include <string>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/sha1.h"
+
+namespace talk_base {
+
+// An RFC 2104 HMAC-SHA1 key. The SHA-1 states after hashing the inner and
+// outer key pads are computed once, when the key is set, so each MAC only
+// hashes the input and the inner digest. Meant for keys that sign or verify
+// many messages, like ICE passwords and TURN long-term credentials.
+class HmacSha1Key {
+ public:
+  enum { kSize = SHA1_DIGEST_SIZE };
+
+  // Creates a key of zero length.
+  HmacSha1Key();
+  HmacSha1Key(const void* key, size_t key_len);
+  explicit HmacSha1Key(const std::string& key);
+
+  void SetKey(const void* key, size_t key_len);
+  void SetKey(const std::string& key) { SetKey(key.data(), key.size()); }
+
+  // Writes the MAC of |input| to |output|. Returns the number of bytes
+  // written, or 0 if |out_len| is smaller than kSize.
+  size_t Compute(const void* input, size_t in_len,
+                 void* output, size_t out_len) const;
+
+ private:
+  SHA1_CTX inner_;
+  SHA1_CTX outer_;
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_HMACSHA1KEY_H_
@@ -0,0 +1,91 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <string>
+
+#include "talk/base/gunit.h"
+#include "talk/base/helpers.h"
+#include "talk/base/hmacsha1key.h"
+#include "talk/base/messagedigest.h"
+#include "talk/base/stringencode.h"
+
+namespace talk_base {
+
+static std::string ComputeHex(const HmacSha1Key& key,
+                              const std::string& input) {
+  char output[HmacSha1Key::kSize];
+  EXPECT_EQ(sizeof(output),
+            key.Compute(input.data(), input.size(), output, sizeof(output)));
+  return hex_encode(output, sizeof(output));
+}
+
+// Test vectors from RFC 2202.
+TEST(HmacSha1KeyTest, TestRfc2202) {
+  EXPECT_EQ("b617318655057264e28bc0b6fb378c8ef146be00",
+            ComputeHex(HmacSha1Key(std::string(20, '\x0b')), "Hi There"));
+  EXPECT_EQ("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+            ComputeHex(HmacSha1Key("Jefe"), "what do ya want for nothing?"));
+  EXPECT_EQ("125d7342b9ac11cd91a39af48aa17b4f63f175d3",
+            ComputeHex(HmacSha1Key(std::string(20, '\xaa')),
+                       std::string(50, '\xdd')));
+  // Keys longer than a block are hashed first.
+  EXPECT_EQ("aa4ae5e15272d00e95705637ce8a3b55ed402112",
+            ComputeHex(HmacSha1Key(std::string(80, '\xaa')),
+                       "Test Using Larger Than Block-Size Key - "
+                       "Hash Key First"));
+}
+
+// Test that a key gives the same MACs as ComputeHmac, however many times it
+// is used and whatever the key and input lengths.
+TEST(HmacSha1KeyTest, TestMatchesComputeHmac) {
+  InitRandom(NULL, 0);
+  for (size_t key_len = 0; key_len <= 130; key_len += 13) {
+    std::string key = CreateRandomString(key_len);
+    HmacSha1Key hmac_key(key);
+    for (size_t in_len = 0; in_len <= 300; in_len += 37) {
+      std::string input = CreateRandomString(in_len);
+      EXPECT_EQ(ComputeHmac(DIGEST_SHA_1, key, input),
+                ComputeHex(hmac_key, input));
+    }
+  }
+}
+
+// Test that SetKey replaces the key, and that short output buffers fail.
+TEST(HmacSha1KeyTest, TestSetKey) {
+  HmacSha1Key key;
+  EXPECT_EQ("fbdb1d1b18aa6c08324b7d64b71fb76370690e1d", ComputeHex(key, ""));
+  key.SetKey("Jefe");
+  EXPECT_EQ("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+            ComputeHex(key, "what do ya want for nothing?"));
+
+  char output[HmacSha1Key::kSize - 1];
+  EXPECT_EQ(0U, key.Compute("abc", 3, output, sizeof(output)));
+}
+
+}  // namespace talk_base
@@ -35,6 +35,7 @@
 #include "talk/base/httpclient.h"
 #include "talk/base/logging.h"
 #include "talk/base/pathutils.h"
+#include "talk/base/resolverpool.h"
 #include "talk/base/socketstream.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/stringutils.h"
@@ -300,7 +301,7 @@ HttpClient::~HttpClient() {
   base_.notify(NULL);
   base_.abort(HE_SHUTDOWN);
   if (resolver_) {
-    resolver_->Destroy(false);
+    resolver_->Destroy();
   }
   release();
   if (free_transaction_)
@@ -316,13 +317,13 @@ void HttpClient::reset() {
   base_.abort(HE_OPERATION_CANCELLED);
 }
 
-void HttpClient::OnResolveResult(SignalThread* thread) {
-  if (thread != resolver_) {
+void HttpClient::OnResolveResult(PooledResolver* resolver) {
+  if (resolver != resolver_) {
     return;
   }
   int error = resolver_->error();
   server_ = resolver_->address();
-  resolver_->Destroy(false);
+  resolver_->Destroy();
   resolver_ = NULL;
   if (error != 0) {
     LOG(LS_ERROR) << "Error " << error << " resolving name: "
@@ -334,10 +335,8 @@ void HttpClient::OnResolveResult(SignalThread* thread) {
 }
 
 void HttpClient::StartDNSLookup() {
-  resolver_ = new AsyncResolver();
-  resolver_->set_address(server_);
-  resolver_->SignalWorkDone.connect(this, &HttpClient::OnResolveResult);
-  resolver_->Start();
+  resolver_ = ResolverPool::Default()->Resolve(server_);
+  resolver_->SignalDone.connect(this, &HttpClient::OnResolveResult);
 }
 
 void HttpClient::set_server(const SocketAddress& address) {
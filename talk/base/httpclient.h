@@ -63,7 +63,7 @@ class DiskCache;
 class HttpClient;
 class IPNetPool;
 
-class SignalThread;
+class PooledResolver;
 // What to do:  Define STRICT_HTTP_ERROR=1 in your makefile.  Use HttpError in
 // your code (HttpErrorType should only be used for code that is shared
 // with groups which have not yet migrated).
@@ -175,7 +175,7 @@ protected:
   HttpError OnHeaderAvailable(bool ignore_data, bool chunked, size_t data_size);
 
   void StartDNSLookup();
-  void OnResolveResult(SignalThread* thread);
+  void OnResolveResult(PooledResolver* resolver);
 
   // IHttpNotify Interface
   virtual HttpError onHttpHeaderComplete(bool chunked, size_t& data_size);
@@ -199,7 +199,7 @@ private:
   scoped_ptr<HttpAuthContext> context_;
   DiskCache* cache_;
   CacheState cache_state_;
-  AsyncResolver* resolver_;
+  PooledResolver* resolver_;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -33,6 +33,7 @@
 #include "talk/base/logging.h"
 #include "talk/base/messagequeue.h"
 #include "talk/base/physicalsocketserver.h"
+#include "talk/base/timerwheel.h"
 
 
 namespace talk_base {
@@ -103,6 +104,7 @@ void MessageQueueManager::Clear(MessageHandler *handler) {
 
 MessageQueue::MessageQueue(SocketServer* ss)
     : ss_(ss), fStop_(false), fPeekKeep_(false), active_(false),
+      msgq_head_(NULL), msgq_tail_(NULL), msgq_size_(0),
       dmsgq_next_num_(0) {
   if (!ss_) {
     // Currently, MessageQueue holds a socket server, and is the base class for
@@ -187,22 +189,26 @@ bool MessageQueue::Get(Message *pmsg, int cmsWait, bool process_io) {
     {
       CritScope cs(&crit_);
 
+      // Posted messages go ahead of delayed messages that trigger now, as
+      // they were posted before this check.
+
+      DrainInbox();
+
       // Check for delayed messages that have been triggered
       // Calc the next trigger too
 
-      while (!dmsgq_.empty()) {
-        if (TimeIsLater(msCurrent, dmsgq_.top().msTrigger_)) {
-          cmsDelayNext = TimeDiff(dmsgq_.top().msTrigger_, msCurrent);
-          break;
-        }
-        msgq_.push_back(dmsgq_.top().msg_);
-        dmsgq_.pop();
-      }
+      cmsDelayNext = PopTriggered(msCurrent);
 
       // Check for posted events
 
-      while (!msgq_.empty()) {
-        *pmsg = msgq_.front();
+      while (msgq_head_) {
+        MessageNode* node = msgq_head_;
+        msgq_head_ = static_cast<MessageNode*>(node->next);
+        if (!msgq_head_)
+          msgq_tail_ = NULL;
+        AtomicOps::Decrement(&msgq_size_);
+        *pmsg = node->msg;
+        delete node;
         if (pmsg->ts_sensitive) {
           long delay = TimeDiff(msCurrent, pmsg->ts_sensitive);
           if (delay > 0) {
@@ -210,7 +216,6 @@ bool MessageQueue::Get(Message *pmsg, int cmsWait, bool process_io) {
                               << (delay + kMaxMsgLatency) << "ms";
           }
         }
-        msgq_.pop_front();
         if (MQID_DISPOSE == pmsg->message_id) {
           ASSERT(NULL == pmsg->phandler);
           delete pmsg->pdata;
@@ -218,6 +223,12 @@ bool MessageQueue::Get(Message *pmsg, int cmsWait, bool process_io) {
         }
         return true;
       }
+
+      // A Post() is in the middle of pushing onto the inbox. It may not wake
+      // us when done, so poll rather than block.
+
+      if (msgq_size_ > 0)
+        cmsDelayNext = 0;
     }
 
     if (fStop_)
@@ -259,20 +270,27 @@ void MessageQueue::Post(MessageHandler *phandler, uint32 id,
     return;
 
   // Keep thread safe
-  // Add the message to the end of the queue
+  // Add the message to the end of the queue; this doesn't take crit_, so
+  // posting threads don't contend with each other or with the consumer.
   // Signal for the multiplexer to return
 
-  CritScope cs(&crit_);
-  EnsureActive();
-  Message msg;
-  msg.phandler = phandler;
-  msg.message_id = id;
-  msg.pdata = pdata;
+  if (!active_) {
+    CritScope cs(&crit_);
+    EnsureActive();
+  }
+  MessageNode* node = new MessageNode;
+  node->msg.phandler = phandler;
+  node->msg.message_id = id;
+  node->msg.pdata = pdata;
   if (time_sensitive) {
-    msg.ts_sensitive = Time() + kMaxMsgLatency;
+    node->msg.ts_sensitive = Time() + kMaxMsgLatency;
   }
-  msgq_.push_back(msg);
-  ss_->WakeUp();
+  // Only the post that makes the queue non-empty needs to wake the
+  // multiplexer; Get() keeps going while msgq_size_ is non-zero.
+  bool was_empty = (AtomicOps::Increment(&msgq_size_) == 1);
+  inbox_.Push(node);
+  if (was_empty)
+    ss_->WakeUp();
 }
 
 void MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
@@ -290,8 +308,13 @@ void MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
   msg.phandler = phandler;
   msg.message_id = id;
   msg.pdata = pdata;
-  DelayedMessage dmsg(cmsDelay, tstamp, dmsgq_next_num_, msg);
-  dmsgq_.push(dmsg);
+  if (dwheel_) {
+    dwheel_->Insert(tstamp, dmsgq_next_num_, msg);
+  } else {
+    DelayedMessage dmsg(cmsDelay, tstamp, dmsgq_next_num_, msg);
+    dmsgq_.push(dmsg);
+  }
+  ++timer_stats_.posted;
   // If this message queue processes 1 message every millisecond for 50 days,
   // we will wrap this number.  Even then, only messages with identical times
   // will be misordered, and then only briefly.  This is probably ok.
@@ -302,9 +325,12 @@ void MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
 int MessageQueue::GetDelay() {
   CritScope cs(&crit_);
 
-  if (!msgq_.empty())
+  if (msgq_size_ > 0)
     return 0;
 
+  if (dwheel_)
+    return dwheel_->GetDelay(Time());
+
   if (!dmsgq_.empty()) {
     int delay = TimeUntil(dmsgq_.top().msTrigger_);
     if (delay < 0)
@@ -332,17 +358,45 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
 
   // Remove from ordered message queue
 
-  for (MessageList::iterator it = msgq_.begin(); it != msgq_.end();) {
-    if (it->Match(phandler, id)) {
+  DrainInbox();
+  MessageNode* prev = NULL;
+  for (MessageNode* node = msgq_head_; node;) {
+    MessageNode* next = static_cast<MessageNode*>(node->next);
+    if (node->msg.Match(phandler, id)) {
+      if (removed) {
+        removed->push_back(node->msg);
+      } else {
+        delete node->msg.pdata;
+      }
+      if (prev) {
+        prev->next = next;
+      } else {
+        msgq_head_ = next;
+      }
+      if (msgq_tail_ == node)
+        msgq_tail_ = prev;
+      AtomicOps::Decrement(&msgq_size_);
+      delete node;
+    } else {
+      prev = node;
+    }
+    node = next;
+  }
+
+  // Remove from the timer wheel
+
+  if (dwheel_) {
+    MessageList timers;
+    dwheel_->Clear(phandler, id, &timers);
+    timer_stats_.cancelled += timers.size();
+    for (MessageList::iterator it = timers.begin(); it != timers.end(); ++it) {
       if (removed) {
         removed->push_back(*it);
       } else {
         delete it->pdata;
       }
-      it = msgq_.erase(it);
-    } else {
-      ++it;
     }
+    return;
   }
 
   // Remove from priority queue. Not directly iterable, so use this approach
@@ -356,6 +410,7 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
       } else {
         delete it->msg_.pdata;
       }
+      ++timer_stats_.cancelled;
     } else {
       *new_end++ = *it;
     }
@@ -364,10 +419,87 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
   dmsgq_.reheap();
 }
 
+bool MessageQueue::SetDelayedStore(DelayedStore store) {
+  CritScope cs(&crit_);
+  if (store == delayed_store())
+    return true;
+  if (delayed_size() != 0)
+    return false;
+  if (store == DELAYED_STORE_WHEEL) {
+    dwheel_.reset(new TimerWheel(Time()));
+  } else {
+    dwheel_.reset();
+  }
+  return true;
+}
+
+MessageQueue::DelayedStore MessageQueue::delayed_store() const {
+  return dwheel_ ? DELAYED_STORE_WHEEL : DELAYED_STORE_HEAP;
+}
+
+MessageQueue::TimerStats MessageQueue::GetTimerStats() const {
+  CritScope cs(&crit_);
+  TimerStats stats = timer_stats_;
+  stats.pending = delayed_size();
+  return stats;
+}
+
 void MessageQueue::Dispatch(Message *pmsg) {
   pmsg->phandler->OnMessage(pmsg);
 }
 
+int MessageQueue::PopTriggered(uint32 now) {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  if (dwheel_) {
+    MessageList triggered;
+    dwheel_->PopExpired(now, &triggered);
+    timer_stats_.fired += triggered.size();
+    for (MessageList::iterator it = triggered.begin(); it != triggered.end();
+         ++it) {
+      MessageNode* node = new MessageNode;
+      node->msg = *it;
+      AtomicOps::Increment(&msgq_size_);
+      AppendToMsgq(node);
+    }
+    return dwheel_->GetDelay(now);
+  }
+
+  while (!dmsgq_.empty()) {
+    if (TimeIsLater(now, dmsgq_.top().msTrigger_))
+      return TimeDiff(dmsgq_.top().msTrigger_, now);
+    MessageNode* node = new MessageNode;
+    node->msg = dmsgq_.top().msg_;
+    AtomicOps::Increment(&msgq_size_);
+    AppendToMsgq(node);
+    dmsgq_.pop();
+    ++timer_stats_.fired;
+  }
+  return kForever;
+}
+
+size_t MessageQueue::delayed_size() const {
+  return dwheel_ ? dwheel_->size() : dmsgq_.size();
+}
+
+void MessageQueue::DrainInbox() {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  // Stops early if a Post() is halfway through its push; msgq_size_ still
+  // counts that message, which keeps Get() from blocking on it.
+  while (MessageNode* node = inbox_.Pop()) {
+    AppendToMsgq(node);
+  }
+}
+
+void MessageQueue::AppendToMsgq(MessageNode* node) {
+  node->next = NULL;
+  if (msgq_tail_) {
+    msgq_tail_->next = node;
+  } else {
+    msgq_head_ = node;
+  }
+  msgq_tail_ = node;
+}
+
 void MessageQueue::EnsureActive() {
   ASSERT(crit_.CurrentThreadIsOwner());
   if (!active_) {
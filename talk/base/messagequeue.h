@@ -38,6 +38,7 @@
 #include "talk/base/constructormagic.h"
 #include "talk/base/criticalsection.h"
 #include "talk/base/messagehandler.h"
+#include "talk/base/mpscqueue.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/sigslot.h"
@@ -48,6 +49,7 @@ namespace talk_base {
 
 struct Message;
 class MessageQueue;
+class TimerWheel;
 
 // MessageQueueManager does cleanup of of message queues
 
@@ -171,6 +173,24 @@ class DelayedMessage {
 
 class MessageQueue {
  public:
+  // Where PostDelayed() and PostAt() messages wait until they trigger.
+  enum DelayedStore {
+    // A binary heap; O(log n) to post, O(n) to Clear().
+    DELAYED_STORE_HEAP,
+    // A TimerWheel; O(1) to post, and Clear() only visits the handler's own
+    // timers. Better for queues holding thousands of timers.
+    DELAYED_STORE_WHEEL,
+  };
+
+  // Counters for a queue's delayed messages.
+  struct TimerStats {
+    TimerStats() : pending(0), posted(0), fired(0), cancelled(0) {}
+    size_t pending;    // Waiting to trigger.
+    uint64 posted;     // Total posted with PostDelayed() or PostAt().
+    uint64 fired;      // Total moved to the ready queue on triggering.
+    uint64 cancelled;  // Total removed by Clear() before triggering.
+  };
+
   explicit MessageQueue(SocketServer* ss = NULL);
   virtual ~MessageQueue();
 
@@ -212,10 +232,15 @@ class MessageQueue {
   // Amount of time until the next message can be retrieved
   virtual int GetDelay();
 
+  // Switches the store for delayed messages. Fails if any are pending.
+  bool SetDelayedStore(DelayedStore store);
+  DelayedStore delayed_store() const;
+  TimerStats GetTimerStats() const;
+
   bool empty() const { return size() == 0u; }
   size_t size() const {
-    CritScope cs(&crit_);  // msgq_.size() is not thread safe.
-    return msgq_.size() + dmsgq_.size() + (fPeekKeep_ ? 1u : 0u);
+    CritScope cs(&crit_);  // dmsgq_.size() is not thread safe.
+    return msgq_size_ + delayed_size() + (fPeekKeep_ ? 1u : 0u);
   }
 
   // Internally posts a message which causes the doomed object to be deleted
@@ -236,9 +261,21 @@ class MessageQueue {
     void reheap() { make_heap(c.begin(), c.end(), comp); }
   };
 
+  // A posted message, linked into either inbox_ or msgq_.
+  struct MessageNode : public MpscNode {
+    Message msg;
+  };
+
   void EnsureActive();
   void DoDelayPost(int cmsDelay, uint32 tstamp, MessageHandler *phandler,
                    uint32 id, MessageData* pdata);
+  // Moves everything in inbox_ to the end of msgq_. Requires crit_.
+  void DrainInbox();
+  void AppendToMsgq(MessageNode* node);
+  // Moves delayed messages that trigger at or before |now| to msgq_ and
+  // returns the time until the next one, or kForever. Requires crit_.
+  int PopTriggered(uint32 now);
+  size_t delayed_size() const;
 
   // The SocketServer is not owned by MessageQueue.
   SocketServer* ss_;
@@ -250,9 +287,19 @@ class MessageQueue {
   // A message queue is active if it has ever had a message posted to it.
   // This also corresponds to being in MessageQueueManager's global list.
   bool active_;
-  MessageList msgq_;
+  // Post() pushes onto inbox_ without taking crit_. Consumers (Get, Clear,
+  // GetDelay) hold crit_ and move posted messages from inbox_ to msgq_, a
+  // singly linked list through MpscNode::next, before looking at it.
+  MpscQueue<MessageNode> inbox_;
+  MessageNode* msgq_head_;
+  MessageNode* msgq_tail_;
+  // Number of messages in inbox_ and msgq_. Changed with AtomicOps only.
+  int msgq_size_;
   PriorityQueue dmsgq_;
+  // Used instead of dmsgq_ with DELAYED_STORE_WHEEL.
+  scoped_ptr<TimerWheel> dwheel_;
   uint32 dmsgq_next_num_;
+  TimerStats timer_stats_;
   mutable CriticalSection crit_;
 
  private:
@@ -30,6 +30,8 @@
 #include "talk/base/timeutils.h"
 #include "talk/base/messagequeue.h"
 #include "talk/base/nullsocketserver.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/thread.h"
 
 using namespace talk_base;
 
@@ -59,4 +61,179 @@ TEST(MessageQueue, DelayedPostsWithIdenticalTimesAreProcessedInFifoOrder) {
   NullSocketServer nullss;
   MessageQueue q_nullss(&nullss);
   DelayedPostsWithIdenticalTimesAreProcessedInFifoOrder(&q_nullss);
+  MessageQueue q_wheel(&nullss);
+  EXPECT_TRUE(q_wheel.SetDelayedStore(MessageQueue::DELAYED_STORE_WHEEL));
+  DelayedPostsWithIdenticalTimesAreProcessedInFifoOrder(&q_wheel);
+}
+
+static void CheckTimerStats(MessageQueue::DelayedStore store) {
+  NullSocketServer nullss;
+  MessageQueue q(&nullss);
+  EXPECT_TRUE(q.SetDelayedStore(store));
+  EXPECT_EQ(store, q.delayed_store());
+  q.PostDelayed(0, NULL, 1);
+  q.PostDelayed(100000, NULL, 2);
+  q.PostDelayed(100000, NULL, 3);
+  // The store can't change while timers are pending.
+  EXPECT_EQ(store == MessageQueue::DELAYED_STORE_HEAP,
+            !q.SetDelayedStore(MessageQueue::DELAYED_STORE_WHEEL));
+
+  MessageQueue::TimerStats stats = q.GetTimerStats();
+  EXPECT_EQ(3u, stats.pending);
+  EXPECT_EQ(3u, stats.posted);
+  EXPECT_EQ(0u, stats.fired);
+  EXPECT_EQ(0u, stats.cancelled);
+
+  Message msg;
+  EXPECT_TRUE(q.Get(&msg, 0));
+  EXPECT_EQ(1u, msg.message_id);
+  EXPECT_GT(q.GetDelay(), 0);
+  q.Clear(NULL, 2);
+
+  stats = q.GetTimerStats();
+  EXPECT_EQ(1u, stats.pending);
+  EXPECT_EQ(1u, stats.fired);
+  EXPECT_EQ(1u, stats.cancelled);
+  EXPECT_EQ(1u, q.size());
+}
+
+TEST(MessageQueue, TimerStats) {
+  CheckTimerStats(MessageQueue::DELAYED_STORE_HEAP);
+  CheckTimerStats(MessageQueue::DELAYED_STORE_WHEEL);
+}
+
+TEST(MessageQueue, PostsAreFifoAndClearRemovesMatching) {
+  NullSocketServer nullss;
+  MessageQueue q(&nullss);
+  for (uint32 i = 0; i < 10; ++i) {
+    q.Post(NULL, i % 3);
+  }
+  EXPECT_EQ(10u, q.size());
+  EXPECT_EQ(0, q.GetDelay());
+
+  MessageList removed;
+  q.Clear(NULL, 1, &removed);
+  EXPECT_EQ(3u, removed.size());
+  EXPECT_EQ(7u, q.size());
+
+  // Clearing must leave the list usable for later posts.
+  q.Clear(NULL, 0, NULL);
+  q.Post(NULL, 5);
+  uint32 expected[] = { 2, 2, 2, 5 };
+  Message msg;
+  for (size_t i = 0; i < ARRAY_SIZE(expected); ++i) {
+    EXPECT_TRUE(q.Get(&msg, 0));
+    EXPECT_EQ(expected[i], msg.message_id);
+  }
+  EXPECT_FALSE(q.Get(&msg, 0));
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(kForever, q.GetDelay());
+}
+
+// Posts |count| messages to |queue|, numbered in the low 24 bits of the id
+// and tagged with |producer| in the high 8.
+class PostingRunnable : public Runnable {
+ public:
+  PostingRunnable(MessageQueue* queue, uint32 producer, uint32 count)
+      : queue_(queue), producer_(producer), count_(count) {}
+  virtual void Run(Thread* thread) {
+    for (uint32 i = 0; i < count_; ++i) {
+      queue_->Post(NULL, (producer_ << 24) | i);
+    }
+  }
+
+ private:
+  MessageQueue* queue_;
+  uint32 producer_;
+  uint32 count_;
+};
+
+// Posts from several threads at once and checks that every message arrives
+// once, in order per producer.
+static void PostFromThreads(size_t num_producers, uint32 count) {
+  NullSocketServer nullss;
+  MessageQueue q(&nullss);
+  std::vector<Thread*> threads;
+  std::vector<PostingRunnable*> runnables;
+  std::vector<uint32> next(num_producers, 0);
+
+  uint32 start = Time();
+  for (size_t i = 0; i < num_producers; ++i) {
+    runnables.push_back(new PostingRunnable(&q, i, count));
+    threads.push_back(new Thread());
+    threads.back()->Start(runnables.back());
+  }
+  Message msg;
+  size_t total = num_producers * count;
+  size_t received = 0;
+  while (received < total && q.Get(&msg, 10000)) {
+    uint32 producer = msg.message_id >> 24;
+    ASSERT_LT(producer, num_producers);
+    EXPECT_EQ(next[producer], msg.message_id & 0xFFFFFF);
+    next[producer] = (msg.message_id & 0xFFFFFF) + 1;
+    ++received;
+  }
+  uint32 elapsed = TimeSince(start);
+  EXPECT_EQ(total, received);
+  EXPECT_TRUE(q.empty());
+
+  for (size_t i = 0; i < num_producers; ++i) {
+    threads[i]->Stop();
+    delete threads[i];
+    delete runnables[i];
+  }
+  LOG(LS_INFO) << num_producers << " producers: " << received
+               << " messages in " << elapsed << " ms";
+}
+
+TEST(MessageQueue, PostFromOneThread) {
+  PostFromThreads(1, 10000);
+}
+
+TEST(MessageQueue, PostFromManyThreads) {
+  PostFromThreads(8, 10000);
+}
+
+TEST(MessageQueue, PostGetPerf) {
+  for (size_t producers = 1; producers <= 8; producers *= 2) {
+    PostFromThreads(producers, 100000);
+  }
+}
+
+class NullHandler : public MessageHandler {
+ public:
+  virtual void OnMessage(Message* msg) {}
+};
+
+// Connections, STUN requests and TURN allocations each keep a few timers
+// running and cancel them by handler; time that pattern with many handlers.
+static void MeasureTimers(MessageQueue::DelayedStore store, size_t count) {
+  NullSocketServer nullss;
+  MessageQueue q(&nullss);
+  EXPECT_TRUE(q.SetDelayedStore(store));
+  std::vector<NullHandler> handlers(count);
+
+  uint32 start = Time();
+  for (size_t i = 0; i < count; ++i) {
+    q.PostDelayed(1000 + i % 5000, &handlers[i], 1);
+    q.PostDelayed(30000, &handlers[i], 2);
+  }
+  uint32 posted = Time();
+  for (size_t i = 0; i < count; ++i) {
+    q.Clear(&handlers[i]);
+  }
+  uint32 cleared = Time();
+  EXPECT_TRUE(q.empty());
+
+  LOG(LS_INFO) << (store == MessageQueue::DELAYED_STORE_WHEEL ?
+                   "Wheel: " : "Heap: ")
+               << 2 * count << " timers posted in "
+               << TimeDiff(posted, start) << " ms, cleared in "
+               << TimeDiff(cleared, posted) << " ms";
+}
+
+TEST(MessageQueue, TimerPerf) {
+  MeasureTimers(MessageQueue::DELAYED_STORE_HEAP, 5000);
+  MeasureTimers(MessageQueue::DELAYED_STORE_WHEEL, 5000);
+  MeasureTimers(MessageQueue::DELAYED_STORE_WHEEL, 50000);
 }
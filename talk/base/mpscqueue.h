@@ -0,0 +1,115 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_MPSCQUEUE_H_
+#define TALK_BASE_MPSCQUEUE_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+
+namespace talk_base {
+
+// Link embedded in every element of an MpscQueue.
+struct MpscNode {
+  MpscNode* volatile next;
+};
+
+// An unbounded, intrusive, multiple-producer single-consumer queue.
+// Push() may be called from any number of threads at once without locking and
+// never blocks. Pop() must only be called by one thread at a time; callers
+// that consume from several threads have to serialize Pop() themselves.
+// T must derive from MpscNode. The queue doesn't own its elements.
+//
+// Pop() can return NULL while a Push() on another thread is half done even
+// though the queue isn't empty; the element becomes visible as soon as that
+// Push() returns, so producers should signal the consumer after pushing.
+template <class T>
+class MpscQueue {
+ public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {
+    stub_.next = NULL;
+  }
+
+  void Push(T* elem) {
+    PushNode(elem);
+  }
+
+  T* Pop() {
+    MpscNode* tail = tail_;
+    MpscNode* next = Load(&tail->next);
+    if (tail == &stub_) {
+      if (!next)
+        return NULL;
+      tail_ = next;
+      tail = next;
+      next = Load(&next->next);
+    }
+    if (next) {
+      tail_ = next;
+      return static_cast<T*>(tail);
+    }
+    if (tail != Load(&head_)) {
+      // A producer has swapped in a new head but not linked it yet.
+      return NULL;
+    }
+    // |tail| is the last element. Put the stub back behind it so that |tail|
+    // can be handed out without leaving the queue empty of nodes.
+    PushNode(&stub_);
+    next = Load(&tail->next);
+    if (next) {
+      tail_ = next;
+      return static_cast<T*>(tail);
+    }
+    return NULL;
+  }
+
+ private:
+  void PushNode(MpscNode* node) {
+    node->next = NULL;
+    MpscNode* prev = static_cast<MpscNode*>(AtomicOps::ExchangePtr(
+        reinterpret_cast<void* volatile*>(&head_), node));
+    AtomicOps::ReleaseStorePtr(
+        reinterpret_cast<void* volatile*>(&prev->next), node);
+  }
+
+  static MpscNode* Load(MpscNode* volatile* ptr) {
+    return static_cast<MpscNode*>(AtomicOps::AcquireLoadPtr(
+        reinterpret_cast<void* volatile*>(ptr)));
+  }
+
+  // Producers append at |head_|, the consumer removes from |tail_|.
+  MpscNode* volatile head_;
+  MpscNode* tail_;
+  MpscNode stub_;
+
+  DISALLOW_COPY_AND_ASSIGN(MpscQueue);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_MPSCQUEUE_H_
@@ -43,6 +43,11 @@
 
 namespace talk_base {
 
+// Looks up |hostname|, blocking until done.  Returns 0 or a getaddrinfo
+// error.  If |family| isn't AF_UNSPEC, only addresses of that family are kept.
+int ResolveHostname(const std::string& hostname, int family,
+                    std::vector<IPAddress>* addresses);
+
 // AsyncResolver will perform async DNS resolution, signaling the result on
 // the inherited SignalWorkDone when the operation completes.
 class AsyncResolver : public SignalThread {
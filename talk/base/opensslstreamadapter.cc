@@ -126,10 +126,7 @@ static int stream_free(BIO* b) {
   return 1;
 }
 
-static int stream_read(BIO* b, char* out, int outl) {
-  if (!out)
-    return -1;
-  StreamInterface* stream = static_cast<StreamInterface*>(b->ptr);
+static int read_stream(BIO* b, StreamInterface* stream, char* out, int outl) {
   BIO_clear_retry_flags(b);
   size_t read;
   int error;
@@ -144,6 +141,12 @@ static int stream_read(BIO* b, char* out, int outl) {
   return -1;
 }
 
+static int stream_read(BIO* b, char* out, int outl) {
+  if (!out)
+    return -1;
+  return read_stream(b, static_cast<StreamInterface*>(b->ptr), out, outl);
+}
+
 static int stream_write(BIO* b, const char* in, int inl) {
   if (!in)
     return -1;
@@ -183,6 +186,95 @@ static long stream_ctrl(BIO* b, int cmd, long num, void* ptr) {
   }
 }
 
+//////////////////////////////////////////////////////////////////////
+// PacketBIO
+// The read side of the SSL object in DTLS mode. While a packet is set with
+// BIO_set_packet, OpenSSL reads it from here straight out of the caller's
+// buffer, and finds nothing more after it. Otherwise, reads go to the
+// wrapped stream, as with StreamBIO.
+//////////////////////////////////////////////////////////////////////
+
+struct PacketBIOData {
+  StreamInterface* stream;
+  const char* packet;
+  size_t packet_len;
+};
+
+static int packet_read(BIO* h, char* buf, int size);
+static int packet_new(BIO* h);
+static int packet_free(BIO* data);
+
+static BIO_METHOD methods_packet = {
+  BIO_TYPE_BIO,
+  "packet",
+  0,
+  packet_read,
+  0,
+  0,
+  stream_ctrl,
+  packet_new,
+  packet_free,
+  NULL,
+};
+
+static BIO_METHOD* BIO_s_packet() { return(&methods_packet); }
+
+static BIO* BIO_new_packet(StreamInterface* stream) {
+  BIO* ret = BIO_new(BIO_s_packet());
+  if (ret == NULL)
+    return NULL;
+  static_cast<PacketBIOData*>(ret->ptr)->stream = stream;
+  return ret;
+}
+
+// A NULL |packet| goes back to reading from the stream.
+static void BIO_set_packet(BIO* b, const char* packet, size_t packet_len) {
+  PacketBIOData* data = static_cast<PacketBIOData*>(b->ptr);
+  data->packet = packet;
+  data->packet_len = packet_len;
+}
+
+static int packet_new(BIO* b) {
+  PacketBIOData* data = new PacketBIOData;
+  data->stream = NULL;
+  data->packet = NULL;
+  data->packet_len = 0;
+  b->shutdown = 0;
+  b->init = 1;
+  b->num = 0;  // 1 means end-of-stream
+  b->ptr = data;
+  return 1;
+}
+
+static int packet_free(BIO* b) {
+  if (b == NULL)
+    return 0;
+  delete static_cast<PacketBIOData*>(b->ptr);
+  b->ptr = NULL;
+  return 1;
+}
+
+static int packet_read(BIO* b, char* out, int outl) {
+  if (!out)
+    return -1;
+  PacketBIOData* data = static_cast<PacketBIOData*>(b->ptr);
+  if (!data->packet)
+    return read_stream(b, data->stream, out, outl);
+
+  BIO_clear_retry_flags(b);
+  if (data->packet_len == 0) {
+    BIO_set_retry_read(b);
+    return -1;
+  }
+  // Like a datagram socket, hand over the whole packet at once and drop
+  // whatever doesn't fit.
+  int len = static_cast<int>(_min(data->packet_len,
+                                  static_cast<size_t>(outl)));
+  memcpy(out, data->packet, len);
+  data->packet_len = 0;
+  return len;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // OpenSSLStreamAdapter
 /////////////////////////////////////////////////////////////////////////////
@@ -192,7 +284,7 @@ OpenSSLStreamAdapter::OpenSSLStreamAdapter(StreamInterface* stream)
       state_(SSL_NONE),
       role_(SSL_CLIENT),
       ssl_read_needs_write_(false), ssl_write_needs_read_(false),
-      ssl_(NULL), ssl_ctx_(NULL),
+      ssl_(NULL), ssl_ctx_(NULL), packet_bio_(NULL),
       custom_verification_succeeded_(false),
       ssl_mode_(SSL_MODE_TLS) {
 }
@@ -436,6 +528,54 @@ StreamResult OpenSSLStreamAdapter::Read(void* data, size_t data_len,
       return SR_ERROR;
   }
 
+  return SSLRead(data, data_len, read, error);
+}
+
+bool OpenSSLStreamAdapter::HasDtlsPacketInput() const {
+  return ssl_mode_ == SSL_MODE_DTLS;
+}
+
+StreamResult OpenSSLStreamAdapter::ReadDtlsPacket(const char* packet,
+                                                  size_t packet_len,
+                                                  void* data, size_t data_len,
+                                                  size_t* read, int* error) {
+  switch (state_) {
+    case SSL_CONNECTED:
+      break;
+
+    case SSL_NONE:
+    case SSL_WAIT:
+    case SSL_CONNECTING:
+      // Handshake packets go through the wrapped stream.
+      return SR_BLOCK;
+
+    case SSL_CLOSED:
+      return SR_EOS;
+
+    case SSL_ERROR:
+    default:
+      if (error)
+        *error = ssl_error_code_;
+      return SR_ERROR;
+  }
+
+  if (!packet_bio_) {
+    if (error)
+      *error = -1;
+    return SR_ERROR;
+  }
+
+  // OpenSSL reads |packet| through packet_bio_. With a NULL |packet|, it
+  // only has the records left over from the previous one.
+  BIO_set_packet(packet_bio_, packet ? packet : "", packet ? packet_len : 0);
+  StreamResult result = SSLRead(data, data_len, read, error);
+  if (packet_bio_)  // SSLRead may have cleaned up on error.
+    BIO_set_packet(packet_bio_, NULL, 0);
+  return result;
+}
+
+StreamResult OpenSSLStreamAdapter::SSLRead(void* data, size_t data_len,
+                                           size_t* read, int* error) {
   // Don't trust OpenSSL with zero byte reads
   if (data_len == 0) {
     if (read)
@@ -622,15 +762,31 @@ int OpenSSLStreamAdapter::BeginSSL() {
   if (!bio)
     return -1;
 
+  // In DTLS mode, reads go through a separate BIO, so that ReadDtlsPacket
+  // can hand packets to OpenSSL directly once the handshake is done.
+  BIO* read_bio = bio;
+  if (ssl_mode_ == SSL_MODE_DTLS) {
+    read_bio = BIO_new_packet(static_cast<StreamInterface*>(stream()));
+    if (!read_bio) {
+      BIO_free(bio);
+      return -1;
+    }
+  }
+
   ssl_ = SSL_new(ssl_ctx_);
   if (!ssl_) {
+    if (read_bio != bio)
+      BIO_free(read_bio);
     BIO_free(bio);
     return -1;
   }
 
   SSL_set_app_data(ssl_, this);
 
-  SSL_set_bio(ssl_, bio, bio);  // the SSL object owns the bio now.
+  // the SSL object owns the bios now.
+  SSL_set_bio(ssl_, read_bio, bio);
+  if (read_bio != bio)
+    packet_bio_ = read_bio;
 
   SSL_set_mode(ssl_, SSL_MODE_ENABLE_PARTIAL_WRITE |
                SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
@@ -711,6 +867,7 @@ void OpenSSLStreamAdapter::Cleanup() {
   if (ssl_) {
     SSL_free(ssl_);
     ssl_ = NULL;
+    packet_bio_ = NULL;
   }
   if (ssl_ctx_) {
     SSL_CTX_free(ssl_ctx_);
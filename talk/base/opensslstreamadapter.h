@@ -35,6 +35,7 @@
 #include "talk/base/sslstreamadapter.h"
 #include "talk/base/opensslidentity.h"
 
+typedef struct bio_st BIO;
 typedef struct ssl_st SSL;
 typedef struct ssl_ctx_st SSL_CTX;
 typedef struct x509_store_ctx_st X509_STORE_CTX;
@@ -110,6 +111,12 @@ class OpenSSLStreamAdapter : public SSLStreamAdapter {
   virtual bool SetDtlsSrtpCiphers(const std::vector<std::string>& ciphers);
   virtual bool GetDtlsSrtpCipher(std::string* cipher);
 
+  // DTLS packet interface
+  virtual bool HasDtlsPacketInput() const;
+  virtual StreamResult ReadDtlsPacket(const char* packet, size_t packet_len,
+                                      void* data, size_t data_len,
+                                      size_t* read, int* error);
+
   // Capabilities interfaces
   static bool HaveDtls();
   static bool HaveDtlsSrtp();
@@ -158,6 +165,9 @@ class OpenSSLStreamAdapter : public SSLStreamAdapter {
   // Override MessageHandler
   virtual void OnMessage(Message* msg);
 
+  // SSL_read into |data|, with the result translated as for Read().
+  StreamResult SSLRead(void* data, size_t data_len, size_t* read, int* error);
+
   // Flush the input buffers by reading left bytes (for DTLS)
   void FlushInput(unsigned int left);
 
@@ -184,6 +194,9 @@ class OpenSSLStreamAdapter : public SSLStreamAdapter {
 
   SSL* ssl_;
   SSL_CTX* ssl_ctx_;
+  // In DTLS mode, the read side of ssl_, through which ReadDtlsPacket hands
+  // packets to OpenSSL. Owned by ssl_.
+  BIO* packet_bio_;
 
   // Our key and certificate, mostly useful in peer-to-peer mode.
   scoped_ptr<OpenSSLIdentity> identity_;
@@ -0,0 +1,208 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/packetpool.h"
+
+#include <new>
+
+#ifdef POSIX
+#include <pthread.h>
+#endif
+
+#ifdef WIN32
+#include "talk/base/win32.h"
+#endif
+
+#include "talk/base/common.h"
+
+namespace talk_base {
+
+namespace {
+
+// Block sizes, excluding the header. The second fits a full-size Ethernet
+// packet with room for SRTP and TURN framing, the third a default
+// ByteBuffer, and the last a maximum-size UDP datagram.
+const size_t kClassSizes[] = { 256, 2048, 8192, 65536 + 512 };
+// How many free blocks of each class a thread keeps.
+const size_t kClassLimits[] = { 256, 256, 64, 8 };
+const size_t kNumClasses = ARRAY_SIZE(kClassSizes);
+
+// Precedes every block; the members only pad it to a safe alignment.
+union BlockHeader {
+  size_t size_class;  // kNumClasses for blocks from the heap.
+  double align_double;
+  int64 align_int64;
+  void* align_pointer;
+};
+
+// A block on a free list, linked through its first bytes.
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct ThreadCache {
+  ThreadCache() {
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      free[i] = NULL;
+      count[i] = 0;
+    }
+  }
+  ~ThreadCache() {
+    Trim();
+  }
+
+  void Trim() {
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      while (free[i]) {
+        FreeBlock* block = free[i];
+        free[i] = block->next;
+        ::operator delete(reinterpret_cast<BlockHeader*>(block) - 1);
+      }
+      stats.cached -= count[i];
+      count[i] = 0;
+    }
+  }
+
+  FreeBlock* free[kNumClasses];
+  size_t count[kNumClasses];
+  PacketPool::Stats stats;
+};
+
+#ifdef POSIX
+void DeleteCache(void* cache) {
+  delete static_cast<ThreadCache*>(cache);
+}
+#endif
+
+// The calling thread's cache, created on first use. On POSIX it is deleted
+// when the thread exits.
+class CurrentCache {
+ public:
+  CurrentCache() {
+#ifdef POSIX
+    pthread_key_create(&key_, &DeleteCache);
+#endif
+#ifdef WIN32
+    key_ = TlsAlloc();
+#endif
+  }
+
+  ThreadCache* Get() {
+#ifdef POSIX
+    ThreadCache* cache = static_cast<ThreadCache*>(pthread_getspecific(key_));
+#endif
+#ifdef WIN32
+    ThreadCache* cache = static_cast<ThreadCache*>(TlsGetValue(key_));
+#endif
+    if (!cache) {
+      cache = new ThreadCache();
+#ifdef POSIX
+      pthread_setspecific(key_, cache);
+#endif
+#ifdef WIN32
+      TlsSetValue(key_, cache);
+#endif
+    }
+    return cache;
+  }
+
+ private:
+#ifdef POSIX
+  pthread_key_t key_;
+#endif
+#ifdef WIN32
+  DWORD key_;
+#endif
+};
+
+ThreadCache* Cache() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(CurrentCache, current, ());
+  return current.Get();
+}
+
+size_t SizeClass(size_t size) {
+  for (size_t i = 0; i < kNumClasses; ++i) {
+    if (size <= kClassSizes[i])
+      return i;
+  }
+  return kNumClasses;
+}
+
+}  // namespace
+
+void* PacketPool::Allocate(size_t size) {
+  ThreadCache* cache = Cache();
+  size_t size_class = SizeClass(size);
+  ++cache->stats.outstanding;
+  if (size_class < kNumClasses && cache->free[size_class]) {
+    FreeBlock* block = cache->free[size_class];
+    cache->free[size_class] = block->next;
+    --cache->count[size_class];
+    --cache->stats.cached;
+    ++cache->stats.hits;
+    return block;
+  }
+
+  ++cache->stats.misses;
+  size_t block_size =
+      (size_class < kNumClasses) ? kClassSizes[size_class] : size;
+  BlockHeader* header = static_cast<BlockHeader*>(
+      ::operator new(sizeof(BlockHeader) + block_size));
+  header->size_class = size_class;
+  return header + 1;
+}
+
+void PacketPool::Free(void* p) {
+  if (!p)
+    return;
+
+  ThreadCache* cache = Cache();
+  BlockHeader* header = static_cast<BlockHeader*>(p) - 1;
+  size_t size_class = header->size_class;
+  --cache->stats.outstanding;
+  if (size_class < kNumClasses &&
+      cache->count[size_class] < kClassLimits[size_class]) {
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = cache->free[size_class];
+    cache->free[size_class] = block;
+    ++cache->count[size_class];
+    ++cache->stats.cached;
+    return;
+  }
+  ::operator delete(header);
+}
+
+PacketPool::Stats PacketPool::GetStats() {
+  return Cache()->stats;
+}
+
+void PacketPool::Trim() {
+  Cache()->Trim();
+}
+
+}  // namespace talk_base
@@ -0,0 +1,71 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_PACKETPOOL_H_
+#define TALK_BASE_PACKETPOOL_H_
+
+#include <cstddef>
+
+#include "talk/base/basictypes.h"
+
+namespace talk_base {
+
+// Per-thread cache of packet-sized memory blocks. Buffer and ByteBuffer take
+// their memory from here, so a thread that keeps receiving and sending
+// packets reuses the same few blocks instead of calling malloc and free for
+// each one.
+//
+// Requests are rounded up to one of a few size classes, the largest big
+// enough for a whole UDP datagram. Each thread keeps a bounded free list per
+// class; larger requests, and blocks freed when the list is full, go to the
+// heap. A block may be freed on any thread and joins that thread's list.
+class PacketPool {
+ public:
+  // Counters for the calling thread.
+  struct Stats {
+    Stats() : hits(0), misses(0), outstanding(0), cached(0) {}
+    uint64 hits;      // Allocations served from the free lists.
+    uint64 misses;    // Allocations that went to the heap.
+    // Blocks allocated on this thread minus blocks freed on it. Goes
+    // negative on a thread that frees blocks other threads allocated.
+    int64 outstanding;
+    size_t cached;    // Blocks in this thread's free lists.
+  };
+
+  // Returns at least |size| bytes, suitably aligned for any type.
+  static void* Allocate(size_t size);
+  // Frees memory from Allocate(). NULL is ignored.
+  static void Free(void* p);
+
+  static Stats GetStats();
+  // Returns this thread's cached blocks to the heap.
+  static void Trim();
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_PACKETPOOL_H_
@@ -0,0 +1,117 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/buffer.h"
+#include "talk/base/bytebuffer.h"
+#include "talk/base/gunit.h"
+#include "talk/base/packetpool.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+class PacketPoolTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    PacketPool::Trim();
+  }
+};
+
+TEST_F(PacketPoolTest, ReusesFreedBlocks) {
+  PacketPool::Stats before = PacketPool::GetStats();
+  EXPECT_EQ(0U, before.cached);
+
+  void* p = PacketPool::Allocate(1500);
+  ASSERT_TRUE(p != NULL);
+  memset(p, 'x', 1500);
+  PacketPool::Free(p);
+  PacketPool::Stats stats = PacketPool::GetStats();
+  EXPECT_EQ(1U, stats.cached);
+  EXPECT_EQ(before.misses + 1, stats.misses);
+  EXPECT_EQ(before.outstanding, stats.outstanding);
+
+  // Any size in the same class gets the block back.
+  EXPECT_EQ(p, PacketPool::Allocate(1024));
+  stats = PacketPool::GetStats();
+  EXPECT_EQ(before.hits + 1, stats.hits);
+  EXPECT_EQ(before.outstanding + 1, stats.outstanding);
+  EXPECT_EQ(0U, stats.cached);
+  PacketPool::Free(p);
+  PacketPool::Free(NULL);
+}
+
+TEST_F(PacketPoolTest, LargeBlocksBypassPool) {
+  void* p = PacketPool::Allocate(256 * 1024);
+  ASSERT_TRUE(p != NULL);
+  PacketPool::Free(p);
+  EXPECT_EQ(0U, PacketPool::GetStats().cached);
+}
+
+// Forwarding packets from buffer to buffer should not touch the heap once
+// the pool has warmed up.
+TEST_F(PacketPoolTest, SteadyStateHitsPool) {
+  const char kPacket[1200] = { 0 };
+  for (int i = 0; i < 2; ++i) {
+    Buffer packet(kPacket, sizeof(kPacket), 1500);
+    ByteBuffer out;
+    out.WriteBytes(packet.data(), packet.length());
+  }
+  PacketPool::Stats before = PacketPool::GetStats();
+  for (int i = 0; i < 1000; ++i) {
+    Buffer packet(kPacket, sizeof(kPacket), 1500);
+    ByteBuffer out;
+    out.WriteBytes(packet.data(), packet.length());
+  }
+  PacketPool::Stats after = PacketPool::GetStats();
+  EXPECT_EQ(before.misses, after.misses);
+  EXPECT_EQ(before.hits + 2000, after.hits);
+  EXPECT_EQ(before.outstanding, after.outstanding);
+}
+
+class FreeBlockRunnable : public Runnable {
+ public:
+  explicit FreeBlockRunnable(void* block) : block_(block) {}
+  virtual void Run(Thread* thread) {
+    PacketPool::Free(block_);
+    stats_ = PacketPool::GetStats();
+  }
+  void* block_;
+  PacketPool::Stats stats_;
+};
+
+TEST_F(PacketPoolTest, FreeOnAnotherThread) {
+  PacketPool::Stats before = PacketPool::GetStats();
+  FreeBlockRunnable runnable(PacketPool::Allocate(100));
+  Thread thread;
+  thread.Start(&runnable);
+  thread.Stop();
+  EXPECT_EQ(1U, runnable.stats_.cached);
+  EXPECT_EQ(-1, runnable.stats_.outstanding);
+  EXPECT_EQ(before.outstanding + 1, PacketPool::GetStats().outstanding);
+}
+
+}  // namespace talk_base
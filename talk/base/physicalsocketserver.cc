@@ -40,6 +40,10 @@
 #include <signal.h>
 #endif
 
+#if defined(LINUX) || defined(ANDROID)
+#include <sys/epoll.h>
+#endif
+
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -106,6 +110,16 @@ static const int IPV6_HEADER_SIZE = 40u;
 static const int ICMP_HEADER_SIZE = 8u;
 static const int ICMP_PING_TIMEOUT_MILLIS = 10000u;
 
+#ifdef LINUX
+// Maximum number of datagrams passed to a single recvmmsg()/sendmmsg().
+static const int kMaxDatagramBatch = 64;
+#endif
+
+#if defined(LINUX) || defined(ANDROID)
+// Maximum number of ready descriptors handled per epoll_wait() call.
+static const int kMaxEpollEvents = 128;
+#endif
+
 class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
  public:
   PhysicalSocket(PhysicalSocketServer* ss, SOCKET s = INVALID_SOCKET)
@@ -141,7 +155,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     udp_ = (SOCK_DGRAM == type);
     UpdateLastError();
     if (udp_)
-      enabled_events_ = DE_READ | DE_WRITE;
+      SetEnabledEvents(DE_READ | DE_WRITE);
     return s_ != INVALID_SOCKET;
   }
 
@@ -224,12 +238,12 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       state_ = CS_CONNECTED;
     } else if (IsBlockingError(error_)) {
       state_ = CS_CONNECTING;
-      enabled_events_ |= DE_CONNECT;
+      EnableEvents(DE_CONNECT);
     } else {
       return SOCKET_ERROR;
     }
 
-    enabled_events_ |= DE_READ | DE_WRITE;
+    EnableEvents(DE_READ | DE_WRITE);
     return 0;
   }
 
@@ -290,7 +304,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     // We have seen minidumps where this may be false.
     ASSERT(sent <= static_cast<int>(cb));
     if ((sent < 0) && IsBlockingError(error_)) {
-      enabled_events_ |= DE_WRITE;
+      EnableEvents(DE_WRITE);
     }
     return sent;
   }
@@ -311,7 +325,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     // We have seen minidumps where this may be false.
     ASSERT(sent <= static_cast<int>(length));
     if ((sent < 0) && IsBlockingError(error_)) {
-      enabled_events_ |= DE_WRITE;
+      EnableEvents(DE_WRITE);
     }
     return sent;
   }
@@ -326,14 +340,14 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       LOG(LS_WARNING) << "EOF from socket; deferring close event";
       // Must turn this back on so that the select() loop will notice the close
       // event.
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
       error_ = EWOULDBLOCK;
       return SOCKET_ERROR;
     }
     UpdateLastError();
     bool success = (received >= 0) || IsBlockingError(error_);
     if (udp_ || success) {
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
     }
     if (!success) {
       LOG_F(LS_VERBOSE) << "Error = " << error_;
@@ -352,7 +366,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       SocketAddressFromSockAddrStorage(addr_storage, out_addr);
     bool success = (received >= 0) || IsBlockingError(error_);
     if (udp_ || success) {
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
     }
     if (!success) {
       LOG_F(LS_VERBOSE) << "Error = " << error_;
@@ -360,12 +374,84 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     return received;
   }
 
+#ifdef LINUX
+  // Uses recvmmsg() to drain up to |count| datagrams with a single syscall.
+  int RecvFromBatch(Datagram* datagrams, size_t count) {
+    mmsghdr msgs[kMaxDatagramBatch];
+    iovec iovs[kMaxDatagramBatch];
+    sockaddr_storage addrs[kMaxDatagramBatch];
+    count = _min(count, static_cast<size_t>(kMaxDatagramBatch));
+    for (size_t i = 0; i < count; ++i) {
+      iovs[i].iov_base = datagrams[i].data;
+      iovs[i].iov_len = datagrams[i].size;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received = ::recvmmsg(s_, msgs, static_cast<unsigned int>(count), 0,
+                              NULL);
+    UpdateLastError();
+    // Drop datagrams that did not fit their buffer, moving the complete ones
+    // to the front. The dropped ones keep the buffers that are left over.
+    int complete = 0;
+    for (int i = 0; i < received; ++i) {
+      SocketAddress addr;
+      SocketAddressFromSockAddrStorage(addrs[i], &addr);
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        LOG(LS_WARNING) << "Dropped datagram from " << addr.ToString()
+                        << " larger than " << iovs[i].iov_len << " bytes";
+        continue;
+      }
+      std::swap(datagrams[complete].data, datagrams[i].data);
+      datagrams[complete].size = msgs[i].msg_len;
+      datagrams[complete].addr = addr;
+      ++complete;
+    }
+    bool success = (received >= 0) || IsBlockingError(error_);
+    if (udp_ || success) {
+      EnableEvents(DE_READ);
+    }
+    if (!success) {
+      LOG_F(LS_VERBOSE) << "Error = " << error_;
+    }
+    return (received < 0) ? received : complete;
+  }
+
+  // Uses sendmmsg() to send up to |count| datagrams with a single syscall.
+  int SendToBatch(const Datagram* datagrams, size_t count) {
+    mmsghdr msgs[kMaxDatagramBatch];
+    iovec iovs[kMaxDatagramBatch];
+    sockaddr_storage addrs[kMaxDatagramBatch];
+    count = _min(count, static_cast<size_t>(kMaxDatagramBatch));
+    for (size_t i = 0; i < count; ++i) {
+      iovs[i].iov_base = datagrams[i].data;
+      iovs[i].iov_len = datagrams[i].size;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = static_cast<socklen_t>(
+          datagrams[i].addr.ToSockAddrStorage(&addrs[i]));
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    // Suppress SIGPIPE. See Send() for explanation.
+    int sent = ::sendmmsg(s_, msgs, static_cast<unsigned int>(count),
+                          MSG_NOSIGNAL);
+    UpdateLastError();
+    if ((sent < 0) && IsBlockingError(error_)) {
+      EnableEvents(DE_WRITE);
+    }
+    return sent;
+  }
+#endif  // LINUX
+
   int Listen(int backlog) {
     int err = ::listen(s_, backlog);
     UpdateLastError();
     if (err == 0) {
       state_ = CS_CONNECTING;
-      enabled_events_ |= DE_ACCEPT;
+      EnableEvents(DE_ACCEPT);
 #ifdef _DEBUG
       dbg_addr_ = "Listening @ ";
       dbg_addr_.append(GetLocalAddress().ToString());
@@ -382,7 +468,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     UpdateLastError();
     if (s == INVALID_SOCKET)
       return NULL;
-    enabled_events_ |= DE_ACCEPT;
+    EnableEvents(DE_ACCEPT);
     if (out_addr != NULL)
       SocketAddressFromSockAddrStorage(addr_storage, out_addr);
     return ss_->WrapSocket(s);
@@ -395,7 +481,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     UpdateLastError();
     s_ = INVALID_SOCKET;
     state_ = CS_CLOSED;
-    enabled_events_ = 0;
+    SetEnabledEvents(0);
     if (resolver_) {
       resolver_->Destroy(false);
       resolver_ = NULL;
@@ -488,6 +574,20 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     error_ = LAST_SYSTEM_ERROR;
   }
 
+  void EnableEvents(uint8 events) {
+    SetEnabledEvents(enabled_events_ | events);
+  }
+
+  void DisableEvents(uint8 events) {
+    SetEnabledEvents(enabled_events_ & ~events);
+  }
+
+  // Overridden by dispatchers that need to tell the socket server when the
+  // set of events they are interested in changes.
+  virtual void SetEnabledEvents(uint8 events) {
+    enabled_events_ = events;
+  }
+
   static int TranslateOption(Option opt, int* slevel, int* sopt) {
     switch (opt) {
       case OPT_DONTFRAGMENT:
@@ -515,6 +615,15 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
         *slevel = IPPROTO_TCP;
         *sopt = TCP_NODELAY;
         break;
+      case OPT_REUSEPORT:
+#if defined(SO_REUSEPORT)
+        *slevel = SOL_SOCKET;
+        *sopt = SO_REUSEPORT;
+        break;
+#else
+        LOG(LS_WARNING) << "Socket::OPT_REUSEPORT not supported.";
+        return -1;
+#endif
       default:
         ASSERT(false);
         return -1;
@@ -866,24 +975,24 @@ class SocketDispatcher : public Dispatcher, public PhysicalSocket {
     // Make sure we deliver connect/accept first. Otherwise, consumers may see
     // something like a READ followed by a CONNECT, which would be odd.
     if ((ff & DE_CONNECT) != 0) {
-      enabled_events_ &= ~DE_CONNECT;
+      DisableEvents(DE_CONNECT);
       SignalConnectEvent(this);
     }
     if ((ff & DE_ACCEPT) != 0) {
-      enabled_events_ &= ~DE_ACCEPT;
+      DisableEvents(DE_ACCEPT);
       SignalReadEvent(this);
     }
     if ((ff & DE_READ) != 0) {
-      enabled_events_ &= ~DE_READ;
+      DisableEvents(DE_READ);
       SignalReadEvent(this);
     }
     if ((ff & DE_WRITE) != 0) {
-      enabled_events_ &= ~DE_WRITE;
+      DisableEvents(DE_WRITE);
       SignalWriteEvent(this);
     }
     if ((ff & DE_CLOSE) != 0) {
       // The socket is now dead to us, so stop checking it.
-      enabled_events_ = 0;
+      SetEnabledEvents(0);
       SignalCloseEvent(this, err);
     }
   }
@@ -895,11 +1004,20 @@ class SocketDispatcher : public Dispatcher, public PhysicalSocket {
     ss_->Remove(this);
     return PhysicalSocket::Close();
   }
+
+ protected:
+  virtual void SetEnabledEvents(uint8 events) {
+    if (events == enabled_events_)
+      return;
+    PhysicalSocket::SetEnabledEvents(events);
+    ss_->Update(this);
+  }
 };
 
 class FileDispatcher: public Dispatcher, public AsyncFile {
  public:
-  FileDispatcher(int fd, PhysicalSocketServer *ss) : ss_(ss), fd_(fd) {
+  FileDispatcher(int fd, PhysicalSocketServer *ss)
+      : ss_(ss), fd_(fd), flags_(0) {
     set_readable(true);
 
     ss_->Add(this);
@@ -943,6 +1061,7 @@ class FileDispatcher: public Dispatcher, public AsyncFile {
 
   virtual void set_readable(bool value) {
     flags_ = value ? (flags_ | DE_READ) : (flags_ & ~DE_READ);
+    ss_->Update(this);
   }
 
   virtual bool writable() {
@@ -951,6 +1070,7 @@ class FileDispatcher: public Dispatcher, public AsyncFile {
 
   virtual void set_writable(bool value) {
     flags_ = value ? (flags_ | DE_WRITE) : (flags_ & ~DE_WRITE);
+    ss_->Update(this);
   }
 
  private:
@@ -1175,6 +1295,34 @@ PhysicalSocketServer::PhysicalSocketServer()
     : fWait_(false),
       last_tick_tracked_(0),
       last_tick_dispatch_count_(0) {
+#if defined(LINUX) || defined(ANDROID)
+  Construct(BACKEND_EPOLL);
+#else
+  Construct(BACKEND_SELECT);
+#endif
+}
+
+PhysicalSocketServer::PhysicalSocketServer(Backend backend)
+    : fWait_(false),
+      last_tick_tracked_(0),
+      last_tick_dispatch_count_(0) {
+  Construct(backend);
+}
+
+void PhysicalSocketServer::Construct(Backend backend) {
+  backend_ = BACKEND_SELECT;
+#if defined(LINUX) || defined(ANDROID)
+  epoll_fd_ = INVALID_SOCKET;
+  if (backend == BACKEND_EPOLL) {
+    epoll_fd_ = epoll_create(FD_SETSIZE);
+    if (epoll_fd_ != INVALID_SOCKET) {
+      fcntl(epoll_fd_, F_SETFD, FD_CLOEXEC);
+      backend_ = BACKEND_EPOLL;
+    } else {
+      LOG_ERR(LS_WARNING) << "epoll_create failed, falling back to select";
+    }
+  }
+#endif
   signal_wakeup_ = new Signaler(this, &fWait_);
 #ifdef WIN32
   socket_ev_ = WSACreateEvent();
@@ -1190,6 +1338,10 @@ PhysicalSocketServer::~PhysicalSocketServer() {
 #endif
   delete signal_wakeup_;
   ASSERT(dispatchers_.empty());
+#if defined(LINUX) || defined(ANDROID)
+  if (epoll_fd_ != INVALID_SOCKET)
+    close(epoll_fd_);
+#endif
 }
 
 void PhysicalSocketServer::WakeUp() {
@@ -1243,6 +1395,21 @@ void PhysicalSocketServer::Add(Dispatcher *pdispatcher) {
   if (pos != dispatchers_.end())
     return;
   dispatchers_.push_back(pdispatcher);
+#ifdef POSIX
+  if ((backend_ == BACKEND_SELECT)
+      && (pdispatcher->GetDescriptor() >= FD_SETSIZE)) {
+    // WaitSelect() will skip this dispatcher.
+    LOG(LS_ERROR) << "Descriptor " << pdispatcher->GetDescriptor()
+                  << " is beyond FD_SETSIZE; "
+                  << "use the epoll backend for this many sockets";
+  }
+#endif
+#if defined(LINUX) || defined(ANDROID)
+  if (backend_ == BACKEND_EPOLL) {
+    epoll_events_[pdispatcher] = 0;
+    UpdateEpoll(pdispatcher, pdispatcher->GetRequestedEvents(), true);
+  }
+#endif
 }
 
 void PhysicalSocketServer::Remove(Dispatcher *pdispatcher) {
@@ -1259,10 +1426,94 @@ void PhysicalSocketServer::Remove(Dispatcher *pdispatcher) {
       --**it;
     }
   }
+#if defined(LINUX) || defined(ANDROID)
+  if (backend_ == BACKEND_EPOLL) {
+    UpdateEpoll(pdispatcher, 0, false);
+    epoll_events_.erase(pdispatcher);
+    // Don't deliver events still pending from the current epoll_wait() batch
+    // to a dispatcher that has gone away.
+    for (size_t i = 0; i < epoll_pending_.size(); ++i) {
+      if (epoll_pending_[i].first == pdispatcher)
+        epoll_pending_[i].first = NULL;
+    }
+  }
+#endif
+}
+
+void PhysicalSocketServer::Update(Dispatcher *pdispatcher) {
+#if defined(LINUX) || defined(ANDROID)
+  if (backend_ == BACKEND_EPOLL) {
+    CritScope cs(&crit_);
+    // Dispatchers update their events before being added and while being
+    // removed; only the ones we know about are in the interest set.
+    if (epoll_events_.find(pdispatcher) != epoll_events_.end())
+      UpdateEpoll(pdispatcher, pdispatcher->GetRequestedEvents(), true);
+  }
+#endif
 }
 
 #ifdef POSIX
+// Translates the readiness of a dispatcher's descriptor into DE_* events and
+// delivers them to the dispatcher.
+static void ProcessEvents(Dispatcher* pdispatcher, bool readable,
+                          bool writable) {
+  int fd = pdispatcher->GetDescriptor();
+  uint32 ff = 0;
+  int errcode = 0;
+
+  // Reap any error code, which can be signaled through reads or writes.
+  // TODO: Should we set errcode if getsockopt fails?
+  if (readable || writable) {
+    socklen_t len = sizeof(errcode);
+    ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &len);
+  }
+
+  // Check readable descriptors. If we're waiting on an accept, signal
+  // that. Otherwise we're waiting for data, check to see if we're
+  // readable or really closed.
+  // TODO: Only peek at TCP descriptors.
+  if (readable) {
+    if (pdispatcher->GetRequestedEvents() & DE_ACCEPT) {
+      ff |= DE_ACCEPT;
+    } else if (errcode || pdispatcher->IsDescriptorClosed()) {
+      ff |= DE_CLOSE;
+    } else {
+      ff |= DE_READ;
+    }
+  }
+
+  // Check writable descriptors. If we're waiting on a connect, detect
+  // success versus failure by the reaped error code.
+  if (writable) {
+    if (pdispatcher->GetRequestedEvents() & DE_CONNECT) {
+      if (!errcode) {
+        ff |= DE_CONNECT;
+      } else {
+        ff |= DE_CLOSE;
+      }
+    } else {
+      ff |= DE_WRITE;
+    }
+  }
+
+  // Tell the descriptor about the event.
+  if (ff != 0) {
+    pdispatcher->OnPreEvent(ff);
+    pdispatcher->OnEvent(ff, errcode);
+  }
+}
+
 bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
+#if defined(LINUX) || defined(ANDROID)
+  // Without process_io only the wakeup descriptor is of interest, and select()
+  // over that single descriptor is cheaper than tearing down the epoll set.
+  if (backend_ == BACKEND_EPOLL && process_io)
+    return WaitEpoll(cmsWait);
+#endif
+  return WaitSelect(cmsWait, process_io);
+}
+
+bool PhysicalSocketServer::WaitSelect(int cmsWait, bool process_io) {
   // Calculate timing information
 
   struct timeval *ptvWait = NULL;
@@ -1305,6 +1556,9 @@ bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
         if (!process_io && (pdispatcher != signal_wakeup_))
           continue;
         int fd = pdispatcher->GetDescriptor();
+        // Out of range for an fd_set; Add() has logged it.
+        if ((fd < 0) || (fd >= FD_SETSIZE))
+          continue;
         if (fd > fdmax)
           fdmax = fd;
 
@@ -1341,51 +1595,15 @@ bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
       for (size_t i = 0; i < dispatchers_.size(); ++i) {
         Dispatcher *pdispatcher = dispatchers_[i];
         int fd = pdispatcher->GetDescriptor();
-        uint32 ff = 0;
-        int errcode = 0;
-
-        // Reap any error code, which can be signaled through reads or writes.
-        // TODO: Should we set errcode if getsockopt fails?
-        if (FD_ISSET(fd, &fdsRead) || FD_ISSET(fd, &fdsWrite)) {
-          socklen_t len = sizeof(errcode);
-          ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &len);
-        }
-
-        // Check readable descriptors. If we're waiting on an accept, signal
-        // that. Otherwise we're waiting for data, check to see if we're
-        // readable or really closed.
-        // TODO: Only peek at TCP descriptors.
-        if (FD_ISSET(fd, &fdsRead)) {
+        if ((fd < 0) || (fd >= FD_SETSIZE))
+          continue;
+        bool readable = FD_ISSET(fd, &fdsRead);
+        if (readable)
           FD_CLR(fd, &fdsRead);
-          if (pdispatcher->GetRequestedEvents() & DE_ACCEPT) {
-            ff |= DE_ACCEPT;
-          } else if (errcode || pdispatcher->IsDescriptorClosed()) {
-            ff |= DE_CLOSE;
-          } else {
-            ff |= DE_READ;
-          }
-        }
-
-        // Check writable descriptors. If we're waiting on a connect, detect
-        // success versus failure by the reaped error code.
-        if (FD_ISSET(fd, &fdsWrite)) {
+        bool writable = FD_ISSET(fd, &fdsWrite);
+        if (writable)
           FD_CLR(fd, &fdsWrite);
-          if (pdispatcher->GetRequestedEvents() & DE_CONNECT) {
-            if (!errcode) {
-              ff |= DE_CONNECT;
-            } else {
-              ff |= DE_CLOSE;
-            }
-          } else {
-            ff |= DE_WRITE;
-          }
-        }
-
-        // Tell the descriptor about the event.
-        if (ff != 0) {
-          pdispatcher->OnPreEvent(ff);
-          pdispatcher->OnEvent(ff, errcode);
-        }
+        ProcessEvents(pdispatcher, readable, writable);
       }
     }
 
@@ -1413,6 +1631,117 @@ bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
   return true;
 }
 
+#if defined(LINUX) || defined(ANDROID)
+// Returns the epoll events that match the DE_* events |requested|.
+static uint32 EpollEvents(uint32 requested) {
+  uint32 events = 0;
+  if (requested & (DE_READ | DE_ACCEPT))
+    events |= EPOLLIN;
+  if (requested & (DE_WRITE | DE_CONNECT))
+    events |= EPOLLOUT;
+  return events;
+}
+
+bool PhysicalSocketServer::WaitEpoll(int cmsWait) {
+  ASSERT(epoll_fd_ != INVALID_SOCKET);
+  uint32 msStop = (cmsWait != kForever) ? TimeAfter(cmsWait) : 0;
+  struct epoll_event events[kMaxEpollEvents];
+
+  fWait_ = true;
+
+  while (fWait_) {
+    int timeout = (cmsWait != kForever) ?
+        _max(TimeUntil(msStop), static_cast<int32>(0)) : -1;
+
+    // Only descriptors with requested events are registered, so this returns
+    // just the ready ones, regardless of how many dispatchers there are.
+    int n = epoll_wait(epoll_fd_, events, kMaxEpollEvents, timeout);
+
+    if (n < 0) {
+      if (errno != EINTR) {
+        LOG_E(LS_ERROR, EN, errno) << "epoll_wait";
+        return false;
+      }
+      // Else ignore the error and keep going. See WaitSelect() for why.
+    } else if (n == 0) {
+      // If timeout, return success
+      return true;
+    } else {
+      // We have signaled descriptors
+      CritScope cr(&crit_);
+      epoll_pending_.resize(n);
+      for (int i = 0; i < n; ++i) {
+        epoll_pending_[i].first = static_cast<Dispatcher*>(events[i].data.ptr);
+        epoll_pending_[i].second = events[i].events;
+      }
+      for (size_t i = 0; i < epoll_pending_.size(); ++i) {
+        // Removed by the handler of an earlier event in this batch.
+        Dispatcher* pdispatcher = epoll_pending_[i].first;
+        if (!pdispatcher)
+          continue;
+        // Errors and hangups are reported as both readable and writable, the
+        // same way select() reports them.
+        uint32 ev = epoll_pending_[i].second;
+        uint32 ff = pdispatcher->GetRequestedEvents();
+        // The descriptor is level-triggered, so events it no longer requests
+        // would keep firing; stop watching for them now.
+        uint32 wanted = EpollEvents(ff);
+        if (wanted != 0)
+          wanted |= EPOLLERR | EPOLLHUP;
+        if (ev & ~wanted)
+          UpdateEpoll(pdispatcher, ff, false);
+        bool readable = (ff & (DE_READ | DE_ACCEPT)) &&
+            (ev & (EPOLLIN | EPOLLERR | EPOLLHUP));
+        bool writable = (ff & (DE_WRITE | DE_CONNECT)) &&
+            (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP));
+        ProcessEvents(pdispatcher, readable, writable);
+      }
+      epoll_pending_.clear();
+    }
+
+    if (cmsWait != kForever && TimeUntil(msStop) <= 0) {
+      return true;
+    }
+  }
+
+  return true;
+}
+
+void PhysicalSocketServer::UpdateEpoll(Dispatcher* pdispatcher,
+                                       uint32 requested, bool lazy) {
+  EpollEventMap::iterator it = epoll_events_.find(pdispatcher);
+  ASSERT(it != epoll_events_.end());
+  uint32 events = EpollEvents(requested);
+  if (events == it->second)
+    return;
+  // Leave extra events registered; WaitEpoll() drops them if they fire.
+  if (lazy && (events & ~it->second) == 0)
+    return;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = pdispatcher;
+  int op;
+  if (it->second == 0) {
+    op = EPOLL_CTL_ADD;
+  } else if (events == 0) {
+    op = EPOLL_CTL_DEL;
+  } else {
+    op = EPOLL_CTL_MOD;
+  }
+  int fd = pdispatcher->GetDescriptor();
+  if (epoll_ctl(epoll_fd_, op, fd, &event) < 0) {
+    // The descriptor may already have been closed underneath us, in which
+    // case the kernel has dropped it from the interest set on its own.
+    if (op != EPOLL_CTL_DEL || (errno != EBADF && errno != ENOENT)) {
+      LOG_E(LS_ERROR, EN, errno) << "epoll_ctl(" << op << ", " << fd << ")";
+    }
+  }
+  it->second = events;
+}
+#endif  // LINUX || ANDROID
+
 static void GlobalSignalHandler(int signum) {
   PosixSignalHandler::Instance()->OnPosixSignalReceived(signum);
 }
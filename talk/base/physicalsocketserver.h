@@ -28,6 +28,7 @@
 #ifndef TALK_BASE_PHYSICALSOCKETSERVER_H__
 #define TALK_BASE_PHYSICALSOCKETSERVER_H__
 
+#include <map>
 #include <vector>
 
 #include "talk/base/asyncfile.h"
@@ -74,9 +75,25 @@ class Dispatcher {
 // A socket server that provides the real sockets of the underlying OS.
 class PhysicalSocketServer : public SocketServer {
  public:
+  // The mechanism used by Wait() to find ready descriptors.
+  enum Backend {
+    // Rebuilds fd_sets from every dispatcher on each pass through Wait().
+    // Portable, but O(n) per wakeup and limited to FD_SETSIZE descriptors.
+    BACKEND_SELECT,
+    // Keeps a level-triggered epoll set that is updated as dispatchers are
+    // added, removed or change their requested events, so Wait() only
+    // touches ready descriptors. Linux only.
+    BACKEND_EPOLL,
+  };
+
+  // Uses the best backend available on this platform.
   PhysicalSocketServer();
+  // Uses |backend|, falling back to BACKEND_SELECT if it is not available.
+  explicit PhysicalSocketServer(Backend backend);
   virtual ~PhysicalSocketServer();
 
+  Backend backend() const { return backend_; }
+
   // SocketFactory:
   virtual Socket* CreateSocket(int type);
   virtual Socket* CreateSocket(int family, int type);
@@ -93,6 +110,10 @@ class PhysicalSocketServer : public SocketServer {
 
   void Add(Dispatcher* dispatcher);
   void Remove(Dispatcher* dispatcher);
+  // Must be called when the value returned by the dispatcher's
+  // GetRequestedEvents() changes, so that the epoll backend can update its
+  // interest set. A no-op for the select backend.
+  void Update(Dispatcher* dispatcher);
 
 #ifdef POSIX
   AsyncFile* CreateFile(int fd);
@@ -117,11 +138,35 @@ class PhysicalSocketServer : public SocketServer {
   typedef std::vector<Dispatcher*> DispatcherList;
   typedef std::vector<size_t*> IteratorList;
 
+  void Construct(Backend backend);
+
 #ifdef POSIX
   static bool InstallSignal(int signum, void (*handler)(int));
 
+  bool WaitSelect(int cms, bool process_io);
+#if defined(LINUX) || defined(ANDROID)
+  typedef std::map<Dispatcher*, uint32> EpollEventMap;
+  typedef std::vector<std::pair<Dispatcher*, uint32> > EpollEventList;
+
+  bool WaitEpoll(int cms);
+  // Registers the epoll events for |requested|. If |lazy|, events that are
+  // no longer requested stay registered until they next fire.
+  void UpdateEpoll(Dispatcher* dispatcher, uint32 requested, bool lazy);
+
+  int epoll_fd_;
+  // The epoll events currently registered for each dispatcher, 0 if it is
+  // not in the kernel's interest set. This may include events the dispatcher
+  // no longer requests; WaitEpoll() ignores those and unregisters them when
+  // they fire, so that a socket that briefly masks its events (as every read
+  // does) costs no epoll_ctl() calls.
+  EpollEventMap epoll_events_;
+  // Events returned by the epoll_wait() call currently being dispatched.
+  EpollEventList epoll_pending_;
+#endif
+
   scoped_ptr<PosixSignalDispatcher> signal_dispatcher_;
 #endif
+  Backend backend_;
   DispatcherList dispatchers_;
   IteratorList iterators_;
   Signaler* signal_wakeup_;
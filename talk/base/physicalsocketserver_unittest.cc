@@ -27,13 +27,18 @@
 
 #include <signal.h>
 #include <stdarg.h>
+#ifdef POSIX
+#include <sys/resource.h>
+#endif
 
+#include "talk/base/asyncudpsocket.h"
 #include "talk/base/gunit.h"
 #include "talk/base/logging.h"
 #include "talk/base/physicalsocketserver.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socket_unittest.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 
 namespace talk_base {
 
@@ -164,6 +169,299 @@ TEST_F(PhysicalSocketTest, TestGetSetOptionsIPv6) {
   SocketTest::TestGetSetOptionsIPv6();
 }
 
+#if defined(LINUX) || defined(ANDROID)
+TEST(PhysicalSocketServerTest, DefaultBackendIsEpoll) {
+  PhysicalSocketServer ss;
+  EXPECT_EQ(PhysicalSocketServer::BACKEND_EPOLL, ss.backend());
+}
+
+// The default backend is epoll here, so run the main tests against select()
+// as well.
+class PhysicalSocketSelectTest : public SocketTest {
+ protected:
+  PhysicalSocketSelectTest()
+      : ss_(PhysicalSocketServer::BACKEND_SELECT),
+        scope_(&ss_) {
+  }
+
+  PhysicalSocketServer ss_;
+  SocketServerScope scope_;
+};
+
+TEST_F(PhysicalSocketSelectTest, TestConnectIPv4) {
+  SocketTest::TestConnectIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestConnectFailIPv4) {
+  SocketTest::TestConnectFailIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestServerCloseIPv4) {
+  SocketTest::TestServerCloseIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestCloseInClosedCallbackIPv4) {
+  SocketTest::TestCloseInClosedCallbackIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestSocketServerWaitIPv4) {
+  SocketTest::TestSocketServerWaitIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestTcpIPv4) {
+  SocketTest::TestTcpIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestUdpIPv4) {
+  SocketTest::TestUdpIPv4();
+}
+
+// A dispatcher whose descriptor doesn't fit in an fd_set.
+class OutOfRangeDispatcher : public Dispatcher {
+ public:
+  OutOfRangeDispatcher() : events_(0) {}
+  virtual uint32 GetRequestedEvents() { return DE_READ | DE_WRITE; }
+  virtual void OnPreEvent(uint32 ff) {}
+  virtual void OnEvent(uint32 ff, int err) { ++events_; }
+  virtual int GetDescriptor() { return FD_SETSIZE + 1; }
+  virtual bool IsDescriptorClosed() { return false; }
+  int events_;
+};
+
+// select() can't watch such a descriptor, so Wait() skips it, both when it
+// fills the fd_sets and when it dispatches.
+TEST_F(PhysicalSocketSelectTest, TestSkipDescriptorBeyondFdSetSize) {
+  OutOfRangeDispatcher dispatcher;
+  ss_.Add(&dispatcher);
+  ss_.WakeUp();
+  EXPECT_TRUE(ss_.Wait(0, true));
+  EXPECT_EQ(0, dispatcher.events_);
+  ss_.Remove(&dispatcher);
+}
+#endif
+
+// Collects the packets delivered by AsyncUDPSocket::SignalReadPacketBatch.
+class BatchReceiver : public sigslot::has_slots<> {
+ public:
+  BatchReceiver() : batches_(0) {}
+  void OnReadPacketBatch(AsyncPacketSocket* socket, const Datagram* packets,
+                         size_t count) {
+    ++batches_;
+    for (size_t i = 0; i < count; ++i) {
+      packets_.push_back(std::string(packets[i].data, packets[i].size));
+      addrs_.push_back(packets[i].addr);
+    }
+  }
+  int batches_;
+  std::vector<std::string> packets_;
+  std::vector<SocketAddress> addrs_;
+};
+
+TEST_F(PhysicalSocketTest, TestUdpBatch) {
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  SocketServer* ss = Thread::Current()->socketserver();
+  scoped_ptr<AsyncUDPSocket> sender(AsyncUDPSocket::Create(ss, loopback));
+  scoped_ptr<AsyncUDPSocket> receiver(AsyncUDPSocket::Create(ss, loopback));
+  ASSERT_TRUE(sender && receiver);
+  EXPECT_FALSE(receiver->SetReceiveBatchSize(0));
+  EXPECT_TRUE(receiver->SetReceiveBatchSize(8));
+  BatchReceiver batch;
+  receiver->SignalReadPacketBatch.connect(&batch,
+                                          &BatchReceiver::OnReadPacketBatch);
+
+  const int kNumPackets = 20;
+  std::vector<std::string> payloads;
+  std::vector<Datagram> datagrams;
+  for (int i = 0; i < kNumPackets; ++i) {
+    payloads.push_back(std::string(i + 1, 'a' + i));
+  }
+  for (int i = 0; i < kNumPackets; ++i) {
+    datagrams.push_back(Datagram(&payloads[i][0], payloads[i].size(),
+                                 receiver->GetLocalAddress()));
+  }
+  EXPECT_EQ(kNumPackets, sender->SendToBatch(&datagrams[0], kNumPackets));
+
+  EXPECT_EQ_WAIT(static_cast<size_t>(kNumPackets), batch.packets_.size(),
+                 5000);
+  // Never more than the batch size at a time, but more than one per batch.
+  EXPECT_LE((kNumPackets + 7) / 8, batch.batches_);
+  EXPECT_GT(kNumPackets, batch.batches_);
+  for (int i = 0; i < kNumPackets; ++i) {
+    EXPECT_EQ(payloads[i], batch.packets_[i]);
+    EXPECT_EQ(sender->GetLocalAddress(), batch.addrs_[i]);
+  }
+}
+
+// Datagrams too large for a batch slot must be dropped, not truncated.
+TEST_F(PhysicalSocketTest, TestUdpBatchDropsLargePackets) {
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  SocketServer* ss = Thread::Current()->socketserver();
+  scoped_ptr<AsyncUDPSocket> sender(AsyncUDPSocket::Create(ss, loopback));
+  scoped_ptr<AsyncUDPSocket> receiver(AsyncUDPSocket::Create(ss, loopback));
+  ASSERT_TRUE(sender && receiver);
+  EXPECT_TRUE(receiver->SetReceiveBatchSize(8));
+  BatchReceiver batch;
+  receiver->SignalReadPacketBatch.connect(&batch,
+                                          &BatchReceiver::OnReadPacketBatch);
+
+  const std::string small1("first"), large(4000, 'x'), small2("second");
+  SocketAddress dest = receiver->GetLocalAddress();
+  EXPECT_EQ(static_cast<int>(small1.size()),
+            sender->SendTo(small1.data(), small1.size(), dest));
+  EXPECT_EQ(static_cast<int>(large.size()),
+            sender->SendTo(large.data(), large.size(), dest));
+  EXPECT_EQ(static_cast<int>(small2.size()),
+            sender->SendTo(small2.data(), small2.size(), dest));
+
+  EXPECT_EQ_WAIT(2U, batch.packets_.size(), 5000);
+  Thread::Current()->ProcessMessages(100);
+  ASSERT_EQ(2U, batch.packets_.size());
+  EXPECT_EQ(small1, batch.packets_[0]);
+  EXPECT_EQ(small2, batch.packets_[1]);
+}
+
+// A read that drops everything it got must not signal an empty batch.
+TEST_F(PhysicalSocketTest, TestUdpBatchSkipsEmptyBatch) {
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  SocketServer* ss = Thread::Current()->socketserver();
+  scoped_ptr<AsyncUDPSocket> sender(AsyncUDPSocket::Create(ss, loopback));
+  scoped_ptr<AsyncUDPSocket> receiver(AsyncUDPSocket::Create(ss, loopback));
+  ASSERT_TRUE(sender && receiver);
+  EXPECT_TRUE(receiver->SetReceiveBatchSize(8));
+  BatchReceiver batch;
+  receiver->SignalReadPacketBatch.connect(&batch,
+                                          &BatchReceiver::OnReadPacketBatch);
+
+  const std::string large(4000, 'x');
+  EXPECT_EQ(static_cast<int>(large.size()),
+            sender->SendTo(large.data(), large.size(),
+                           receiver->GetLocalAddress()));
+  Thread::Current()->ProcessMessages(100);
+  EXPECT_EQ(0, batch.batches_);
+}
+
+// The default RecvFromBatch() can't see truncation, so it drops datagrams
+// that fill their buffer exactly.
+TEST_F(PhysicalSocketTest, TestDefaultRecvFromBatchDropsFullBuffers) {
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  SocketServer* ss = Thread::Current()->socketserver();
+  scoped_ptr<AsyncSocket> sender(ss->CreateAsyncSocket(SOCK_DGRAM));
+  // The adapter forwards RecvFrom() but not RecvFromBatch().
+  scoped_ptr<AsyncSocketAdapter> receiver(
+      new AsyncSocketAdapter(ss->CreateAsyncSocket(SOCK_DGRAM)));
+  ASSERT_EQ(0, sender->Bind(loopback));
+  ASSERT_EQ(0, receiver->Bind(loopback));
+  SocketAddress dest = receiver->GetLocalAddress();
+
+  const size_t kSlotSize = 16;
+  const std::string small1("first"), full(kSlotSize, 'x'), small2("second");
+  sender->SendTo(small1.data(), small1.size(), dest);
+  sender->SendTo(full.data(), full.size(), dest);
+  sender->SendTo(small2.data(), small2.size(), dest);
+
+  char buffers[2][kSlotSize];
+  Datagram datagrams[2];
+  for (int i = 0; i < 2; ++i) {
+    datagrams[i] = Datagram(buffers[i], kSlotSize, SocketAddress());
+  }
+  EXPECT_EQ(2, receiver->RecvFromBatch(datagrams, 2));
+  EXPECT_EQ(small1, std::string(datagrams[0].data, datagrams[0].size));
+  EXPECT_EQ(small2, std::string(datagrams[1].data, datagrams[1].size));
+
+  // Dropping everything is not an error.
+  sender->SendTo(full.data(), full.size(), dest);
+  datagrams[0].size = kSlotSize;
+  EXPECT_EQ(0, receiver->RecvFromBatch(datagrams, 1));
+  EXPECT_EQ(SOCKET_ERROR, receiver->RecvFromBatch(datagrams, 1));
+}
+
+// Counts and drains packets arriving on a socket, then wakes up the socket
+// server so that Wait() returns.
+class PacketSink : public sigslot::has_slots<> {
+ public:
+  explicit PacketSink(SocketServer* ss) : ss_(ss), count_(0) {}
+  void OnReadEvent(AsyncSocket* socket) {
+    char buf[64];
+    while (socket->Recv(buf, sizeof(buf)) > 0) {
+      ++count_;
+    }
+    ss_->WakeUp();
+  }
+  SocketServer* ss_;
+  int count_;
+};
+
+// Measures the cost of a Wait() that has one ready socket among
+// |num_idle| idle ones.
+static void MeasureWait(PhysicalSocketServer::Backend backend, int num_idle) {
+  PhysicalSocketServer ss(backend);
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  std::vector<AsyncSocket*> idle;
+  for (int i = 0; i < num_idle; ++i) {
+    AsyncSocket* socket = ss.CreateAsyncSocket(SOCK_DGRAM);
+    if (!socket) {
+      break;
+    }
+    idle.push_back(socket);
+    socket->Bind(loopback);
+  }
+
+  scoped_ptr<AsyncSocket> sender(ss.CreateAsyncSocket(SOCK_DGRAM));
+  scoped_ptr<AsyncSocket> receiver(ss.CreateAsyncSocket(SOCK_DGRAM));
+  if (static_cast<int>(idle.size()) == num_idle && sender && receiver) {
+    sender->Bind(loopback);
+    receiver->Bind(loopback);
+    PacketSink sink(&ss);
+    receiver->SignalReadEvent.connect(&sink, &PacketSink::OnReadEvent);
+    // Let every socket report its initial writability and go idle.
+    ss.Wait(0, true);
+
+    const int kIterations = 2000;
+    SocketAddress dest = receiver->GetLocalAddress();
+    uint32 start = Time();
+    for (int i = 0; i < kIterations; ++i) {
+      sender->SendTo("x", 1, dest);
+      while (sink.count_ <= i && ss.Wait(1000, true)) {
+      }
+    }
+    uint32 elapsed = TimeSince(start);
+    EXPECT_EQ(kIterations, sink.count_);
+    LOG(LS_INFO) << (backend == PhysicalSocketServer::BACKEND_EPOLL ?
+                     "epoll" : "select")
+                 << " with " << num_idle << " idle sockets: "
+                 << (elapsed * 1000.0 / kIterations) << " us per wakeup";
+  } else {
+    LOG(LS_WARNING) << "Could only create " << idle.size() << " of "
+                    << num_idle << " sockets, skipping";
+  }
+
+  for (size_t i = 0; i < idle.size(); ++i) {
+    delete idle[i];
+  }
+}
+
+// Compares select() and epoll at increasing numbers of idle sockets.
+TEST(PhysicalSocketServerTest, WaitPerf) {
+#ifdef POSIX
+  // Ask for enough descriptors for the largest run.
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < 10100) {
+    limit.rlim_cur = _min<rlim_t>(10100, limit.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+#endif
+  const int kCounts[] = { 100, 1000, 10000 };
+  for (size_t i = 0; i < ARRAY_SIZE(kCounts); ++i) {
+    // select() can't watch descriptors beyond FD_SETSIZE.
+    if (kCounts[i] + 16 < FD_SETSIZE) {
+      MeasureWait(PhysicalSocketServer::BACKEND_SELECT, kCounts[i]);
+    }
+#if defined(LINUX) || defined(ANDROID)
+    MeasureWait(PhysicalSocketServer::BACKEND_EPOLL, kCounts[i]);
+#endif
+  }
+}
+
 #ifdef POSIX
 
 class PosixSignalDeliveryTest : public testing::Test {
@@ -0,0 +1,228 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/resolverpool.h"
+
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+#include "talk/base/nethelpers.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+
+namespace {
+
+enum {
+  MSG_DONE = 1,
+  MSG_LOOKUP,
+};
+
+class SystemHostResolver : public HostResolver {
+ public:
+  virtual int Resolve(const std::string& hostname, int family,
+                      std::vector<IPAddress>* addresses) {
+    return ResolveHostname(hostname, family, addresses);
+  }
+};
+
+}  // namespace
+
+// PooledResolver
+
+PooledResolver::PooledResolver(ResolverPool* pool, const SocketAddress& addr)
+    : pool_(pool), thread_(Thread::Current()), addr_(addr), error_(0),
+      signaling_(false), destroyed_(false) {
+  ASSERT(thread_ != NULL);
+}
+
+PooledResolver::~PooledResolver() {
+}
+
+void PooledResolver::Destroy() {
+  ASSERT(thread_->IsCurrent());
+  if (signaling_) {
+    destroyed_ = true;
+    return;
+  }
+  pool_->Cancel(this);
+  thread_->Clear(this);
+  delete this;
+}
+
+void PooledResolver::Complete(int error,
+                              const std::vector<IPAddress>& addresses) {
+  error_ = error;
+  addresses_ = addresses;
+  if (!addresses_.empty())
+    addr_.SetIP(addresses_[0]);
+  thread_->Post(this, MSG_DONE);
+}
+
+void PooledResolver::OnMessage(Message* msg) {
+  ASSERT(msg->message_id == MSG_DONE);
+  signaling_ = true;
+  SignalDone(this);
+  signaling_ = false;
+  if (destroyed_)
+    delete this;
+}
+
+// ResolverPool
+
+const size_t ResolverPool::kDefaultMaxWorkers;
+const int ResolverPool::kDefaultCacheTtl;
+
+ResolverPool::ResolverPool(HostResolver* resolver, size_t max_workers)
+    : resolver_(resolver ? resolver : new SystemHostResolver()),
+      max_workers_(_max(max_workers, static_cast<size_t>(1))),
+      cache_ttl_(kDefaultCacheTtl) {
+}
+
+ResolverPool::~ResolverPool() {
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->Stop();
+    delete workers_[i];
+  }
+}
+
+ResolverPool* ResolverPool::Default() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(ResolverPool, pool,
+                                (NULL, kDefaultMaxWorkers));
+  return &pool;
+}
+
+PooledResolver* ResolverPool::Resolve(const SocketAddress& addr) {
+  PooledResolver* resolver = new PooledResolver(this, addr);
+  LookupKey key(addr.hostname(), addr.family());
+
+  CritScope cs(&crit_);
+  ++stats_.requests;
+
+  Cache::iterator cached = cache_.find(key);
+  if (cached != cache_.end()) {
+    if (TimeIsLater(Time(), cached->second.expires)) {
+      ++stats_.cache_hits;
+      resolver->Complete(0, cached->second.addresses);
+      return resolver;
+    }
+    cache_.erase(cached);
+  }
+
+  PendingMap::iterator pending = pending_.find(key);
+  if (pending != pending_.end()) {
+    ++stats_.coalesced;
+    pending->second.push_back(resolver);
+    return resolver;
+  }
+
+  pending_[key].push_back(resolver);
+  queue_.push_back(key);
+  Thread* worker;
+  if (!idle_workers_.empty()) {
+    worker = idle_workers_.back();
+    idle_workers_.pop_back();
+  } else if (workers_.size() < max_workers_) {
+    worker = new Thread();
+    worker->SetName("ResolverPool", this);
+    worker->Start();
+    workers_.push_back(worker);
+    stats_.workers = workers_.size();
+  } else {
+    // A busy worker will get to it.
+    return resolver;
+  }
+  worker->Post(this, MSG_LOOKUP);
+  return resolver;
+}
+
+void ResolverPool::ClearCache() {
+  CritScope cs(&crit_);
+  cache_.clear();
+}
+
+ResolverPool::Stats ResolverPool::GetStats() {
+  CritScope cs(&crit_);
+  return stats_;
+}
+
+void ResolverPool::Cancel(PooledResolver* resolver) {
+  CritScope cs(&crit_);
+  LookupKey key(resolver->addr_.hostname(), resolver->addr_.family());
+  PendingMap::iterator it = pending_.find(key);
+  if (it == pending_.end())
+    return;
+  std::vector<PooledResolver*>& waiters = it->second;
+  for (size_t i = 0; i < waiters.size(); ++i) {
+    if (waiters[i] == resolver) {
+      waiters.erase(waiters.begin() + i);
+      break;
+    }
+  }
+  // The lookup itself still runs, and its result is cached.
+}
+
+void ResolverPool::OnMessage(Message* msg) {
+  ASSERT(msg->message_id == MSG_LOOKUP);
+  DoLookups();
+}
+
+void ResolverPool::DoLookups() {
+  CritScope cs(&crit_);
+  while (!queue_.empty()) {
+    LookupKey key = queue_.front();
+    queue_.pop_front();
+    ++stats_.lookups;
+
+    // Let go of the lock while the lookup blocks.
+    std::vector<IPAddress> addresses;
+    crit_.Leave();
+    int error = resolver_->Resolve(key.first, key.second, &addresses);
+    crit_.Enter();
+
+    if (error == 0) {
+      CacheEntry& entry = cache_[key];
+      entry.addresses = addresses;
+      entry.expires = TimeAfter(cache_ttl_);
+    } else {
+      LOG(LS_WARNING) << "Error " << error << " resolving " << key.first;
+    }
+
+    // Hand out the result while holding the lock, so none of the waiters can
+    // be destroyed in the meantime.
+    PendingMap::iterator it = pending_.find(key);
+    if (it != pending_.end()) {
+      for (size_t i = 0; i < it->second.size(); ++i)
+        it->second[i]->Complete(error, addresses);
+      pending_.erase(it);
+    }
+  }
+  idle_workers_.push_back(Thread::Current());
+}
+
+}  // namespace talk_base
@@ -0,0 +1,174 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_BASE_RESOLVERPOOL_H_
+#define TALK_BASE_RESOLVERPOOL_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/messagehandler.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/sigslot.h"
+#include "talk/base/socketaddress.h"
+
+namespace talk_base {
+
+class ResolverPool;
+class Thread;
+
+// Looks up host names for a ResolverPool.  Resolve() runs on the pool's
+// worker threads and may block.  Tests can plug in an in-memory one.
+class HostResolver {
+ public:
+  virtual ~HostResolver() {}
+
+  // Returns 0 and fills in |addresses|, or returns an error as
+  // ResolveHostname does.
+  virtual int Resolve(const std::string& hostname, int family,
+                      std::vector<IPAddress>* addresses) = 0;
+};
+
+// One lookup started with ResolverPool::Resolve().  SignalDone fires on the
+// thread that started it, after which the results can be read.  Whoever
+// started the lookup must call Destroy() when done with it, which is also how
+// to cancel it before it completes.
+class PooledResolver : public MessageHandler {
+ public:
+  // The address asked for, with the IP filled in if the lookup succeeded.
+  const SocketAddress& address() const { return addr_; }
+  const std::vector<IPAddress>& addresses() const { return addresses_; }
+  int error() const { return error_; }
+
+  // Deletes this.  SignalDone won't fire after this returns.  May be called
+  // from SignalDone.
+  void Destroy();
+
+  sigslot::signal1<PooledResolver*> SignalDone;
+
+  virtual void OnMessage(Message* msg);
+
+ private:
+  PooledResolver(ResolverPool* pool, const SocketAddress& addr);
+  virtual ~PooledResolver();
+
+  // Takes the results and has SignalDone fire on |thread_|.
+  void Complete(int error, const std::vector<IPAddress>& addresses);
+
+  ResolverPool* pool_;
+  Thread* thread_;
+  SocketAddress addr_;
+  std::vector<IPAddress> addresses_;
+  int error_;
+  bool signaling_;  // In SignalDone.
+  bool destroyed_;  // Destroy() was called from SignalDone.
+
+  friend class ResolverPool;
+  DISALLOW_EVIL_CONSTRUCTORS(PooledResolver);
+};
+
+// Resolves host names on a bounded number of worker threads, instead of a new
+// thread per lookup as AsyncResolver does.  Lookups of a name that is already
+// being looked up wait for that lookup rather than starting their own, and
+// successful results are cached for cache_ttl() ms.  Resolve() and Destroy()
+// may be called from any thread with a message queue.
+class ResolverPool : public MessageHandler {
+ public:
+  // Counters for a pool's lookups.
+  struct Stats {
+    Stats() : requests(0), cache_hits(0), coalesced(0), lookups(0),
+              workers(0) {}
+    uint64 requests;    // Total Resolve() calls.
+    uint64 cache_hits;  // Answered from the cache.
+    uint64 coalesced;   // Joined a lookup that was already under way.
+    uint64 lookups;     // Passed to the HostResolver.
+    size_t workers;     // Worker threads started.
+  };
+
+  static const size_t kDefaultMaxWorkers = 4;
+  static const int kDefaultCacheTtl = 60 * 1000;  // ms
+
+  // Takes ownership of |resolver|.  If it is NULL, the system resolver is
+  // used.
+  ResolverPool(HostResolver* resolver, size_t max_workers);
+  // Stops the workers, waiting for any lookups they are in the middle of.
+  // Lookups that haven't completed never will.
+  virtual ~ResolverPool();
+
+  // The pool shared by the whole process, using the system resolver.
+  static ResolverPool* Default();
+
+  // Starts looking up |addr|'s host name.  The caller owns the result and
+  // must Destroy() it.
+  PooledResolver* Resolve(const SocketAddress& addr);
+
+  int cache_ttl() const { return cache_ttl_; }
+  void set_cache_ttl(int ttl) { cache_ttl_ = ttl; }
+  // Forgets all cached results.
+  void ClearCache();
+
+  Stats GetStats();
+
+  virtual void OnMessage(Message* msg);
+
+ private:
+  typedef std::pair<std::string, int> LookupKey;  // Host name and family.
+  struct CacheEntry {
+    std::vector<IPAddress> addresses;
+    uint32 expires;
+  };
+  typedef std::map<LookupKey, CacheEntry> Cache;
+  typedef std::map<LookupKey, std::vector<PooledResolver*> > PendingMap;
+
+  void Cancel(PooledResolver* resolver);
+  // Runs lookups from queue_ on a worker thread until it is empty.
+  void DoLookups();
+
+  scoped_ptr<HostResolver> resolver_;
+  size_t max_workers_;
+  int cache_ttl_;
+  CriticalSection crit_;
+  Cache cache_;
+  PendingMap pending_;
+  std::deque<LookupKey> queue_;  // Lookups waiting for a worker.
+  std::vector<Thread*> workers_;
+  std::vector<Thread*> idle_workers_;
+  Stats stats_;
+
+  friend class PooledResolver;
+  DISALLOW_EVIL_CONSTRUCTORS(ResolverPool);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_RESOLVERPOOL_H_
@@ -0,0 +1,221 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "talk/base/criticalsection.h"
+#include "talk/base/event.h"
+#include "talk/base/gunit.h"
+#include "talk/base/resolverpool.h"
+#include "talk/base/thread.h"
+
+using namespace talk_base;
+
+// Answers from an in-memory table, optionally holding every lookup until
+// Release() is called.
+class FakeHostResolver : public HostResolver {
+ public:
+  explicit FakeHostResolver(bool hold)
+      : released_(true, !hold), lookups_(0) {}
+
+  void AddHost(const std::string& hostname, const IPAddress& ip) {
+    CritScope cs(&crit_);
+    hosts_[hostname] = ip;
+  }
+  void Release() { released_.Set(); }
+  int lookups() {
+    CritScope cs(&crit_);
+    return lookups_;
+  }
+
+  virtual int Resolve(const std::string& hostname, int family,
+                      std::vector<IPAddress>* addresses) {
+    released_.Wait(kForever);
+    CritScope cs(&crit_);
+    ++lookups_;
+    addresses->clear();
+    std::map<std::string, IPAddress>::iterator it = hosts_.find(hostname);
+    if (it == hosts_.end())
+      return -1;
+    addresses->push_back(it->second);
+    return 0;
+  }
+
+ private:
+  CriticalSection crit_;
+  Event released_;
+  std::map<std::string, IPAddress> hosts_;
+  int lookups_;
+};
+
+class ResolverPoolTest : public testing::Test, public sigslot::has_slots<> {
+ public:
+  ResolverPoolTest() : done_(0) {}
+
+  void CreatePool(bool hold, size_t max_workers) {
+    fake_ = new FakeHostResolver(hold);
+    fake_->AddHost("stun.example.com", IPAddress(0x01020304));
+    fake_->AddHost("turn.example.com", IPAddress(0x05060708));
+    pool_.reset(new ResolverPool(fake_, max_workers));
+  }
+
+  PooledResolver* Resolve(const std::string& hostname) {
+    PooledResolver* resolver = pool_->Resolve(SocketAddress(hostname, 3478));
+    resolver->SignalDone.connect(this, &ResolverPoolTest::OnDone);
+    resolvers_.push_back(resolver);
+    return resolver;
+  }
+
+  void OnDone(PooledResolver* resolver) {
+    EXPECT_TRUE(Thread::Current()->IsCurrent());
+    ++done_;
+  }
+
+  // Starts a lookup that destroys itself when done.
+  void ResolveAndDestroy(const std::string& hostname) {
+    PooledResolver* resolver = pool_->Resolve(SocketAddress(hostname, 3478));
+    resolver->SignalDone.connect(this, &ResolverPoolTest::OnDoneDestroy);
+  }
+
+  void OnDoneDestroy(PooledResolver* resolver) {
+    ++done_;
+    resolver->Destroy();
+  }
+
+  virtual void TearDown() {
+    for (size_t i = 0; i < resolvers_.size(); ++i)
+      resolvers_[i]->Destroy();
+    pool_.reset();
+  }
+
+ protected:
+  FakeHostResolver* fake_;
+  scoped_ptr<ResolverPool> pool_;
+  std::vector<PooledResolver*> resolvers_;
+  int done_;
+};
+
+// Test that a lookup finishes on the calling thread with the address filled
+// in.
+TEST_F(ResolverPoolTest, TestResolve) {
+  CreatePool(false, 1);
+  PooledResolver* resolver = Resolve("stun.example.com");
+  EXPECT_EQ_WAIT(1, done_, 1000);
+  EXPECT_EQ(0, resolver->error());
+  ASSERT_EQ(1U, resolver->addresses().size());
+  EXPECT_EQ(IPAddress(0x01020304), resolver->address().ipaddr());
+  EXPECT_EQ(3478, resolver->address().port());
+}
+
+// Test that a failed lookup reports its error and isn't cached.
+TEST_F(ResolverPoolTest, TestResolveError) {
+  CreatePool(false, 1);
+  PooledResolver* resolver = Resolve("nowhere.example.com");
+  EXPECT_EQ_WAIT(1, done_, 1000);
+  EXPECT_NE(0, resolver->error());
+  EXPECT_TRUE(resolver->addresses().empty());
+  Resolve("nowhere.example.com");
+  EXPECT_EQ_WAIT(2, done_, 1000);
+  EXPECT_EQ(2, fake_->lookups());
+}
+
+// Test that lookups of a name that was just looked up come from the cache,
+// until the cached result expires.
+TEST_F(ResolverPoolTest, TestCache) {
+  CreatePool(false, 1);
+  Resolve("stun.example.com");
+  EXPECT_EQ_WAIT(1, done_, 1000);
+  PooledResolver* resolver = Resolve("stun.example.com");
+  EXPECT_EQ_WAIT(2, done_, 1000);
+  EXPECT_EQ(IPAddress(0x01020304), resolver->address().ipaddr());
+  EXPECT_EQ(1, fake_->lookups());
+  EXPECT_EQ(1U, pool_->GetStats().cache_hits);
+
+  pool_->set_cache_ttl(0);
+  pool_->ClearCache();
+  Resolve("stun.example.com");
+  EXPECT_EQ_WAIT(3, done_, 1000);
+  Resolve("stun.example.com");
+  EXPECT_EQ_WAIT(4, done_, 1000);
+  EXPECT_EQ(3, fake_->lookups());
+}
+
+// Test that lookups of a name that is already being looked up share that
+// lookup.
+TEST_F(ResolverPoolTest, TestCoalesce) {
+  CreatePool(true, 4);
+  Resolve("stun.example.com");
+  Resolve("stun.example.com");
+  Resolve("stun.example.com");
+  fake_->Release();
+  EXPECT_EQ_WAIT(3, done_, 1000);
+  EXPECT_EQ(1, fake_->lookups());
+  ResolverPool::Stats stats = pool_->GetStats();
+  EXPECT_EQ(3U, stats.requests);
+  EXPECT_EQ(2U, stats.coalesced);
+  EXPECT_EQ(1U, stats.lookups);
+  EXPECT_EQ(1U, stats.workers);
+}
+
+// Test that no more than the maximum number of workers are started.
+TEST_F(ResolverPoolTest, TestMaxWorkers) {
+  CreatePool(true, 2);
+  Resolve("a.example.com");
+  Resolve("b.example.com");
+  Resolve("c.example.com");
+  Resolve("stun.example.com");
+  Resolve("turn.example.com");
+  EXPECT_EQ(2U, pool_->GetStats().workers);
+  fake_->Release();
+  EXPECT_EQ_WAIT(5, done_, 1000);
+  EXPECT_EQ(5, fake_->lookups());
+  EXPECT_EQ(2U, pool_->GetStats().workers);
+  EXPECT_EQ(IPAddress(0x05060708), resolvers_[4]->address().ipaddr());
+}
+
+// Test that a destroyed lookup doesn't signal, and the others still do.
+TEST_F(ResolverPoolTest, TestDestroyBeforeDone) {
+  CreatePool(true, 1);
+  PooledResolver* resolver = Resolve("stun.example.com");
+  Resolve("stun.example.com");
+  resolvers_.erase(resolvers_.begin());
+  resolver->Destroy();
+  fake_->Release();
+  EXPECT_EQ_WAIT(1, done_, 1000);
+  Thread::Current()->ProcessMessages(100);
+  EXPECT_EQ(1, done_);
+}
+
+// Test that a lookup can be destroyed from its own SignalDone.
+TEST_F(ResolverPoolTest, TestDestroyFromSignal) {
+  CreatePool(false, 1);
+  ResolveAndDestroy("stun.example.com");
+  EXPECT_EQ_WAIT(1, done_, 1000);
+}
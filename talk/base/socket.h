@@ -140,6 +140,22 @@ inline bool IsBlockingError(int e) {
   return (e == EWOULDBLOCK) || (e == EAGAIN) || (e == EINPROGRESS);
 }
 
+// One datagram for Socket::RecvFromBatch() and Socket::SendToBatch(). When
+// receiving, |data| and |size| describe the buffer to fill in; on return
+// |size| is the length of the datagram and |addr| is where it came from. When
+// sending, |addr| is the destination and |data| is not modified.
+// RecvFromBatch() drops received datagrams too large for their buffer, and
+// may reorder the buffers of the array to do so.
+struct Datagram {
+  Datagram() : data(NULL), size(0) {}
+  Datagram(char* data, size_t size, const SocketAddress& addr)
+      : data(data), size(size), addr(addr) {}
+
+  char* data;
+  size_t size;
+  SocketAddress addr;
+};
+
 // General interface for the socket implementations of various networks.  The
 // methods match those of normal UNIX sockets very closely.
 class Socket {
@@ -160,6 +176,42 @@ class Socket {
   virtual int SendTo(const void *pv, size_t cb, const SocketAddress& addr) = 0;
   virtual int Recv(void *pv, size_t cb) = 0;
   virtual int RecvFrom(void *pv, size_t cb, SocketAddress *paddr) = 0;
+
+  // Datagram sockets may receive or send several packets with one call.
+  // Both return the number of datagrams transferred, or SOCKET_ERROR if the
+  // first one failed. The default implementations just loop over
+  // RecvFrom() and SendTo(); sockets that can do better override them.
+  // RecvFrom() can't tell whether it truncated a datagram, so the default
+  // RecvFromBatch() drops any datagram that fills its buffer exactly; make
+  // the buffers a byte larger than the largest datagram to be kept.
+  virtual int RecvFromBatch(Datagram* datagrams, size_t count) {
+    size_t i = 0;
+    bool dropped = false;
+    while (i < count) {
+      int received = RecvFrom(datagrams[i].data, datagrams[i].size,
+                              &datagrams[i].addr);
+      if (received < 0)
+        break;
+      if (static_cast<size_t>(received) >= datagrams[i].size) {
+        dropped = true;  // Maybe truncated; read the next one in its place.
+        continue;
+      }
+      datagrams[i].size = received;
+      ++i;
+    }
+    if (i == 0 && count != 0 && !dropped)
+      return SOCKET_ERROR;
+    return static_cast<int>(i);
+  }
+  virtual int SendToBatch(const Datagram* datagrams, size_t count) {
+    size_t i = 0;
+    for (; i < count; ++i) {
+      if (SendTo(datagrams[i].data, datagrams[i].size, datagrams[i].addr) < 0)
+        break;
+    }
+    return (i == 0 && count != 0) ? SOCKET_ERROR : static_cast<int>(i);
+  }
+
   virtual int Listen(int backlog) = 0;
   virtual Socket *Accept(SocketAddress *paddr) = 0;
   virtual int Close() = 0;
@@ -184,7 +236,8 @@ class Socket {
     OPT_RCVBUF,      // receive buffer size
     OPT_SNDBUF,      // send buffer size
     OPT_NODELAY,     // whether Nagle algorithm is enabled
-    OPT_IPV6_V6ONLY  // Whether the socket is IPv6 only.
+    OPT_IPV6_V6ONLY, // Whether the socket is IPv6 only.
+    OPT_REUSEPORT    // Whether other sockets may bind the same address.
   };
   virtual int GetOption(Option opt, int* value) = 0;
   virtual int SetOption(Option opt, int value) = 0;
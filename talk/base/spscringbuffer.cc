@@ -0,0 +1,127 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/spscringbuffer.h"
+
+#include <string.h>
+
+#include "talk/base/common.h"
+#include "talk/base/criticalsection.h"
+
+namespace talk_base {
+
+SpscRingBuffer::SpscRingBuffer(size_t capacity)
+    : capacity_(capacity),
+      length_(static_cast<int>(capacity + 1)),
+      buffer_(new char[capacity + 1]),
+      read_position_(0),
+      write_position_(0) {
+}
+
+SpscRingBuffer::~SpscRingBuffer() {
+}
+
+size_t SpscRingBuffer::Write(const void* data, size_t len) {
+  const char* src = static_cast<const char*>(data);
+  size_t written = 0;
+  while (written < len) {
+    size_t available = 0;
+    char* dst = static_cast<char*>(GetWriteBuffer(&available));
+    if (available == 0) {
+      break;
+    }
+    size_t copy = _min(available, len - written);
+    memcpy(dst, src + written, copy);
+    ConsumeWriteBuffer(copy);
+    written += copy;
+  }
+  return written;
+}
+
+void* SpscRingBuffer::GetWriteBuffer(size_t* len) {
+  int read = AtomicOps::AcquireLoad(&read_position_);
+  int write = write_position_;
+  if (write >= read) {
+    // Free up to the end, except that the last byte stays empty when the
+    // reader is at the start.
+    *len = length_ - write - ((read == 0) ? 1 : 0);
+  } else {
+    *len = read - write - 1;
+  }
+  return &buffer_[write];
+}
+
+void SpscRingBuffer::ConsumeWriteBuffer(size_t used) {
+  ASSERT(used <= GetWriteRemaining());
+  int write = (write_position_ + static_cast<int>(used)) % length_;
+  // Publish the data before the new position.
+  AtomicOps::ReleaseStore(&write_position_, write);
+}
+
+size_t SpscRingBuffer::GetWriteRemaining() const {
+  return capacity_ - GetBuffered();
+}
+
+size_t SpscRingBuffer::Read(void* buffer, size_t len) {
+  char* dst = static_cast<char*>(buffer);
+  size_t read = 0;
+  while (read < len) {
+    size_t available = 0;
+    const char* src = static_cast<const char*>(GetReadData(&available));
+    if (available == 0) {
+      break;
+    }
+    size_t copy = _min(available, len - read);
+    memcpy(dst + read, src, copy);
+    ConsumeReadData(copy);
+    read += copy;
+  }
+  return read;
+}
+
+const void* SpscRingBuffer::GetReadData(size_t* len) {
+  int write = AtomicOps::AcquireLoad(&write_position_);
+  int read = read_position_;
+  *len = (write >= read) ? (write - read) : (length_ - read);
+  return &buffer_[read];
+}
+
+void SpscRingBuffer::ConsumeReadData(size_t used) {
+  ASSERT(used <= GetBuffered());
+  int read = (read_position_ + static_cast<int>(used)) % length_;
+  // Finish reading the data before handing its space back.
+  AtomicOps::ReleaseStore(&read_position_, read);
+}
+
+size_t SpscRingBuffer::GetBuffered() const {
+  int read = AtomicOps::AcquireLoad(&read_position_);
+  int write = AtomicOps::AcquireLoad(&write_position_);
+  return (write - read + length_) % length_;
+}
+
+}  // namespace talk_base
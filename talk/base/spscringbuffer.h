@@ -0,0 +1,91 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_BASE_SPSCRINGBUFFER_H_
+#define TALK_BASE_SPSCRINGBUFFER_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/scoped_ptr.h"
+
+namespace talk_base {
+
+// A fixed-size byte ring buffer that hands a stream of data from one thread
+// to another without locking. One thread may call the producer methods
+// (Write, GetWriteBuffer, ConsumeWriteBuffer, GetWriteRemaining) while another
+// calls the consumer methods (Read, GetReadData, ConsumeReadData,
+// GetBuffered). Callers that produce or consume on more than one thread have
+// to serialize those calls themselves.
+class SpscRingBuffer {
+ public:
+  explicit SpscRingBuffer(size_t capacity);
+  ~SpscRingBuffer();
+
+  size_t capacity() const { return capacity_; }
+
+  // Producer methods.
+
+  // Copies up to |len| bytes from |data| into the buffer. Returns the number
+  // of bytes copied, which is 0 if the buffer is full.
+  size_t Write(const void* data, size_t len);
+  // Returns the free space at the write position and sets |len| to its size,
+  // which is less than GetWriteRemaining() if the free space wraps. Data put
+  // there becomes readable once ConsumeWriteBuffer() is called.
+  void* GetWriteBuffer(size_t* len);
+  void ConsumeWriteBuffer(size_t used);
+  size_t GetWriteRemaining() const;
+
+  // Consumer methods.
+
+  // Copies up to |len| bytes out of the buffer into |buffer|. Returns the
+  // number of bytes copied, which is 0 if the buffer is empty.
+  size_t Read(void* buffer, size_t len);
+  // Returns the data at the read position and sets |len| to its size, which
+  // is less than GetBuffered() if the data wraps. The data stays in the
+  // buffer until ConsumeReadData() is called.
+  const void* GetReadData(size_t* len);
+  void ConsumeReadData(size_t used);
+  size_t GetBuffered() const;
+
+ private:
+  // One byte of |buffer_| is never used, so that a full buffer can be told
+  // apart from an empty one.
+  const size_t capacity_;
+  const int length_;
+  scoped_array<char> buffer_;
+  // Only the consumer moves |read_position_| and only the producer moves
+  // |write_position_|.
+  volatile int read_position_;
+  volatile int write_position_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpscRingBuffer);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_SPSCRINGBUFFER_H_
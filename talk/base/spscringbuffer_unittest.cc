@@ -0,0 +1,164 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+
+#include "talk/base/gunit.h"
+#include "talk/base/spscringbuffer.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+
+TEST(SpscRingBufferTest, ReadWrite) {
+  const char in[] = "0123456789ABCDEF";
+  char out[16];
+  SpscRingBuffer buf(10);
+  EXPECT_EQ(10U, buf.capacity());
+  EXPECT_EQ(0U, buf.GetBuffered());
+  EXPECT_EQ(10U, buf.GetWriteRemaining());
+  EXPECT_EQ(0U, buf.Read(out, sizeof(out)));
+
+  // Only as much as fits goes in.
+  EXPECT_EQ(10U, buf.Write(in, 16));
+  EXPECT_EQ(10U, buf.GetBuffered());
+  EXPECT_EQ(0U, buf.GetWriteRemaining());
+  EXPECT_EQ(0U, buf.Write(in, 1));
+
+  EXPECT_EQ(6U, buf.Read(out, 6));
+  EXPECT_EQ(0, memcmp(out, in, 6));
+
+  // This write wraps around the end of the buffer.
+  EXPECT_EQ(6U, buf.Write(in + 10, 6));
+  EXPECT_EQ(10U, buf.GetBuffered());
+  EXPECT_EQ(10U, buf.Read(out, sizeof(out)));
+  EXPECT_EQ(0, memcmp(out, in + 6, 10));
+  EXPECT_EQ(0U, buf.GetBuffered());
+}
+
+TEST(SpscRingBufferTest, GetReadDataAndWriteBuffer) {
+  SpscRingBuffer buf(10);
+  size_t len = 0;
+
+  // The whole buffer is free and contiguous at first.
+  char* p = static_cast<char*>(buf.GetWriteBuffer(&len));
+  EXPECT_EQ(10U, len);
+  memcpy(p, "abcdefgh", 8);
+  buf.ConsumeWriteBuffer(8);
+  EXPECT_EQ(8U, buf.GetBuffered());
+
+  const char* q = static_cast<const char*>(buf.GetReadData(&len));
+  EXPECT_EQ(8U, len);
+  EXPECT_EQ(0, memcmp(q, "abcdefgh", 8));
+  buf.ConsumeReadData(5);
+
+  // The free space now wraps, so only the part up to the end is returned.
+  p = static_cast<char*>(buf.GetWriteBuffer(&len));
+  EXPECT_EQ(3U, len);
+  memcpy(p, "ijk", 3);
+  buf.ConsumeWriteBuffer(3);
+  p = static_cast<char*>(buf.GetWriteBuffer(&len));
+  EXPECT_EQ(4U, len);
+  memcpy(p, "lm", 2);
+  buf.ConsumeWriteBuffer(2);
+  EXPECT_EQ(8U, buf.GetBuffered());
+
+  // Likewise for the data.
+  q = static_cast<const char*>(buf.GetReadData(&len));
+  EXPECT_EQ(6U, len);
+  EXPECT_EQ(0, memcmp(q, "fghijk", 6));
+  buf.ConsumeReadData(6);
+  q = static_cast<const char*>(buf.GetReadData(&len));
+  EXPECT_EQ(2U, len);
+  EXPECT_EQ(0, memcmp(q, "lm", 2));
+}
+
+// Writes |total| bytes of a counting pattern into |buf|, waiting while it's
+// full.
+class RingWriter : public Runnable {
+ public:
+  RingWriter(SpscRingBuffer* buf, size_t total) : buf_(buf), total_(total) {}
+  virtual void Run(Thread* thread) {
+    char block[1000];
+    size_t written = 0;
+    while (written < total_) {
+      size_t len = _min(sizeof(block), total_ - written);
+      for (size_t i = 0; i < len; ++i) {
+        block[i] = static_cast<char>(written + i);
+      }
+      size_t sent = 0;
+      while (sent < len) {
+        size_t copied = buf_->Write(block + sent, len - sent);
+        if (copied == 0) {
+          Thread::SleepMs(1);
+        }
+        sent += copied;
+      }
+      written += len;
+    }
+  }
+
+ private:
+  SpscRingBuffer* buf_;
+  size_t total_;
+};
+
+// Reads the writer's data on this thread while it writes on another, and
+// checks that every byte arrives intact and in order.
+TEST(SpscRingBufferTest, WriteFromAnotherThread) {
+  const size_t kTotal = 8 * 1024 * 1024;
+  SpscRingBuffer buf(64 * 1024);
+  RingWriter writer(&buf, kTotal);
+  Thread thread;
+
+  uint32 start = Time();
+  thread.Start(&writer);
+  char block[3000];
+  size_t received = 0;
+  size_t errors = 0;
+  while (received < kTotal && TimeSince(start) < 10000) {
+    size_t len = buf.Read(block, sizeof(block));
+    if (len == 0) {
+      Thread::SleepMs(1);
+    }
+    for (size_t i = 0; i < len; ++i) {
+      if (block[i] != static_cast<char>(received + i)) {
+        ++errors;
+      }
+    }
+    received += len;
+  }
+  uint32 elapsed = TimeSince(start);
+  thread.Stop();
+  EXPECT_EQ(kTotal, received);
+  EXPECT_EQ(0U, errors);
+  LOG(LS_INFO) << "Handed off " << received << " bytes in " << elapsed
+               << " ms";
+}
+
+}  // namespace talk_base
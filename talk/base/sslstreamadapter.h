@@ -169,6 +169,23 @@ class SSLStreamAdapter : public StreamAdapterInterface {
     return false;
   }
 
+  // DTLS packet interface
+  // Once a DTLS stream is open, received packets can be handed straight to
+  // ReadDtlsPacket instead of being read from the wrapped stream.
+  // ReadDtlsPacket decrypts the application data of the first record in
+  // |packet| into |data| and returns SR_SUCCESS, or returns SR_BLOCK if there
+  // is none. A packet may hold more than one record; call again with a NULL
+  // |packet| until SR_BLOCK to read the rest. Other results are as for Read.
+  virtual bool HasDtlsPacketInput() const {
+    return false;  // Default is unsupported
+  }
+
+  virtual StreamResult ReadDtlsPacket(const char* packet, size_t packet_len,
+                                      void* data, size_t data_len,
+                                      size_t* read, int* error) {
+    return SR_ERROR;
+  }
+
   // Capabilities testing
   static bool HaveDtls();
   static bool HaveDtlsSrtp();
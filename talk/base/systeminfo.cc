@@ -43,6 +43,9 @@
 #include <sys/sysctl.h>  // NOLINT - lint thinks this is duplicate include
 #elif defined(LINUX) || defined(ANDROID)
 #include <unistd.h>
+#if defined(__ARM_FEATURE_CRC32)
+#include <sys/auxv.h>
+#endif
 #include "talk/base/linux.h"
 #endif
 
@@ -256,6 +259,40 @@ int SystemInfo::GetCurCpus() {
   return cur_cpus;
 }
 
+bool SystemInfo::HasCpuFeature(CpuFeature feature) {
+  switch (feature) {
+    case SI_FEATURE_PCLMULQDQ: {
+#if defined(CPU_X86)
+      int cpu_info[4];
+      __cpuid(cpu_info, 0);
+      if (cpu_info[0] < 1) {
+        return false;
+      }
+      __cpuid(cpu_info, 1);
+      return (cpu_info[2] & (1 << 1)) != 0;  // ECX bit 1
+#else
+      return false;
+#endif
+    }
+    case SI_FEATURE_ARM_CRC32: {
+      // Only reported when the compiler could have emitted the instructions,
+      // as there is no other use for knowing.
+#if defined(__ARM_FEATURE_CRC32) && (defined(LINUX) || defined(ANDROID))
+#if defined(__aarch64__)
+      return (getauxval(AT_HWCAP) & (1 << 7)) != 0;   // HWCAP_CRC32
+#else
+      return (getauxval(AT_HWCAP2) & (1 << 4)) != 0;  // HWCAP2_CRC32
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+      return true;
+#else
+      return false;
+#endif
+    }
+  }
+  return false;
+}
+
 // Return the type of this CPU.
 SystemInfo::Architecture SystemInfo::GetCpuArchitecture() {
   return cpu_arch_;
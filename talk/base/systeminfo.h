@@ -42,8 +42,18 @@ class SystemInfo {
     SI_ARCH_ARM = 2
   };
 
+  // Instruction set extensions that callers may pick faster code paths for.
+  enum CpuFeature {
+    SI_FEATURE_PCLMULQDQ = 0,  // x86 carry-less multiplication
+    SI_FEATURE_ARM_CRC32 = 1   // ARMv8 CRC32 instructions
+  };
+
   SystemInfo();
 
+  // Whether the CPU this process runs on supports |feature|. Unlike the
+  // queries below, this doesn't read any system files, so it's cheap.
+  static bool HasCpuFeature(CpuFeature feature);
+
   // The number of CPU Cores in the system.
   int GetMaxPhysicalCpus();
   // The number of CPU Threads in the system.
@@ -0,0 +1,239 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/timerwheel.h"
+
+#include <algorithm>
+
+#include "talk/base/common.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+
+TimerWheel::TimerWheel(uint32 now)
+    : now_(now), has_next_(false), next_(0), size_(0), overdue_(NULL) {
+  memset(first_level_, 0, sizeof(first_level_));
+  memset(levels_, 0, sizeof(levels_));
+}
+
+TimerWheel::~TimerWheel() {
+  for (HandlerMap::iterator it = handlers_.begin(); it != handlers_.end();
+       ++it) {
+    Timer* timer = it->second;
+    while (timer) {
+      Timer* next = timer->handler_next;
+      delete timer;
+      timer = next;
+    }
+  }
+}
+
+void TimerWheel::Insert(uint32 trigger, uint32 num, const Message& msg) {
+  Timer* timer = new Timer;
+  timer->trigger = trigger;
+  timer->num = num;
+  timer->msg = msg;
+  Place(timer);
+
+  Timer*& first = handlers_[msg.phandler];
+  timer->handler_prev = NULL;
+  timer->handler_next = first;
+  if (first)
+    first->handler_prev = timer;
+  first = timer;
+
+  ++size_;
+  if (has_next_ && TimeIsLater(trigger, next_))
+    next_ = trigger;
+}
+
+void TimerWheel::PopExpired(uint32 now, MessageList* expired) {
+  has_next_ = false;
+
+  for (Timer* timer = overdue_; timer; timer = timer->next) {
+    expired_.push_back(timer);
+  }
+  overdue_ = NULL;
+  size_t remaining = size_ - expired_.size();
+
+  while (TimeIsLaterOrEqual(now_, now)) {
+    if (remaining == 0) {
+      now_ = now + 1;
+      break;
+    }
+    if ((now_ & (kFirstLevelSlots - 1)) == 0) {
+      // Crossing into a new first level span; bring its timers down. Each
+      // level cascades only when the one below has wrapped around.
+      int shift = kFirstLevelBits;
+      for (int level = 1; level < kLevels; ++level) {
+        Cascade(level);
+        if (((now_ >> shift) & (kLevelSlots - 1)) != 0)
+          break;
+        shift += kLevelBits;
+      }
+    }
+    Timer*& slot = first_level_[now_ & (kFirstLevelSlots - 1)];
+    for (Timer* timer = slot; timer; timer = timer->next) {
+      expired_.push_back(timer);
+      --remaining;
+    }
+    slot = NULL;
+    ++now_;
+  }
+
+  // Timers in a slot aren't ordered, and overdue ones come from anywhere.
+  std::sort(expired_.begin(), expired_.end(), IsEarlier);
+  for (size_t i = 0; i < expired_.size(); ++i) {
+    Timer* timer = expired_[i];
+    expired->push_back(timer->msg);
+    UnlinkHandler(timer);
+    delete timer;
+  }
+  size_ -= expired_.size();
+  expired_.clear();
+}
+
+int TimerWheel::GetDelay(uint32 now) {
+  if (size_ == 0)
+    return kForever;
+  if (overdue_)
+    return 0;
+
+  if (!has_next_) {
+    // The first level holds the exact trigger times for the next 256 ms.
+    // Past that, wake up when the next span is cascaded down.
+    next_ = (now_ | (kFirstLevelSlots - 1)) + 1;
+    for (uint32 i = 0; i < kFirstLevelSlots; ++i) {
+      if (first_level_[(now_ + i) & (kFirstLevelSlots - 1)]) {
+        next_ = now_ + i;
+        break;
+      }
+    }
+    has_next_ = true;
+  }
+
+  int delay = TimeDiff(next_, now);
+  return (delay < 0) ? 0 : delay;
+}
+
+void TimerWheel::Clear(MessageHandler* phandler, uint32 id,
+                       MessageList* removed) {
+  HandlerMap::iterator it, end;
+  if (phandler) {
+    it = handlers_.find(phandler);
+    if (it == handlers_.end())
+      return;
+    end = it;
+    ++end;
+  } else {
+    it = handlers_.begin();
+    end = handlers_.end();
+  }
+
+  while (it != end) {
+    Timer* timer = it->second;
+    // UnlinkHandler() may erase this entry, so step past it first.
+    ++it;
+    while (timer) {
+      Timer* next = timer->handler_next;
+      if (timer->msg.Match(phandler, id)) {
+        removed->push_back(timer->msg);
+        Unlink(timer);
+        UnlinkHandler(timer);
+        delete timer;
+        --size_;
+      }
+      timer = next;
+    }
+  }
+}
+
+bool TimerWheel::IsEarlier(const Timer* a, const Timer* b) {
+  return TimeIsLater(a->trigger, b->trigger)
+      || (a->trigger == b->trigger && a->num < b->num);
+}
+
+void TimerWheel::Place(Timer* timer) {
+  Timer** slot;
+  uint32 delta = timer->trigger - now_;
+  if (TimeIsLater(timer->trigger, now_)) {
+    slot = &overdue_;
+  } else if (delta < static_cast<uint32>(kFirstLevelSlots)) {
+    slot = &first_level_[timer->trigger & (kFirstLevelSlots - 1)];
+  } else {
+    int level = 1;
+    int shift = kFirstLevelBits;
+    while (level < kLevels - 1 && (delta >> (shift + kLevelBits)) != 0) {
+      ++level;
+      shift += kLevelBits;
+    }
+    slot = &levels_[level - 1][(timer->trigger >> shift) & (kLevelSlots - 1)];
+  }
+
+  timer->slot = slot;
+  timer->prev = NULL;
+  timer->next = *slot;
+  if (*slot)
+    (*slot)->prev = timer;
+  *slot = timer;
+}
+
+void TimerWheel::Cascade(int level) {
+  int shift = kFirstLevelBits + (level - 1) * kLevelBits;
+  Timer*& slot = levels_[level - 1][(now_ >> shift) & (kLevelSlots - 1)];
+  Timer* timer = slot;
+  slot = NULL;
+  while (timer) {
+    Timer* next = timer->next;
+    Place(timer);
+    timer = next;
+  }
+}
+
+void TimerWheel::Unlink(Timer* timer) {
+  if (timer->prev) {
+    timer->prev->next = timer->next;
+  } else {
+    *timer->slot = timer->next;
+  }
+  if (timer->next)
+    timer->next->prev = timer->prev;
+}
+
+void TimerWheel::UnlinkHandler(Timer* timer) {
+  if (timer->handler_next)
+    timer->handler_next->handler_prev = timer->handler_prev;
+  if (timer->handler_prev) {
+    timer->handler_prev->handler_next = timer->handler_next;
+  } else if (timer->handler_next) {
+    handlers_[timer->msg.phandler] = timer->handler_next;
+  } else {
+    handlers_.erase(timer->msg.phandler);
+  }
+}
+
+}  // namespace talk_base
@@ -0,0 +1,125 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_TIMERWHEEL_H_
+#define TALK_BASE_TIMERWHEEL_H_
+
+#include <map>
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/messagequeue.h"
+
+namespace talk_base {
+
+// Hierarchical timing wheel holding a MessageQueue's delayed messages.
+// Insert() and removing a single timer are O(1), and Clear() for a handler
+// only visits that handler's timers, unlike the binary heap MessageQueue
+// uses by default. Times are in milliseconds, as returned by Time().
+//
+// The first level has one slot per millisecond for the next 256 ms; each
+// further level has 64 slots covering 64 slots of the level below. Timers
+// move down a level when the wheel's clock reaches their slot.
+//
+// Not thread safe; MessageQueue guards it with its lock.
+class TimerWheel {
+ public:
+  explicit TimerWheel(uint32 now);
+  // Frees the timers but not their MessageData.
+  ~TimerWheel();
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Adds a message that triggers at |trigger|. Messages with the same
+  // trigger time come out in increasing |num| order.
+  void Insert(uint32 trigger, uint32 num, const Message& msg);
+
+  // Appends all messages that trigger at or before |now| to |expired|, in
+  // trigger time order.
+  void PopExpired(uint32 now, MessageList* expired);
+
+  // Milliseconds from |now| until the next message may trigger, or kForever.
+  // May be early when the next timer is more than 256 ms out, in which case
+  // the caller should just check again.
+  int GetDelay(uint32 now);
+
+  // Removes the messages matching |phandler| and |id| (see Message::Match)
+  // and appends them to |removed|.
+  void Clear(MessageHandler* phandler, uint32 id, MessageList* removed);
+
+ private:
+  struct Timer {
+    uint32 trigger;
+    uint32 num;
+    Message msg;
+    // Links for the slot (or overdue list) this timer is in.
+    Timer** slot;
+    Timer* prev;
+    Timer* next;
+    // Links for the list of timers with the same handler.
+    Timer* handler_prev;
+    Timer* handler_next;
+  };
+  typedef std::map<MessageHandler*, Timer*> HandlerMap;
+
+  static const int kLevels = 5;
+  static const int kFirstLevelBits = 8;
+  static const int kLevelBits = 6;
+  static const int kFirstLevelSlots = 1 << kFirstLevelBits;
+  static const int kLevelSlots = 1 << kLevelBits;
+
+  static bool IsEarlier(const Timer* a, const Timer* b);
+
+  // Puts |timer| in the slot matching its trigger time relative to now_.
+  void Place(Timer* timer);
+  // Moves the timers in |level|'s slot for now_ down to lower levels.
+  void Cascade(int level);
+  void Unlink(Timer* timer);
+  void UnlinkHandler(Timer* timer);
+
+  // Every time before now_ has been processed.
+  uint32 now_;
+  // Cached result for GetDelay(), valid if has_next_.
+  bool has_next_;
+  uint32 next_;
+  size_t size_;
+  // Timers inserted with a trigger time before now_.
+  Timer* overdue_;
+  Timer* first_level_[kFirstLevelSlots];
+  Timer* levels_[kLevels - 1][kLevelSlots];
+  HandlerMap handlers_;
+  // Scratch space for PopExpired().
+  std::vector<Timer*> expired_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerWheel);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_TIMERWHEEL_H_
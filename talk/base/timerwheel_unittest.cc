@@ -0,0 +1,134 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/gunit.h"
+#include "talk/base/timerwheel.h"
+
+namespace talk_base {
+
+class TestHandler : public MessageHandler {
+ public:
+  virtual void OnMessage(Message* msg) {}
+};
+
+static Message MakeMessage(MessageHandler* handler, uint32 id) {
+  Message msg;
+  msg.phandler = handler;
+  msg.message_id = id;
+  return msg;
+}
+
+// Pops everything expired at |now| and returns their ids in order.
+static std::vector<uint32> PopIds(TimerWheel* wheel, uint32 now) {
+  MessageList expired;
+  wheel->PopExpired(now, &expired);
+  std::vector<uint32> ids;
+  for (MessageList::iterator it = expired.begin(); it != expired.end(); ++it) {
+    ids.push_back(it->message_id);
+  }
+  return ids;
+}
+
+TEST(TimerWheelTest, EmptyWheel) {
+  TimerWheel wheel(1000);
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_EQ(kForever, wheel.GetDelay(1000));
+  EXPECT_TRUE(PopIds(&wheel, 5000).empty());
+}
+
+TEST(TimerWheelTest, TriggersInTimeThenInsertionOrder) {
+  TimerWheel wheel(1000);
+  wheel.Insert(1010, 0, MakeMessage(NULL, 3));
+  wheel.Insert(1005, 1, MakeMessage(NULL, 1));
+  wheel.Insert(995, 2, MakeMessage(NULL, 0));  // Already overdue.
+  wheel.Insert(1005, 3, MakeMessage(NULL, 2));
+  EXPECT_EQ(4u, wheel.size());
+  EXPECT_EQ(0, wheel.GetDelay(1000));
+
+  std::vector<uint32> ids = PopIds(&wheel, 1004);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ(0u, ids[0]);
+  EXPECT_EQ(1, wheel.GetDelay(1004));
+
+  ids = PopIds(&wheel, 1010);
+  ASSERT_EQ(3u, ids.size());
+  EXPECT_EQ(1u, ids[0]);
+  EXPECT_EQ(2u, ids[1]);
+  EXPECT_EQ(3u, ids[2]);
+  EXPECT_TRUE(wheel.empty());
+}
+
+// Timers far enough out to start on the upper levels must fire on time, and
+// in order with timers for the same time added later on a lower level.
+TEST(TimerWheelTest, CascadesFromUpperLevels) {
+  const uint32 kStart = 0xFFFF0000;  // Wraps around during the test.
+  TimerWheel wheel(kStart);
+  uint32 delays[] = { 300, 20000, 2000000, 70000000 };
+  for (size_t i = 0; i < ARRAY_SIZE(delays); ++i) {
+    wheel.Insert(kStart + delays[i], i, MakeMessage(NULL, i));
+  }
+  for (size_t i = 0; i < ARRAY_SIZE(delays); ++i) {
+    uint32 trigger = kStart + delays[i];
+    // Step up to the trigger time the way a busy queue would.
+    uint32 now = trigger - 1000;
+    EXPECT_TRUE(PopIds(&wheel, now).empty());
+    int delay = wheel.GetDelay(now);
+    EXPECT_GE(delay, 0);
+    EXPECT_LE(delay, 1000);
+    wheel.Insert(trigger, 100 + i, MakeMessage(NULL, 100 + i));
+    EXPECT_TRUE(PopIds(&wheel, trigger - 1).empty());
+    std::vector<uint32> ids = PopIds(&wheel, trigger);
+    ASSERT_EQ(2u, ids.size());
+    EXPECT_EQ(i, ids[0]);
+    EXPECT_EQ(100 + i, ids[1]);
+  }
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, ClearByHandlerAndId) {
+  TestHandler a, b;
+  TimerWheel wheel(0);
+  for (uint32 i = 0; i < 10; ++i) {
+    wheel.Insert(100 * i, i, MakeMessage((i % 2) ? &a : &b, i % 3));
+  }
+
+  MessageList removed;
+  wheel.Clear(&a, 1, &removed);  // 1 and 7.
+  EXPECT_EQ(2u, removed.size());
+  wheel.Clear(NULL, 2, &removed);  // 2, 5 and 8.
+  EXPECT_EQ(5u, removed.size());
+  wheel.Clear(&b, MQID_ANY, &removed);  // 0, 4 and 6.
+  EXPECT_EQ(8u, removed.size());
+  EXPECT_EQ(2u, wheel.size());
+
+  std::vector<uint32> ids = PopIds(&wheel, 1000);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ(0u, ids[0]);  // 3 % 3
+  EXPECT_EQ(0u, ids[1]);  // 9 % 3
+}
+
+}  // namespace talk_base
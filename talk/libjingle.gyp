@@ -153,6 +153,7 @@
         'base/firewallsocketserver.cc',
         'base/flags.cc',
         'base/helpers.cc',
+        'base/hmacsha1key.cc',
         'base/host.cc',
         'base/httpbase.cc',
         'base/httpclient.cc',
@@ -175,6 +176,7 @@
         'base/nssidentity.cc',
         'base/nssstreamadapter.cc',
         'base/optionsfile.cc',
+        'base/packetpool.cc',
         'base/pathutils.cc',
         'base/physicalsocketserver.cc',
         'base/proxydetect.cc',
@@ -182,6 +184,7 @@
         'base/proxyserver.cc',
         'base/ratelimiter.cc',
         'base/ratetracker.cc',
+        'base/resolverpool.cc',
         'base/sha1.cc',
         'base/sharedexclusivelock.cc',
         'base/signalthread.cc',
@@ -190,6 +193,7 @@
         'base/socketaddresspair.cc',
         'base/socketpool.cc',
         'base/socketstream.cc',
+        'base/spscringbuffer.cc',
         'base/ssladapter.cc',
         'base/sslsocketfactory.cc',
         'base/sslidentity.cc',
@@ -204,6 +208,7 @@
         'base/taskrunner.cc',
         'base/testclient.cc',
         'base/thread.cc',
+        'base/timerwheel.cc',
         'base/timeutils.cc',
         'base/timing.cc',
         'base/transformadapter.cc',
@@ -535,11 +540,13 @@
         'p2p/base/p2ptransport.cc',
         'p2p/base/p2ptransportchannel.cc',
         'p2p/base/parsing.cc',
+        'p2p/base/pingpacer.cc',
         'p2p/base/port.cc',
         'p2p/base/portallocator.cc',
         'p2p/base/portallocatorsessionproxy.cc',
         'p2p/base/portproxy.cc',
         'p2p/base/pseudotcp.cc',
+        'p2p/base/pseudotcpcongestioncontrol.cc',
         'p2p/base/relayport.cc',
         'p2p/base/relayserver.cc',
         'p2p/base/rawtransport.cc',
@@ -565,6 +572,7 @@
         'p2p/client/httpportallocator.cc',
         'p2p/client/socketmonitor.cc',
         'session/tunnel/pseudotcpchannel.cc',
+        'session/tunnel/streammultiplexer.cc',
         'session/tunnel/tunnelsessionclient.cc',
         'session/tunnel/securetunnelsessionclient.cc',
         'session/media/audiomonitor.cc',
@@ -580,6 +588,7 @@
         'session/media/rtcpmuxfilter.cc',
         'session/media/rtcpmuxfilter.cc',
         'session/media/soundclip.cc',
+        'session/media/srtpcryptopool.cc',
         'session/media/srtpfilter.cc',
         'session/media/ssrcmuxfilter.cc',
         'session/media/typingmonitor.cc',
@@ -85,7 +85,9 @@
         'base/event_unittest.cc',
         'base/filelock_unittest.cc',
         'base/fileutils_unittest.cc',
+        'base/flathashmap_unittest.cc',
         'base/helpers_unittest.cc',
+        'base/hmacsha1key_unittest.cc',
         'base/host_unittest.cc',
         'base/httpbase_unittest.cc',
         'base/httpcommon_unittest.cc',
@@ -100,6 +102,7 @@
         'base/network_unittest.cc',
         'base/nullsocketserver_unittest.cc',
         'base/optionsfile_unittest.cc',
+        'base/packetpool_unittest.cc',
         'base/pathutils_unittest.cc',
         'base/physicalsocketserver_unittest.cc',
         'base/proxy_unittest.cc',
@@ -107,6 +110,7 @@
         'base/ratelimiter_unittest.cc',
         'base/ratetracker_unittest.cc',
         'base/referencecountedsingletonfactory_unittest.cc',
+        'base/resolverpool_unittest.cc',
         'base/rollingaccumulator_unittest.cc',
         'base/sha1digest_unittest.cc',
         'base/sharedexclusivelock_unittest.cc',
@@ -114,6 +118,7 @@
         'base/sigslot_unittest.cc',
         'base/socket_unittest.cc',
         'base/socketaddress_unittest.cc',
+        'base/spscringbuffer_unittest.cc',
         'base/stream_unittest.cc',
         'base/stringencode_unittest.cc',
         'base/stringutils_unittest.cc',
@@ -122,6 +127,7 @@
         'base/task_unittest.cc',
         'base/testclient_unittest.cc',
         'base/thread_unittest.cc',
+        'base/timerwheel_unittest.cc',
         'base/timeutils_unittest.cc',
         'base/urlencode_unittest.cc',
         'base/versionparsing_unittest.cc',
@@ -267,9 +273,11 @@
         'media/base/testutils.cc',
         'p2p/base/dtlstransportchannel_unittest.cc',
         'p2p/base/p2ptransportchannel_unittest.cc',
+        'p2p/base/pingpacer_unittest.cc',
         'p2p/base/port_unittest.cc',
         'p2p/base/portallocatorsessionproxy_unittest.cc',
         'p2p/base/pseudotcp_unittest.cc',
+        'p2p/base/pseudotcpcongestioncontrol_unittest.cc',
         'p2p/base/relayport_unittest.cc',
         'p2p/base/relayserver_unittest.cc',
         'p2p/base/session_unittest.cc',
@@ -279,6 +287,7 @@
         'p2p/base/stunserver_unittest.cc',
         'p2p/base/transport_unittest.cc',
         'p2p/base/transportdescriptionfactory_unittest.cc',
+        'p2p/base/turnserver_unittest.cc',
         'p2p/client/connectivitychecker_unittest.cc',
         'p2p/client/portallocator_unittest.cc',
         'session/media/channel_unittest.cc',
@@ -289,8 +298,10 @@
         'session/media/mediasession_unittest.cc',
         'session/media/mediasessionclient_unittest.cc',
         'session/media/rtcpmuxfilter_unittest.cc',
+        'session/media/srtpcryptopool_unittest.cc',
         'session/media/srtpfilter_unittest.cc',
         'session/media/ssrcmuxfilter_unittest.cc',
+        'session/tunnel/streammultiplexer_unittest.cc',
       ],
       'conditions': [
         ['OS=="win"', {
@@ -170,6 +170,23 @@ bool GetRtcpSsrc(const void* data, size_t len, uint32* value) {
   return true;
 }
 
+bool GetCompoundRtcpSsrc(const void* data, size_t len, uint32* value) {
+  if (!data || !value) return false;
+  const uint8* packet = static_cast<const uint8*>(data);
+  size_t offset = 0;
+  while (offset + kMinRtcpPacketLen <= len) {
+    const uint8* sub_packet = packet + offset;
+    // Past the first sub-packet, stop at anything that isn't RTCP; the length
+    // fields can't be trusted any further.
+    if (offset > 0 && (sub_packet[0] >> 6) != kRtpVersion) return false;
+    if (sub_packet[kRtcpPayloadTypeOffset] != kRtcpTypeSDES) {
+      return GetRtcpSsrc(sub_packet, len - offset, value);
+    }
+    offset += (talk_base::GetBE16(sub_packet + 2) + 1) * 4;
+  }
+  return false;
+}
+
 bool SetRtpHeaderFlags(
     void* data, size_t len,
     bool padding, bool extension, int csrc_count) {
@@ -60,6 +60,9 @@ bool GetRtpSsrc(const void* data, size_t len, uint32* value);
 bool GetRtpHeaderLen(const void* data, size_t len, size_t* value);
 bool GetRtcpType(const void* data, size_t len, int* value);
 bool GetRtcpSsrc(const void* data, size_t len, uint32* value);
+// Like GetRtcpSsrc, but for a compound packet: skips over leading SDES
+// sub-packets and returns the SSRC of the first other one.
+bool GetCompoundRtcpSsrc(const void* data, size_t len, uint32* value);
 bool GetRtpHeader(const void* data, size_t len, RtpHeader* header);
 
 // Assumes marker bit is 0.
@@ -74,6 +74,19 @@ static const unsigned char kNonCompoundRtcpSDESPacket[] = {
     0x80, 0xCA, 0x00, 0x00
 };
 
+// SDES with one chunk for SSRC 0x1111 and no items, followed by an RR from
+// SSRC 0x2222 with no report blocks.
+static const unsigned char kCompoundRtcpSdesRrPacket[] = {
+    0x81, 0xCA, 0x00, 0x01, 0x00, 0x00, 0x11, 0x11,
+    0x80, 0xC9, 0x00, 0x01, 0x00, 0x00, 0x22, 0x22,
+};
+
+// The same SDES, followed by something that isn't RTCP.
+static const unsigned char kCompoundRtcpSdesGarbagePacket[] = {
+    0x81, 0xCA, 0x00, 0x01, 0x00, 0x00, 0x11, 0x11,
+    0x00, 0xC9, 0x00, 0x01, 0x00, 0x00, 0x22, 0x22,
+};
+
 TEST(RtpUtilsTest, GetRtp) {
   int pt;
   EXPECT_TRUE(GetRtpPayloadType(kPcmuFrame, sizeof(kPcmuFrame), &pt));
@@ -187,4 +200,24 @@ TEST(RtpUtilsTest, GetRtcp) {
                            &ssrc));
 }
 
+TEST(RtpUtilsTest, GetCompoundRtcpSsrc) {
+  uint32 ssrc = 0;
+  EXPECT_TRUE(GetCompoundRtcpSsrc(kRtcpReport, sizeof(kRtcpReport), &ssrc));
+  EXPECT_EQ(1U, ssrc);
+  EXPECT_TRUE(GetCompoundRtcpSsrc(kCompoundRtcpSdesRrPacket,
+                                  sizeof(kCompoundRtcpSdesRrPacket), &ssrc));
+  EXPECT_EQ(0x2222U, ssrc);
+  EXPECT_FALSE(GetCompoundRtcpSsrc(kCompoundRtcpSdesGarbagePacket,
+                                   sizeof(kCompoundRtcpSdesGarbagePacket),
+                                   &ssrc));
+  EXPECT_FALSE(GetCompoundRtcpSsrc(kNonCompoundRtcpSDESPacket,
+                                   sizeof(kNonCompoundRtcpSDESPacket), &ssrc));
+  // The RR is cut short.
+  EXPECT_FALSE(GetCompoundRtcpSsrc(kCompoundRtcpSdesRrPacket,
+                                   sizeof(kCompoundRtcpSdesRrPacket) - 2,
+                                   &ssrc));
+  EXPECT_FALSE(GetCompoundRtcpSsrc(kInvalidPacket, sizeof(kInvalidPacket),
+                                   &ssrc));
+}
+
 }  // namespace cricket
@@ -517,11 +517,36 @@ bool DtlsTransportChannelWrapper::HandleDtlsPacket(const char* data,
     tmp_size -= record_len + kDtlsRecordHeaderLen;
   }
 
-  // Looks good. Pass to the SIC which ends up being passed to
-  // the DTLS stack.
+  // Looks good. Once the handshake is done, hand it straight to the DTLS
+  // stack if it can take it. Otherwise pass it to the SIC which ends up being
+  // passed to the DTLS stack.
+  if (dtls_state_ == STATE_OPEN && dtls_->HasDtlsPacketInput())
+    return ReadDtlsPacket(data, size);
   return downward_->OnPacketReceived(data, size);
 }
 
+// Decrypts the application data in a DTLS packet and signals it upwards.
+bool DtlsTransportChannelWrapper::ReadDtlsPacket(const char* data,
+                                                 size_t size) {
+  char buf[kMaxDtlsPacketLen];
+  size_t read;
+  int error;
+  talk_base::StreamResult result;
+  // Records after the first one in the packet are read with a NULL packet.
+  while ((result = dtls_->ReadDtlsPacket(data, size, buf, sizeof(buf),
+                                         &read, &error)) ==
+         talk_base::SR_SUCCESS) {
+    SignalReadPacket(this, buf, read, 0);
+    data = NULL;
+    size = 0;
+  }
+  if (result == talk_base::SR_ERROR) {
+    LOG_J(LS_ERROR, this) << "Failed to read DTLS packet, error=" << error;
+    return false;
+  }
+  return true;
+}
+
 void DtlsTransportChannelWrapper::OnRequestSignaling(
     TransportChannelImpl* channel) {
   ASSERT(channel == channel_);
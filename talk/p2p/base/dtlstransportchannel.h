@@ -97,6 +97,11 @@ class StreamInterfaceChannel : public talk_base::StreamInterface,
 //     dtls_ is listening for events on downward_, so it immediately calls
 //     downward_->Read().
 //
+//   - Once the handshake is done, HandleDtlsPacket instead hands DTLS packets
+//     to dtls_->ReadDtlsPacket(), if supported, which decrypts them straight
+//     from the packet buffer. This skips the copy into downward_ and the
+//     event round trip.
+//
 //   - Data written to DtlsTransportChannelWrapper is passed either to
 //      downward_ or directly to channel_, depending on whether DTLS is
 //     negotiated and whether the flags include PF_SRTP_BYPASS
@@ -213,6 +218,7 @@ class DtlsTransportChannelWrapper : public TransportChannelImpl {
   bool SetupDtls();
   bool MaybeStartDtls();
   bool HandleDtlsPacket(const char* data, size_t size);
+  bool ReadDtlsPacket(const char* data, size_t size);
   void OnRequestSignaling(TransportChannelImpl* channel);
   void OnCandidateReady(TransportChannelImpl* channel, const Candidate& c);
   void OnCandidatesAllocationDone(TransportChannelImpl* channel);
@@ -34,6 +34,7 @@
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/stringutils.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/p2p/base/fakesession.h"
 #include "talk/base/ssladapter.h"
 #include "talk/base/sslidentity.h"
@@ -404,8 +405,14 @@ class DtlsTransportChannelTest : public testing::Test {
   void TestTransfer(size_t channel, size_t size, size_t count, bool srtp) {
     LOG(LS_INFO) << "Expect packets, size=" << size;
     client2_.ExpectPackets(channel, size);
+    uint32 start = talk_base::Time();
     client1_.SendPackets(channel, size, count, srtp);
     EXPECT_EQ_WAIT(count, client2_.NumPacketsReceived(), 10000);
+    uint32 elapsed = talk_base::TimeSince(start);
+    LOG(LS_INFO) << "Transferred " << count << " packets of " << size
+                 << " bytes in " << elapsed << " ms ("
+                 << count * size * 8 / talk_base::_max<uint32>(elapsed, 1)
+                 << " Kbps)";
   }
 
  protected:
@@ -490,6 +497,15 @@ TEST_F(DtlsTransportChannelTest, TestTransferDtls) {
   TestTransfer(0, 1000, 100, false);
 }
 
+// Throughput benchmark: connect with DTLS and transfer a lot of application
+// data, with the rate logged.
+TEST_F(DtlsTransportChannelTest, TestTransferDtlsThroughput) {
+  MAYBE_SKIP_TEST(HaveDtls);
+  PrepareDtls(true, true);
+  ASSERT_TRUE(Connect());
+  TestTransfer(0, 1000, 20000, false);
+}
+
 // Create two channels with DTLS, and transfer some data.
 TEST_F(DtlsTransportChannelTest, TestTransferDtlsTwoChannels) {
   MAYBE_SKIP_TEST(HaveDtls);
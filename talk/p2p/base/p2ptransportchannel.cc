@@ -41,7 +41,6 @@ namespace {
 // messages for queuing up work for ourselves
 enum {
   MSG_SORT = 1,
-  MSG_PING,
 };
 
 // When the socket is unwritable, we will use 10 Kbps (ignoring IP+UDP headers)
@@ -96,40 +95,6 @@ int CompareConnections(cricket::Connection *a, cricket::Connection *b) {
   return CompareConnectionCandidates(a, b);
 }
 
-// Wraps the comparison connection into a less than operator that puts higher
-// priority writable connections first.
-class ConnectionCompare {
- public:
-  bool operator()(const cricket::Connection *ca,
-                  const cricket::Connection *cb) {
-    cricket::Connection* a = const_cast<cricket::Connection*>(ca);
-    cricket::Connection* b = const_cast<cricket::Connection*>(cb);
-
-    ASSERT(a->port()->IceProtocol() == b->port()->IceProtocol());
-
-    // Compare first on writability and static preferences.
-    int cmp = CompareConnections(a, b);
-    if (cmp > 0)
-      return true;
-    if (cmp < 0)
-      return false;
-
-    // Otherwise, sort based on latency estimate.
-    return a->rtt() < b->rtt();
-
-    // Should we bother checking for the last connection that last received
-    // data? It would help rendezvous on the connection that is also receiving
-    // packets.
-    //
-    // TODO: Yes we should definitely do this.  The TCP protocol gains
-    // efficiency by being used bidirectionally, as opposed to two separate
-    // unidirectional streams.  This test should probably occur before
-    // comparison of local prefs (assuming combined prefs are the same).  We
-    // need to be careful though, not to bounce back and forth with both sides
-    // trying to rendevous with the other.
-  }
-};
-
 // Determines whether we should switch between two connections, based first on
 // static preferences and then (if those are equal) on latency estimates.
 bool ShouldSwitch(cricket::Connection* a_conn, cricket::Connection* b_conn) {
@@ -152,6 +117,37 @@ bool ShouldSwitch(cricket::Connection* a_conn, cricket::Connection* b_conn) {
 
 namespace cricket {
 
+// A less than operator that puts higher priority writable connections first,
+// in the same order as CompareConnections, and then the lower latency ones.
+bool P2PTransportChannel::ConnectionRankCompare::operator()(
+    const ConnectionRank& a, const ConnectionRank& b) const {
+  // Sort based on write-state.  Better states have lower values.
+  if (a.write_state != b.write_state)
+    return a.write_state < b.write_state;
+
+  // Then on priority, and then prefer a younger generation.
+  if (a.priority != b.priority)
+    return a.priority > b.priority;
+  if (a.generation != b.generation)
+    return a.generation > b.generation;
+
+  // Otherwise, sort based on latency estimate.
+  if (a.rtt != b.rtt)
+    return a.rtt < b.rtt;
+
+  // Should we bother checking for the last connection that last received
+  // data? It would help rendezvous on the connection that is also receiving
+  // packets.
+  //
+  // TODO: Yes we should definitely do this.  The TCP protocol gains
+  // efficiency by being used bidirectionally, as opposed to two separate
+  // unidirectional streams.  This test should probably occur before
+  // comparison of local prefs (assuming combined prefs are the same).  We
+  // need to be careful though, not to bounce back and forth with both sides
+  // trying to rendevous with the other.
+  return a.sequence < b.sequence;
+}
+
 P2PTransportChannel::P2PTransportChannel(const std::string& content_name,
                                          int component,
                                          P2PTransport* transport,
@@ -163,6 +159,7 @@ P2PTransportChannel::P2PTransportChannel(const std::string& content_name,
     incoming_only_(false),
     waiting_for_signaling_(false),
     error_(0),
+    next_sequence_(0),
     best_connection_(NULL),
     sort_dirty_(false),
     was_writable_(false),
@@ -170,11 +167,14 @@ P2PTransportChannel::P2PTransportChannel(const std::string& content_name,
     protocol_type_(ICEPROTO_GOOGLE),
     role_(ROLE_UNKNOWN),
     tiebreaker_(0) {
+  pacer_ = PingPacer::Register(worker_thread_, this);
 }
 
 P2PTransportChannel::~P2PTransportChannel() {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
 
+  pacer_->Unregister(this);
+
   for (uint32 i = 0; i < allocator_sessions_.size(); ++i)
     delete allocator_sessions_[i];
 }
@@ -207,7 +207,10 @@ void P2PTransportChannel::SetRole(TransportRole role) {
        it != ports_.end(); ++it) {
     (*it)->SetRole(role_);
   }
-  // TODO - Recompute the priorites for the connections.
+
+  // The role determines the pair priorities, so rank everything again.
+  for (uint32 i = 0; i < connections_.size(); ++i)
+    UpdateConnectionRank(connections_[i]);
 }
 
 void P2PTransportChannel::SetTiebreaker(uint64 tiebreaker) {
@@ -253,7 +256,7 @@ void P2PTransportChannel::Connect() {
   Allocate();
 
   // Start pinging as the ports come in.
-  thread()->Post(this, MSG_PING);
+  pacer_->Schedule(this, 0);
 }
 
 // Reset the socket, clear up any previous allocations and start over
@@ -267,6 +270,10 @@ void P2PTransportChannel::Reset() {
   allocator_sessions_.clear();
   ports_.clear();
   connections_.clear();
+  connection_entries_.clear();
+  ranking_.clear();
+  writable_pings_.clear();
+  unwritable_pings_.clear();
   best_connection_ = NULL;
 
   // Forget about all of the candidates we got before.
@@ -288,7 +295,7 @@ void P2PTransportChannel::Reset() {
 
   // Start pinging as the ports come in.
   thread()->Clear(this);
-  thread()->Post(this, MSG_PING);
+  pacer_->Schedule(this, 0);
 }
 
 // A new port is available, attempt to make connections for it
@@ -561,10 +568,13 @@ bool P2PTransportChannel::CreateConnection(PortInterface* port,
       return false;
 
     connections_.push_back(connection);
+    AddConnectionRank(connection);
     connection->SignalReadPacket.connect(
         this, &P2PTransportChannel::OnReadPacket);
     connection->SignalStateChange.connect(
         this, &P2PTransportChannel::OnConnectionStateChange);
+    connection->SignalRttChange.connect(
+        this, &P2PTransportChannel::OnConnectionRttChange);
     connection->SignalDestroyed.connect(
         this, &P2PTransportChannel::OnConnectionDestroyed);
     connection->SignalUseCandidate.connect(
@@ -584,9 +594,66 @@ bool P2PTransportChannel::CreateConnection(PortInterface* port,
 
 bool P2PTransportChannel::FindConnection(
     cricket::Connection* connection) const {
-  std::vector<Connection*>::const_iterator citer =
-      std::find(connections_.begin(), connections_.end(), connection);
-  return citer != connections_.end();
+  return connection_entries_.find(connection) != connection_entries_.end();
+}
+
+void P2PTransportChannel::AddConnectionRank(Connection* conn) {
+  ConnectionEntry entry;
+  entry.rank.sequence = next_sequence_++;
+  entry.rank.connection = conn;
+  InsertConnectionRank(
+      &connection_entries_.insert(std::make_pair(conn, entry)).first->second);
+}
+
+// Moves the connection to its place in the ranking and the ping queues.  This
+// must be called whenever anything they are ordered by changes.
+void P2PTransportChannel::UpdateConnectionRank(Connection* conn) {
+  ConnectionEntryMap::iterator it = connection_entries_.find(conn);
+  if (it == connection_entries_.end())
+    return;
+  EraseConnectionRank(it->second);
+  InsertConnectionRank(&it->second);
+}
+
+void P2PTransportChannel::RemoveConnectionRank(Connection* conn) {
+  ConnectionEntryMap::iterator it = connection_entries_.find(conn);
+  if (it == connection_entries_.end())
+    return;
+  EraseConnectionRank(it->second);
+  connection_entries_.erase(it);
+}
+
+void P2PTransportChannel::InsertConnectionRank(ConnectionEntry* entry) {
+  Connection* conn = entry->rank.connection;
+  entry->rank.write_state = conn->write_state();
+  entry->rank.priority = conn->priority();
+  entry->rank.generation =
+      conn->remote_candidate().generation() + conn->port()->generation();
+  entry->rank.rtt = conn->rtt();
+  entry->last_ping_sent = conn->last_ping_sent();
+  ranking_.insert(entry->rank);
+
+  // If we are writable, then we only want to ping connections that could be
+  // better than the best one, i.e., the ones that were not pruned.  If we are
+  // not writable, then we need to try everything that might work.  This
+  // includes both connections that do not have write timeout as well as ones
+  // that do not have read timeout.  A connection could be readable but be in
+  // write-timeout if we pruned it before.  Since the other side is still
+  // pinging it, it very well might still work.
+  PingKey key(entry->last_ping_sent, entry->rank.sequence);
+  if (conn->write_state() != Connection::STATE_WRITE_TIMEOUT) {
+    writable_pings_[key] = conn;
+    unwritable_pings_[key] = conn;
+  } else if (conn->read_state() != Connection::STATE_READ_TIMEOUT) {
+    unwritable_pings_[key] = conn;
+  }
+}
+
+void P2PTransportChannel::EraseConnectionRank(const ConnectionEntry& entry) {
+  ranking_.erase(entry.rank);
+  PingKey key(entry.last_ping_sent, entry.rank.sequence);
+  writable_pings_.erase(key);
+  unwritable_pings_.erase(key);
 }
 
 // Maintain our remote candidate list, adding this new remote one.
@@ -667,9 +734,9 @@ bool P2PTransportChannel::GetStats(ConnectionInfos *infos) {
   // Gather connection infos.
   infos->clear();
 
-  std::vector<Connection *>::const_iterator it;
-  for (it = connections_.begin(); it != connections_.end(); ++it) {
-    Connection *connection = *it;
+  ConnectionRanking::const_iterator it;
+  for (it = ranking_.begin(); it != ranking_.end(); ++it) {
+    Connection *connection = it->connection;
     ConnectionInfo info;
     info.best_connection = (best_connection_ == connection);
     info.readable =
@@ -738,21 +805,21 @@ void P2PTransportChannel::SortConnections() {
   for (uint32 i = 0; i < connections_.size(); ++i)
     networks.insert(connections_[i]->port()->Network());
 
-  // Find the best alternative connection by sorting.  It is important to note
-  // that amongst equal preference, writable connections, this will choose the
-  // one whose estimated latency is lowest.  So it is the only one that we
-  // need to consider switching to.
-
-  ConnectionCompare cmp;
-  std::stable_sort(connections_.begin(), connections_.end(), cmp);
-  LOG(LS_VERBOSE) << "Sorting available connections:";
-  for (uint32 i = 0; i < connections_.size(); ++i) {
-    LOG(LS_VERBOSE) << connections_[i]->ToString();
+  // The best alternative connection is the first in the ranking.  It is
+  // important to note that amongst equal preference, writable connections,
+  // this will choose the one whose estimated latency is lowest.  So it is the
+  // only one that we need to consider switching to.
+  if (LOG_CHECK_LEVEL(LS_VERBOSE)) {
+    LOG(LS_VERBOSE) << "Sorting available connections:";
+    ConnectionRanking::const_iterator it;
+    for (it = ranking_.begin(); it != ranking_.end(); ++it) {
+      LOG(LS_VERBOSE) << it->connection->ToString();
+    }
   }
 
   Connection* top_connection = NULL;
-  if (connections_.size() > 0)
-    top_connection = connections_[0];
+  if (!ranking_.empty())
+    top_connection = ranking_.begin()->connection;
 
   // If necessary, switch to the new choice.
   if (ShouldSwitch(best_connection_, top_connection))
@@ -913,9 +980,10 @@ Connection* P2PTransportChannel::GetBestConnectionOnNetwork(
     return best_connection_;
 
   // Otherwise, we return the top-most in sorted order.
-  for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (connections_[i]->port()->Network() == network)
-      return connections_[i];
+  ConnectionRanking::const_iterator it;
+  for (it = ranking_.begin(); it != ranking_.end(); ++it) {
+    if (it->connection->port()->Network() == network)
+      return it->connection;
   }
 
   return NULL;
@@ -943,9 +1011,6 @@ void P2PTransportChannel::OnMessage(talk_base::Message *pmsg) {
     case MSG_SORT:
       OnSort();
       break;
-    case MSG_PING:
-      OnPing();
-      break;
     default:
       ASSERT(false);
       break;
@@ -958,42 +1023,22 @@ void P2PTransportChannel::OnSort() {
   SortConnections();
 }
 
-// Handle queued up ping request
-void P2PTransportChannel::OnPing() {
+// Our turn to ping has come up
+void P2PTransportChannel::OnPingSlot() {
   // Make sure the states of the connections are up-to-date (since this affects
   // which ones are pingable).
   UpdateConnectionStates();
 
   // Find the oldest pingable connection and have it do a ping.
   Connection* conn = FindNextPingableConnection();
-  if (conn)
+  if (conn) {
     conn->Ping(talk_base::Time());
+    UpdateConnectionRank(conn);
+  }
 
-  // Post ourselves a message to perform the next ping.
+  // Ask for our next turn.
   uint32 delay = writable() ? WRITABLE_DELAY : UNWRITABLE_DELAY;
-  thread()->PostDelayed(delay, this, MSG_PING);
-}
-
-// Is the connection in a state for us to even consider pinging the other side?
-bool P2PTransportChannel::IsPingable(Connection* conn) {
-  // An unconnected connection cannot be written to at all, so pinging is out
-  // of the question.
-  if (!conn->connected())
-    return false;
-
-  if (writable()) {
-    // If we are writable, then we only want to ping connections that could be
-    // better than this one, i.e., the ones that were not pruned.
-    return (conn->write_state() != Connection::STATE_WRITE_TIMEOUT);
-  } else {
-    // If we are not writable, then we need to try everything that might work.
-    // This includes both connections that do not have write timeout as well as
-    // ones that do not have read timeout.  A connection could be readable but
-    // be in write-timeout if we pruned it before.  Since the other side is
-    // still pinging it, it very well might still work.
-    return (conn->write_state() != Connection::STATE_WRITE_TIMEOUT) ||
-           (conn->read_state() != Connection::STATE_READ_TIMEOUT);
-  }
+  pacer_->Schedule(this, delay);
 }
 
 // Returns the next pingable connection to ping.  This will be the oldest
@@ -1008,27 +1053,15 @@ Connection* P2PTransportChannel::FindNextPingableConnection() {
     return best_connection_;
   }
 
-  Connection* oldest_conn = NULL;
-  uint32 oldest_time = 0xFFFFFFFF;
-  for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (IsPingable(connections_[i])) {
-      if (connections_[i]->last_ping_sent() < oldest_time) {
-        oldest_time = connections_[i]->last_ping_sent();
-        oldest_conn = connections_[i];
-      }
-    }
-  }
-  return oldest_conn;
-}
-
-// return the number of "pingable" connections
-int P2PTransportChannel::NumPingableConnections() {
-  int count = 0;
-  for (size_t i = 0; i < connections_.size(); ++i) {
-    if (IsPingable(connections_[i]))
-      ++count;
+  // An unconnected connection cannot be written to at all, so pinging is out
+  // of the question.  Only TCP connections are ever unconnected, and only
+  // briefly, so they are skipped here rather than tracked.
+  const PingQueue& pings = writable() ? writable_pings_ : unwritable_pings_;
+  for (PingQueue::const_iterator it = pings.begin(); it != pings.end(); ++it) {
+    if (it->second->connected())
+      return it->second;
   }
-  return count;
+  return NULL;
 }
 
 // When a connection's state changes, we need to figure out who to use as
@@ -1036,11 +1069,20 @@ int P2PTransportChannel::NumPingableConnections() {
 void P2PTransportChannel::OnConnectionStateChange(Connection *connection) {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
 
+  UpdateConnectionRank(connection);
+
   // We have to unroll the stack before doing this because we may be changing
   // the state of connections while sorting.
   RequestSort();
 }
 
+// A new latency estimate only changes the ranking; it is acted on at the next
+// sort, as before.
+void P2PTransportChannel::OnConnectionRttChange(Connection *connection) {
+  ASSERT(worker_thread_ == talk_base::Thread::Current());
+  UpdateConnectionRank(connection);
+}
+
 // When a connection is removed, edit it out, and then update our best
 // connection.
 void P2PTransportChannel::OnConnectionDestroyed(Connection *connection) {
@@ -1054,6 +1096,7 @@ void P2PTransportChannel::OnConnectionDestroyed(Connection *connection) {
       std::find(connections_.begin(), connections_.end(), connection);
   ASSERT(iter != connections_.end());
   connections_.erase(iter);
+  RemoveConnectionRank(connection);
 
   LOG_J(LS_INFO, this) << "Removed connection ("
     << static_cast<int>(connections_.size()) << " remaining)";
@@ -38,10 +38,12 @@
 #define TALK_P2P_BASE_P2PTRANSPORTCHANNEL_H_
 
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include "talk/base/sigslot.h"
 #include "talk/p2p/base/candidate.h"
+#include "talk/p2p/base/pingpacer.h"
 #include "talk/p2p/base/portinterface.h"
 #include "talk/p2p/base/portallocator.h"
 #include "talk/p2p/base/transport.h"
@@ -65,7 +67,8 @@ class RemoteCandidate : public Candidate {
 // P2PTransportChannel manages the candidates and connection process to keep
 // two P2P clients connected to each other.
 class P2PTransportChannel : public TransportChannelImpl,
-                            public talk_base::MessageHandler {
+                            public talk_base::MessageHandler,
+                            public PingPacer::Client {
  public:
   P2PTransportChannel(const std::string& content_name,
                       int component,
@@ -121,9 +124,10 @@ class P2PTransportChannel : public TransportChannelImpl,
   bool FindConnection(cricket::Connection* connection) const;
   void RememberRemoteCandidate(const Candidate& remote_candidate,
                                PortInterface* origin_port);
-  bool IsPingable(Connection* conn);
+  void AddConnectionRank(Connection* conn);
+  void UpdateConnectionRank(Connection* conn);
+  void RemoveConnectionRank(Connection* conn);
   Connection* FindNextPingableConnection();
-  int NumPingableConnections();
   void AddAllocatorSession(PortAllocatorSession* session);
 
   void OnPortReady(PortAllocatorSession *session, PortInterface* port);
@@ -139,6 +143,7 @@ class P2PTransportChannel : public TransportChannelImpl,
   void OnPortDestroyed(PortInterface* port);
 
   void OnConnectionStateChange(Connection *connection);
+  void OnConnectionRttChange(Connection *connection);
   void OnReadPacket(Connection *connection, const char *data, size_t len);
   void OnConnectionDestroyed(Connection *connection);
   void NominateBestConnection();
@@ -148,17 +153,53 @@ class P2PTransportChannel : public TransportChannelImpl,
 
   virtual void OnMessage(talk_base::Message *pmsg);
   void OnSort();
-  void OnPing();
+  // From PingPacer::Client:
+  virtual void OnPingSlot();
+
+  // The values a connection was last ranked by.  The ranking is kept up to
+  // date as these change, so the best connection is always the first one.
+  // Ties go to the older connection.
+  struct ConnectionRank {
+    int write_state;
+    uint64 priority;
+    uint32 generation;
+    uint32 rtt;
+    uint32 sequence;
+    Connection* connection;
+  };
+  struct ConnectionRankCompare {
+    bool operator()(const ConnectionRank& a, const ConnectionRank& b) const;
+  };
+  typedef std::set<ConnectionRank, ConnectionRankCompare> ConnectionRanking;
+
+  // Pingable connections by the time of their last ping, oldest first.
+  typedef std::pair<uint32, uint32> PingKey;  // last_ping_sent, sequence
+  typedef std::map<PingKey, Connection*> PingQueue;
+
+  struct ConnectionEntry {
+    ConnectionRank rank;
+    uint32 last_ping_sent;
+  };
+  typedef std::map<Connection*, ConnectionEntry> ConnectionEntryMap;
+  void InsertConnectionRank(ConnectionEntry* entry);
+  void EraseConnectionRank(const ConnectionEntry& entry);
 
   P2PTransport* transport_;
   PortAllocator *allocator_;
   talk_base::Thread *worker_thread_;
+  PingPacer* pacer_;
   bool incoming_only_;
   bool waiting_for_signaling_;
   int error_;
   std::vector<PortAllocatorSession*> allocator_sessions_;
   std::vector<PortInterface *> ports_;
   std::vector<Connection *> connections_;
+  ConnectionEntryMap connection_entries_;
+  ConnectionRanking ranking_;
+  // The connections we ping while writable, and the ones we ping otherwise.
+  PingQueue writable_pings_;
+  PingQueue unwritable_pings_;
+  uint32 next_sequence_;
   Connection *best_connection_;
   std::vector<RemoteCandidate> remote_candidates_;
   bool sort_dirty_;  // indicates whether another sort is needed right now
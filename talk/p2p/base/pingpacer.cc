@@ -0,0 +1,203 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/p2p/base/pingpacer.h"
+
+#include "talk/base/common.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+
+namespace cricket {
+
+namespace {
+
+typedef std::map<talk_base::Thread*, PingPacer*> PacerMap;
+
+struct Pacers {
+  talk_base::CriticalSection crit;
+  PacerMap pacers;
+};
+
+Pacers* GetPacers() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(Pacers, pacers, ());
+  return &pacers;
+}
+
+}  // namespace
+
+const int PingPacer::kDefaultInterval;
+const int PingPacer::kDefaultBurst;
+
+PingPacer* PingPacer::Register(talk_base::Thread* thread, Client* client) {
+  ASSERT(thread->IsCurrent());
+  Pacers* pacers = GetPacers();
+  PingPacer* pacer;
+  {
+    talk_base::CritScope cs(&pacers->crit);
+    PacerMap::iterator it = pacers->pacers.find(thread);
+    if (it != pacers->pacers.end()) {
+      pacer = it->second;
+    } else {
+      pacer = new PingPacer(thread);
+      pacers->pacers[thread] = pacer;
+    }
+  }
+  pacer->clients_.insert(client);
+  return pacer;
+}
+
+void PingPacer::Unregister(Client* client) {
+  ASSERT(thread_->IsCurrent());
+  Cancel(client);
+  clients_.erase(client);
+  if (!clients_.empty())
+    return;
+
+  Pacers* pacers = GetPacers();
+  {
+    talk_base::CritScope cs(&pacers->crit);
+    pacers->pacers.erase(thread_);
+  }
+  delete this;
+}
+
+PingPacer::PingPacer(talk_base::Thread* thread)
+    : thread_(thread),
+      interval_(kDefaultInterval),
+      burst_(kDefaultBurst),
+      next_slot_(talk_base::Time()),
+      wakeup_pending_(false),
+      wakeup_(0) {
+}
+
+PingPacer::~PingPacer() {
+  thread_->Clear(this);
+}
+
+void PingPacer::Schedule(Client* client, int delay) {
+  ASSERT(clients_.find(client) != clients_.end());
+  Cancel(client);
+  uint32 due = talk_base::TimeAfter(delay);
+  waiting_index_[client] = waiting_.insert(std::make_pair(due, client));
+  ScheduleWakeup();
+}
+
+void PingPacer::Cancel(Client* client) {
+  std::map<Client*, WaitQueue::iterator>::iterator it =
+      waiting_index_.find(client);
+  if (it != waiting_index_.end()) {
+    waiting_.erase(it->second);
+    waiting_index_.erase(it);
+    return;
+  }
+  // The ready queue holds at most one entry per client, so it is never
+  // longer than the number of channels on the thread.
+  for (ReadyQueue::iterator rit = ready_.begin(); rit != ready_.end(); ++rit) {
+    if (rit->first == client) {
+      ready_.erase(rit);
+      return;
+    }
+  }
+}
+
+PingPacer::Stats PingPacer::GetStats() const {
+  Stats stats = stats_;
+  stats.clients = clients_.size();
+  stats.queue_depth = ready_.size();
+  return stats;
+}
+
+void PingPacer::OnMessage(talk_base::Message* msg) {
+  uint32 now = talk_base::Time();
+  wakeup_pending_ = false;
+
+  // Everyone who is due joins the back of the line.
+  while (!waiting_.empty() &&
+         talk_base::TimeIsLaterOrEqual(waiting_.begin()->first, now)) {
+    Client* client = waiting_.begin()->second;
+    ready_.push_back(std::make_pair(client, waiting_.begin()->first));
+    waiting_index_.erase(client);
+    waiting_.erase(waiting_.begin());
+  }
+  if (ready_.size() > stats_.max_queue_depth)
+    stats_.max_queue_depth = ready_.size();
+
+  // Slots not used while things were quiet are not saved up, beyond the
+  // burst allowance.
+  if (talk_base::TimeIsLater(next_slot_, now))
+    next_slot_ = now;
+  if (ready_.empty() || !talk_base::TimeIsLaterOrEqual(NextSlotTime(), now)) {
+    ScheduleWakeup();
+    return;
+  }
+
+  // Hand the slot to the front of the line.
+  Client* client = ready_.front().first;
+  uint32 latency = talk_base::TimeDiff(now, ready_.front().second);
+  ready_.pop_front();
+  ++stats_.slots;
+  stats_.total_latency += latency;
+  if (latency > stats_.max_latency)
+    stats_.max_latency = latency;
+  next_slot_ += interval_;
+  ScheduleWakeup();
+
+  // Last, since the client may reschedule or unregister itself.
+  client->OnPingSlot();
+}
+
+uint32 PingPacer::NextSlotTime() const {
+  return next_slot_ - (talk_base::_max(burst_, 1) - 1) * interval_;
+}
+
+// Makes sure there is a wakeup posted for the next time something can
+// happen: the next slot if someone is waiting for one, or else when the
+// next client becomes due (but no earlier than the next slot).
+void PingPacer::ScheduleWakeup() {
+  uint32 target;
+  if (!ready_.empty()) {
+    target = NextSlotTime();
+  } else if (!waiting_.empty()) {
+    target = talk_base::TimeMax(waiting_.begin()->first, NextSlotTime());
+  } else {
+    return;
+  }
+
+  if (wakeup_pending_) {
+    if (talk_base::TimeIsLaterOrEqual(wakeup_, target))
+      return;
+    thread_->Clear(this);
+  }
+  int delay = talk_base::TimeUntil(target);
+  thread_->PostDelayed(talk_base::_max(delay, 0), this);
+  wakeup_pending_ = true;
+  wakeup_ = target;
+}
+
+}  // namespace cricket
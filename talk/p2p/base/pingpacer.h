@@ -0,0 +1,139 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_P2P_BASE_PINGPACER_H_
+#define TALK_P2P_BASE_PINGPACER_H_
+
+#include <list>
+#include <map>
+#include <set>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/messagehandler.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+class Thread;
+}
+
+namespace cricket {
+
+// Paces the connectivity checks (pings) of every P2PTransportChannel on a
+// thread. Channels ask for a slot when they want to ping, and the pacer hands
+// out slots to the channels that are due, in the order they became due, at
+// no more than one per interval (the Ta of RFC 5245 section 16) on average.
+// Up to |burst| slots may go out back to back after a quiet spell, so a
+// thread that is within its budget pings exactly when its channels ask to;
+// with a burst of 1, every slot is at least an interval after the last.
+class PingPacer : public talk_base::MessageHandler {
+ public:
+  class Client {
+   public:
+    // Called when it is this client's turn to send a check. The client asks
+    // for its next turn with Schedule().
+    virtual void OnPingSlot() = 0;
+
+   protected:
+    virtual ~Client() {}
+  };
+
+  // Counters for a pacer's slots.
+  struct Stats {
+    Stats()
+        : clients(0), queue_depth(0), max_queue_depth(0), slots(0),
+          total_latency(0), max_latency(0) {}
+    size_t clients;          // Registered.
+    size_t queue_depth;      // Due and waiting for a slot.
+    size_t max_queue_depth;  // Largest queue_depth so far.
+    uint64 slots;            // Total handed out.
+    uint64 total_latency;    // Total ms between being due and getting a slot.
+    uint32 max_latency;      // Longest such wait, in ms.
+  };
+
+  // The default interval lets a thread send 200 checks per second, enough
+  // for a few calls' worth of channels to ping at their own rates.
+  static const int kDefaultInterval = 5;  // ms
+  static const int kDefaultBurst = 4;
+
+  // Returns the pacer for |thread|, creating it if needed, and registers
+  // |client| with it. Must be called on |thread|.
+  static PingPacer* Register(talk_base::Thread* thread, Client* client);
+  // Cancels |client|'s slot and unregisters it. The pacer deletes itself
+  // when its last client unregisters.
+  void Unregister(Client* client);
+
+  // Asks for a slot |delay| ms from now, replacing any slot asked for before.
+  void Schedule(Client* client, int delay);
+  void Cancel(Client* client);
+
+  int interval() const { return interval_; }
+  void set_interval(int interval) { interval_ = interval; }
+  int burst() const { return burst_; }
+  void set_burst(int burst) { burst_ = burst; }
+
+  Stats GetStats() const;
+
+  virtual void OnMessage(talk_base::Message* msg);
+
+ private:
+  // Orders due times across a wraparound of Time(). That is a strict weak
+  // ordering because all due times are within a few seconds of each other.
+  struct DueTimeLess {
+    bool operator()(uint32 a, uint32 b) const {
+      return talk_base::TimeIsLater(a, b);
+    }
+  };
+  typedef std::multimap<uint32, Client*, DueTimeLess> WaitQueue;
+  typedef std::list<std::pair<Client*, uint32> > ReadyQueue;
+
+  explicit PingPacer(talk_base::Thread* thread);
+  virtual ~PingPacer();
+
+  // The earliest time the next slot can be handed out.
+  uint32 NextSlotTime() const;
+  void ScheduleWakeup();
+
+  talk_base::Thread* thread_;
+  int interval_;
+  int burst_;
+  std::set<Client*> clients_;
+  WaitQueue waiting_;
+  std::map<Client*, WaitQueue::iterator> waiting_index_;
+  ReadyQueue ready_;
+  uint32 next_slot_;  // When the next slot would be, with no bursts.
+  bool wakeup_pending_;
+  uint32 wakeup_;
+  Stats stats_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PingPacer);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_PINGPACER_H_
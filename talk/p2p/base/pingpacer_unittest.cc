@@ -0,0 +1,170 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <vector>
+
+#include "talk/base/gunit.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+#include "talk/p2p/base/pingpacer.h"
+
+using cricket::PingPacer;
+
+// Records when it got its slots, and asks for the next one |delay| ms later
+// until it has had |max_slots|.
+class TestClient : public PingPacer::Client {
+ public:
+  TestClient(int id, std::vector<int>* order)
+      : id_(id), order_(order), delay_(0), max_slots_(0), pacer_(NULL) {
+    pacer_ = PingPacer::Register(talk_base::Thread::Current(), this);
+  }
+  virtual ~TestClient() {
+    pacer_->Unregister(this);
+  }
+
+  PingPacer* pacer() { return pacer_; }
+  const std::vector<uint32>& slots() const { return slots_; }
+
+  void Start(int delay, size_t max_slots) {
+    delay_ = delay;
+    max_slots_ = max_slots;
+    pacer_->Schedule(this, 0);
+  }
+
+  virtual void OnPingSlot() {
+    slots_.push_back(talk_base::Time());
+    order_->push_back(id_);
+    if (slots_.size() < max_slots_)
+      pacer_->Schedule(this, delay_);
+  }
+
+ private:
+  int id_;
+  std::vector<int>* order_;
+  int delay_;
+  size_t max_slots_;
+  PingPacer* pacer_;
+  std::vector<uint32> slots_;
+};
+
+// Test that all the clients on a thread share one pacer.
+TEST(PingPacerTest, TestSharedPerThread) {
+  std::vector<int> order;
+  TestClient a(1, &order);
+  TestClient b(2, &order);
+  EXPECT_EQ(a.pacer(), b.pacer());
+  EXPECT_EQ(2U, a.pacer()->GetStats().clients);
+}
+
+// Test that clients which are due together take turns, and that their slots
+// are at least an interval apart.
+TEST(PingPacerTest, TestRoundRobin) {
+  std::vector<int> order;
+  TestClient a(1, &order), b(2, &order), c(3, &order);
+  PingPacer* pacer = a.pacer();
+  pacer->set_interval(20);
+  pacer->set_burst(1);
+  a.Start(0, 3);
+  b.Start(0, 3);
+  c.Start(0, 3);
+  EXPECT_EQ_WAIT(9U, order.size(), 1000);
+
+  const int kExpected[] = { 1, 2, 3, 1, 2, 3, 1, 2, 3 };
+  EXPECT_EQ(std::vector<int>(kExpected, kExpected + 9), order);
+  EXPECT_GE(talk_base::TimeDiff(b.slots()[0], a.slots()[0]), 20);
+  EXPECT_GE(talk_base::TimeDiff(c.slots()[0], b.slots()[0]), 20);
+  EXPECT_GE(talk_base::TimeDiff(a.slots()[1], c.slots()[0]), 20);
+
+  PingPacer::Stats stats = pacer->GetStats();
+  EXPECT_EQ(9U, stats.slots);
+  EXPECT_EQ(0U, stats.queue_depth);
+  EXPECT_EQ(3U, stats.max_queue_depth);
+  // The last client in each round waits two intervals for its slot.
+  EXPECT_GE(stats.max_latency, 40U);
+  EXPECT_GT(stats.total_latency, 0U);
+}
+
+// Test that up to a burst of slots can go out together, and that the ones
+// after that wait their turn.
+TEST(PingPacerTest, TestBurst) {
+  std::vector<int> order;
+  TestClient a(1, &order), b(2, &order), c(3, &order), d(4, &order);
+  PingPacer* pacer = a.pacer();
+  pacer->set_interval(50);
+  pacer->set_burst(3);
+  a.Start(0, 1);
+  b.Start(0, 1);
+  c.Start(0, 1);
+  d.Start(0, 1);
+  EXPECT_EQ_WAIT(3U, order.size(), 40);
+  EXPECT_EQ_WAIT(4U, order.size(), 1000);
+  EXPECT_LT(talk_base::TimeDiff(c.slots()[0], a.slots()[0]), 40);
+  EXPECT_GE(talk_base::TimeDiff(d.slots()[0], a.slots()[0]), 50);
+}
+
+// Test that a client's own delay is kept when the pacer isn't busy.
+TEST(PingPacerTest, TestClientDelay) {
+  std::vector<int> order;
+  TestClient a(1, &order);
+  a.Start(50, 3);
+  EXPECT_EQ_WAIT(3U, order.size(), 1000);
+  EXPECT_GE(talk_base::TimeDiff(a.slots()[1], a.slots()[0]), 50);
+  EXPECT_GE(talk_base::TimeDiff(a.slots()[2], a.slots()[1]), 50);
+}
+
+// Test that a cancelled client, or one scheduled again, only gets the slot
+// it asked for last.
+TEST(PingPacerTest, TestCancelAndReschedule) {
+  std::vector<int> order;
+  TestClient a(1, &order), b(2, &order);
+  a.Start(0, 1);
+  b.Start(0, 1);
+  a.pacer()->Cancel(&a);
+  a.pacer()->Schedule(&b, 0);
+  EXPECT_EQ_WAIT(1U, order.size(), 1000);
+  talk_base::Thread::Current()->ProcessMessages(100);
+  ASSERT_EQ(1U, order.size());
+  EXPECT_EQ(2, order[0]);
+  EXPECT_EQ(1U, a.pacer()->GetStats().slots);
+}
+
+// Test that a client can unregister while others are queued.
+TEST(PingPacerTest, TestUnregisterWhileQueued) {
+  std::vector<int> order;
+  TestClient a(1, &order);
+  {
+    TestClient b(2, &order);
+    a.Start(0, 1);
+    b.Start(0, 1);
+  }
+  EXPECT_EQ(1U, a.pacer()->GetStats().clients);
+  EXPECT_EQ_WAIT(1U, order.size(), 1000);
+  talk_base::Thread::Current()->ProcessMessages(100);
+  ASSERT_EQ(1U, order.size());
+  EXPECT_EQ(1, order[0]);
+}
@@ -197,6 +197,7 @@ void Port::Construct() {
     ice_username_fragment_ = talk_base::CreateRandomString(ICE_UFRAG_LENGTH);
     password_ = talk_base::CreateRandomString(ICE_PWD_LENGTH);
   }
+  integrity_key_.SetKey(password_);
   LOG_J(LS_INFO, this) << "Port created";
 }
 
@@ -365,7 +366,7 @@ bool Port::GetStunMessage(const char* data, size_t size,
 
     // If ICE, and the MESSAGE-INTEGRITY is bad, fail with a 401 Unauthorized
     if (ice_protocol_ == ICEPROTO_RFC5245 &&
-        !stun_msg->ValidateMessageIntegrity(data, size, password_)) {
+        !stun_msg->ValidateMessageIntegrity(data, size, integrity_key_)) {
       LOG_J(LS_ERROR, this) << "Received STUN request with bad M-I "
                             << "from " << addr.ToString();
       SendBindingErrorResponse(stun_msg.get(), addr, STUN_ERROR_UNAUTHORIZED,
@@ -566,7 +567,7 @@ void Port::SendBindingResponse(StunMessage* request,
   if (ice_protocol_ == ICEPROTO_RFC5245) {
     response.AddAttribute(
         new StunXorAddressAttribute(STUN_ATTR_XOR_MAPPED_ADDRESS, addr));
-    response.AddMessageIntegrity(password_);
+    response.AddMessageIntegrity(integrity_key_);
     response.AddFingerprint();
   } else if (ice_protocol_ == ICEPROTO_GOOGLE) {
     response.AddAttribute(
@@ -618,7 +619,7 @@ void Port::SendBindingErrorResponse(StunMessage* request,
     // because we don't have enough information to determine the shared secret.
     if (error_code != STUN_ERROR_BAD_REQUEST &&
         error_code != STUN_ERROR_UNAUTHORIZED)
-      response.AddMessageIntegrity(password_);
+      response.AddMessageIntegrity(integrity_key_);
     response.AddFingerprint();
   } else if (ice_protocol_ == ICEPROTO_GOOGLE) {
     // GICE responses include a username, if one exists.
@@ -758,7 +759,7 @@ class ConnectionRequest : public StunRequest {
           new StunUInt32Attribute(STUN_ATTR_PRIORITY, prflx_priority));
 
       // Adding Message Integrity attribute.
-      request->AddMessageIntegrity(connection_->remote_candidate().password());
+      request->AddMessageIntegrity(connection_->remote_integrity_key_);
       // Adding Fingerprint.
       request->AddFingerprint();
     }
@@ -795,7 +796,9 @@ class ConnectionRequest : public StunRequest {
 Connection::Connection(Port* port, size_t index,
                        const Candidate& remote_candidate)
   : port_(port), local_candidate_index_(index),
-    remote_candidate_(remote_candidate), read_state_(STATE_READ_INIT),
+    remote_candidate_(remote_candidate),
+    remote_integrity_key_(remote_candidate.password()),
+    read_state_(STATE_READ_INIT),
     write_state_(STATE_WRITE_INIT), connected_(true), pruned_(false),
     requests_(port->thread()), rtt_(DEFAULT_RTT),
     last_ping_sent_(0), last_ping_received_(0), last_data_received_(0),
@@ -965,8 +968,7 @@ void Connection::OnReadPacket(const char* data, size_t size) {
       case STUN_BINDING_RESPONSE:
       case STUN_BINDING_ERROR_RESPONSE:
         if (port_->IceProtocol() == ICEPROTO_GOOGLE ||
-            msg->ValidateMessageIntegrity(
-                data, size, remote_candidate().password())) {
+            msg->ValidateMessageIntegrity(data, size, remote_integrity_key_)) {
           requests_.CheckResponse(msg.get());
         }
         // Otherwise silently discard the response message.
@@ -1175,7 +1177,10 @@ void Connection::OnConnectionRequestResponse(ConnectionRequest* request,
 
   pings_since_last_response_.clear();
   last_ping_response_received_ = talk_base::Time();
+  uint32 old_rtt = rtt_;
   rtt_ = (RTT_RATIO * rtt_ + rtt) / (RTT_RATIO + 1);
+  if (rtt_ != old_rtt)
+    SignalRttChange(this);
 }
 
 void Connection::OnConnectionRequestErrorResponse(ConnectionRequest* request,
@@ -347,6 +347,8 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   // username_fragment().
   std::string ice_username_fragment_;
   std::string password_;
+  // Signs and checks MESSAGE-INTEGRITY with |password_|.
+  talk_base::HmacSha1Key integrity_key_;
   std::vector<Candidate> candidates_;
   AddressMap connections_;
   enum Lifetime { LT_PRESTART, LT_PRETIMEOUT, LT_POSTTIMEOUT } lifetime_;
@@ -421,6 +423,9 @@ class Connection : public talk_base::MessageHandler,
   size_t recv_bytes_second();
   sigslot::signal1<Connection*> SignalStateChange;
 
+  // Sent when a ping response changes the round-trip time estimate.
+  sigslot::signal1<Connection*> SignalRttChange;
+
   // Sent when the connection has decided that it is no longer of value.  It
   // will delete itself immediately after this call.
   sigslot::signal1<Connection*> SignalDestroyed;
@@ -506,6 +511,8 @@ class Connection : public talk_base::MessageHandler,
   Port* port_;
   size_t local_candidate_index_;
   Candidate remote_candidate_;
+  // Signs and checks MESSAGE-INTEGRITY with the remote password.
+  talk_base::HmacSha1Key remote_integrity_key_;
   ReadState read_state_;
   WriteState write_state_;
   bool connected_;
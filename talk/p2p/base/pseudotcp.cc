@@ -27,6 +27,7 @@
 
 #include "talk/p2p/base/pseudotcp.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <set>
@@ -128,6 +129,12 @@ const uint32 DEF_ACK_DELAY = 100; // 100 milliseconds
 
 const uint8 FLAG_CTL = 0x02;
 const uint8 FLAG_RST = 0x04;
+// Set on acks without data when SACK is in use. The payload then holds up to
+// MAX_SACK_BLOCKS pairs of left and right edges of received ranges.
+const uint8 FLAG_SACK = 0x08;
+
+const uint32 MAX_SACK_BLOCKS = 4;
+const uint32 SACK_BLOCK_SIZE = 8;
 
 const uint8 CTL_CONNECT = 0;
 //const uint8 CTL_REDIRECT = 1;
@@ -138,6 +145,7 @@ const uint8 TCP_OPT_EOL = 0;  // End of list.
 const uint8 TCP_OPT_NOOP = 1;  // No-op.
 const uint8 TCP_OPT_MSS = 2;  // Maximum segment size.
 const uint8 TCP_OPT_WND_SCALE = 3;  // Window scale factor.
+const uint8 TCP_OPT_SACK_PERMITTED = 4;  // Selective acknowledgements.
 
 /*
 const uint8 FLAG_FIN = 0x01;
@@ -263,14 +271,22 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
 
   m_rto_base = 0;
 
-  m_cwnd = 2 * m_mss;
-  m_ssthresh = m_rbuf_len;
+  m_cc.reset(PseudoTcpCongestionControl::Create(CC_RENO));
+  m_cc->Init(m_mss, m_rbuf_len);
   m_lastrecv = m_lastsend = m_lasttraffic = now;
   m_bOutgoing = false;
 
   m_dup_acks = 0;
   m_recover = 0;
 
+  m_rlist_recent = 0;
+  m_sack_enabled = false;
+  m_sack_high = m_sack_rexmit = 0;
+
+  m_autotune_max = 0;
+  m_rcv_rtt = m_rcv_rtt_seq = m_rcv_rtt_time = 0;
+  m_rcv_copied = m_rcv_copied_time = 0;
+
   m_ts_recent = m_ts_lastack = 0;
 
   m_rx_rto = DEF_RTO;
@@ -279,6 +295,7 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
   m_use_nagling = true;
   m_ack_delay = DEF_ACK_DELAY;
   m_support_wnd_scale = true;
+  m_support_sack = true;
 }
 
 PseudoTcp::~PseudoTcp() {
@@ -330,9 +347,15 @@ void PseudoTcp::NotifyClock(uint32 now) {
       }
 
       uint32 nInFlight = m_snd_nxt - m_snd_una;
-      m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
-      //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
-      m_cwnd = m_mss;
+      m_cc->OnRetransmitTimeout(nInFlight, now);
+
+      if (m_sack_enabled) {
+        // Anything outstanding may have been lost. Retransmit the holes in
+        // the scoreboard as acks come back, rather than waiting for another
+        // timeout for each of them.
+        m_recover = m_snd_nxt;
+        m_sack_rexmit = m_slist.front().seq + m_slist.front().len;
+      }
 
       // Back off retransmit timer.  Note: the limit is lower when connecting.
       uint32 rto_limit = (m_state < TCP_ESTABLISHED) ? DEF_RTO : MAX_RTO;
@@ -397,6 +420,10 @@ void PseudoTcp::GetOption(Option opt, int* value) {
     *value = m_sbuf_len;
   } else if (opt == OPT_RCVBUF) {
     *value = m_rbuf_len;
+  } else if (opt == OPT_CONGESTION_CONTROL) {
+    *value = m_cc->type();
+  } else if (opt == OPT_AUTOTUNE_MAX) {
+    *value = m_autotune_max;
   } else {
     ASSERT(false);
   }
@@ -412,13 +439,27 @@ void PseudoTcp::SetOption(Option opt, int value) {
   } else if (opt == OPT_RCVBUF) {
     ASSERT(m_state == TCP_LISTEN);
     resizeReceiveBuffer(value);
+  } else if (opt == OPT_CONGESTION_CONTROL) {
+    ASSERT(m_state == TCP_LISTEN);
+    PseudoTcpCongestionControl* cc = PseudoTcpCongestionControl::Create(
+        static_cast<CongestionControlType>(value));
+    ASSERT(cc != NULL);
+    if (cc) {
+      cc->Init(m_mss, m_cc->ssthresh());
+      m_cc.reset(cc);
+    }
+  } else if (opt == OPT_AUTOTUNE_MAX) {
+    ASSERT(m_state == TCP_LISTEN);
+    m_autotune_max = value;
+    // Pick a window scale that leaves room to grow.
+    resizeReceiveBuffer(m_rbuf_len);
   } else {
     ASSERT(false);
   }
 }
 
 uint32 PseudoTcp::GetCongestionWindow() const {
-  return m_cwnd;
+  return m_cc->cwnd();
 }
 
 uint32 PseudoTcp::GetBytesInFlight() const {
@@ -456,6 +497,11 @@ int PseudoTcp::Recv(char* buffer, size_t len) {
   }
   ASSERT(result == talk_base::SR_SUCCESS);
 
+  if (m_autotune_max) {
+    m_rcv_copied += read;
+    autotuneReceiveBuffer(Now());
+  }
+
   size_t available_space = 0;
   m_rbuf.GetWriteRemaining(&available_space);
 
@@ -560,6 +606,16 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
     ASSERT(static_cast<uint32>(bytes_read) == len);
   }
 
+  // Acks without data tell the peer which out-of-order data has arrived.
+  uint32 sack_len = 0;
+  if ((len == 0) && m_sack_enabled && !m_rlist.empty()) {
+    sack_len = SACK_BLOCK_SIZE *
+        buildSackBlocks(buffer + HEADER_SIZE, MAX_SACK_BLOCKS);
+    if (sack_len) {
+      buffer[13] |= FLAG_SACK;
+    }
+  }
+
 #if _DEBUGMSG >= _DBG_VERBOSE
   LOG(LS_INFO) << "<-- <CONV=" << m_conv
                << "><FLG=" << static_cast<unsigned>(flags)
@@ -571,7 +627,8 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
                << "><LEN=" << len << ">";
 #endif // _DEBUGMSG
 
-  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacket(this, reinterpret_cast<char *>(buffer), len + HEADER_SIZE);
+  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacket(
+      this, reinterpret_cast<char *>(buffer), HEADER_SIZE + sack_len + len);
   // Note: When len is 0, this is an ACK packet.  We don't read the return value for those,
   // and thus we won't retry.  So go ahead and treat the packet as a success (basically simulate
   // as if it were dropped), which will prevent our timers from being messed up.
@@ -605,6 +662,18 @@ bool PseudoTcp::parse(const uint8* buffer, uint32 size) {
   seg.data = reinterpret_cast<const char *>(buffer) + HEADER_SIZE;
   seg.len = size - HEADER_SIZE;
 
+  seg.sack = NULL;
+  seg.sack_blocks = 0;
+  if (seg.flags & FLAG_SACK) {
+    if ((seg.len % SACK_BLOCK_SIZE) != 0) {
+      LOG_F(LS_WARNING) << "invalid SACK blocks";
+      return false;
+    }
+    seg.sack = seg.data;
+    seg.sack_blocks = seg.len / SACK_BLOCK_SIZE;
+    seg.len = 0;
+  }
+
 #if _DEBUGMSG >= _DBG_VERBOSE
   LOG(LS_INFO) << "--> <CONV=" << seg.conv
                << "><FLG=" << static_cast<unsigned>(seg.flags)
@@ -758,6 +827,7 @@ bool PseudoTcp::process(Segment& seg) {
     for (uint32 nFree = nAcked; nFree > 0; ) {
       ASSERT(!m_slist.empty());
       if (nFree < m_slist.front().len) {
+        m_slist.front().seq += nFree;
         m_slist.front().len -= nFree;
         nFree = 0;
       } else {
@@ -769,10 +839,14 @@ bool PseudoTcp::process(Segment& seg) {
       }
     }
 
+    if (m_sack_enabled) {
+      applySack(seg);
+    }
+
     if (m_dup_acks >= 3) {
       if (m_snd_una >= m_recover) { // NewReno
         uint32 nInFlight = m_snd_nxt - m_snd_una;
-        m_cwnd = talk_base::_min(m_ssthresh, nInFlight + m_mss); // (Fast Retransmit)
+        m_cc->OnExitRecovery(nInFlight); // (Fast Retransmit)
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "exit recovery";
 #endif // _DEBUGMSG
@@ -781,46 +855,72 @@ bool PseudoTcp::process(Segment& seg) {
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "recovery retransmit";
 #endif // _DEBUGMSG
-        if (!transmit(m_slist.begin(), now)) {
+        bool bSent = m_sack_enabled ? retransmitLost(now)
+                                    : transmit(m_slist.begin(), now);
+        if (!bSent) {
           closedown(ECONNABORTED);
           return false;
         }
-        m_cwnd += m_mss - talk_base::_min(nAcked, m_cwnd);
+        m_cc->OnPartialAck(nAcked);
       }
     } else {
       m_dup_acks = 0;
-      // Slow start, congestion avoidance
-      if (m_cwnd < m_ssthresh) {
-        m_cwnd += m_mss;
-      } else {
-        m_cwnd += talk_base::_max<uint32>(1, m_mss * m_mss / m_cwnd);
+      m_cc->OnAck(nAcked, m_rx_srtt, now);
+
+      if (m_sack_enabled && (m_snd_una < m_recover)) {
+        // Recovering from a timeout. Fill up to two holes for every ack, so
+        // that the retransmissions ramp up the way slow start would.
+        if (!retransmitLost(now) || !retransmitLost(now)) {
+          closedown(ECONNABORTED);
+          return false;
+        }
       }
     }
   } else if (seg.ack == m_snd_una) {
     // !?! Note, tcp says don't do this... but otherwise how does a closed window become open?
     m_snd_wnd = static_cast<uint32>(seg.wnd) << m_swnd_scale;
 
+    if (m_sack_enabled) {
+      applySack(seg);
+    }
+
     // Check duplicate acks
     if (seg.len > 0) {
       // it's a dup ack, but with a data payload, so don't modify m_dup_acks
     } else if (m_snd_una != m_snd_nxt) {
-      m_dup_acks += 1;
+      if (m_sack_enabled && (m_dup_acks < 3) && (m_snd_una < m_recover)) {
+        // Recovering from a timeout; the duplicates report holes that are
+        // already being filled, so they don't start a fast retransmit.
+        if (!retransmitLost(now)) {
+          closedown(ECONNABORTED);
+          return false;
+        }
+      } else {
+        m_dup_acks += 1;
+      }
       if (m_dup_acks == 3) { // (Fast Retransmit)
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "enter recovery";
         LOG(LS_INFO) << "recovery retransmit";
 #endif // _DEBUGMSG
-        if (!transmit(m_slist.begin(), now)) {
+        m_sack_rexmit = m_snd_una;
+        bool bSent = m_sack_enabled ? retransmitLost(now)
+                                    : transmit(m_slist.begin(), now);
+        if (!bSent) {
           closedown(ECONNABORTED);
           return false;
         }
         m_recover = m_snd_nxt;
+        // Give the retransmission a full timeout before giving up on it.
+        m_rto_base = now;
         uint32 nInFlight = m_snd_nxt - m_snd_una;
-        m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
-        //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
-        m_cwnd = m_ssthresh + 3 * m_mss;
+        m_cc->OnEnterRecovery(nInFlight, now);
       } else if (m_dup_acks > 3) {
-        m_cwnd += m_mss;
+        m_cc->OnDupAck();
+        if (m_sack_enabled && !retransmitLost(now)) {
+          closedown(ECONNABORTED);
+          return false;
+        }
       }
     } else {
       m_dup_acks = 0;
@@ -838,6 +938,10 @@ bool PseudoTcp::process(Segment& seg) {
     //notify(evOpen);
   }
 
+  if (m_autotune_max) {
+    autotuneSendBuffer();
+  }
+
   // If we make room in the send queue, notify the user
   // The goal it to make sure we always have at least enough data to fill the
   // window.  We'd like to notify the app when we are halfway to that point.
@@ -923,6 +1027,9 @@ bool PseudoTcp::process(Segment& seg) {
         m_rcv_nxt += seg.len;
         m_rcv_wnd -= seg.len;
         bNewData = true;
+        if (m_autotune_max) {
+          measureReceiveRtt(now);
+        }
 
         RList::iterator it = m_rlist.begin();
         while ((it != m_rlist.end()) && (it->seq <= m_rcv_nxt)) {
@@ -945,10 +1052,9 @@ bool PseudoTcp::process(Segment& seg) {
         RSegment rseg;
         rseg.seq = seg.seq;
         rseg.len = seg.len;
-        RList::iterator it = m_rlist.begin();
-        while ((it != m_rlist.end()) && (it->seq < rseg.seq)) {
-          ++it;
-        }
+        m_rlist_recent = rseg.seq;
+        RList::iterator it = std::lower_bound(m_rlist.begin(), m_rlist.end(),
+                                              rseg.seq, SeqLess());
         m_rlist.insert(it, rseg);
       }
     }
@@ -968,7 +1074,7 @@ bool PseudoTcp::process(Segment& seg) {
   return true;
 }
 
-bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
+bool PseudoTcp::transmit(SList::iterator seg, uint32 now) {
   if (seg->xmit >= ((m_state == TCP_ESTABLISHED) ? 15 : 30)) {
     LOG_F(LS_VERBOSE) << "too many retransmits";
     return false;
@@ -1002,7 +1108,7 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
       // !?! We need to break up all outstanding and pending packets and then retransmit!?!
 
       m_mss = PACKET_MAXIMUMS[++m_msslevel] - PACKET_OVERHEAD;
-      m_cwnd = 2 * m_mss; // I added this... haven't researched actual formula
+      m_cc->OnMtuReduced(m_mss); // I added this... haven't researched actual formula
       if (m_mss < nTransmit) {
         nTransmit = m_mss;
         break;
@@ -1021,8 +1127,9 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
     subseg.xmit = seg->xmit;
     seg->len = nTransmit;
 
-    SList::iterator next = seg;
-    m_slist.insert(++next, subseg);
+    SList::difference_type index = seg - m_slist.begin();
+    m_slist.insert(seg + 1, subseg);
+    seg = m_slist.begin() + index;
   }
 
   if (seg->xmit == 0) {
@@ -1037,11 +1144,90 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
   return true;
 }
 
+void PseudoTcp::applySack(const Segment& seg) {
+  for (uint32 i = 0; i < seg.sack_blocks; ++i) {
+    uint32 left = bytes_to_long(seg.sack + i * SACK_BLOCK_SIZE);
+    uint32 right = bytes_to_long(seg.sack + i * SACK_BLOCK_SIZE + 4);
+    if ((left >= right) || (left < m_snd_una) || (right > m_snd_nxt)) {
+      // Stale or bogus block.
+      continue;
+    }
+    if (right > m_sack_high) {
+      m_sack_high = right;
+    }
+    for (SList::iterator it = std::lower_bound(m_slist.begin(),
+                                               m_slist.end(), left, SeqLess());
+         (it != m_slist.end()) && (it->seq < right); ++it) {
+      if (it->seq + it->len <= right) {
+        it->bSacked = true;
+      }
+    }
+  }
+}
+
+bool PseudoTcp::retransmitLost(uint32 now) {
+  SList::iterator it = m_slist.begin();
+  if ((it != m_slist.end()) && (it->bSacked || (it->seq < m_sack_rexmit))) {
+    // Skip what this recovery has already retransmitted, and what the peer
+    // has already received.
+    it = std::lower_bound(it + 1, m_slist.end(), m_sack_rexmit, SeqLess());
+    while ((it != m_slist.end()) && it->bSacked) {
+      ++it;
+    }
+    if ((it != m_slist.end()) && (it->seq >= m_sack_high)) {
+      // Nothing past here has been selectively acknowledged, so as far as we
+      // know it's still in flight.
+      return true;
+    }
+  }
+  if ((it == m_slist.end()) || (it->xmit == 0)) {
+    // Never sent, so not lost.
+    return true;
+  }
+#if _DEBUGMSG >= _DBG_NORMAL
+  LOG(LS_INFO) << "sack retransmit " << it->seq << ":" << it->seq + it->len;
+#endif // _DEBUGMSG
+  SList::difference_type index = it - m_slist.begin();
+  if (!transmit(it, now)) {
+    return false;
+  }
+  m_sack_rexmit = m_slist[index].seq + m_slist[index].len;
+  return true;
+}
+
+uint32 PseudoTcp::buildSackBlocks(uint8* buf, uint32 max_blocks) const {
+  // |m_rlist| is sorted, but its segments may overlap or abut, so merge them
+  // into ranges as we go. The first pass finds the range holding the most
+  // recent segment (RFC 2018, section 4); the second adds the others.
+  uint32 count = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    RList::const_iterator it = m_rlist.begin();
+    while ((it != m_rlist.end()) && (count < max_blocks)) {
+      uint32 left = it->seq;
+      uint32 right = it->seq + it->len;
+      for (++it; (it != m_rlist.end()) && (it->seq <= right); ++it) {
+        right = talk_base::_max(right, it->seq + it->len);
+      }
+      bool recent = (left <= m_rlist_recent) && (m_rlist_recent < right);
+      if ((pass == 0) != recent) {
+        continue;
+      }
+      long_to_bytes(left, buf + count * SACK_BLOCK_SIZE);
+      long_to_bytes(right, buf + count * SACK_BLOCK_SIZE + 4);
+      ++count;
+      if (pass == 0) {
+        break;
+      }
+    }
+  }
+  return count;
+}
+
 void PseudoTcp::attemptSend(SendFlags sflags) {
   uint32 now = Now();
 
   if (talk_base::TimeDiff(now, m_lastsend) > static_cast<long>(m_rx_rto)) {
-    m_cwnd = m_mss;
+    m_cc->OnIdle();
   }
 
 #if _DEBUGMSG
@@ -1050,7 +1236,7 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
 #endif // _DEBUGMSG
 
   while (true) {
-    uint32 cwnd = m_cwnd;
+    uint32 cwnd = m_cc->cwnd();
     if ((m_dup_acks == 1) || (m_dup_acks == 2)) { // Limited Transmit
       cwnd += m_dup_acks * m_mss;
     }
@@ -1078,13 +1264,13 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
       m_sbuf.GetWriteRemaining(&available_space);
 
       bFirst = false;
-      LOG(LS_INFO) << "[cwnd: " << m_cwnd
+      LOG(LS_INFO) << "[cwnd: " << m_cc->cwnd()
                    << "  nWindow: " << nWindow
                    << "  nInFlight: " << nInFlight
                    << "  nAvailable: " << nAvailable
                    << "  nQueued: " << snd_buffered
                    << "  nEmpty: " << available_space
-                   << "  ssthresh: " << m_ssthresh << "]";
+                   << "  ssthresh: " << m_cc->ssthresh() << "]";
     }
 #endif // _DEBUGMSG
 
@@ -1109,19 +1295,20 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
       return;
     }
 
-    // Find the next segment to transmit
-    SList::iterator it = m_slist.begin();
-    while (it->xmit > 0) {
-      ++it;
-      ASSERT(it != m_slist.end());
-    }
-    SList::iterator seg = it;
+    // Find the next segment to transmit. Everything before |m_snd_nxt| has
+    // been sent at least once.
+    SList::iterator seg = std::lower_bound(m_slist.begin(), m_slist.end(),
+                                           m_snd_nxt, SeqLess());
+    ASSERT(seg != m_slist.end());
+    ASSERT(seg->xmit == 0);
 
     // If the segment is too large, break it into two
     if (seg->len > nAvailable) {
       SSegment subseg(seg->seq + nAvailable, seg->len - nAvailable, seg->bCtrl);
       seg->len = nAvailable;
-      m_slist.insert(++it, subseg);
+      SList::difference_type index = seg - m_slist.begin();
+      m_slist.insert(seg + 1, subseg);
+      seg = m_slist.begin() + index;
     }
 
     if (!transmit(seg, now)) {
@@ -1158,8 +1345,79 @@ PseudoTcp::adjustMTU() {
   LOG(LS_INFO) << "Adjusting mss to " << m_mss << " bytes";
 #endif // _DEBUGMSG
   // Enforce minimums on ssthresh and cwnd
-  m_ssthresh = talk_base::_max(m_ssthresh, 2 * m_mss);
-  m_cwnd = talk_base::_max(m_cwnd, m_mss);
+  m_cc->OnMtuAdjusted(m_mss);
+}
+
+void
+PseudoTcp::measureReceiveRtt(uint32 now) {
+  // Time how long it takes for the window advertised at the start of the
+  // measurement to be filled. While the sender is window limited this is one
+  // round trip; otherwise it overestimates, which only slows the tuning down.
+  if (m_rcv_rtt_time) {
+    if (m_rcv_nxt < m_rcv_rtt_seq) {
+      return;
+    }
+    uint32 sample = talk_base::_max<long>(1,
+        talk_base::TimeDiff(now, m_rcv_rtt_time));
+    if ((m_rcv_rtt == 0) || (sample < m_rcv_rtt)) {
+      m_rcv_rtt = sample;
+    } else {
+      m_rcv_rtt = (7 * m_rcv_rtt + sample) / 8;
+    }
+  }
+  m_rcv_rtt_seq = m_rcv_nxt + talk_base::_max(m_rcv_wnd, m_mss);
+  m_rcv_rtt_time = now;
+}
+
+void
+PseudoTcp::autotuneReceiveBuffer(uint32 now) {
+  if (m_rcv_rtt == 0) {
+    return;
+  }
+  if (m_rcv_copied_time == 0) {
+    m_rcv_copied_time = now;
+    return;
+  }
+  if (talk_base::TimeDiff(now, m_rcv_copied_time) <
+      static_cast<long>(m_rcv_rtt)) {
+    return;
+  }
+
+  // To keep the sender from stalling on the window, the buffer has to hold
+  // a round trip of data in flight plus a round trip of data the application
+  // hasn't read yet. The scaled window also has to fit in the header.
+  uint32 new_size = talk_base::_min(2 * m_rcv_copied, m_autotune_max);
+  new_size = talk_base::_min(new_size, 0xFFFFu << m_rwnd_scale);
+  m_rcv_copied = 0;
+  m_rcv_copied_time = now;
+
+  // Resizing only keeps the data that has been received in order, so wait
+  // until the out-of-order segments have been filled in.
+  if ((new_size <= m_rbuf_len) || !m_rlist.empty()) {
+    return;
+  }
+  if (m_rbuf.SetCapacity(new_size)) {
+#if _DEBUGMSG >= _DBG_NORMAL
+    LOG(LS_INFO) << "Growing receive buffer to " << new_size << " bytes";
+#endif // _DEBUGMSG
+    m_rbuf_len = new_size;
+  }
+}
+
+void
+PseudoTcp::autotuneSendBuffer() {
+  // One window in flight, and one queued behind it so the application has a
+  // round trip to refill the buffer.
+  uint32 wanted = 2 * talk_base::_min(m_snd_wnd, m_cc->cwnd());
+  if ((wanted <= m_sbuf_len) || (m_sbuf_len >= m_autotune_max)) {
+    return;
+  }
+  uint32 new_size = talk_base::_min(m_autotune_max,
+                                    talk_base::_max(wanted, 2 * m_sbuf_len));
+#if _DEBUGMSG >= _DBG_NORMAL
+  LOG(LS_INFO) << "Growing send buffer to " << new_size << " bytes";
+#endif // _DEBUGMSG
+  resizeSendBuffer(new_size);
 }
 
 bool
@@ -1174,6 +1432,11 @@ PseudoTcp::disableWindowScale() {
   m_support_wnd_scale = false;
 }
 
+void
+PseudoTcp::disableSack() {
+  m_support_sack = false;
+}
+
 void
 PseudoTcp::queueConnectMessage() {
   talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK);
@@ -1184,6 +1447,10 @@ PseudoTcp::queueConnectMessage() {
     buf.WriteUInt8(1);
     buf.WriteUInt8(m_rwnd_scale);
   }
+  if (m_support_sack) {
+    buf.WriteUInt8(TCP_OPT_SACK_PERMITTED);
+    buf.WriteUInt8(0);
+  }
   m_snd_wnd = buf.Length();
   queue(buf.Data(), buf.Length(), true);
 }
@@ -1229,11 +1496,18 @@ PseudoTcp::parseOptions(const char* data, uint32 len) {
 
     if (m_rwnd_scale > 0) {
       // Peer doesn't support TCP options and window scaling.
-      // Revert receive buffer size to default value.
+      // Revert receive buffer size to default value. Without scaling the
+      // window can't grow past 64 KB, so stop auto-tuning too.
+      m_autotune_max = 0;
       resizeReceiveBuffer(DEFAULT_RCV_BUF_SIZE);
       m_swnd_scale = 0;
     }
   }
+
+  // Selective acknowledgements are only used if both sides ask for them.
+  m_sack_enabled = m_support_sack &&
+      (options_specified.find(TCP_OPT_SACK_PERMITTED) !=
+       options_specified.end());
 }
 
 void
@@ -1268,14 +1542,16 @@ PseudoTcp::resizeReceiveBuffer(uint32 new_size) {
   uint8 scale_factor = 0;
 
   // Determine the scale factor such that the scaled window size can fit
-  // in a 16-bit unsigned integer.
-  while (new_size > 0xFFFF) {
+  // in a 16-bit unsigned integer, even after auto-tuning has grown the
+  // buffer as far as it may.
+  uint32 max_size = talk_base::_max(new_size, m_autotune_max);
+  while (max_size > 0xFFFF) {
     ++scale_factor;
-    new_size >>= 1;
+    max_size >>= 1;
   }
 
   // Determine the proper size of the buffer.
-  new_size <<= scale_factor;
+  new_size = (new_size >> scale_factor) << scale_factor;
   bool result = m_rbuf.SetCapacity(new_size);
 
   // Make sure the new buffer is large enough to contain data in the old
@@ -1286,7 +1562,7 @@ PseudoTcp::resizeReceiveBuffer(uint32 new_size) {
   UNUSED(result);
   m_rbuf_len = new_size;
   m_rwnd_scale = scale_factor;
-  m_ssthresh = new_size;
+  m_cc->set_ssthresh(talk_base::_max(new_size, m_autotune_max));
 
   size_t available_space = 0;
   m_rbuf.GetWriteRemaining(&available_space);
@@ -28,10 +28,12 @@
 #ifndef TALK_P2P_BASE_PSEUDOTCP_H_
 #define TALK_P2P_BASE_PSEUDOTCP_H_
 
-#include <list>
+#include <deque>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/scoped_ptr.h"
 #include "talk/base/stream.h"
+#include "talk/p2p/base/pseudotcpcongestioncontrol.h"
 
 namespace cricket {
 
@@ -99,13 +101,15 @@ class PseudoTcp {
   // instance's behaviour for the kind of data it will carry.
   // If an unrecognized option is set or got, an assertion will fire.
   //
-  // Setting options for OPT_RCVBUF or OPT_SNDBUF after Connect() is called
-  // will result in an assertion.
+  // Setting options for OPT_RCVBUF, OPT_SNDBUF, OPT_CONGESTION_CONTROL or
+  // OPT_AUTOTUNE_MAX after Connect() is called will result in an assertion.
   enum Option {
     OPT_NODELAY,      // Whether to enable Nagle's algorithm (0 == off)
     OPT_ACKDELAY,     // The Delayed ACK timeout (0 == off).
     OPT_RCVBUF,       // Set the receive buffer size, in bytes.
     OPT_SNDBUF,       // Set the send buffer size, in bytes.
+    OPT_CONGESTION_CONTROL,  // A CongestionControlType (CC_RENO by default).
+    OPT_AUTOTUNE_MAX,  // Grow the buffers on demand up to this size (0 == off).
   };
   void GetOption(Option opt, int* value);
   void SetOption(Option opt, int value);
@@ -124,6 +128,9 @@ class PseudoTcp {
   // Returns current round-trip time estimate in milliseconds.
   uint32 GetRoundTripTimeEstimateMs() const;
 
+  // Returns true if both sides agreed to use selective acknowledgements.
+  bool IsSackEnabled() const { return m_sack_enabled; }
+
  protected:
   enum SendFlags { sfNone, sfDelayedAck, sfImmediateAck };
 
@@ -134,22 +141,37 @@ class PseudoTcp {
     const char * data;
     uint32 len;
     uint32 tsval, tsecr;
+    // SACK blocks (pairs of left and right edges in network order).
+    const char * sack;
+    uint32 sack_blocks;
   };
 
   struct SSegment {
     SSegment(uint32 s, uint32 l, bool c)
-        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c) {
+        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c), bSacked(false) {
     }
     uint32 seq, len;
     //uint32 tstamp;
     uint8 xmit;
     bool bCtrl;
+    bool bSacked;  // The peer has selectively acknowledged this segment.
   };
-  typedef std::list<SSegment> SList;
+  typedef std::deque<SSegment> SList;
 
   struct RSegment {
     uint32 seq, len;
   };
+  typedef std::deque<RSegment> RList;
+
+  // Orders segments by sequence number, for binary searches of the lists.
+  struct SeqLess {
+    bool operator()(const SSegment& seg, uint32 seq) const {
+      return seg.seq < seq;
+    }
+    bool operator()(const RSegment& seg, uint32 seq) const {
+      return seg.seq < seq;
+    }
+  };
 
   uint32 queue(const char* data, uint32 len, bool bCtrl);
 
@@ -172,10 +194,32 @@ class PseudoTcp {
   bool clock_check(uint32 now, long& nTimeout);
 
   bool process(Segment& seg);
-  bool transmit(const SList::iterator& seg, uint32 now);
+  // Sends |seg|, splitting it first if the MTU has shrunk. Splitting
+  // invalidates other iterators into |m_slist|.
+  bool transmit(SList::iterator seg, uint32 now);
+
+  // Marks the segments covered by the SACK blocks in |seg| as received.
+  void applySack(const Segment& seg);
+  // Retransmits the first segment that the SACK scoreboard shows as lost
+  // and that hasn't been retransmitted since recovery began. The segment at
+  // |m_snd_una| always counts as lost. Returns false if the retransmit failed.
+  bool retransmitLost(uint32 now);
+  // Writes up to |max_blocks| SACK blocks describing |m_rlist| to |buf|,
+  // the block holding the most recently received segment first. Returns the
+  // number of blocks written.
+  uint32 buildSackBlocks(uint8* buf, uint32 max_blocks) const;
 
   void adjustMTU();
 
+  // Updates the receiver's round-trip estimate, |m_rcv_rtt|, after in-order
+  // data has arrived.
+  void measureReceiveRtt(uint32 now);
+  // Grows the receive buffer if the application has been reading more than
+  // half of it every round trip.
+  void autotuneReceiveBuffer(uint32 now);
+  // Grows the send buffer so it can hold two windows' worth of data.
+  void autotuneSendBuffer();
+
  protected:
   // This method is used in test only to query receive buffer state.
   bool isReceiveBufferFull() const;
@@ -184,6 +228,10 @@ class PseudoTcp {
   // support for testing backward compatibility.
   void disableWindowScale();
 
+  // This method is only used in tests, to disable selective acknowledgements
+  // for testing backward compatibility.
+  void disableSack();
+
  private:
   // Queue the connect message with TCP options.
   void queueConnectMessage();
@@ -215,8 +263,8 @@ class PseudoTcp {
   uint32 m_lasttraffic;
 
   // Incoming data
-  typedef std::list<RSegment> RList;
   RList m_rlist;
+  uint32 m_rlist_recent;  // Start of the last segment added to |m_rlist|.
   uint32 m_rbuf_len, m_rcv_nxt, m_rcv_wnd, m_lastrecv;
   uint8 m_rwnd_scale;  // Window scale factor.
   talk_base::FifoBuffer m_rbuf;
@@ -239,11 +287,24 @@ class PseudoTcp {
   uint32 m_rx_rttvar, m_rx_srtt, m_rx_rto;
 
   // Congestion avoidance, Fast retransmit/recovery, Delayed ACKs
-  uint32 m_ssthresh, m_cwnd;
-  uint8 m_dup_acks;
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> m_cc;
+  uint32 m_dup_acks;
   uint32 m_recover;
   uint32 m_t_ack;
 
+  // Selective acknowledgement: whether the peer agreed to it, the highest
+  // sequence number it has selectively acknowledged, and the point up to
+  // which lost segments have been retransmitted during the current recovery.
+  bool m_sack_enabled;
+  uint32 m_sack_high, m_sack_rexmit;
+
+  // Buffer auto-tuning: the size the buffers may grow to, the receiver's
+  // round-trip estimate (the time it takes to receive a window's worth of
+  // data), and the bytes the application read since |m_rcv_copied_time|.
+  uint32 m_autotune_max;
+  uint32 m_rcv_rtt, m_rcv_rtt_seq, m_rcv_rtt_time;
+  uint32 m_rcv_copied, m_rcv_copied_time;
+
   // Configuration options
   bool m_use_nagling;
   uint32 m_ack_delay;
@@ -251,6 +312,10 @@ class PseudoTcp {
   // This is used by unit tests to test backward compatibility of
   // PseudoTcp implementations that don't support window scaling.
   bool m_support_wnd_scale;
+
+  // This is used by unit tests to test backward compatibility of
+  // PseudoTcp implementations that don't support selective acknowledgements.
+  bool m_support_sack;
 };
 
 }  // namespace cricket
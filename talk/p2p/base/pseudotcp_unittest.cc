@@ -27,12 +27,16 @@
 
 #include <vector>
 
+#include "talk/base/asyncudpsocket.h"
 #include "talk/base/gunit.h"
 #include "talk/base/helpers.h"
 #include "talk/base/messagehandler.h"
+#include "talk/base/physicalsocketserver.h"
+#include "talk/base/scoped_ptr.h"
 #include "talk/base/stream.h"
 #include "talk/base/thread.h"
 #include "talk/base/timeutils.h"
+#include "talk/base/virtualsocketserver.h"
 #include "talk/p2p/base/pseudotcp.h"
 
 using cricket::PseudoTcp;
@@ -54,6 +58,10 @@ class PseudoTcpForTest : public cricket::PseudoTcp {
   void disableWindowScale() {
     PseudoTcp::disableWindowScale();
   }
+
+  void disableSack() {
+    PseudoTcp::disableSack();
+  }
 };
 
 class PseudoTcpTestBase : public testing::Test,
@@ -114,6 +122,33 @@ class PseudoTcpTestBase : public testing::Test,
   void DisableLocalWindowScale() {
     local_.disableWindowScale();
   }
+  void DisableRemoteSack() {
+    remote_.disableSack();
+  }
+  void DisableLocalSack() {
+    local_.disableSack();
+  }
+  void SetOptCongestionControl(cricket::CongestionControlType type) {
+    local_.SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, type);
+    remote_.SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, type);
+  }
+  void SetOptAutotuneMax(int size) {
+    local_.SetOption(PseudoTcp::OPT_AUTOTUNE_MAX, size);
+    remote_.SetOption(PseudoTcp::OPT_AUTOTUNE_MAX, size);
+  }
+  void SetLocalOptAutotuneMax(int size) {
+    local_.SetOption(PseudoTcp::OPT_AUTOTUNE_MAX, size);
+  }
+  int GetLocalOption(PseudoTcp::Option opt) {
+    int value = 0;
+    local_.GetOption(opt, &value);
+    return value;
+  }
+  int GetRemoteOption(PseudoTcp::Option opt) {
+    int value = 0;
+    remote_.GetOption(opt, &value);
+    return value;
+  }
 
  protected:
   int Connect() {
@@ -330,6 +365,61 @@ class PseudoTcpTest : public PseudoTcpTestBase {
   talk_base::MemoryStream recv_stream_;
 };
 
+// Runs the transfers over UDP sockets on a VirtualSocketServer, so that the
+// delay and loss come from the simulated network rather than from the test
+// harness.
+class PseudoTcpTestVirtualNetwork : public PseudoTcpTest,
+                                    public sigslot::has_slots<> {
+ public:
+  PseudoTcpTestVirtualNetwork()
+      : pss_(new talk_base::PhysicalSocketServer),
+        vss_(new talk_base::VirtualSocketServer(pss_.get())),
+        ss_scope_(vss_.get()),
+        local_socket_(talk_base::AsyncUDPSocket::Create(
+            vss_.get(), talk_base::SocketAddress("1.1.1.1", 1000))),
+        remote_socket_(talk_base::AsyncUDPSocket::Create(
+            vss_.get(), talk_base::SocketAddress("2.2.2.2", 2000))) {
+    local_socket_->SignalReadPacket.connect(
+        this, &PseudoTcpTestVirtualNetwork::OnReadPacket);
+    remote_socket_->SignalReadPacket.connect(
+        this, &PseudoTcpTestVirtualNetwork::OnReadPacket);
+  }
+  // Sets the round-trip time in milliseconds and the packet loss in percent.
+  void SetNetwork(int rtt, int loss) {
+    vss_->set_delay_mean(rtt / 2);
+    vss_->UpdateDelayDistribution();
+    vss_->set_drop_probability(loss / 100.0);
+  }
+
+ protected:
+  virtual WriteResult TcpWritePacket(PseudoTcp* tcp,
+                                     const char* buffer, size_t len) {
+    if (tcp == &local_) {
+      local_socket_->SendTo(buffer, len, remote_socket_->GetLocalAddress());
+    } else {
+      remote_socket_->SendTo(buffer, len, local_socket_->GetLocalAddress());
+    }
+    return WR_SUCCESS;
+  }
+  void OnReadPacket(talk_base::AsyncPacketSocket* socket,
+                    const char* data, size_t size,
+                    const talk_base::SocketAddress& remote_addr) {
+    if (socket == local_socket_.get()) {
+      local_.NotifyPacket(data, size);
+      UpdateLocalClock();
+    } else {
+      remote_.NotifyPacket(data, size);
+      UpdateRemoteClock();
+    }
+  }
+
+ private:
+  talk_base::scoped_ptr<talk_base::PhysicalSocketServer> pss_;
+  talk_base::scoped_ptr<talk_base::VirtualSocketServer> vss_;
+  talk_base::SocketServerScope ss_scope_;
+  talk_base::scoped_ptr<talk_base::AsyncUDPSocket> local_socket_;
+  talk_base::scoped_ptr<talk_base::AsyncUDPSocket> remote_socket_;
+};
 
 class PseudoTcpTestPingPong : public PseudoTcpTestBase {
  public:
@@ -723,6 +813,61 @@ TEST_F(PseudoTcpTest, TestSendBothUseLargeWindowScale) {
   TestTransfer(10000000);
 }
 
+// Test that both sides agree on selective acknowledgements and that they
+// keep a lossy transfer going.
+TEST_F(PseudoTcpTest, TestSendWithLossAndSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLoss(10);
+  TestTransfer(100000);
+  EXPECT_TRUE(local_.IsSackEnabled());
+  EXPECT_TRUE(remote_.IsSackEnabled());
+}
+
+// Test a lossy transfer with a receiver that doesn't support selective
+// acknowledgements.
+TEST_F(PseudoTcpTest, TestSendWithLossRemoteNoSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLoss(10);
+  DisableRemoteSack();
+  TestTransfer(100000);
+  EXPECT_FALSE(local_.IsSackEnabled());
+  EXPECT_FALSE(remote_.IsSackEnabled());
+}
+
+// Test a lossy transfer with a sender that doesn't support selective
+// acknowledgements.
+TEST_F(PseudoTcpTest, TestSendWithLossLocalNoSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLoss(10);
+  DisableLocalSack();
+  TestTransfer(100000);
+  EXPECT_FALSE(local_.IsSackEnabled());
+  EXPECT_FALSE(remote_.IsSackEnabled());
+}
+
+// Test sending data with a 50 ms RTT and 10% packet loss using CUBIC.
+TEST_F(PseudoTcpTest, TestSendWithDelayAndLossCubic) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  SetOptCongestionControl(cricket::CC_CUBIC);
+  TestTransfer(100000);  // less data so test runs faster
+}
+
+// Test using a large window scale value with CUBIC.
+TEST_F(PseudoTcpTest, TestSendBothUseLargeWindowScaleCubic) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetRemoteOptRcvBuf(1000000);
+  SetLocalOptRcvBuf(1000000);
+  SetOptCongestionControl(cricket::CC_CUBIC);
+  TestTransfer(10000000);
+}
+
 // Test using a small receive buffer.
 TEST_F(PseudoTcpTest, TestSendSmallReceiveBuffer) {
   SetLocalMtu(1500);
@@ -741,6 +886,81 @@ TEST_F(PseudoTcpTest, TestSendVerySmallReceiveBuffer) {
   TestTransfer(100000);
 }
 
+// Test that auto-tuning grows the receiver's window and the sender's buffer
+// past their defaults when the path needs it.
+TEST_F(PseudoTcpTest, TestSendWithDelayAndAutotune) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetOptAutotuneMax(1024 * 1024);
+  TestTransfer(2000000);
+  EXPECT_EQ(1024 * 1024, GetLocalOption(PseudoTcp::OPT_AUTOTUNE_MAX));
+  EXPECT_GT(GetRemoteOption(PseudoTcp::OPT_RCVBUF), 60 * 1024);
+  EXPECT_GT(GetLocalOption(PseudoTcp::OPT_SNDBUF), 90 * 1024);
+  EXPECT_LE(GetRemoteOption(PseudoTcp::OPT_RCVBUF), 1024 * 1024);
+  EXPECT_LE(GetLocalOption(PseudoTcp::OPT_SNDBUF), 1024 * 1024);
+}
+
+// Test that auto-tuning is turned off when the peer can't scale its window.
+TEST_F(PseudoTcpTest, TestSendWithAutotuneRemoteNoWindowScale) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLocalOptAutotuneMax(1024 * 1024);
+  DisableRemoteWindowScale();
+  TestTransfer(500000);
+  EXPECT_EQ(0, GetLocalOption(PseudoTcp::OPT_AUTOTUNE_MAX));
+  EXPECT_EQ(60 * 1024, GetLocalOption(PseudoTcp::OPT_RCVBUF));
+  EXPECT_EQ(90 * 1024, GetLocalOption(PseudoTcp::OPT_SNDBUF));
+}
+
+// Throughput tests over a simulated network with a 256 KB window, selective
+// acknowledgements and CUBIC. Each logs the throughput it achieved.
+
+TEST_F(PseudoTcpTestVirtualNetwork, TestThroughput50msRtt1PercentLoss) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLocalOptRcvBuf(256 * 1024);
+  SetRemoteOptRcvBuf(256 * 1024);
+  SetOptSndBuf(384 * 1024);
+  SetOptCongestionControl(cricket::CC_CUBIC);
+  SetNetwork(50, 1);
+  TestTransfer(1000000);
+}
+
+TEST_F(PseudoTcpTestVirtualNetwork, TestThroughput50msRtt5PercentLoss) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLocalOptRcvBuf(256 * 1024);
+  SetRemoteOptRcvBuf(256 * 1024);
+  SetOptSndBuf(384 * 1024);
+  SetOptCongestionControl(cricket::CC_CUBIC);
+  SetNetwork(50, 5);
+  TestTransfer(400000);
+}
+
+TEST_F(PseudoTcpTestVirtualNetwork, TestThroughput200msRtt1PercentLoss) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLocalOptRcvBuf(256 * 1024);
+  SetRemoteOptRcvBuf(256 * 1024);
+  SetOptSndBuf(384 * 1024);
+  SetOptCongestionControl(cricket::CC_CUBIC);
+  SetNetwork(200, 1);
+  TestTransfer(500000);
+}
+
+TEST_F(PseudoTcpTestVirtualNetwork, TestThroughput200msRtt5PercentLoss) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLocalOptRcvBuf(256 * 1024);
+  SetRemoteOptRcvBuf(256 * 1024);
+  SetOptSndBuf(384 * 1024);
+  SetOptCongestionControl(cricket::CC_CUBIC);
+  SetNetwork(200, 5);
+  TestTransfer(150000);
+}
+
 // Ping-pong (request/response) tests
 
 // Test sending <= 1x MTU of data in each ping/pong.  Should take <10ms.
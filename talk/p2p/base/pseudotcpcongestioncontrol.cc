@@ -0,0 +1,186 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "talk/p2p/base/pseudotcpcongestioncontrol.h"
+
+#include <cmath>
+
+#include "talk/base/common.h"
+#include "talk/base/timeutils.h"
+
+namespace cricket {
+
+// CUBIC parameters from RFC 8312, section 5.
+const double CUBIC_C = 0.4;
+const double CUBIC_BETA = 0.7;
+// Reno-equivalent additive increase, in segments per round trip, for a
+// multiplicative decrease of CUBIC_BETA (RFC 8312, section 4.2).
+const double CUBIC_ALPHA = 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA);
+
+PseudoTcpCongestionControl* PseudoTcpCongestionControl::Create(
+    CongestionControlType type) {
+  switch (type) {
+    case CC_RENO:
+      return new RenoCongestionControl();
+    case CC_CUBIC:
+      return new CubicCongestionControl();
+  }
+  return NULL;
+}
+
+PseudoTcpCongestionControl::PseudoTcpCongestionControl()
+    : mss_(0), cwnd_(0), ssthresh_(0) {
+}
+
+void PseudoTcpCongestionControl::Init(uint32 mss, uint32 ssthresh) {
+  mss_ = mss;
+  cwnd_ = 2 * mss;
+  ssthresh_ = ssthresh;
+}
+
+void PseudoTcpCongestionControl::OnMtuAdjusted(uint32 mss) {
+  mss_ = mss;
+  ssthresh_ = talk_base::_max(ssthresh_, 2 * mss_);
+  cwnd_ = talk_base::_max(cwnd_, mss_);
+}
+
+void PseudoTcpCongestionControl::OnMtuReduced(uint32 mss) {
+  mss_ = mss;
+  cwnd_ = 2 * mss_;
+}
+
+void PseudoTcpCongestionControl::OnIdle() {
+  cwnd_ = mss_;
+}
+
+void PseudoTcpCongestionControl::OnEnterRecovery(uint32 in_flight,
+                                                 uint32 now) {
+  OnCongestionEvent(in_flight, now);
+  // Account for the three segments that left the network (Fast Retransmit).
+  cwnd_ = ssthresh_ + 3 * mss_;
+}
+
+void PseudoTcpCongestionControl::OnDupAck() {
+  cwnd_ += mss_;
+}
+
+void PseudoTcpCongestionControl::OnPartialAck(uint32 acked) {
+  cwnd_ += mss_ - talk_base::_min(acked, cwnd_);
+}
+
+void PseudoTcpCongestionControl::OnExitRecovery(uint32 in_flight) {
+  cwnd_ = talk_base::_min(ssthresh_, in_flight + mss_);
+}
+
+void PseudoTcpCongestionControl::OnRetransmitTimeout(uint32 in_flight,
+                                                     uint32 now) {
+  OnCongestionEvent(in_flight, now);
+  cwnd_ = mss_;
+}
+
+//////////////////////////////////////////////////////////////////////
+// RenoCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+void RenoCongestionControl::OnAck(uint32 acked, uint32 srtt, uint32 now) {
+  // Slow start, congestion avoidance
+  if (cwnd_ < ssthresh_) {
+    cwnd_ += mss_;
+  } else {
+    cwnd_ += talk_base::_max<uint32>(1, mss_ * mss_ / cwnd_);
+  }
+}
+
+void RenoCongestionControl::OnCongestionEvent(uint32 in_flight, uint32 now) {
+  ssthresh_ = talk_base::_max(in_flight / 2, 2 * mss_);
+}
+
+//////////////////////////////////////////////////////////////////////
+// CubicCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+CubicCongestionControl::CubicCongestionControl()
+    : epoch_start_(0), w_max_(0), k_(0), origin_(0), w_tcp_(0) {
+}
+
+void CubicCongestionControl::OnIdle() {
+  PseudoTcpCongestionControl::OnIdle();
+  epoch_start_ = 0;
+}
+
+void CubicCongestionControl::OnAck(uint32 acked, uint32 srtt, uint32 now) {
+  if (cwnd_ < ssthresh_) {
+    cwnd_ += mss_;
+    return;
+  }
+
+  double cwnd = static_cast<double>(cwnd_) / mss_;
+  if (epoch_start_ == 0) {
+    epoch_start_ = now;
+    if (cwnd < w_max_) {
+      k_ = std::pow((w_max_ - cwnd) / CUBIC_C, 1.0 / 3);
+      origin_ = w_max_;
+    } else {
+      k_ = 0;
+      origin_ = cwnd;
+    }
+    w_tcp_ = cwnd;
+  }
+
+  // Aim for where the cubic function will be one round trip from now.
+  double t = (talk_base::TimeDiff(now, epoch_start_) + srtt) / 1000.0;
+  double target = origin_ + CUBIC_C * (t - k_) * (t - k_) * (t - k_);
+
+  w_tcp_ += CUBIC_ALPHA * acked / mss_ / cwnd;
+  target = talk_base::_max(target, w_tcp_);
+  target = talk_base::_min(target, 1.5 * cwnd);
+
+  if (target > cwnd) {
+    cwnd_ += talk_base::_max<uint32>(
+        1, static_cast<uint32>((target - cwnd) / cwnd * acked));
+  } else {
+    cwnd_ += talk_base::_max<uint32>(1, mss_ * mss_ / (100 * cwnd_));
+  }
+}
+
+void CubicCongestionControl::OnCongestionEvent(uint32 in_flight, uint32 now) {
+  epoch_start_ = 0;
+  double w = static_cast<double>(in_flight) / mss_;
+  // Fast convergence: if the window is shrinking, give up some of it so that
+  // newer flows can catch up.
+  if (w < w_max_) {
+    w_max_ = w * (1 + CUBIC_BETA) / 2;
+  } else {
+    w_max_ = w;
+  }
+  ssthresh_ = talk_base::_max(static_cast<uint32>(in_flight * CUBIC_BETA),
+                              2 * mss_);
+}
+
+}  // namespace cricket
@@ -0,0 +1,155 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef TALK_P2P_BASE_PSEUDOTCPCONGESTIONCONTROL_H_
+#define TALK_P2P_BASE_PSEUDOTCPCONGESTIONCONTROL_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+
+namespace cricket {
+
+// The congestion control algorithms PseudoTcp can use.
+enum CongestionControlType {
+  CC_RENO,   // NewReno (RFC 5681/6582). The default.
+  CC_CUBIC,  // CUBIC (RFC 8312).
+};
+
+// Decides how much data PseudoTcp may have in flight. The controller owns the
+// congestion window and the slow start threshold, both in bytes. PseudoTcp
+// keeps the loss detection and recovery state, and reports acks and losses
+// here. The recovery mechanics (window inflation while duplicate acks arrive,
+// deflation on partial acks) are shared; implementations decide how the
+// window grows and how far it is cut on a congestion event.
+class PseudoTcpCongestionControl {
+ public:
+  // Returns NULL if |type| is unknown.
+  static PseudoTcpCongestionControl* Create(CongestionControlType type);
+
+  virtual ~PseudoTcpCongestionControl() {}
+
+  virtual CongestionControlType type() const = 0;
+
+  uint32 cwnd() const { return cwnd_; }
+  uint32 ssthresh() const { return ssthresh_; }
+  uint32 mss() const { return mss_; }
+
+  // Starts over with an initial window of two segments.
+  void Init(uint32 mss, uint32 ssthresh);
+  // Until the first loss, the slow start threshold follows the receive buffer.
+  void set_ssthresh(uint32 ssthresh) { ssthresh_ = ssthresh; }
+
+  // Called when the path MTU has been (re)discovered. Keeps the window at no
+  // less than a segment.
+  void OnMtuAdjusted(uint32 mss);
+  // Called when a packet turned out to be too large for the path.
+  void OnMtuReduced(uint32 mss);
+  // Called when nothing has been sent for longer than the retransmit timeout.
+  virtual void OnIdle();
+
+  // Called when |acked| new bytes are acknowledged outside of recovery.
+  // |srtt| is the smoothed round-trip time in milliseconds.
+  virtual void OnAck(uint32 acked, uint32 srtt, uint32 now) = 0;
+
+  // Called on the third duplicate ack, with |in_flight| bytes outstanding.
+  void OnEnterRecovery(uint32 in_flight, uint32 now);
+  // Called for every further duplicate ack while in recovery.
+  void OnDupAck();
+  // Called when an ack during recovery covers some but not all of the data
+  // that was outstanding when recovery began.
+  void OnPartialAck(uint32 acked);
+  // Called when recovery completes with |in_flight| bytes outstanding.
+  void OnExitRecovery(uint32 in_flight);
+  // Called when the retransmit timer fires.
+  void OnRetransmitTimeout(uint32 in_flight, uint32 now);
+
+ protected:
+  PseudoTcpCongestionControl();
+
+  // Called on every loss (duplicate acks or a timeout). Must lower
+  // |ssthresh_|; the caller then sets |cwnd_| from it.
+  virtual void OnCongestionEvent(uint32 in_flight, uint32 now) = 0;
+
+  uint32 mss_;
+  uint32 cwnd_;
+  uint32 ssthresh_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PseudoTcpCongestionControl);
+};
+
+// Slow start, then one segment per round trip; halves on loss.
+class RenoCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  RenoCongestionControl() {}
+
+  virtual CongestionControlType type() const { return CC_RENO; }
+  virtual void OnAck(uint32 acked, uint32 srtt, uint32 now);
+
+ protected:
+  virtual void OnCongestionEvent(uint32 in_flight, uint32 now);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RenoCongestionControl);
+};
+
+// Grows the window as a cubic function of the time since the last loss, so
+// it climbs back to the window where loss occurred quickly regardless of the
+// round-trip time, probes carefully around it, and then speeds up again. It
+// never grows slower than Reno would (the "TCP-friendly" region), and it
+// only backs off by 30% on loss.
+class CubicCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  CubicCongestionControl();
+
+  virtual CongestionControlType type() const { return CC_CUBIC; }
+  virtual void OnIdle();
+  virtual void OnAck(uint32 acked, uint32 srtt, uint32 now);
+
+ protected:
+  virtual void OnCongestionEvent(uint32 in_flight, uint32 now);
+
+ private:
+  // Start of the current growth epoch in ms, or 0 if none has started.
+  uint32 epoch_start_;
+  // Window before the last loss, in segments.
+  double w_max_;
+  // Time in seconds for the cubic function to reach |origin_|.
+  double k_;
+  // Window the cubic function is centred on, in segments.
+  double origin_;
+  // Estimate of what Reno's window would be, in segments.
+  double w_tcp_;
+
+  DISALLOW_COPY_AND_ASSIGN(CubicCongestionControl);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_PSEUDOTCPCONGESTIONCONTROL_H_
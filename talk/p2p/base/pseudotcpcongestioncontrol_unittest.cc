@@ -0,0 +1,150 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "talk/base/gunit.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/p2p/base/pseudotcpcongestioncontrol.h"
+
+using cricket::PseudoTcpCongestionControl;
+
+static const uint32 kMss = 1000;
+
+// Creates a controller of the given type that is out of slow start with a
+// window of |segments| segments.
+static PseudoTcpCongestionControl* CreateAtWindow(
+    cricket::CongestionControlType type, uint32 segments) {
+  PseudoTcpCongestionControl* cc = PseudoTcpCongestionControl::Create(type);
+  cc->Init(kMss, 2 * kMss);
+  while (cc->cwnd() < segments * kMss) {
+    cc->OnDupAck();
+  }
+  return cc;
+}
+
+TEST(PseudoTcpCongestionControlTest, TestCreate) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> reno(
+      PseudoTcpCongestionControl::Create(cricket::CC_RENO));
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cubic(
+      PseudoTcpCongestionControl::Create(cricket::CC_CUBIC));
+  ASSERT_TRUE(reno.get() != NULL);
+  ASSERT_TRUE(cubic.get() != NULL);
+  EXPECT_EQ(cricket::CC_RENO, reno->type());
+  EXPECT_EQ(cricket::CC_CUBIC, cubic->type());
+
+  reno->Init(kMss, 60 * kMss);
+  EXPECT_EQ(2 * kMss, reno->cwnd());
+  EXPECT_EQ(60 * kMss, reno->ssthresh());
+}
+
+// Test that both grow the window by a segment per ack in slow start.
+TEST(PseudoTcpCongestionControlTest, TestSlowStart) {
+  for (int type = cricket::CC_RENO; type <= cricket::CC_CUBIC; ++type) {
+    talk_base::scoped_ptr<PseudoTcpCongestionControl> cc(
+        PseudoTcpCongestionControl::Create(
+            static_cast<cricket::CongestionControlType>(type)));
+    cc->Init(kMss, 60 * kMss);
+    for (int i = 0; i < 10; ++i) {
+      cc->OnAck(kMss, 100, 1000 + i);
+    }
+    EXPECT_EQ(12 * kMss, cc->cwnd());
+  }
+}
+
+// Test that Reno halves the window on loss, and CUBIC only backs off by 30%.
+TEST(PseudoTcpCongestionControlTest, TestCongestionEvent) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> reno(
+      CreateAtWindow(cricket::CC_RENO, 100));
+  reno->OnEnterRecovery(100 * kMss, 1000);
+  EXPECT_EQ(50 * kMss, reno->ssthresh());
+  EXPECT_EQ(53 * kMss, reno->cwnd());
+  reno->OnExitRecovery(40 * kMss);
+  EXPECT_EQ(41 * kMss, reno->cwnd());
+
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cubic(
+      CreateAtWindow(cricket::CC_CUBIC, 100));
+  cubic->OnEnterRecovery(100 * kMss, 1000);
+  EXPECT_EQ(70 * kMss, cubic->ssthresh());
+  EXPECT_EQ(73 * kMss, cubic->cwnd());
+
+  cubic->OnRetransmitTimeout(100 * kMss, 2000);
+  EXPECT_EQ(kMss, cubic->cwnd());
+  EXPECT_LE(2 * kMss, cubic->ssthresh());
+}
+
+// Test that after a loss on a long path CUBIC gets back to the old window
+// within a few seconds, while Reno needs a round trip per segment.
+TEST(PseudoTcpCongestionControlTest, TestCubicRecoversWindow) {
+  const uint32 kRtt = 200;
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> reno(
+      CreateAtWindow(cricket::CC_RENO, 100));
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cubic(
+      CreateAtWindow(cricket::CC_CUBIC, 100));
+  reno->OnEnterRecovery(100 * kMss, 1000);
+  reno->OnExitRecovery(100 * kMss);
+  cubic->OnEnterRecovery(100 * kMss, 1000);
+  cubic->OnExitRecovery(100 * kMss);
+
+  // Ack a window's worth of data every round trip, for 30 round trips.
+  uint32 now = 1000;
+  for (int rtt = 0; rtt < 30; ++rtt) {
+    now += kRtt;
+    uint32 segments = reno->cwnd() / kMss;
+    for (uint32 i = 0; i < segments; ++i) {
+      reno->OnAck(kMss, kRtt, now);
+    }
+    segments = cubic->cwnd() / kMss;
+    for (uint32 i = 0; i < segments; ++i) {
+      cubic->OnAck(kMss, kRtt, now);
+    }
+  }
+  EXPECT_GT(100 * kMss, reno->cwnd());
+  EXPECT_LE(100 * kMss, cubic->cwnd());
+}
+
+// Test that a window reduced by back-to-back losses converges downwards.
+TEST(PseudoTcpCongestionControlTest, TestCubicFastConvergence) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cubic(
+      CreateAtWindow(cricket::CC_CUBIC, 100));
+  cubic->OnEnterRecovery(100 * kMss, 1000);
+  cubic->OnExitRecovery(100 * kMss);
+  cubic->OnEnterRecovery(70 * kMss, 2000);
+  cubic->OnExitRecovery(70 * kMss);
+  EXPECT_EQ(49 * kMss, cubic->ssthresh());
+
+  // The window now plateaus at (1 + beta) / 2 of the 70 segments, not at 70.
+  uint32 now = 2000;
+  for (int rtt = 0; rtt < 10; ++rtt) {
+    now += 100;
+    uint32 segments = cubic->cwnd() / kMss;
+    for (uint32 i = 0; i < segments; ++i) {
+      cubic->OnAck(kMss, 100, now);
+    }
+  }
+  EXPECT_GT(62 * kMss, cubic->cwnd());
+}
@@ -120,6 +120,8 @@ void RelayServer::AddInternalSocket(talk_base::AsyncPacketSocket* socket) {
       std::find(internal_sockets_.begin(), internal_sockets_.end(), socket));
   internal_sockets_.push_back(socket);
   socket->SignalReadPacket.connect(this, &RelayServer::OnInternalPacket);
+  socket->SignalReadPacketBatch.connect(this,
+                                        &RelayServer::OnInternalPacketBatch);
 }
 
 void RelayServer::RemoveInternalSocket(talk_base::AsyncPacketSocket* socket) {
@@ -128,6 +130,7 @@ void RelayServer::RemoveInternalSocket(talk_base::AsyncPacketSocket* socket) {
   ASSERT(iter != internal_sockets_.end());
   internal_sockets_.erase(iter);
   socket->SignalReadPacket.disconnect(this);
+  socket->SignalReadPacketBatch.disconnect(this);
 }
 
 void RelayServer::AddExternalSocket(talk_base::AsyncPacketSocket* socket) {
@@ -135,6 +138,8 @@ void RelayServer::AddExternalSocket(talk_base::AsyncPacketSocket* socket) {
       std::find(external_sockets_.begin(), external_sockets_.end(), socket));
   external_sockets_.push_back(socket);
   socket->SignalReadPacket.connect(this, &RelayServer::OnExternalPacket);
+  socket->SignalReadPacketBatch.connect(this,
+                                        &RelayServer::OnExternalPacketBatch);
 }
 
 void RelayServer::RemoveExternalSocket(talk_base::AsyncPacketSocket* socket) {
@@ -143,6 +148,7 @@ void RelayServer::RemoveExternalSocket(talk_base::AsyncPacketSocket* socket) {
   ASSERT(iter != external_sockets_.end());
   external_sockets_.erase(iter);
   socket->SignalReadPacket.disconnect(this);
+  socket->SignalReadPacketBatch.disconnect(this);
 }
 
 void RelayServer::AddInternalServerSocket(talk_base::AsyncSocket* socket,
@@ -195,9 +201,25 @@ void RelayServer::OnReadEvent(talk_base::AsyncSocket* socket) {
 void RelayServer::OnInternalPacket(
     talk_base::AsyncPacketSocket* socket, const char* bytes, size_t size,
     const talk_base::SocketAddress& remote_addr) {
-
   // Get the address of the connection we just received on.
   talk_base::SocketAddressPair ap(remote_addr, socket->GetLocalAddress());
+  HandleInternalPacket(socket, bytes, size, ap);
+}
+
+void RelayServer::OnInternalPacketBatch(
+    talk_base::AsyncPacketSocket* socket, const talk_base::Datagram* packets,
+    size_t count) {
+  // The local address is the same for the whole batch.
+  talk_base::SocketAddress local_addr = socket->GetLocalAddress();
+  for (size_t i = 0; i < count; ++i) {
+    talk_base::SocketAddressPair ap(packets[i].addr, local_addr);
+    HandleInternalPacket(socket, packets[i].data, packets[i].size, ap);
+  }
+}
+
+void RelayServer::HandleInternalPacket(
+    talk_base::AsyncPacketSocket* socket, const char* bytes, size_t size,
+    const talk_base::SocketAddressPair& ap) {
   ASSERT(!ap.destination().IsNil());
 
   // If this did not come from an existing connection, it should be a STUN
@@ -239,9 +261,24 @@ void RelayServer::OnInternalPacket(
 void RelayServer::OnExternalPacket(
     talk_base::AsyncPacketSocket* socket, const char* bytes, size_t size,
     const talk_base::SocketAddress& remote_addr) {
-
   // Get the address of the connection we just received on.
   talk_base::SocketAddressPair ap(remote_addr, socket->GetLocalAddress());
+  HandleExternalPacket(socket, bytes, size, ap);
+}
+
+void RelayServer::OnExternalPacketBatch(
+    talk_base::AsyncPacketSocket* socket, const talk_base::Datagram* packets,
+    size_t count) {
+  talk_base::SocketAddress local_addr = socket->GetLocalAddress();
+  for (size_t i = 0; i < count; ++i) {
+    talk_base::SocketAddressPair ap(packets[i].addr, local_addr);
+    HandleExternalPacket(socket, packets[i].data, packets[i].size, ap);
+  }
+}
+
+void RelayServer::HandleExternalPacket(
+    talk_base::AsyncPacketSocket* socket, const char* bytes, size_t size,
+    const talk_base::SocketAddressPair& ap) {
   ASSERT(!ap.destination().IsNil());
 
   // If this connection already exists, then forward the traffic.
@@ -107,6 +107,17 @@ class RelayServer : public talk_base::MessageHandler,
   void OnExternalPacket(talk_base::AsyncPacketSocket* socket,
                         const char* bytes, size_t size,
                         const talk_base::SocketAddress& remote_addr);
+  // Called with all the packets read from a socket in one go.
+  void OnInternalPacketBatch(talk_base::AsyncPacketSocket* socket,
+                             const talk_base::Datagram* packets, size_t count);
+  void OnExternalPacketBatch(talk_base::AsyncPacketSocket* socket,
+                             const talk_base::Datagram* packets, size_t count);
+  void HandleInternalPacket(talk_base::AsyncPacketSocket* socket,
+                            const char* bytes, size_t size,
+                            const talk_base::SocketAddressPair& ap);
+  void HandleExternalPacket(talk_base::AsyncPacketSocket* socket,
+                            const char* bytes, size_t size,
+                            const talk_base::SocketAddressPair& ap);
 
   void OnReadEvent(talk_base::AsyncSocket* socket);
 
@@ -51,6 +51,9 @@ int main(int argc, char **argv) {
   }
 
   talk_base::Thread *pthMain = talk_base::Thread::Current();
+  // Every binding keeps a timeout running; cancelling them from a heap gets
+  // slow with many bindings.
+  pthMain->SetDelayedStore(talk_base::MessageQueue::DELAYED_STORE_WHEEL);
 
   talk_base::scoped_ptr<talk_base::AsyncUDPSocket> int_socket(
       talk_base::AsyncUDPSocket::Create(pthMain->socketserver(), int_addr));
@@ -68,6 +71,10 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  // Drain several packets per wakeup on both sides of the relay.
+  int_socket->SetReceiveBatchSize(16);
+  ext_socket->SetReceiveBatchSize(16);
+
   cricket::RelayServer server(pthMain);
   server.AddInternalSocket(int_socket.get());
   server.AddExternalSocket(ext_socket.get());
@@ -63,12 +63,11 @@ StunMessage::StunMessage()
       length_(0),
       transaction_id_(EMPTY_TRANSACTION_ID) {
   ASSERT(IsValidTransactionId(transaction_id_));
-  attrs_ = new std::vector<StunAttribute*>();
+  attrs_ = new std::vector<AttributeEntry>();
 }
 
 StunMessage::~StunMessage() {
-  for (size_t i = 0; i < attrs_->size(); i++)
-    delete (*attrs_)[i];
+  ClearAttributes();
   delete attrs_;
 }
 
@@ -83,6 +82,14 @@ bool StunMessage::SetTransactionID(const std::string& str) {
   if (!IsValidTransactionId(str)) {
     return false;
   }
+  // XOR addresses that haven't been decoded yet depend on the old ID.
+  for (size_t i = 0; i < attrs_->size(); ++i) {
+    AttributeEntry& entry = (*attrs_)[i];
+    if (!entry.attr &&
+        GetAttributeValueType(entry.type) == STUN_VALUE_XOR_ADDRESS) {
+      Materialize(&entry);
+    }
+  }
   transaction_id_ = str;
   return true;
 }
@@ -92,7 +99,9 @@ bool StunMessage::AddAttribute(StunAttribute* attr) {
   if (attr->value_type() != GetAttributeValueType(attr->type())) {
     return false;
   }
-  attrs_->push_back(attr);
+  AttributeEntry entry = { static_cast<uint16>(attr->type()),
+                           static_cast<uint16>(attr->length()), 0, attr };
+  attrs_->push_back(entry);
   attr->SetOwner(this);
   size_t attr_length = attr->length();
   if (attr_length % 4 != 0) {
@@ -145,6 +154,12 @@ const StunUInt16ListAttribute* StunMessage::GetUnknownAttributes() const {
 // procedure outlined in RFC 5389, section 15.4.
 bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
                                            const std::string& password) {
+  return ValidateMessageIntegrity(data, size,
+                                  talk_base::HmacSha1Key(password));
+}
+
+bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
+                                           const talk_base::HmacSha1Key& key) {
   // Verifying the size of the message.
   if ((size % 4) != 0) {
     return false;
@@ -207,10 +222,7 @@ bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
   }
 
   char hmac[kStunMessageIntegritySize];
-  size_t ret = talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
-                                      password.c_str(), password.size(),
-                                      temp_data.get(), mi_pos,
-                                      hmac, sizeof(hmac));
+  size_t ret = key.Compute(temp_data.get(), mi_pos, hmac, sizeof(hmac));
   ASSERT(ret == sizeof(hmac));
   if (ret != sizeof(hmac))
     return false;
@@ -226,6 +238,10 @@ bool StunMessage::AddMessageIntegrity(const std::string& password) {
 
 bool StunMessage::AddMessageIntegrity(const char* key,
                                       size_t keylen) {
+  return AddMessageIntegrity(talk_base::HmacSha1Key(key, keylen));
+}
+
+bool StunMessage::AddMessageIntegrity(const talk_base::HmacSha1Key& key) {
   // Add the attribute with a dummy value. Since this is a known attribute, it
   // can't fail.
   StunByteStringAttribute* msg_integrity_attr =
@@ -241,10 +257,7 @@ bool StunMessage::AddMessageIntegrity(const char* key,
   int msg_len_for_hmac = buf.Length() -
       kStunAttributeHeaderSize - msg_integrity_attr->length();
   char hmac[kStunMessageIntegritySize];
-  size_t ret = talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
-                                      key, keylen,
-                                      buf.Data(), msg_len_for_hmac,
-                                      hmac, sizeof(hmac));
+  size_t ret = key.Compute(buf.Data(), msg_len_for_hmac, hmac, sizeof(hmac));
   ASSERT(ret == sizeof(hmac));
   if (ret != sizeof(hmac)) {
     LOG(LS_ERROR) << "HMAC computation failed. Message-Integrity "
@@ -342,32 +355,40 @@ bool StunMessage::Read(ByteBuffer* buf) {
   if (length_ != buf->Length())
     return false;
 
-  attrs_->resize(0);
+  // Keep one copy of the attributes and only record where each one is; the
+  // attribute objects are created on demand by Materialize.
+  ClearAttributes();
+  wire_.SetData(buf->Data(), length_);
+  buf->Consume(length_);
 
-  size_t rest = buf->Length() - length_;
-  while (buf->Length() > rest) {
-    uint16 attr_type, attr_length;
-    if (!buf->ReadUInt16(&attr_type))
-      return false;
-    if (!buf->ReadUInt16(&attr_length))
+  const char* data = wire_.data();
+  size_t pos = 0;
+  while (pos < length_) {
+    if (pos + kStunAttributeHeaderSize > length_)
       return false;
+    uint16 attr_type = talk_base::GetBE16(data + pos);
+    uint16 attr_length = talk_base::GetBE16(data + pos + sizeof(attr_type));
+    pos += kStunAttributeHeaderSize;
 
-    StunAttribute* attr = CreateAttribute(attr_type, attr_length);
-    if (!attr) {
-      // Skip any unknown or malformed attributes.
-      if ((attr_length % 4) != 0) {
-        attr_length += (4 - (attr_length % 4));
-      }
-      if (!buf->Consume(attr_length))
+    size_t padded_length = attr_length;
+    if ((padded_length % 4) != 0) {
+      padded_length += (4 - (padded_length % 4));
+    }
+    StunAttributeValueType value_type = GetAttributeValueType(attr_type);
+    if (value_type == STUN_VALUE_UNKNOWN) {
+      // Skip any unknown attributes.
+      if (pos + padded_length > length_)
         return false;
     } else {
-      if (!attr->Read(buf))
+      // The padding of the last attribute may be missing.
+      if (pos + attr_length > length_ ||
+          !IsValidAttribute(value_type, data + pos, attr_length))
         return false;
-      attrs_->push_back(attr);
+      AttributeEntry entry = { attr_type, attr_length, pos, NULL };
+      attrs_->push_back(entry);
     }
+    pos += padded_length;
   }
-
-  ASSERT(buf->Length() == rest);
   return true;
 }
 
@@ -379,9 +400,28 @@ bool StunMessage::Write(ByteBuffer* buf) const {
   buf->WriteString(transaction_id_);
 
   for (size_t i = 0; i < attrs_->size(); ++i) {
-    buf->WriteUInt16((*attrs_)[i]->type());
-    buf->WriteUInt16((*attrs_)[i]->length());
-    if (!(*attrs_)[i]->Write(buf))
+    AttributeEntry& entry = (*attrs_)[i];
+    if (!entry.attr) {
+      // Byte strings and integers are written exactly as they were read, so
+      // they can be copied without decoding them.
+      StunAttributeValueType value_type = GetAttributeValueType(entry.type);
+      if (value_type == STUN_VALUE_BYTE_STRING ||
+          value_type == STUN_VALUE_UINT32 ||
+          value_type == STUN_VALUE_UINT64) {
+        buf->WriteUInt16(entry.type);
+        buf->WriteUInt16(entry.length);
+        buf->WriteBytes(wire_.data() + entry.offset, entry.length);
+        if ((entry.length % 4) != 0) {
+          char zeroes[4] = {0};
+          buf->WriteBytes(zeroes, 4 - (entry.length % 4));
+        }
+        continue;
+      }
+    }
+    const StunAttribute* attr = Materialize(&entry);
+    buf->WriteUInt16(attr->type());
+    buf->WriteUInt16(attr->length());
+    if (!attr->Write(buf))
       return false;
   }
 
@@ -413,12 +453,77 @@ StunAttribute* StunMessage::CreateAttribute(int type, size_t length) /*const*/ {
 
 const StunAttribute* StunMessage::GetAttribute(int type) const {
   for (size_t i = 0; i < attrs_->size(); ++i) {
-    if ((*attrs_)[i]->type() == type)
-      return (*attrs_)[i];
+    if ((*attrs_)[i].type == type)
+      return Materialize(&(*attrs_)[i]);
   }
   return NULL;
 }
 
+StunAttribute* StunMessage::Materialize(AttributeEntry* entry) const {
+  if (entry->attr)
+    return entry->attr;
+
+  // Read has already checked the value, so none of this can fail.
+  const char* data = wire_.data() + entry->offset;
+  StunAttributeValueType value_type = GetAttributeValueType(entry->type);
+  switch (value_type) {
+    case STUN_VALUE_UINT32:
+      entry->attr = new StunUInt32Attribute(entry->type,
+                                            talk_base::GetBE32(data));
+      break;
+    case STUN_VALUE_UINT64:
+      entry->attr = new StunUInt64Attribute(entry->type,
+                                            talk_base::GetBE64(data));
+      break;
+    case STUN_VALUE_BYTE_STRING: {
+      StunByteStringAttribute* attr = new StunByteStringAttribute(entry->type);
+      attr->SetView(data, entry->length);
+      entry->attr = attr;
+      break;
+    }
+    default: {
+      StunMessage* owner = const_cast<StunMessage*>(this);
+      entry->attr = StunAttribute::Create(value_type, entry->type,
+                                          entry->length, owner);
+      ByteBuffer buf(data, entry->length);
+      VERIFY(entry->attr->Read(&buf));
+      break;
+    }
+  }
+  return entry->attr;
+}
+
+void StunMessage::ClearAttributes() {
+  for (size_t i = 0; i < attrs_->size(); ++i)
+    delete (*attrs_)[i].attr;
+  attrs_->clear();
+}
+
+// Performs the checks that the attribute's Read would, so that it can be
+// materialized later without failing.
+bool StunMessage::IsValidAttribute(StunAttributeValueType value_type,
+                                   const char* data, size_t length) {
+  switch (value_type) {
+    case STUN_VALUE_ADDRESS:
+    case STUN_VALUE_XOR_ADDRESS:
+      if (length == StunAddressAttribute::SIZE_IP4)
+        return static_cast<uint8>(data[1]) == STUN_ADDRESS_IPV4;
+      if (length == StunAddressAttribute::SIZE_IP6)
+        return static_cast<uint8>(data[1]) == STUN_ADDRESS_IPV6;
+      return false;
+    case STUN_VALUE_UINT32:
+      return length == StunUInt32Attribute::SIZE;
+    case STUN_VALUE_UINT64:
+      return length == StunUInt64Attribute::SIZE;
+    case STUN_VALUE_ERROR_CODE:
+      return length >= StunErrorCodeAttribute::MIN_SIZE;
+    case STUN_VALUE_UINT16_LIST:
+      return (length % 2) == 0;
+    default:
+      return true;
+  }
+}
+
 bool StunMessage::IsValidTransactionId(const std::string& transaction_id) {
   return transaction_id.size() == kStunTransactionIdLength ||
       transaction_id.size() == kStunLegacyTransactionIdLength;
@@ -702,28 +807,29 @@ bool StunUInt64Attribute::Write(ByteBuffer* buf) const {
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type)
-    : StunAttribute(type, 0), bytes_(NULL) {
+    : StunAttribute(type, 0), bytes_(NULL), owns_bytes_(true) {
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type,
                                                  const std::string& str)
-    : StunAttribute(type, 0), bytes_(NULL) {
+    : StunAttribute(type, 0), bytes_(NULL), owns_bytes_(true) {
   CopyBytes(str.c_str(), str.size());
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type,
                                                  const void* bytes,
                                                  size_t length)
-    : StunAttribute(type, 0), bytes_(NULL) {
+    : StunAttribute(type, 0), bytes_(NULL), owns_bytes_(true) {
   CopyBytes(bytes, length);
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type, uint16 length)
-    : StunAttribute(type, length), bytes_(NULL) {
+    : StunAttribute(type, length), bytes_(NULL), owns_bytes_(true) {
 }
 
 StunByteStringAttribute::~StunByteStringAttribute() {
-  delete [] bytes_;
+  if (owns_bytes_)
+    delete [] bytes_;
 }
 
 void StunByteStringAttribute::CopyBytes(const char* bytes) {
@@ -736,6 +842,14 @@ void StunByteStringAttribute::CopyBytes(const void* bytes, size_t length) {
   SetBytes(new_bytes, length);
 }
 
+void StunByteStringAttribute::SetView(const char* bytes, size_t length) {
+  if (owns_bytes_)
+    delete [] bytes_;
+  bytes_ = const_cast<char*>(bytes);
+  owns_bytes_ = false;
+  SetLength(static_cast<uint16>(length));
+}
+
 uint8 StunByteStringAttribute::GetByte(size_t index) const {
   ASSERT(bytes_ != NULL);
   ASSERT(index < length());
@@ -745,11 +859,16 @@ uint8 StunByteStringAttribute::GetByte(size_t index) const {
 void StunByteStringAttribute::SetByte(size_t index, uint8 value) {
   ASSERT(bytes_ != NULL);
   ASSERT(index < length());
+  if (!owns_bytes_)
+    CopyBytes(bytes_, length());
   bytes_[index] = value;
 }
 
 bool StunByteStringAttribute::Read(ByteBuffer* buf) {
+  if (owns_bytes_)
+    delete [] bytes_;
   bytes_ = new char[length()];
+  owns_bytes_ = true;
   if (!buf->ReadBytes(bytes_, length())) {
     return false;
   }
@@ -765,8 +884,10 @@ bool StunByteStringAttribute::Write(ByteBuffer* buf) const {
 }
 
 void StunByteStringAttribute::SetBytes(char* bytes, size_t length) {
-  delete [] bytes_;
+  if (owns_bytes_)
+    delete [] bytes_;
   bytes_ = bytes;
+  owns_bytes_ = true;
   SetLength(length);
 }
 
@@ -925,4 +1046,137 @@ bool ComputeStunCredentialHash(const std::string& username,
   return true;
 }
 
+static size_t PaddedLength(size_t length) {
+  return (length + 3) & ~static_cast<size_t>(3);
+}
+
+// Applies, or undoes, the XOR that XOR-*-ADDRESS attributes use to hide an
+// IP address: with the magic cookie, then with |transaction_id| for IPv6.
+static void XorIPBytes(char* ip, size_t length, const char* transaction_id) {
+  char mask[kStunMagicCookieLength + kStunTransactionIdLength];
+  talk_base::SetBE32(mask, kStunMagicCookie);
+  memcpy(mask + kStunMagicCookieLength, transaction_id,
+         kStunTransactionIdLength);
+  for (size_t i = 0; i < length; ++i) {
+    ip[i] ^= mask[i];
+  }
+}
+
+// Reads the value of an XOR-*-ADDRESS attribute, as StunXorAddressAttribute
+// does.
+static bool ReadXorAddress(const char* value, size_t length,
+                           const char* transaction_id,
+                           talk_base::SocketAddress* addr) {
+  if (length < 4)
+    return false;
+  if (value[1] == STUN_ADDRESS_IPV4 && length == 4 + sizeof(in_addr)) {
+    in_addr v4addr;
+    memcpy(&v4addr, value + 4, sizeof(v4addr));
+    XorIPBytes(reinterpret_cast<char*>(&v4addr), sizeof(v4addr),
+               transaction_id);
+    addr->SetIP(talk_base::IPAddress(v4addr));
+  } else if (value[1] == STUN_ADDRESS_IPV6 && length == 4 + sizeof(in6_addr)) {
+    in6_addr v6addr;
+    memcpy(&v6addr, value + 4, sizeof(v6addr));
+    XorIPBytes(reinterpret_cast<char*>(&v6addr), sizeof(v6addr),
+               transaction_id);
+    addr->SetIP(talk_base::IPAddress(v6addr));
+  } else {
+    return false;
+  }
+  addr->SetPort(talk_base::GetBE16(value + 2) ^ (kStunMagicCookie >> 16));
+  return true;
+}
+
+bool ReadTurnIndication(int type, const char* data, size_t size,
+                        talk_base::SocketAddress* peer,
+                        const char** payload, size_t* payload_size) {
+  if (size < kStunHeaderSize || talk_base::GetBE16(data) != type ||
+      talk_base::GetBE16(data + 2) + kStunHeaderSize != size ||
+      talk_base::GetBE32(data + 4) != kStunMagicCookie) {
+    return false;
+  }
+
+  const char* transaction_id = data + 8;
+  bool has_peer = false, has_payload = false;
+  size_t pos = kStunHeaderSize;
+  while (pos + kStunAttributeHeaderSize <= size) {
+    int attr_type = talk_base::GetBE16(data + pos);
+    size_t attr_length = talk_base::GetBE16(data + pos + 2);
+    const char* value = data + pos + kStunAttributeHeaderSize;
+    pos += kStunAttributeHeaderSize + PaddedLength(attr_length);
+    if (pos > size) {
+      return false;
+    }
+    if (attr_type == STUN_ATTR_XOR_PEER_ADDRESS && !has_peer) {
+      if (!ReadXorAddress(value, attr_length, transaction_id, peer))
+        return false;
+      has_peer = true;
+    } else if (attr_type == STUN_ATTR_DATA && !has_payload) {
+      *payload = value;
+      *payload_size = attr_length;
+      has_payload = true;
+    }
+  }
+  return pos == size && has_peer && has_payload;
+}
+
+bool WriteTurnIndication(int type, const std::string& transaction_id,
+                         const talk_base::SocketAddress& peer,
+                         const char* payload, size_t payload_size,
+                         const std::string& software,
+                         talk_base::ByteBuffer* buf) {
+  int family = peer.ipaddr().family();
+  if (transaction_id.size() != kStunTransactionIdLength ||
+      (family != AF_INET && family != AF_INET6)) {
+    return false;
+  }
+
+  char addr_value[4 + sizeof(in6_addr)];
+  size_t addr_length;
+  addr_value[0] = 0;
+  talk_base::SetBE16(addr_value + 2, peer.port() ^ (kStunMagicCookie >> 16));
+  if (family == AF_INET) {
+    addr_value[1] = STUN_ADDRESS_IPV4;
+    in_addr v4addr = peer.ipaddr().ipv4_address();
+    memcpy(addr_value + 4, &v4addr, sizeof(v4addr));
+    addr_length = 4 + sizeof(v4addr);
+  } else {
+    addr_value[1] = STUN_ADDRESS_IPV6;
+    in6_addr v6addr = peer.ipaddr().ipv6_address();
+    memcpy(addr_value + 4, &v6addr, sizeof(v6addr));
+    addr_length = 4 + sizeof(v6addr);
+  }
+  XorIPBytes(addr_value + 4, addr_length - 4, transaction_id.data());
+
+  size_t length = kStunAttributeHeaderSize + addr_length +
+      kStunAttributeHeaderSize + PaddedLength(payload_size);
+  if (!software.empty()) {
+    length += kStunAttributeHeaderSize + PaddedLength(software.size());
+  }
+  if (length > 0xFFFF) {
+    return false;
+  }
+
+  const char zeroes[4] = { 0 };
+  buf->WriteUInt16(type);
+  buf->WriteUInt16(static_cast<uint16>(length));
+  buf->WriteUInt32(kStunMagicCookie);
+  buf->WriteString(transaction_id);
+  buf->WriteUInt16(STUN_ATTR_XOR_PEER_ADDRESS);
+  buf->WriteUInt16(static_cast<uint16>(addr_length));
+  buf->WriteBytes(addr_value, addr_length);
+  buf->WriteUInt16(STUN_ATTR_DATA);
+  buf->WriteUInt16(static_cast<uint16>(payload_size));
+  buf->WriteBytes(payload, payload_size);
+  buf->WriteBytes(zeroes, PaddedLength(payload_size) - payload_size);
+  if (!software.empty()) {
+    buf->WriteUInt16(STUN_ATTR_SOFTWARE);
+    buf->WriteUInt16(static_cast<uint16>(software.size()));
+    buf->WriteString(software);
+    buf->WriteBytes(zeroes, PaddedLength(software.size()) - software.size());
+  }
+  return true;
+}
+
 }  // namespace cricket
@@ -35,7 +35,9 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/buffer.h"
 #include "talk/base/bytebuffer.h"
+#include "talk/base/hmacsha1key.h"
 #include "talk/base/socketaddress.h"
 
 namespace cricket {
@@ -144,6 +146,10 @@ class StunUInt16ListAttribute;
 // any number of attributes.  Each attribute is parsed into an instance of an
 // appropriate class (see above).  The Get* methods will return instances of
 // that attribute class.
+// Read keeps a single copy of the message and only records where each
+// attribute lies in it; the attribute objects are created the first time a
+// Get* method asks for them, and byte strings refer to that copy rather than
+// holding their own.
 class StunMessage {
  public:
   StunMessage();
@@ -183,9 +189,13 @@ class StunMessage {
   // padding data (which we discard when reading a StunMessage).
   static bool ValidateMessageIntegrity(const char* data, size_t size,
                                        const std::string& password);
+  // As above, with a key prepared once for checking many messages.
+  static bool ValidateMessageIntegrity(const char* data, size_t size,
+                                       const talk_base::HmacSha1Key& key);
   // Adds a MESSAGE-INTEGRITY attribute that is valid for the current message.
   bool AddMessageIntegrity(const std::string& password);
   bool AddMessageIntegrity(const char* key, size_t keylen);
+  bool AddMessageIntegrity(const talk_base::HmacSha1Key& key);
 
   // Verifies that a given buffer is STUN by checking for a correct FINGERPRINT.
   static bool ValidateFingerprint(const char* data, size_t size);
@@ -194,7 +204,8 @@ class StunMessage {
   bool AddFingerprint();
 
   // Parses the STUN packet in the given buffer and records it here. The
-  // return value indicates whether this was successful.
+  // return value indicates whether this was successful. Every attribute is
+  // validated here, so a Get* method never fails on a message that was read.
   bool Read(talk_base::ByteBuffer* buf);
 
   // Writes this object into a STUN packet. The return value indicates whether
@@ -209,14 +220,29 @@ class StunMessage {
   virtual StunAttributeValueType GetAttributeValueType(int type) const;
 
  private:
+  // An attribute of the message. For one found by Read, |offset| locates its
+  // value in |wire_| and |attr| stays NULL until it is first needed; one
+  // added with AddAttribute has |attr| set from the start.
+  struct AttributeEntry {
+    uint16 type;
+    uint16 length;
+    size_t offset;
+    StunAttribute* attr;
+  };
+
   StunAttribute* CreateAttribute(int type, size_t length) /* const*/;
   const StunAttribute* GetAttribute(int type) const;
+  StunAttribute* Materialize(AttributeEntry* entry) const;
+  void ClearAttributes();
+  static bool IsValidAttribute(StunAttributeValueType value_type,
+                               const char* data, size_t length);
   static bool IsValidTransactionId(const std::string& transaction_id);
 
   uint16 type_;
   uint16 length_;
   std::string transaction_id_;
-  std::vector<StunAttribute*>* attrs_;
+  std::vector<AttributeEntry>* attrs_;
+  talk_base::Buffer wire_;
 };
 
 // Base class for all STUN/TURN attributes.
@@ -411,6 +437,9 @@ class StunByteStringAttribute : public StunAttribute {
 
   void CopyBytes(const char* bytes);  // uses strlen
   void CopyBytes(const void* bytes, size_t length);
+  // Refers to |length| bytes owned by someone else, which must outlive this
+  // attribute or the next call that changes it; SetByte copies them first.
+  void SetView(const char* bytes, size_t length);
 
   uint8 GetByte(size_t index) const;
   void SetByte(size_t index, uint8 value);
@@ -422,6 +451,7 @@ class StunByteStringAttribute : public StunAttribute {
   void SetBytes(char* bytes, size_t length);
 
   char* bytes_;
+  bool owns_bytes_;
 };
 
 // Implements STUN attributes that record an error code.
@@ -614,6 +644,23 @@ class TurnMessage : public StunMessage {
   virtual StunMessage* CreateNew() const { return new TurnMessage(); }
 };
 
+// Finds the XOR-PEER-ADDRESS and DATA attributes of a TURN Send or Data
+// indication of |type| in place, without building a TurnMessage; relays use
+// this for every indication they forward. On success, |*payload| points
+// into |data|. Returns false if the message isn't such an indication, or is
+// malformed, or lacks either attribute.
+bool ReadTurnIndication(int type, const char* data, size_t size,
+                        talk_base::SocketAddress* peer,
+                        const char** payload, size_t* payload_size);
+// Writes the same message as a TurnMessage of |type| with XOR-PEER-ADDRESS,
+// DATA and, if |software| isn't empty, SOFTWARE attributes, but without
+// allocating any attribute objects.
+bool WriteTurnIndication(int type, const std::string& transaction_id,
+                         const talk_base::SocketAddress& peer,
+                         const char* payload, size_t payload_size,
+                         const std::string& software,
+                         talk_base::ByteBuffer* buf);
+
 // RFC 5245 ICE STUN attributes.
 enum IceAttributeType {
   STUN_ATTR_PRIORITY                    = 0x0024,  // UInt32
@@ -33,6 +33,7 @@
 #include "talk/base/messagedigest.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketaddress.h"
+#include "talk/base/timeutils.h"
 #include "talk/p2p/base/stun.h"
 
 namespace cricket {
@@ -1464,4 +1465,283 @@ TEST_F(StunTest, ReadRelayMessage) {
   EXPECT_EQ(0, std::memcmp(outstring2.c_str(), input, len2));
 }
 
+// Send and Data indications written by WriteTurnIndication must match what
+// TurnMessage writes, and ReadTurnIndication must read both.
+static void CheckTurnIndication(const talk_base::SocketAddress& peer) {
+  const std::string transaction_id(
+      reinterpret_cast<const char*>(kTestTransactionId1),
+      kStunTransactionIdLength);
+  TurnMessage msg;
+  msg.SetType(TURN_DATA_INDICATION);
+  msg.SetTransactionID(transaction_id);
+  EXPECT_TRUE(msg.AddAttribute(new StunXorAddressAttribute(
+      STUN_ATTR_XOR_PEER_ADDRESS, peer)));
+  EXPECT_TRUE(msg.AddAttribute(new StunByteStringAttribute(
+      STUN_ATTR_DATA, "abcdefg")));
+  EXPECT_TRUE(msg.AddAttribute(new StunByteStringAttribute(
+      STUN_ATTR_SOFTWARE, "sw")));
+  talk_base::ByteBuffer expected;
+  EXPECT_TRUE(msg.Write(&expected));
+
+  talk_base::ByteBuffer out;
+  EXPECT_TRUE(WriteTurnIndication(TURN_DATA_INDICATION, transaction_id, peer,
+                                  "abcdefg", 7, "sw", &out));
+  ASSERT_EQ(expected.Length(), out.Length());
+  EXPECT_EQ(0, memcmp(expected.Data(), out.Data(), out.Length()));
+
+  talk_base::SocketAddress read_peer;
+  const char* payload;
+  size_t payload_size;
+  ASSERT_TRUE(ReadTurnIndication(TURN_DATA_INDICATION, out.Data(),
+                                 out.Length(), &read_peer, &payload,
+                                 &payload_size));
+  EXPECT_EQ(peer, read_peer);
+  EXPECT_EQ("abcdefg", std::string(payload, payload_size));
+  // The payload is read in place.
+  EXPECT_TRUE(payload > out.Data() && payload < out.Data() + out.Length());
+
+  // Wrong type, or a truncated message, is not read.
+  EXPECT_FALSE(ReadTurnIndication(TURN_SEND_INDICATION, out.Data(),
+                                  out.Length(), &read_peer, &payload,
+                                  &payload_size));
+  EXPECT_FALSE(ReadTurnIndication(TURN_DATA_INDICATION, out.Data(),
+                                  out.Length() - 4, &read_peer, &payload,
+                                  &payload_size));
+}
+
+TEST_F(StunTest, ReadWriteTurnIndication) {
+  CheckTurnIndication(talk_base::SocketAddress(
+      talk_base::IPAddress(kIPv4TestAddress1), kTestMessagePort1));
+  CheckTurnIndication(talk_base::SocketAddress(
+      talk_base::IPAddress(kIPv6TestAddress1), kTestMessagePort1));
+
+  // An indication without DATA is not read.
+  TurnMessage msg;
+  msg.SetType(TURN_SEND_INDICATION);
+  msg.SetTransactionID("ABCDABCDABCD");
+  EXPECT_TRUE(msg.AddAttribute(new StunXorAddressAttribute(
+      STUN_ATTR_XOR_PEER_ADDRESS, talk_base::SocketAddress(
+          talk_base::IPAddress(kIPv4TestAddress1), kTestMessagePort1))));
+  talk_base::ByteBuffer out;
+  EXPECT_TRUE(msg.Write(&out));
+  talk_base::SocketAddress peer;
+  const char* payload;
+  size_t payload_size;
+  EXPECT_FALSE(ReadTurnIndication(TURN_SEND_INDICATION, out.Data(),
+                                  out.Length(), &peer, &payload,
+                                  &payload_size));
+}
+
+TEST_F(StunTest, SetTransactionIDAfterRead) {
+  // An XOR address that hasn't been looked at yet must still be decoded with
+  // the transaction ID it was read with.
+  StunMessage msg;
+  ReadStunMessage(&msg, kStunMessageWithIPv6XorMappedAddress);
+  EXPECT_TRUE(msg.SetTransactionID("ABCDABCDABCD"));
+  const StunAddressAttribute* addr =
+      msg.GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS);
+  CheckStunAddressAttribute(addr, STUN_ADDRESS_IPV6, kTestMessagePort1,
+                            talk_base::IPAddress(kIPv6TestAddress1));
+
+  // And it is written with the new one.
+  talk_base::ByteBuffer out;
+  EXPECT_TRUE(msg.Write(&out));
+  StunMessage msg2;
+  EXPECT_TRUE(msg2.Read(&out));
+  EXPECT_EQ("ABCDABCDABCD", msg2.transaction_id());
+  addr = msg2.GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS);
+  CheckStunAddressAttribute(addr, STUN_ADDRESS_IPV6, kTestMessagePort1,
+                            talk_base::IPAddress(kIPv6TestAddress1));
+}
+
+TEST_F(StunTest, ReadByteStringAsView) {
+  StunMessage msg;
+  talk_base::ByteBuffer buf(
+      reinterpret_cast<const char*>(kStunMessageWithByteStringAttribute),
+      sizeof(kStunMessageWithByteStringAttribute));
+  ASSERT_TRUE(msg.Read(&buf));
+  const StunByteStringAttribute* username =
+      msg.GetByteString(STUN_ATTR_USERNAME);
+  ASSERT_TRUE(username != NULL);
+  EXPECT_EQ(kTestUserName1, username->GetString());
+  // Asking again returns the same attribute.
+  EXPECT_EQ(username, msg.GetByteString(STUN_ATTR_USERNAME));
+
+  // Changing the view copies it first.
+  StunByteStringAttribute attr(STUN_ATTR_USERNAME);
+  attr.SetView(username->bytes(), username->length());
+  EXPECT_EQ(username->bytes(), attr.bytes());
+  attr.SetByte(0, 'X');
+  EXPECT_NE(username->bytes(), attr.bytes());
+  EXPECT_EQ(kTestUserName1, username->GetString());
+  EXPECT_EQ('X', attr.GetByte(0));
+  EXPECT_EQ(username->GetString().substr(1), attr.GetString().substr(1));
+
+  // Writing the message back out reproduces it.
+  talk_base::ByteBuffer out;
+  EXPECT_TRUE(msg.Write(&out));
+  ASSERT_EQ(sizeof(kStunMessageWithByteStringAttribute), out.Length());
+  EXPECT_EQ(0, std::memcmp(kStunMessageWithByteStringAttribute, out.Data(),
+                           out.Length()));
+}
+
+// Measures what a connectivity check costs each side: the controlled agent
+// validates a binding request and answers it, and the controlling agent
+// validates the response.
+TEST_F(StunTest, BindingPerf) {
+  const std::string password(kRfc5769SampleMsgPassword);
+  const talk_base::SocketAddress mapped_address(
+      talk_base::IPAddress(kIPv4TestAddress1), kTestMessagePort1);
+
+  IceMessage request;
+  request.SetType(STUN_BINDING_REQUEST);
+  request.SetTransactionID("ABCDABCDABCD");
+  EXPECT_TRUE(request.AddAttribute(new StunByteStringAttribute(
+      STUN_ATTR_USERNAME, "abcdefghijklmnop:qrstuvwxyzabcdef")));
+  EXPECT_TRUE(request.AddAttribute(new StunUInt32Attribute(
+      STUN_ATTR_PRIORITY, 0x6e7f1eff)));
+  EXPECT_TRUE(request.AddAttribute(new StunUInt64Attribute(
+      STUN_ATTR_ICE_CONTROLLING, 0x0123456789abcdefULL)));
+  EXPECT_TRUE(request.AddAttribute(
+      StunAttribute::CreateByteString(STUN_ATTR_USE_CANDIDATE)));
+  EXPECT_TRUE(request.AddMessageIntegrity(password));
+  EXPECT_TRUE(request.AddFingerprint());
+  talk_base::ByteBuffer request_buf;
+  EXPECT_TRUE(request.Write(&request_buf));
+
+  const int count = 20000;
+  uint32 start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    talk_base::ByteBuffer buf(request_buf.Data(), request_buf.Length());
+    IceMessage msg;
+    ASSERT_TRUE(msg.Read(&buf));
+    ASSERT_TRUE(msg.GetByteString(STUN_ATTR_USERNAME) != NULL);
+    ASSERT_TRUE(msg.GetUInt32(STUN_ATTR_PRIORITY) != NULL);
+    ASSERT_TRUE(msg.GetUInt64(STUN_ATTR_ICE_CONTROLLING) != NULL);
+  }
+  int parse_time = talk_base::TimeSince(start);
+
+  size_t response_size = 0;
+  std::string response_data;
+  start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    ASSERT_TRUE(StunMessage::ValidateFingerprint(request_buf.Data(),
+                                                 request_buf.Length()));
+    talk_base::ByteBuffer buf(request_buf.Data(), request_buf.Length());
+    IceMessage msg;
+    ASSERT_TRUE(msg.Read(&buf));
+    ASSERT_TRUE(StunMessage::ValidateMessageIntegrity(
+        request_buf.Data(), request_buf.Length(), password));
+    ASSERT_TRUE(msg.GetByteString(STUN_ATTR_USERNAME) != NULL);
+    ASSERT_TRUE(msg.GetUInt32(STUN_ATTR_PRIORITY) != NULL);
+    ASSERT_TRUE(msg.GetUInt64(STUN_ATTR_ICE_CONTROLLING) != NULL);
+
+    IceMessage response;
+    response.SetType(STUN_BINDING_RESPONSE);
+    response.SetTransactionID(msg.transaction_id());
+    ASSERT_TRUE(response.AddAttribute(new StunXorAddressAttribute(
+        STUN_ATTR_XOR_MAPPED_ADDRESS, mapped_address)));
+    ASSERT_TRUE(response.AddMessageIntegrity(password));
+    ASSERT_TRUE(response.AddFingerprint());
+    talk_base::ByteBuffer out;
+    ASSERT_TRUE(response.Write(&out));
+    response_size = out.Length();
+    if (i == 0)
+      response_data.assign(out.Data(), out.Length());
+  }
+  int request_time = talk_base::TimeSince(start);
+
+  start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    ASSERT_TRUE(StunMessage::ValidateFingerprint(response_data.data(),
+                                                 response_size));
+    talk_base::ByteBuffer buf(response_data.data(), response_size);
+    IceMessage msg;
+    ASSERT_TRUE(msg.Read(&buf));
+    ASSERT_TRUE(StunMessage::ValidateMessageIntegrity(
+        response_data.data(), response_size, password));
+    const StunAddressAttribute* addr =
+        msg.GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS);
+    ASSERT_TRUE(addr != NULL);
+    ASSERT_EQ(mapped_address, addr->GetAddress());
+  }
+  int response_time = talk_base::TimeSince(start);
+
+  LOG(LS_INFO) << "Binding request: "
+               << (parse_time * 1000000.0 / count) << " ns to parse, "
+               << (request_time * 1000000.0 / count) << " ns to answer; "
+               << "response: "
+               << (response_time * 1000000.0 / count) << " ns";
+}
+
+// Compares signing and checking MESSAGE-INTEGRITY with a password string,
+// which sets up the HMAC key for every message, against a prepared key.
+TEST_F(StunTest, IntegrityPerf) {
+  const std::string password(kRfc5769SampleMsgPassword);
+  const talk_base::HmacSha1Key key(password);
+
+  IceMessage msg;
+  msg.SetType(STUN_BINDING_REQUEST);
+  msg.SetTransactionID("ABCDABCDABCD");
+  EXPECT_TRUE(msg.AddAttribute(new StunByteStringAttribute(
+      STUN_ATTR_USERNAME, "abcdefghijklmnop:qrstuvwxyzabcdef")));
+  EXPECT_TRUE(msg.AddAttribute(new StunUInt32Attribute(
+      STUN_ATTR_PRIORITY, 0x6e7f1eff)));
+  EXPECT_TRUE(msg.AddAttribute(new StunUInt64Attribute(
+      STUN_ATTR_ICE_CONTROLLING, 0x0123456789abcdefULL)));
+  EXPECT_TRUE(msg.AddMessageIntegrity(key));
+  talk_base::ByteBuffer buf;
+  EXPECT_TRUE(msg.Write(&buf));
+
+  // MESSAGE-INTEGRITY is the last attribute, so the HMAC covers everything
+  // before it as written.
+  const size_t hmac_len =
+      buf.Length() - kStunAttributeHeaderSize - kStunMessageIntegritySize;
+  const char* expected_hmac = buf.Data() + buf.Length() -
+      kStunMessageIntegritySize;
+  char hmac[kStunMessageIntegritySize];
+
+  // The HMAC as computed before HmacSha1Key, keyed on every call.
+  const int count = 20000;
+  uint32 start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    ASSERT_EQ(sizeof(hmac), talk_base::ComputeHmac(
+        talk_base::DIGEST_SHA_1, password.data(), password.size(),
+        buf.Data(), hmac_len, hmac, sizeof(hmac)));
+  }
+  int hmac_time = talk_base::TimeSince(start);
+  EXPECT_EQ(0, memcmp(expected_hmac, hmac, sizeof(hmac)));
+
+  start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    ASSERT_EQ(sizeof(hmac), key.Compute(buf.Data(), hmac_len,
+                                        hmac, sizeof(hmac)));
+  }
+  int hmac_key_time = talk_base::TimeSince(start);
+  EXPECT_EQ(0, memcmp(expected_hmac, hmac, sizeof(hmac)));
+
+  start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    ASSERT_TRUE(StunMessage::ValidateMessageIntegrity(
+        buf.Data(), buf.Length(), key));
+  }
+  int verify_key_time = talk_base::TimeSince(start);
+
+  start = talk_base::Time();
+  for (int i = 0; i < count; ++i) {
+    IceMessage response;
+    response.SetType(STUN_BINDING_RESPONSE);
+    response.SetTransactionID(msg.transaction_id());
+    ASSERT_TRUE(response.AddMessageIntegrity(key));
+  }
+  int sign_key_time = talk_base::TimeSince(start);
+
+  LOG(LS_INFO) << "MESSAGE-INTEGRITY HMAC: "
+               << (hmac_time * 1000000.0 / count) << " ns with ComputeHmac, "
+               << (hmac_key_time * 1000000.0 / count) << " ns with key; "
+               << "with key: "
+               << (verify_key_time * 1000000.0 / count) << " ns to verify, "
+               << (sign_key_time * 1000000.0 / count) << " ns to sign";
+}
+
 }  // namespace cricket
@@ -30,7 +30,7 @@
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
 #include "talk/base/helpers.h"
-#include "talk/base/nethelpers.h"
+#include "talk/base/resolverpool.h"
 #include "talk/p2p/base/common.h"
 #include "talk/p2p/base/stun.h"
 
@@ -172,7 +172,7 @@ bool UDPPort::Init() {
 
 UDPPort::~UDPPort() {
   if (resolver_) {
-    resolver_->Destroy(false);
+    resolver_->Destroy();
   }
   if (!SharedSocket())
     delete socket_;
@@ -286,14 +286,12 @@ void UDPPort::ResolveStunAddress() {
   if (resolver_)
     return;
 
-  resolver_ = new talk_base::AsyncResolver();
-  resolver_->SignalWorkDone.connect(this, &UDPPort::OnResolveResult);
-  resolver_->set_address(server_addr_);
-  resolver_->Start();
+  resolver_ = talk_base::ResolverPool::Default()->Resolve(server_addr_);
+  resolver_->SignalDone.connect(this, &UDPPort::OnResolveResult);
 }
 
-void UDPPort::OnResolveResult(talk_base::SignalThread* t) {
-  ASSERT(t == resolver_);
+void UDPPort::OnResolveResult(talk_base::PooledResolver* resolver) {
+  ASSERT(resolver == resolver_);
   if (resolver_->error() != 0) {
     LOG_J(LS_WARNING, this) << "StunPort: stun host lookup received error "
                             << resolver_->error();
@@ -36,8 +36,7 @@
 
 // TODO(mallinath) - Rename stunport.cc|h to udpport.cc|h.
 namespace talk_base {
-class AsyncResolver;
-class SignalThread;
+class PooledResolver;
 }
 
 namespace cricket {
@@ -138,7 +137,7 @@ class UDPPort : public Port {
  private:
   // DNS resolution of the STUN server.
   void ResolveStunAddress();
-  void OnResolveResult(talk_base::SignalThread* thread);
+  void OnResolveResult(talk_base::PooledResolver* resolver);
 
   // Below methods handles binding request responses.
   void OnStunBindingRequestSucceeded(const talk_base::SocketAddress& stun_addr);
@@ -155,7 +154,7 @@ class UDPPort : public Port {
   StunRequestManager requests_;
   talk_base::AsyncPacketSocket* socket_;
   int error_;
-  talk_base::AsyncResolver* resolver_;
+  talk_base::PooledResolver* resolver_;
   bool ready_;
   int stun_keepalive_delay_;
 
@@ -33,22 +33,59 @@
 
 namespace cricket {
 
-const uint32 MSG_STUN_SEND = 1;
+const uint32 MSG_STUN_TIMER = 1;
 
 const int MAX_SENDS = 9;
 const int DELAY_UNIT = 100;  // 100 milliseconds
 const int DELAY_MAX_FACTOR = 16;
 
+// The timing wheel has kWheelSlots slots of kWheelTick ms each, which covers
+// the whole STUN backoff schedule; longer delays wrap around the wheel.
+const uint32 kWheelTick = 16;
+const uint32 kWheelSlots = 128;
+
+static inline uint32 WheelTick(uint32 time) {
+  return time / kWheelTick;
+}
+
+StunRequestManager::TransactionKey::TransactionKey(const char* data,
+                                                   size_t length)
+    : hash(2166136261U),
+      length(static_cast<uint8>(talk_base::_min(length, sizeof(bytes)))) {
+  // FNV-1a; the IDs are random, so a simple hash spreads them well.
+  memcpy(bytes, data, this->length);
+  for (size_t i = 0; i < this->length; ++i) {
+    hash ^= static_cast<uint8>(bytes[i]);
+    hash *= 16777619U;
+  }
+}
+
+bool StunRequestManager::TransactionKey::operator==(
+    const TransactionKey& key) const {
+  return hash == key.hash && length == key.length &&
+      memcmp(bytes, key.bytes, length) == 0;
+}
+
+StunRequest* StunRequestManager::FindRequest(
+    const TransactionKey& key) const {
+  StunRequest* const* request = requests_.Find(key);
+  return request ? *request : NULL;
+}
+
 StunRequestManager::StunRequestManager(talk_base::Thread* thread)
-    : thread_(thread) {
+    : thread_(thread), scheduled_(0), last_tick_(0) {
 }
 
 StunRequestManager::~StunRequestManager() {
-  while (requests_.begin() != requests_.end()) {
-    StunRequest *request = requests_.begin()->second;
-    requests_.erase(requests_.begin());
-    delete request;
+  std::vector<StunRequest*> requests;
+  requests_.GetValues(&requests);
+  for (size_t i = 0; i < requests.size(); ++i) {
+    // StunRequest destructor calls Remove() which deletes requests
+    // from |requests_|.
+    delete requests[i];
   }
+  if (!timers_.empty())
+    thread_->Clear(this, MSG_STUN_TIMER);
 }
 
 void StunRequestManager::Send(StunRequest* request) {
@@ -57,26 +94,22 @@ void StunRequestManager::Send(StunRequest* request) {
 
 void StunRequestManager::SendDelayed(StunRequest* request, int delay) {
   request->set_manager(this);
-  ASSERT(requests_.find(request->id()) == requests_.end());
+  request->key_ = TransactionKey(request->id().data(), request->id().size());
   request->Construct();
-  requests_[request->id()] = request;
-  thread_->PostDelayed(delay, request, MSG_STUN_SEND, NULL);
+  VERIFY(requests_.Insert(request->key_, request));
+  Schedule(request, delay);
 }
 
 void StunRequestManager::Remove(StunRequest* request) {
   ASSERT(request->manager() == this);
-  RequestMap::iterator iter = requests_.find(request->id());
-  if (iter != requests_.end()) {
-    ASSERT(iter->second == request);
-    requests_.erase(iter);
-    thread_->Clear(request);
-  }
+  if (FindRequest(request->key_) == request)
+    requests_.Erase(request->key_);
+  Unschedule(request);
 }
 
 void StunRequestManager::Clear() {
   std::vector<StunRequest*> requests;
-  for (RequestMap::iterator i = requests_.begin(); i != requests_.end(); ++i)
-    requests.push_back(i->second);
+  requests_.GetValues(&requests);
 
   for (uint32 i = 0; i < requests.size(); ++i) {
     // StunRequest destructor calls Remove() which deletes requests
@@ -86,11 +119,11 @@ void StunRequestManager::Clear() {
 }
 
 bool StunRequestManager::CheckResponse(StunMessage* msg) {
-  RequestMap::iterator iter = requests_.find(msg->transaction_id());
-  if (iter == requests_.end())
+  const std::string& id = msg->transaction_id();
+  StunRequest* request = FindRequest(TransactionKey(id.data(), id.size()));
+  if (!request)
     return false;
 
-  StunRequest* request = iter->second;
   if (msg->type() == GetStunSuccessResponseType(request->type())) {
     request->OnResponse(msg);
   } else if (msg->type() == GetStunErrorResponseType(request->type())) {
@@ -113,33 +146,173 @@ bool StunRequestManager::CheckResponse(const char* data, size_t size) {
   if (size < 20)
     return false;
 
-  std::string id;
-  id.append(data + kStunTransactionIdOffset, kStunTransactionIdLength);
-
-  RequestMap::iterator iter = requests_.find(id);
-  if (iter == requests_.end())
+  StunRequest* request = FindRequest(
+      TransactionKey(data + kStunTransactionIdOffset,
+                     kStunTransactionIdLength));
+  if (!request)
     return false;
 
   // Parse the STUN message and continue processing as usual.
 
   talk_base::ByteBuffer buf(data, size);
-  talk_base::scoped_ptr<StunMessage> response(iter->second->msg_->CreateNew());
+  talk_base::scoped_ptr<StunMessage> response(request->msg_->CreateNew());
   if (!response->Read(&buf))
     return false;
 
   return CheckResponse(response.get());
 }
 
+StunRequestManager::Stats StunRequestManager::GetStats() const {
+  Stats stats(stats_);
+  stats.outstanding = requests_.size();
+  return stats;
+}
+
+void StunRequestManager::OnMessage(talk_base::Message* pmsg) {
+  ASSERT(pmsg->message_id == MSG_STUN_TIMER);
+
+  // Timer messages are delivered in order of their due times, so this one
+  // was the earliest still pending.
+  std::vector<uint32>::iterator earliest = timers_.begin();
+  for (std::vector<uint32>::iterator it = timers_.begin();
+       it != timers_.end(); ++it) {
+    if (talk_base::TimeIsLater(*it, *earliest))
+      earliest = it;
+  }
+  if (earliest != timers_.end())
+    timers_.erase(earliest);
+
+  FireDueRequests();
+}
+
+void StunRequestManager::Schedule(StunRequest* request, int delay) {
+  ASSERT(request->slot_ == -1);
+  if (wheel_.empty()) {
+    WheelSlot empty = { NULL, NULL };
+    wheel_.resize(kWheelSlots, empty);
+  }
+
+  uint32 now = talk_base::Time();
+  if (scheduled_ == 0)
+    last_tick_ = WheelTick(now);
+
+  request->due_ = now + talk_base::_max(delay, 0);
+  request->slot_ = static_cast<int>(WheelTick(request->due_) % kWheelSlots);
+  WheelSlot& slot = wheel_[request->slot_];
+  request->prev_ = slot.tail;
+  request->next_ = NULL;
+  if (slot.tail) {
+    slot.tail->next_ = request;
+  } else {
+    slot.head = request;
+  }
+  slot.tail = request;
+  ++scheduled_;
+
+  UpdateTimer(now);
+}
+
+void StunRequestManager::Unschedule(StunRequest* request) {
+  if (request->slot_ == -1)
+    return;
+  WheelSlot& slot = wheel_[request->slot_];
+  if (request->prev_) {
+    request->prev_->next_ = request->next_;
+  } else {
+    slot.head = request->next_;
+  }
+  if (request->next_) {
+    request->next_->prev_ = request->prev_;
+  } else {
+    slot.tail = request->prev_;
+  }
+  request->slot_ = -1;
+  request->prev_ = request->next_ = NULL;
+  --scheduled_;
+}
+
+void StunRequestManager::FireDueRequests() {
+  uint32 now = talk_base::Time();
+  uint32 now_tick = WheelTick(now);
+  uint32 ticks = talk_base::_min(now_tick - last_tick_ + 1, kWheelSlots);
+
+  // Requests are only ever scheduled at or after |last_tick_|, so the slots
+  // from there up to now hold every request that is due.
+  for (uint32 i = 0; i < ticks && scheduled_ > 0; ++i) {
+    size_t slot = (last_tick_ + i) % kWheelSlots;
+    StunRequest* request = wheel_[slot].head;
+    while (request) {
+      if (talk_base::TimeIsLater(now, request->due_)) {
+        request = request->next_;
+        continue;
+      }
+      // Sending may reschedule this request or delete any others, so start
+      // over from the head of the slot afterwards.
+      Unschedule(request);
+      request->OnSendTimer();
+      request = wheel_[slot].head;
+    }
+  }
+  last_tick_ = now_tick;
+
+  UpdateTimer(now);
+}
+
+void StunRequestManager::UpdateTimer(uint32 now) {
+  if (scheduled_ == 0)
+    return;
+
+  // Find the earliest due time.  A request in the slot |i| ticks ahead that
+  // is due within this turn of the wheel is due exactly |i| ticks from now,
+  // so the first slot holding one has the earliest; requests further out
+  // than one turn are only found by looking at all of them.
+  uint32 now_tick = WheelTick(now);
+  const int32 turn = (kWheelSlots - 1) * kWheelTick;
+  bool found = false;
+  uint32 next = 0;
+  for (uint32 i = 0; i < kWheelSlots && !found; ++i) {
+    for (StunRequest* request = wheel_[(now_tick + i) % kWheelSlots].head;
+         request; request = request->next_) {
+      if (talk_base::TimeDiff(request->due_, now) < turn &&
+          (!found || talk_base::TimeIsLater(request->due_, next))) {
+        next = request->due_;
+        found = true;
+      }
+    }
+  }
+  for (uint32 i = 0; i < kWheelSlots && !found; ++i) {
+    for (StunRequest* request = wheel_[i].head; request;
+         request = request->next_) {
+      if (!found || talk_base::TimeIsLater(request->due_, next)) {
+        next = request->due_;
+        found = true;
+      }
+    }
+  }
+  ASSERT(found);
+
+  // Only post another message if none of the pending ones comes soon enough.
+  for (size_t i = 0; i < timers_.size(); ++i) {
+    if (!talk_base::TimeIsLater(next, timers_[i]))
+      return;
+  }
+  timers_.push_back(next);
+  int delay = talk_base::_max(talk_base::TimeDiff(next, now), 0);
+  thread_->PostDelayed(delay, this, MSG_STUN_TIMER);
+}
+
 StunRequest::StunRequest()
     : count_(0), timeout_(false), manager_(0),
-      msg_(new StunMessage()), tstamp_(0) {
+      msg_(new StunMessage()), tstamp_(0), sent_(false),
+      due_(0), slot_(-1), prev_(NULL), next_(NULL) {
   msg_->SetTransactionID(
       talk_base::CreateRandomString(kStunTransactionIdLength));
 }
 
 StunRequest::StunRequest(StunMessage* request)
     : count_(0), timeout_(false), manager_(0),
-      msg_(request), tstamp_(0) {
+      msg_(request), tstamp_(0), sent_(false),
+      due_(0), slot_(-1), prev_(NULL), next_(NULL) {
   msg_->SetTransactionID(
       talk_base::CreateRandomString(kStunTransactionIdLength));
 }
@@ -148,7 +321,6 @@ StunRequest::~StunRequest() {
   ASSERT(manager_ != NULL);
   if (manager_) {
     manager_->Remove(this);
-    manager_->thread_->Clear(this);
   }
   delete msg_;
 }
@@ -170,24 +342,28 @@ void StunRequest::set_manager(StunRequestManager* manager) {
   manager_ = manager;
 }
 
-void StunRequest::OnMessage(talk_base::Message* pmsg) {
+void StunRequest::OnSendTimer() {
   ASSERT(manager_ != NULL);
-  ASSERT(pmsg->message_id == MSG_STUN_SEND);
 
   if (timeout_) {
+    manager_->stats_.timeouts++;
     OnTimeout();
     delete this;
     return;
   }
 
   tstamp_ = talk_base::Time();
+  manager_->stats_.sends++;
+  if (sent_)
+    manager_->stats_.retransmits++;
+  sent_ = true;
 
   talk_base::ByteBuffer buf;
   msg_->Write(&buf);
   manager_->SignalSendPacket(buf.Data(), buf.Length(), this);
 
   int delay = GetNextDelay();
-  manager_->thread_->PostDelayed(delay, this, MSG_STUN_SEND, NULL);
+  manager_->Schedule(this, delay);
 }
 
 uint32 StunRequest::Elapsed() const {
@@ -28,11 +28,12 @@
 #ifndef TALK_P2P_BASE_STUNREQUEST_H_
 #define TALK_P2P_BASE_STUNREQUEST_H_
 
+#include "talk/base/flathashmap.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/thread.h"
 #include "talk/p2p/base/stun.h"
-#include <map>
 #include <string>
+#include <vector>
 
 namespace cricket {
 
@@ -40,10 +41,24 @@ class StunRequest;
 
 // Manages a set of STUN requests, sending and resending until we receive a
 // response or determine that the request has timed out.
-class StunRequestManager {
+//
+// Outstanding requests are kept in an open-addressing table keyed by their
+// binary transaction ID, and their (re)transmissions are scheduled on a
+// per-manager timing wheel that is driven by a single thread message, rather
+// than by one message per request.
+class StunRequestManager : public talk_base::MessageHandler {
 public:
+  // Counters describing the requests handled by this manager.
+  struct Stats {
+    Stats() : outstanding(0), sends(0), retransmits(0), timeouts(0) {}
+    size_t outstanding;  // requests waiting for a response
+    uint32 sends;        // packets sent, including retransmissions
+    uint32 retransmits;  // packets sent for a request already sent before
+    uint32 timeouts;     // requests that gave up without a response
+  };
+
   StunRequestManager(talk_base::Thread* thread);
-  ~StunRequestManager();
+  virtual ~StunRequestManager();
 
   // Starts sending the given request (perhaps after a delay).
   void Send(StunRequest* request);
@@ -61,23 +76,69 @@ public:
   bool CheckResponse(StunMessage* msg);
   bool CheckResponse(const char* data, size_t size);
 
-  bool empty() { return requests_.empty(); }
+  bool empty() { return requests_.size() == 0; }
+
+  // Returns a snapshot of the counters for this manager.
+  Stats GetStats() const;
 
   // Raised when there are bytes to be sent.
   sigslot::signal3<const void*, size_t, StunRequest*> SignalSendPacket;
 
+  // Drives the timing wheel.
+  virtual void OnMessage(talk_base::Message* pmsg);
+
 private:
-  typedef std::map<std::string, StunRequest*> RequestMap;
+  // A transaction ID in a fixed-size buffer, with its hash computed once, so
+  // that incoming responses can be matched without building a std::string.
+  struct TransactionKey {
+    TransactionKey() : hash(0), length(0) {}
+    TransactionKey(const char* data, size_t length);
+    bool operator==(const TransactionKey& key) const;
+
+    uint32 hash;
+    uint8 length;
+    char bytes[kStunLegacyTransactionIdLength];
+  };
+
+  struct TransactionKeyHasher {
+    size_t operator()(const TransactionKey& key) const { return key.hash; }
+  };
+  // The outstanding requests, keyed by StunRequest::key_.
+  typedef talk_base::FlatHashMap<TransactionKey, StunRequest*,
+                                 TransactionKeyHasher> RequestTable;
+
+  // Returns the outstanding request with |key|, or NULL.
+  StunRequest* FindRequest(const TransactionKey& key) const;
+
+  // Puts |request| on the timing wheel, due |delay| ms from now.
+  void Schedule(StunRequest* request, int delay);
+  void Unschedule(StunRequest* request);
+  // Sends or times out every request that is due, then rearms the timer.
+  void FireDueRequests();
+  void UpdateTimer(uint32 now);
 
   talk_base::Thread* thread_;
-  RequestMap requests_;
+  RequestTable requests_;
+  // A slot on the timing wheel; its requests are kept in the order they
+  // were scheduled, so that requests due together go out in that order.
+  struct WheelSlot {
+    StunRequest* head;
+    StunRequest* tail;
+  };
+
+  std::vector<WheelSlot> wheel_;  // sized on first use
+  size_t scheduled_;
+  uint32 last_tick_;
+  // Due times of the timer messages that are posted but not yet delivered.
+  std::vector<uint32> timers_;
+  Stats stats_;
 
   friend class StunRequest;
 };
 
 // Represents an individual request to be sent.  The STUN message can either be
 // constructed beforehand or built on demand.
-class StunRequest : public talk_base::MessageHandler {
+class StunRequest {
 public:
   StunRequest();
   StunRequest(StunMessage* request);
@@ -95,9 +156,6 @@ public:
   // Returns the STUN type of the request message.
   int type();
 
-  // Handles messages for sending and timeout.
-  void OnMessage(talk_base::Message* pmsg);
-
   // Time elapsed since last send (in ms)
   uint32 Elapsed() const;
 
@@ -119,9 +177,20 @@ private:
   StunRequestManager* manager_;
   StunMessage* msg_;
   uint32 tstamp_;
+  bool sent_;
+
+  // Position on the manager's timing wheel; |slot_| is -1 when unscheduled.
+  StunRequestManager::TransactionKey key_;
+  uint32 due_;
+  int slot_;
+  StunRequest* prev_;
+  StunRequest* next_;
 
   void set_manager(StunRequestManager* manager);
 
+  // Sends the request, or times it out, when it comes due on the wheel.
+  void OnSendTimer();
+
   friend class StunRequestManager;
 };
 
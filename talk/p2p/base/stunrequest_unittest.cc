@@ -198,6 +198,12 @@ TEST_F(StunRequestTest, TestTimeout) {
   EXPECT_FALSE(success_);
   EXPECT_FALSE(failure_);
   EXPECT_TRUE(timeout_);
+
+  StunRequestManager::Stats stats = manager_.GetStats();
+  EXPECT_EQ(0U, stats.outstanding);
+  EXPECT_EQ(9U, stats.sends);
+  EXPECT_EQ(8U, stats.retransmits);
+  EXPECT_EQ(1U, stats.timeouts);
   delete res;
 }
 
@@ -220,3 +226,55 @@ TEST_F(StunRequestTest, TestNoEmptyRequest) {
   EXPECT_FALSE(timeout_);
   delete res;
 }
+
+// Test that responses are matched among many outstanding requests, both as
+// parsed messages and as raw packets.
+TEST_F(StunRequestTest, TestManyOutstanding) {
+  const int kRequests = 1000;
+  std::vector<StunMessage*> reqs;
+  for (int i = 0; i < kRequests; ++i) {
+    StunMessage* req = CreateStunMessage(STUN_BINDING_REQUEST, NULL);
+    reqs.push_back(req);
+    manager_.Send(new StunRequestThunker(req, this));
+  }
+  EXPECT_EQ(static_cast<size_t>(kRequests), manager_.GetStats().outstanding);
+  EXPECT_EQ_WAIT(kRequests, request_count_, 1000);
+
+  // Answer every other request, from the back, as a raw packet.
+  for (int i = kRequests - 1; i >= 0; i -= 2) {
+    talk_base::scoped_ptr<StunMessage> res(
+        CreateStunMessage(STUN_BINDING_RESPONSE, reqs[i]));
+    talk_base::ByteBuffer buf;
+    res->Write(&buf);
+    EXPECT_TRUE(manager_.CheckResponse(buf.Data(), buf.Length()));
+  }
+  EXPECT_EQ(static_cast<size_t>(kRequests / 2),
+            manager_.GetStats().outstanding);
+
+  // Answer the rest from the front; a second answer matches nothing.
+  for (int i = 0; i < kRequests; i += 2) {
+    talk_base::scoped_ptr<StunMessage> res(
+        CreateStunMessage(STUN_BINDING_RESPONSE, reqs[i]));
+    EXPECT_TRUE(manager_.CheckResponse(res.get()));
+    EXPECT_FALSE(manager_.CheckResponse(res.get()));
+  }
+  EXPECT_TRUE(manager_.empty());
+  EXPECT_EQ(0U, manager_.GetStats().retransmits);
+}
+
+// Test that a request removed before it is due is never sent, and that the
+// remaining requests still go out on time.
+TEST_F(StunRequestTest, TestRemoveBeforeSend) {
+  uint32 start = talk_base::Time();
+  StunRequestThunker* removed = new StunRequestThunker(this);
+  manager_.SendDelayed(removed, 50);
+  manager_.SendDelayed(new StunRequestThunker(this), 100);
+  delete removed;
+  EXPECT_EQ(1U, manager_.GetStats().outstanding);
+
+  EXPECT_EQ_WAIT(1, request_count_, 1000);
+  EXPECT_LE(100, talk_base::TimeSince(start));
+  talk_base::Thread::Current()->ProcessMessages(50);
+  EXPECT_EQ(1, request_count_);
+  EXPECT_EQ(1U, manager_.GetStats().sends);
+}
@@ -34,6 +34,7 @@
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
 #include "talk/base/nethelpers.h"
+#include "talk/base/resolverpool.h"
 #include "talk/base/socketaddress.h"
 #include "talk/base/stringencode.h"
 #include "talk/p2p/base/common.h"
@@ -171,6 +172,9 @@ TurnPort::~TurnPort() {
   while (!entries_.empty()) {
     DestroyEntry(entries_.front()->address());
   }
+  if (resolver_) {
+    resolver_->Destroy();
+  }
 }
 
 bool TurnPort::Init() {
@@ -294,7 +298,7 @@ void TurnPort::OnReadPacket(talk_base::AsyncPacketSocket* socket,
     // This must be a response for one of our requests.
     // Check success responses, but not errors, for MESSAGE-INTEGRITY.
     if (IsStunSuccessResponseType(msg_type) &&
-        !StunMessage::ValidateMessageIntegrity(data, size, hash())) {
+        !StunMessage::ValidateMessageIntegrity(data, size, integrity_key_)) {
       LOG_J(LS_WARNING, this) << "Received TURN message with invalid "
                               << "message integrity, msg_type=" << msg_type;
       return;
@@ -307,14 +311,12 @@ void TurnPort::ResolveTurnAddress() {
   if (resolver_)
     return;
 
-  resolver_ = new talk_base::AsyncResolver();
-  resolver_->SignalWorkDone.connect(this, &TurnPort::OnResolveResult);
-  resolver_->set_address(server_address_);
-  resolver_->Start();
+  resolver_ = talk_base::ResolverPool::Default()->Resolve(server_address_);
+  resolver_->SignalDone.connect(this, &TurnPort::OnResolveResult);
 }
 
-void TurnPort::OnResolveResult(talk_base::SignalThread* signal_thread) {
-  ASSERT(signal_thread == resolver_);
+void TurnPort::OnResolveResult(talk_base::PooledResolver* resolver) {
+  ASSERT(resolver == resolver_);
   if (resolver_->error() != 0) {
     LOG_J(LS_WARNING, this) << "TURN host lookup received error "
                             << resolver_->error();
@@ -350,39 +352,24 @@ void TurnPort::OnAllocateError() {
 
 void TurnPort::HandleDataIndication(const char* data, size_t size) {
   // Read in the message, and process according to RFC5766, Section 10.4.
-  talk_base::ByteBuffer buf(data, size);
-  TurnMessage msg;
-  if (!msg.Read(&buf)) {
+  // Only the mandatory attributes are needed, so read them in place.
+  talk_base::SocketAddress ext_addr;
+  const char* payload;
+  size_t payload_size;
+  if (!ReadTurnIndication(TURN_DATA_INDICATION, data, size, &ext_addr,
+                          &payload, &payload_size)) {
     LOG_J(LS_WARNING, this) << "Received invalid TURN data indication";
     return;
   }
 
-  // Check mandatory attributes.
-  const StunAddressAttribute* addr_attr =
-      msg.GetAddress(STUN_ATTR_XOR_PEER_ADDRESS);
-  if (!addr_attr) {
-    LOG_J(LS_WARNING, this) << "Missing STUN_ATTR_XOR_PEER_ADDRESS attribute "
-                            << "in data indication.";
-    return;
-  }
-
-  const StunByteStringAttribute* data_attr =
-      msg.GetByteString(STUN_ATTR_DATA);
-  if (!data_attr) {
-    LOG_J(LS_WARNING, this) << "Missing STUN_ATTR_DATA attribute in "
-                            << "data indication.";
-    return;
-  }
-
   // Verify that the data came from somewhere we think we have a permission for.
-  talk_base::SocketAddress ext_addr(addr_attr->GetAddress());
   if (!HasPermission(ext_addr.ipaddr())) {
     LOG_J(LS_WARNING, this) << "Received TURN data indication with invalid "
                             << "peer address, addr=" << ext_addr.ToString();
     return;
   }
 
-  DispatchPacket(data_attr->bytes(), data_attr->length(), ext_addr, PROTO_UDP);
+  DispatchPacket(payload, payload_size, ext_addr, PROTO_UDP);
 }
 
 void TurnPort::HandleChannelData(int channel_id, const char* data,
@@ -455,7 +442,7 @@ void TurnPort::AddRequestAuthInfo(StunMessage* msg) {
       STUN_ATTR_REALM, realm_)));
   VERIFY(msg->AddAttribute(new StunByteStringAttribute(
       STUN_ATTR_NONCE, nonce_)));
-  VERIFY(msg->AddMessageIntegrity(hash()));
+  VERIFY(msg->AddMessageIntegrity(integrity_key_));
 }
 
 int TurnPort::Send(const void* data, size_t len) {
@@ -465,6 +452,7 @@ int TurnPort::Send(const void* data, size_t len) {
 void TurnPort::UpdateHash() {
   VERIFY(ComputeStunCredentialHash(credentials_.username, realm_,
                                    credentials_.password, &hash_));
+  integrity_key_.SetKey(hash_);
 }
 
 static bool MatchesIP(TurnEntry* e, talk_base::IPAddress ipaddr) {
@@ -37,8 +37,7 @@
 
 namespace talk_base {
 class AsyncPacketSocket;
-class AsyncResolver;
-class SignalThread;
+class PooledResolver;
 }
 
 namespace cricket {
@@ -115,7 +114,7 @@ class TurnPort : public Port {
   }
 
   void ResolveTurnAddress();
-  void OnResolveResult(talk_base::SignalThread* signal_thread);
+  void OnResolveResult(talk_base::PooledResolver* resolver);
 
   void AddRequestAuthInfo(StunMessage* msg);
   void OnSendStunPacket(const void* data, size_t size, StunRequest* request);
@@ -145,13 +144,14 @@ class TurnPort : public Port {
   RelayCredentials credentials_;
 
   talk_base::scoped_ptr<talk_base::AsyncPacketSocket> socket_;
-  talk_base::AsyncResolver* resolver_;
+  talk_base::PooledResolver* resolver_;
   int error_;
 
   StunRequestManager request_manager_;
   std::string realm_;       // From 401 response message.
   std::string nonce_;       // From 401 response message.
   std::string hash_;        // Digest of username:realm:password
+  talk_base::HmacSha1Key integrity_key_;  // MESSAGE-INTEGRITY key for hash_
 
   int next_channel_number_;
   EntryList entries_;
@@ -248,3 +248,48 @@ TEST_F(TurnPortTest, TestTurnSendData) {
     EXPECT_EQ(turn_packets_[i], udp_packets_[i]);
   }
 }
+
+// Succeeds if the password is the same as the username, like TestTurnServer.
+class ShardedTurnAuth : public cricket::TurnAuthInterface {
+ public:
+  virtual bool GetKey(const std::string& username, const std::string& realm,
+                      std::string* key) {
+    return cricket::ComputeStunCredentialHash(username, realm, username, key);
+  }
+};
+
+// Allocate from several local ports through a ShardedTurnServer. The kernel
+// spreads the clients across the workers' sockets; every allocation must
+// succeed whichever worker it lands on.
+TEST(ShardedTurnServerTest, TestTurnAllocate) {
+  talk_base::Thread* main = talk_base::Thread::Current();
+  talk_base::PhysicalSocketServer pss;
+  talk_base::SocketServerScope ss_scope(&pss);
+  const talk_base::IPAddress loopback(INADDR_LOOPBACK);
+  talk_base::Network network("unittest", "unittest", loopback, 32);
+  network.AddIP(loopback);
+  talk_base::BasicPacketSocketFactory socket_factory(main);
+
+  ShardedTurnAuth auth;
+  cricket::ShardedTurnServer server(4);
+  server.set_realm(cricket::kTestRealm);
+  server.set_auth_hook(&auth);
+  ASSERT_TRUE(server.Start(SocketAddress(loopback, 0), loopback));
+  EXPECT_NE(0, server.internal_address().port());
+
+  const size_t kNumPorts = 8;
+  std::vector<TurnPort*> ports;
+  for (size_t i = 0; i < kNumPorts; ++i) {
+    cricket::RelayCredentials credentials(kTurnUsername, kTurnPassword);
+    TurnPort* port = TurnPort::Create(main, &socket_factory, &network,
+                                      loopback, 0, 0, kIceUfrag1, kIcePwd1,
+                                      server.internal_address(), credentials);
+    port->PrepareAddress();
+    ports.push_back(port);
+  }
+  for (size_t i = 0; i < kNumPorts; ++i) {
+    EXPECT_EQ_WAIT(1U, ports[i]->Candidates().size(), kTimeout);
+    delete ports[i];
+  }
+  server.Stop();
+}
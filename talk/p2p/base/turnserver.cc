@@ -28,7 +28,10 @@
 #include "talk/p2p/base/turnserver.h"
 
 #include "talk/base/asyncpacketsocket.h"
+#include "talk/base/asyncudpsocket.h"
+#include "talk/base/basicpacketsocketfactory.h"
 #include "talk/base/bytebuffer.h"
+#include "talk/base/flathashmap.h"
 #include "talk/base/helpers.h"
 #include "talk/base/logging.h"
 #include "talk/base/messagedigest.h"
@@ -55,6 +58,9 @@ static const size_t kNonceSize = 40;
 
 static const size_t TURN_CHANNEL_HEADER_SIZE = 4U;
 
+// Number of packets read per readiness event on the relayed sockets.
+static const size_t kReceiveBatchSize = 16;
+
 inline bool IsTurnChannelData(uint16 msg_type) {
   // The first two bits of a channel data message are 0b01.
   return ((msg_type & 0xC000) == 0x4000);
@@ -63,6 +69,8 @@ inline bool IsTurnChannelData(uint16 msg_type) {
 // IDs used for posted messages.
 enum {
   MSG_TIMEOUT,
+  MSG_START_SHARD,
+  MSG_STOP_SHARD,
 };
 
 // Encapsulates a TURN allocation.
@@ -81,6 +89,9 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
 
   const Connection& conn() const { return conn_; }
   const std::string& key() const { return key_; }
+  const talk_base::HmacSha1Key& integrity_key() const {
+    return integrity_key_;
+  }
   const std::string& transaction_id() const { return transaction_id_; }
   const std::string& username() const { return username_; }
 
@@ -88,22 +99,45 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
 
   void HandleTurnMessage(const TurnMessage* msg);
   void HandleChannelData(const char* data, size_t size);
+  // Forwards a Send indication without parsing it into a TurnMessage.
+  // Returns false if it couldn't be read that way.
+  bool HandleSendIndication(const char* data, size_t size);
 
   sigslot::signal1<Allocation*> SignalDestroyed;
 
  private:
-  typedef std::list<Permission*> PermissionList;
-  typedef std::list<Channel*> ChannelList;
+  struct IPAddressHasher {
+    size_t operator()(const talk_base::IPAddress& addr) const {
+      return talk_base::HashIP(addr);
+    }
+  };
+  struct SocketAddressHasher {
+    size_t operator()(const talk_base::SocketAddress& addr) const {
+      return addr.Hash();
+    }
+  };
+  // Hashed indexes for the per-packet lookups. Channels are indexed both
+  // ways, as ChannelData arrives by number and peer packets by address.
+  typedef talk_base::FlatHashMap<talk_base::IPAddress, Permission*,
+                                 IPAddressHasher> PermissionMap;
+  typedef talk_base::FlatHashMap<int, Channel*,
+                                 talk_base::IntegerHasher> ChannelMap;
+  typedef talk_base::FlatHashMap<talk_base::SocketAddress, Channel*,
+                                 SocketAddressHasher> ChannelAddressMap;
 
   void HandleAllocateRequest(const TurnMessage* msg);
   void HandleRefreshRequest(const TurnMessage* msg);
   void HandleSendIndication(const TurnMessage* msg);
+  void SendToPeer(const char* data, size_t size,
+                  const talk_base::SocketAddress& peer);
   void HandleCreatePermissionRequest(const TurnMessage* msg);
   void HandleChannelBindRequest(const TurnMessage* msg);
 
   void OnExternalPacket(talk_base::AsyncPacketSocket* socket,
                         const char* data, size_t size,
                         const talk_base::SocketAddress& addr);
+  void OnExternalPacketBatch(talk_base::AsyncPacketSocket* socket,
+                             const talk_base::Datagram* packets, size_t count);
 
   static int ComputeLifetime(const TurnMessage* msg);
   bool HasPermission(const talk_base::IPAddress& addr);
@@ -128,10 +162,12 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
   Connection conn_;
   talk_base::scoped_ptr<talk_base::AsyncPacketSocket> external_socket_;
   std::string key_;
+  talk_base::HmacSha1Key integrity_key_;
   std::string transaction_id_;
   std::string username_;
-  PermissionList perms_;
-  ChannelList channels_;
+  PermissionMap perms_;
+  ChannelMap channels_;
+  ChannelAddressMap channels_by_addr_;
 };
 
 // Encapsulates a TURN permission.
@@ -215,6 +251,8 @@ void TurnServer::AddInternalServerSocket(talk_base::AsyncPacketSocket* socket) {
   ASSERT(server_socket_ == NULL);
   server_socket_.reset(socket);
   socket->SignalReadPacket.connect(this, &TurnServer::OnInternalPacket);
+  socket->SignalReadPacketBatch.connect(this,
+                                        &TurnServer::OnInternalPacketBatch);
 }
 
 void TurnServer::SetExternalSocketFactory(
@@ -227,22 +265,47 @@ void TurnServer::SetExternalSocketFactory(
 void TurnServer::OnInternalPacket(talk_base::AsyncPacketSocket* socket,
                                   const char* data, size_t size,
                                   const talk_base::SocketAddress& addr) {
+  HandleInternalPacket(socket->GetLocalAddress(), data, size, addr);
+}
+
+void TurnServer::OnInternalPacketBatch(talk_base::AsyncPacketSocket* socket,
+                                       const talk_base::Datagram* packets,
+                                       size_t count) {
+  // All the packets arrived on the same socket, so only look up its address
+  // once.
+  talk_base::SocketAddress local_addr = socket->GetLocalAddress();
+  for (size_t i = 0; i < count; ++i) {
+    HandleInternalPacket(local_addr, packets[i].data, packets[i].size,
+                         packets[i].addr);
+  }
+}
+
+void TurnServer::HandleInternalPacket(
+    const talk_base::SocketAddress& local_addr,
+    const char* data, size_t size, const talk_base::SocketAddress& addr) {
   // Fail if the packet is too small to even contain a channel header.
   if (size < TURN_CHANNEL_HEADER_SIZE) {
    return;
   }
 
-  Connection conn(addr, socket->GetLocalAddress(), TURNPROTO_UDP);
+  Connection conn(addr, local_addr, TURNPROTO_UDP);
   uint16 msg_type = talk_base::GetBE16(data);
-  if (!IsTurnChannelData(msg_type)) {
-    // This is a STUN message.
-    HandleStunMessage(conn, data, size);
-  } else {
+  if (IsTurnChannelData(msg_type)) {
     // This is a channel message; let the allocation handle it.
     Allocation* allocation = FindAllocation(conn);
     if (allocation) {
       allocation->HandleChannelData(data, size);
     }
+  } else if (msg_type == TURN_SEND_INDICATION) {
+    // Send indications carry data but no credentials, so the allocation can
+    // forward them without a full parse.
+    Allocation* allocation = FindAllocation(conn);
+    if (!allocation || !allocation->HandleSendIndication(data, size)) {
+      HandleStunMessage(conn, data, size);
+    }
+  } else {
+    // This is a STUN message.
+    HandleStunMessage(conn, data, size);
   }
 }
 
@@ -262,18 +325,23 @@ void TurnServer::HandleStunMessage(const Connection& conn, const char* data,
   }
 
   // Look up the key that we'll use to validate the M-I. If we have an
-  // existing allocation, the key will already be cached.
+  // existing allocation, the key and its HMAC state will already be cached.
   Allocation* allocation = FindAllocation(conn);
   std::string key;
+  talk_base::HmacSha1Key new_integrity_key;
+  const talk_base::HmacSha1Key* integrity_key = &new_integrity_key;
   if (!allocation) {
-    GetKey(&msg, &key);
+    if (GetKey(&msg, &key)) {
+      new_integrity_key.SetKey(key);
+    }
   } else {
     key = allocation->key();
+    integrity_key = &allocation->integrity_key();
   }
 
   // Ensure the message is authorized; only needed for requests.
   if (IsStunRequestType(msg.type())) {
-    if (!CheckAuthorization(conn, &msg, data, size, key)) {
+    if (!CheckAuthorization(conn, &msg, data, size, key, *integrity_key)) {
       return;
     }
   }
@@ -312,10 +380,10 @@ bool TurnServer::GetKey(const StunMessage* msg, std::string* key) {
   return (auth_hook_ != NULL && auth_hook_->GetKey(username, realm_, key));
 }
 
-bool TurnServer::CheckAuthorization(const Connection& conn,
-                                    const StunMessage* msg,
-                                    const char* data, size_t size,
-                                    const std::string& key) {
+bool TurnServer::CheckAuthorization(
+    const Connection& conn, const StunMessage* msg,
+    const char* data, size_t size, const std::string& key,
+    const talk_base::HmacSha1Key& integrity_key) {
   // RFC 5389, 10.2.2.
   ASSERT(IsStunRequestType(msg->type()));
   const StunByteStringAttribute* mi_attr =
@@ -350,7 +418,8 @@ bool TurnServer::CheckAuthorization(const Connection& conn,
 
   // Fail if bad username or M-I.
   // We need |data| and |size| for the call to ValidateMessageIntegrity.
-  if (key.empty() || !StunMessage::ValidateMessageIntegrity(data, size, key)) {
+  if (key.empty() ||
+      !StunMessage::ValidateMessageIntegrity(data, size, integrity_key)) {
     SendErrorResponseWithRealmAndNonce(conn, msg, STUN_ERROR_UNAUTHORIZED,
                                        STUN_ERROR_REASON_UNAUTHORIZED);
     return false;
@@ -519,7 +588,11 @@ bool TurnServer::Connection::operator==(const Connection& c) const {
 }
 
 bool TurnServer::Connection::operator<(const Connection& c) const {
-  return src_ < c.src_ || dst_ < c.dst_ || proto_ < c.proto_;
+  if (src_ != c.src_)
+    return src_ < c.src_;
+  if (dst_ != c.dst_)
+    return dst_ < c.dst_;
+  return proto_ < c.proto_;
 }
 
 std::string TurnServer::Connection::ToString() const {
@@ -540,19 +613,25 @@ TurnServer::Allocation::Allocation(TurnServer* server,
       thread_(thread),
       conn_(conn),
       external_socket_(socket),
-      key_(key) {
+      key_(key),
+      integrity_key_(key) {
   external_socket_->SignalReadPacket.connect(
       this, &TurnServer::Allocation::OnExternalPacket);
+  external_socket_->SignalReadPacketBatch.connect(
+      this, &TurnServer::Allocation::OnExternalPacketBatch);
+  external_socket_->SetReceiveBatchSize(kReceiveBatchSize);
 }
 
 TurnServer::Allocation::~Allocation() {
-  for (ChannelList::iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    delete *it;
+  std::vector<Channel*> channels;
+  channels_.GetValues(&channels);
+  for (size_t i = 0; i < channels.size(); ++i) {
+    delete channels[i];
   }
-  for (PermissionList::iterator it = perms_.begin();
-       it != perms_.end(); ++it) {
-    delete *it;
+  std::vector<Permission*> perms;
+  perms_.GetValues(&perms);
+  for (size_t i = 0; i < perms.size(); ++i) {
+    delete perms[i];
   }
   thread_->Clear(this, MSG_TIMEOUT);
   LOG_J(LS_INFO, this) << "Allocation destroyed";
@@ -652,13 +731,30 @@ void TurnServer::Allocation::HandleSendIndication(const TurnMessage* msg) {
     return;
   }
 
+  SendToPeer(data_attr->bytes(), data_attr->length(), peer_attr->GetAddress());
+}
+
+bool TurnServer::Allocation::HandleSendIndication(const char* data,
+                                                  size_t size) {
+  talk_base::SocketAddress peer;
+  const char* payload;
+  size_t payload_size;
+  if (!ReadTurnIndication(TURN_SEND_INDICATION, data, size, &peer,
+                          &payload, &payload_size)) {
+    return false;
+  }
+  SendToPeer(payload, payload_size, peer);
+  return true;
+}
+
+void TurnServer::Allocation::SendToPeer(const char* data, size_t size,
+                                        const talk_base::SocketAddress& peer) {
   // If a permission exists, send the data on to the peer.
-  if (HasPermission(peer_attr->GetAddress().ipaddr())) {
-    SendExternal(data_attr->bytes(), data_attr->length(),
-                 peer_attr->GetAddress());
+  if (HasPermission(peer.ipaddr())) {
+    SendExternal(data, size, peer);
   } else {
     LOG_J(LS_WARNING, this) << "Received send indication without permission"
-                            << "peer=" << peer_attr->GetAddress();
+                            << "peer=" << peer;
   }
 }
 
@@ -716,7 +812,8 @@ void TurnServer::Allocation::HandleChannelBindRequest(const TurnMessage* msg) {
     channel1 = new Channel(thread_, channel_id, peer_attr->GetAddress());
     channel1->SignalDestroyed.connect(this,
         &TurnServer::Allocation::OnChannelDestroyed);
-    channels_.push_back(channel1);
+    channels_.Insert(channel_id, channel1);
+    channels_by_addr_.Insert(channel1->peer(), channel1);
   } else {
     channel1->Refresh();
   }
@@ -761,22 +858,29 @@ void TurnServer::Allocation::OnExternalPacket(
     buf.WriteBytes(data, size);
     server_->Send(conn_, buf);
   } else if (HasPermission(addr.ipaddr())) {
-    // No channel, but a permission exists. Send as a data indication.
-    TurnMessage msg;
-    msg.SetType(TURN_DATA_INDICATION);
-    msg.SetTransactionID(
-        talk_base::CreateRandomString(kStunTransactionIdLength));
-    VERIFY(msg.AddAttribute(new StunXorAddressAttribute(
-        STUN_ATTR_XOR_PEER_ADDRESS, addr)));
-    VERIFY(msg.AddAttribute(new StunByteStringAttribute(
-        STUN_ATTR_DATA, data, size)));
-    server_->SendStun(conn_, &msg);
+    // No channel, but a permission exists. Send as a data indication,
+    // written directly rather than through a TurnMessage.
+    talk_base::ByteBuffer buf;
+    if (WriteTurnIndication(TURN_DATA_INDICATION,
+            talk_base::CreateRandomString(kStunTransactionIdLength), addr,
+            data, size, server_->software(), &buf)) {
+      server_->Send(conn_, buf);
+    }
   } else {
     LOG_J(LS_WARNING, this) << "Received external packet without permission, "
                             << "peer=" << addr;
   }
 }
 
+void TurnServer::Allocation::OnExternalPacketBatch(
+    talk_base::AsyncPacketSocket* socket,
+    const talk_base::Datagram* packets, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    OnExternalPacket(socket, packets[i].data, packets[i].size,
+                     packets[i].addr);
+  }
+}
+
 int TurnServer::Allocation::ComputeLifetime(const TurnMessage* msg) {
   // Return the smaller of our default lifetime and the requested lifetime.
   uint32 lifetime = kDefaultAllocationTimeout / 1000;  // convert to seconds
@@ -794,7 +898,10 @@ bool TurnServer::Allocation::HasPermission(const talk_base::IPAddress& addr) {
 void TurnServer::Allocation::AddPermission(const talk_base::IPAddress& addr) {
   Permission* perm = FindPermission(addr);
   if (!perm) {
-    perms_.push_back(new Permission(thread_, addr));
+    perm = new Permission(thread_, addr);
+    perm->SignalDestroyed.connect(this,
+        &TurnServer::Allocation::OnPermissionDestroyed);
+    perms_.Insert(addr, perm);
   } else {
     perm->Refresh();
   }
@@ -802,36 +909,24 @@ void TurnServer::Allocation::AddPermission(const talk_base::IPAddress& addr) {
 
 TurnServer::Permission* TurnServer::Allocation::FindPermission(
     const talk_base::IPAddress& addr) const {
-  for (PermissionList::const_iterator it = perms_.begin();
-       it != perms_.end(); ++it) {
-    if ((*it)->peer() == addr)
-      return *it;
-  }
-  return NULL;
+  Permission* const* perm = perms_.Find(addr);
+  return perm ? *perm : NULL;
 }
 
 TurnServer::Channel* TurnServer::Allocation::FindChannel(int channel_id) const {
-  for (ChannelList::const_iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    if ((*it)->id() == channel_id)
-      return *it;
-  }
-  return NULL;
+  Channel* const* channel = channels_.Find(channel_id);
+  return channel ? *channel : NULL;
 }
 
 TurnServer::Channel* TurnServer::Allocation::FindChannel(
     const talk_base::SocketAddress& addr) const {
-  for (ChannelList::const_iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    if ((*it)->peer() == addr)
-      return *it;
-  }
-  return NULL;
+  Channel* const* channel = channels_by_addr_.Find(addr);
+  return channel ? *channel : NULL;
 }
 
 void TurnServer::Allocation::SendResponse(TurnMessage* msg) {
   // Success responses always have M-I.
-  msg->AddMessageIntegrity(key_);
+  msg->AddMessageIntegrity(integrity_key_);
   server_->SendStun(conn_, msg);
 }
 
@@ -856,16 +951,15 @@ void TurnServer::Allocation::OnMessage(talk_base::Message* msg) {
 }
 
 void TurnServer::Allocation::OnPermissionDestroyed(Permission* perm) {
-  PermissionList::iterator it = std::find(perms_.begin(), perms_.end(), perm);
-  ASSERT(it != perms_.end());
-  perms_.erase(it);
+  ASSERT(FindPermission(perm->peer()) == perm);
+  perms_.Erase(perm->peer());
 }
 
 void TurnServer::Allocation::OnChannelDestroyed(Channel* channel) {
-  ChannelList::iterator it =
-      std::find(channels_.begin(), channels_.end(), channel);
-  ASSERT(it != channels_.end());
-  channels_.erase(it);
+  ASSERT(FindChannel(channel->id()) == channel);
+  channels_.Erase(channel->id());
+  ASSERT(FindChannel(channel->peer()) == channel);
+  channels_by_addr_.Erase(channel->peer());
 }
 
 TurnServer::Permission::Permission(talk_base::Thread* thread,
@@ -910,4 +1004,125 @@ void TurnServer::Channel::OnMessage(talk_base::Message* msg) {
   delete this;
 }
 
+// One worker of a ShardedTurnServer. Passed to the worker's thread as the
+// data of MSG_START_SHARD and MSG_STOP_SHARD.
+struct ShardedTurnServer::Shard : public talk_base::MessageData {
+  Shard() : started(false) {}
+  talk_base::scoped_ptr<talk_base::Thread> thread;
+  talk_base::scoped_ptr<TurnServer> server;
+  bool started;
+};
+
+ShardedTurnServer::ShardedTurnServer(int num_shards)
+    : auth_hook_(NULL) {
+  ASSERT(num_shards > 0);
+  for (int i = 0; i < num_shards; ++i) {
+    shards_.push_back(new Shard());
+  }
+}
+
+ShardedTurnServer::~ShardedTurnServer() {
+  Stop();
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    delete shards_[i];
+  }
+}
+
+bool ShardedTurnServer::Start(const talk_base::SocketAddress& int_addr,
+                              const talk_base::IPAddress& ext_addr) {
+  int_addr_ = int_addr;
+  ext_addr_ = talk_base::SocketAddress(ext_addr, 0);
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    Shard* shard = shards_[i];
+    shard->thread.reset(new talk_base::Thread());
+    shard->thread->SetName("TurnServerShard", shard);
+    if (!shard->thread->Start()) {
+      Stop();
+      return false;
+    }
+    // The shard's sockets and timers belong to its thread, so set it up
+    // there.
+    shard->thread->Send(this, MSG_START_SHARD, shard);
+    if (!shard->started) {
+      Stop();
+      return false;
+    }
+  }
+  return true;
+}
+
+void ShardedTurnServer::Stop() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    Shard* shard = shards_[i];
+    if (!shard->thread)
+      continue;
+    if (shard->thread->started()) {
+      shard->thread->Send(this, MSG_STOP_SHARD, shard);
+      shard->thread->Stop();
+    }
+    shard->thread.reset();
+  }
+}
+
+bool ShardedTurnServer::StartShard(Shard* shard) {
+  talk_base::Thread* thread = shard->thread.get();
+  // Every allocation keeps timers running; see turnserver_main.cc.
+  thread->SetDelayedStore(talk_base::MessageQueue::DELAYED_STORE_WHEEL);
+
+  talk_base::AsyncSocket* socket = thread->socketserver()->CreateAsyncSocket(
+      int_addr_.family(), SOCK_DGRAM);
+  if (!socket) {
+    LOG(LS_ERROR) << "Failed to create an internal socket";
+    return false;
+  }
+  if (shards_.size() > 1 &&
+      socket->SetOption(talk_base::Socket::OPT_REUSEPORT, 1) != 0) {
+    LOG(LS_ERROR) << "Failed to share " << int_addr_.ToString()
+                  << " between workers";
+    delete socket;
+    return false;
+  }
+  if (socket->Bind(int_addr_) < 0) {
+    LOG(LS_ERROR) << "Failed to bind an internal socket at "
+                  << int_addr_.ToString() << ", err=" << socket->GetError();
+    delete socket;
+    return false;
+  }
+  // Later shards bind to the port the first one got.
+  if (int_addr_.port() == 0) {
+    int_addr_ = socket->GetLocalAddress();
+  }
+
+  talk_base::AsyncUDPSocket* int_socket =
+      new talk_base::AsyncUDPSocket(socket);
+  int_socket->SetReceiveBatchSize(kReceiveBatchSize);
+
+  shard->server.reset(new TurnServer(thread));
+  shard->server->set_realm(realm_);
+  shard->server->set_software(software_);
+  shard->server->set_auth_hook(auth_hook_);
+  shard->server->AddInternalServerSocket(int_socket);
+  shard->server->SetExternalSocketFactory(
+      new talk_base::BasicPacketSocketFactory(thread), ext_addr_);
+  return true;
+}
+
+void ShardedTurnServer::StopShard(Shard* shard) {
+  shard->server.reset();
+}
+
+void ShardedTurnServer::OnMessage(talk_base::Message* msg) {
+  Shard* shard = static_cast<Shard*>(msg->pdata);
+  switch (msg->message_id) {
+    case MSG_START_SHARD:
+      shard->started = StartShard(shard);
+      break;
+    case MSG_STOP_SHARD:
+      StopShard(shard);
+      break;
+    default:
+      ASSERT(false);
+  }
+}
+
 }  // namespace cricket
@@ -28,11 +28,12 @@
 #ifndef TALK_P2P_BASE_TURNSERVER_H_
 #define TALK_P2P_BASE_TURNSERVER_H_
 
-#include <list>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
+#include "talk/base/hmacsha1key.h"
 #include "talk/base/messagequeue.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socketaddress.h"
@@ -120,6 +121,11 @@ class TurnServer : public sigslot::has_slots<> {
 
   void OnInternalPacket(talk_base::AsyncPacketSocket* socket, const char* data,
                         size_t size, const talk_base::SocketAddress& address);
+  void OnInternalPacketBatch(talk_base::AsyncPacketSocket* socket,
+                             const talk_base::Datagram* packets, size_t count);
+  void HandleInternalPacket(const talk_base::SocketAddress& local_addr,
+                            const char* data, size_t size,
+                            const talk_base::SocketAddress& address);
   void HandleStunMessage(const Connection& conn, const char* data, size_t size);
   void HandleBindingRequest(const Connection& conn, const StunMessage* msg);
   void HandleAllocateRequest(const Connection& conn, const TurnMessage* msg,
@@ -128,7 +134,8 @@ class TurnServer : public sigslot::has_slots<> {
   bool GetKey(const StunMessage* msg, std::string* key);
   bool CheckAuthorization(const Connection& conn, const StunMessage* msg,
                           const char* data, size_t size,
-                          const std::string& key);
+                          const std::string& key,
+                          const talk_base::HmacSha1Key& integrity_key);
   std::string GenerateNonce() const;
   bool ValidateNonce(const std::string& nonce) const;
 
@@ -158,6 +165,55 @@ class TurnServer : public sigslot::has_slots<> {
   AllocationMap allocations_;
 };
 
+// Runs one TurnServer per worker thread, all behind the same internal
+// address, so that a relay can use more than one core. Each worker binds its
+// own internal UDP socket to the address with SO_REUSEPORT; the kernel picks
+// a socket for each client by hashing its 5-tuple, so a client always lands
+// on the same worker. A worker's TurnServer owns its allocations,
+// permissions and channel bindings outright; workers share only the
+// configuration below.
+// Needs SO_REUSEPORT (Linux 3.9 or later) for more than one worker.
+class ShardedTurnServer : public talk_base::MessageHandler {
+ public:
+  explicit ShardedTurnServer(int num_shards);
+  virtual ~ShardedTurnServer();
+
+  int num_shards() const { return static_cast<int>(shards_.size()); }
+
+  // These must be set before Start(). The auth hook is called from every
+  // worker thread, so it must be thread-safe.
+  void set_realm(const std::string& realm) { realm_ = realm; }
+  void set_software(const std::string& software) { software_ = software; }
+  void set_auth_hook(TurnAuthInterface* auth_hook) { auth_hook_ = auth_hook; }
+
+  // Starts the workers, listening on |int_addr| and relaying from
+  // |ext_addr|. If |int_addr| has port 0, all workers share the port the
+  // first one is given.
+  bool Start(const talk_base::SocketAddress& int_addr,
+             const talk_base::IPAddress& ext_addr);
+  // Destroys each worker's TurnServer on its thread, then stops the threads.
+  void Stop();
+
+  // The address the workers are listening on, once started.
+  const talk_base::SocketAddress& internal_address() const {
+    return int_addr_;
+  }
+
+ private:
+  struct Shard;
+
+  bool StartShard(Shard* shard);
+  void StopShard(Shard* shard);
+  virtual void OnMessage(talk_base::Message* msg);
+
+  std::vector<Shard*> shards_;
+  std::string realm_;
+  std::string software_;
+  TurnAuthInterface* auth_hook_;
+  talk_base::SocketAddress int_addr_;
+  talk_base::SocketAddress ext_addr_;
+};
+
 }  // namespace cricket
 
 #endif  // TALK_P2P_BASE_TURNSERVER_H_
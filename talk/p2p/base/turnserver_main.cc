@@ -29,6 +29,7 @@
 
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/basicpacketsocketfactory.h"
+#include "talk/base/flags.h"
 #include "talk/base/optionsfile.h"
 #include "talk/base/thread.h"
 #include "talk/base/stringencode.h"
@@ -36,6 +37,8 @@
 
 static const char kSoftware[] = "libjingle TurnServer";
 
+DEFINE_int(workers, 1, "Number of threads to spread allocations across.");
+
 class TurnFileAuth : public cricket::TurnAuthInterface {
  public:
   explicit TurnFileAuth(const std::string& path) : file_(path) {}
@@ -57,9 +60,10 @@ class TurnFileAuth : public cricket::TurnAuthInterface {
 };
 
 int main(int argc, char **argv) {
-  if (argc != 5) {
-    std::cerr << "usage: turnserver int-addr ext-ip realm auth-file"
-              << std::endl;
+  FlagList::SetFlagsFromCommandLine(&argc, argv, true);
+  if (argc != 5 || FLAG_workers < 1) {
+    std::cerr << "usage: turnserver [--workers=N] int-addr ext-ip realm "
+              << "auth-file" << std::endl;
     return 1;
   }
 
@@ -75,7 +79,28 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  TurnFileAuth auth(argv[4]);
   talk_base::Thread* main = talk_base::Thread::Current();
+  if (FLAG_workers > 1) {
+    cricket::ShardedTurnServer server(FLAG_workers);
+    server.set_realm(argv[3]);
+    server.set_software(kSoftware);
+    server.set_auth_hook(&auth);
+    if (!server.Start(int_addr, ext_addr)) {
+      std::cerr << "Failed to start " << FLAG_workers << " workers at "
+                << int_addr.ToString() << std::endl;
+      return 1;
+    }
+    std::cout << "Listening internally at "
+              << server.internal_address().ToString() << " with "
+              << FLAG_workers << " workers" << std::endl;
+    main->Run();
+    return 0;
+  }
+
+  // Every allocation keeps timers running; cancelling them from a heap
+  // gets slow with many allocations.
+  main->SetDelayedStore(talk_base::MessageQueue::DELAYED_STORE_WHEEL);
   talk_base::AsyncUDPSocket* int_socket =
       talk_base::AsyncUDPSocket::Create(main->socketserver(), int_addr);
   if (!int_socket) {
@@ -83,9 +108,10 @@ int main(int argc, char **argv) {
               << int_addr.ToString() << std::endl;
     return 1;
   }
+  // Drain several client packets per wakeup.
+  int_socket->SetReceiveBatchSize(16);
 
   cricket::TurnServer server(main);
-  TurnFileAuth auth(argv[4]);
   server.set_realm(argv[3]);
   server.set_software(kSoftware);
   server.set_auth_hook(&auth);
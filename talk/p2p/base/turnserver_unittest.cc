@@ -0,0 +1,362 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/asyncudpsocket.h"
+#include "talk/base/bytebuffer.h"
+#include "talk/base/gunit.h"
+#include "talk/base/helpers.h"
+#include "talk/base/logging.h"
+#include "talk/base/physicalsocketserver.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+#include "talk/base/virtualsocketserver.h"
+#include "talk/p2p/base/stun.h"
+#include "talk/p2p/base/testturnserver.h"
+
+using talk_base::ByteBuffer;
+using talk_base::SocketAddress;
+using cricket::TurnMessage;
+
+static const SocketAddress kTurnIntAddr("99.99.99.4",
+                                        cricket::TURN_SERVER_PORT);
+static const SocketAddress kTurnExtAddr("99.99.99.5", 0);
+static const SocketAddress kClientAddr("11.11.11.11", 5000);
+static const uint32 kPeerIp = 0x16160000;  // 22.22.0.0
+static const int kPeerPort = 6000;
+static const int kMinChannel = 0x4000;
+static const char kUsername[] = "test";
+static const int kTimeout = 5000;
+
+// Records the packets a socket receives.
+class PacketCounter : public sigslot::has_slots<> {
+ public:
+  explicit PacketCounter(talk_base::AsyncPacketSocket* socket) : count_(0) {
+    socket->SignalReadPacket.connect(this, &PacketCounter::OnReadPacket);
+  }
+  void OnReadPacket(talk_base::AsyncPacketSocket* socket, const char* data,
+                    size_t size, const SocketAddress& addr) {
+    last_.assign(data, size);
+    ++count_;
+  }
+  size_t count_;
+  std::string last_;
+};
+
+// Talks to a TestTurnServer as a TURN client, one request at a time, and
+// relays between the client and peers on its allocation.
+class TurnServerTest : public testing::Test {
+ public:
+  TurnServerTest()
+      : pss_(new talk_base::PhysicalSocketServer),
+        ss_(new talk_base::VirtualSocketServer(pss_.get())),
+        ss_scope_(ss_.get()),
+        server_(talk_base::Thread::Current(), kTurnIntAddr, kTurnExtAddr),
+        client_(talk_base::AsyncUDPSocket::Create(ss_.get(), kClientAddr)),
+        client_packets_(client_.get()) {
+  }
+
+  static SocketAddress PeerAddress(int i) {
+    return SocketAddress(talk_base::IPAddress(kPeerIp + i), kPeerPort);
+  }
+
+  static void WaitFor(const size_t* count, size_t expected) {
+    uint32 end = talk_base::TimeAfter(kTimeout);
+    while (*count < expected && talk_base::TimeUntil(end) > 0) {
+      talk_base::Thread::Current()->ProcessMessages(1);
+    }
+  }
+
+  // Sends |req| and returns the response, or NULL if there was none.
+  TurnMessage* SendRequest(TurnMessage* req, bool authenticate) {
+    req->SetTransactionID(
+        talk_base::CreateRandomString(cricket::kStunTransactionIdLength));
+    if (authenticate) {
+      req->AddAttribute(new cricket::StunByteStringAttribute(
+          cricket::STUN_ATTR_USERNAME, kUsername));
+      req->AddAttribute(new cricket::StunByteStringAttribute(
+          cricket::STUN_ATTR_REALM, realm_));
+      req->AddAttribute(new cricket::StunByteStringAttribute(
+          cricket::STUN_ATTR_NONCE, nonce_));
+      req->AddMessageIntegrity(key_);
+    }
+    ByteBuffer buf;
+    req->Write(&buf);
+    size_t expected = client_packets_.count_ + 1;
+    client_->SendTo(buf.Data(), buf.Length(), kTurnIntAddr);
+    WaitFor(&client_packets_.count_, expected);
+    if (client_packets_.count_ < expected) {
+      return NULL;
+    }
+
+    ByteBuffer resp_buf(client_packets_.last_.data(),
+                        client_packets_.last_.size());
+    TurnMessage* resp = new TurnMessage();
+    if (!resp->Read(&resp_buf)) {
+      delete resp;
+      return NULL;
+    }
+    return resp;
+  }
+
+  // Makes an allocation, fetching a nonce first.
+  bool Allocate() {
+    TurnMessage req;
+    req.SetType(cricket::STUN_ALLOCATE_REQUEST);
+    req.AddAttribute(new cricket::StunUInt32Attribute(
+        cricket::STUN_ATTR_REQUESTED_TRANSPORT, IPPROTO_UDP << 24));
+    talk_base::scoped_ptr<TurnMessage> resp(SendRequest(&req, false));
+    if (!resp || resp->type() != cricket::STUN_ALLOCATE_ERROR_RESPONSE ||
+        !resp->GetByteString(cricket::STUN_ATTR_REALM) ||
+        !resp->GetByteString(cricket::STUN_ATTR_NONCE)) {
+      return false;
+    }
+    realm_ = resp->GetByteString(cricket::STUN_ATTR_REALM)->GetString();
+    nonce_ = resp->GetByteString(cricket::STUN_ATTR_NONCE)->GetString();
+    cricket::ComputeStunCredentialHash(kUsername, realm_, kUsername, &key_);
+
+    TurnMessage auth_req;
+    auth_req.SetType(cricket::STUN_ALLOCATE_REQUEST);
+    auth_req.AddAttribute(new cricket::StunUInt32Attribute(
+        cricket::STUN_ATTR_REQUESTED_TRANSPORT, IPPROTO_UDP << 24));
+    resp.reset(SendRequest(&auth_req, true));
+    if (!resp || resp->type() != cricket::STUN_ALLOCATE_RESPONSE) {
+      return false;
+    }
+    relayed_addr_ = resp->GetAddress(
+        cricket::STUN_ATTR_XOR_RELAYED_ADDRESS)->GetAddress();
+    return true;
+  }
+
+  // Binds |channel| to |peer|, which also gives |peer| a permission.
+  bool BindChannel(int channel, const SocketAddress& peer) {
+    TurnMessage req;
+    req.SetType(cricket::TURN_CHANNEL_BIND_REQUEST);
+    req.AddAttribute(new cricket::StunUInt32Attribute(
+        cricket::STUN_ATTR_CHANNEL_NUMBER, channel << 16));
+    req.AddAttribute(new cricket::StunXorAddressAttribute(
+        cricket::STUN_ATTR_XOR_PEER_ADDRESS, peer));
+    talk_base::scoped_ptr<TurnMessage> resp(SendRequest(&req, true));
+    return resp && resp->type() == cricket::TURN_CHANNEL_BIND_RESPONSE;
+  }
+
+  // Gives |peer| a permission.
+  bool CreatePermission(const SocketAddress& peer) {
+    TurnMessage req;
+    req.SetType(cricket::TURN_CREATE_PERMISSION_REQUEST);
+    req.AddAttribute(new cricket::StunXorAddressAttribute(
+        cricket::STUN_ATTR_XOR_PEER_ADDRESS, peer));
+    talk_base::scoped_ptr<TurnMessage> resp(SendRequest(&req, true));
+    return resp && resp->type() == cricket::TURN_CREATE_PERMISSION_RESPONSE;
+  }
+
+  void WriteSendIndication(const SocketAddress& peer, const char* data,
+                           size_t size, ByteBuffer* buf) {
+    TurnMessage msg;
+    msg.SetType(cricket::TURN_SEND_INDICATION);
+    msg.SetTransactionID(
+        talk_base::CreateRandomString(cricket::kStunTransactionIdLength));
+    msg.AddAttribute(new cricket::StunXorAddressAttribute(
+        cricket::STUN_ATTR_XOR_PEER_ADDRESS, peer));
+    msg.AddAttribute(new cricket::StunByteStringAttribute(
+        cricket::STUN_ATTR_DATA, data, size));
+    msg.Write(buf);
+  }
+
+  // Relays |count| packets each way between the client and a peer with a
+  // permission but no channel, as Send and Data indications.
+  void MeasureIndications(int count) {
+    ASSERT_TRUE(Allocate());
+    ASSERT_TRUE(CreatePermission(PeerAddress(0)));
+    talk_base::scoped_ptr<talk_base::AsyncUDPSocket> peer(
+        talk_base::AsyncUDPSocket::Create(ss_.get(), PeerAddress(0)));
+    PacketCounter peer_packets(peer.get());
+
+    char payload[200] = { 0 };
+    ByteBuffer indication;
+    WriteSendIndication(PeerAddress(0), payload, sizeof(payload),
+                        &indication);
+
+    uint32 start = talk_base::Time();
+    for (int i = 0; i < count; ++i) {
+      client_->SendTo(indication.Data(), indication.Length(), kTurnIntAddr);
+      talk_base::Thread::Current()->ProcessMessages(0);
+    }
+    WaitFor(&peer_packets.count_, count);
+    uint32 to_peer = talk_base::TimeSince(start);
+    EXPECT_EQ(static_cast<size_t>(count), peer_packets.count_);
+
+    size_t expected = client_packets_.count_ + count;
+    start = talk_base::Time();
+    for (int i = 0; i < count; ++i) {
+      peer->SendTo(payload, sizeof(payload), relayed_addr_);
+      talk_base::Thread::Current()->ProcessMessages(0);
+    }
+    WaitFor(&client_packets_.count_, expected);
+    uint32 to_client = talk_base::TimeSince(start);
+    EXPECT_EQ(expected, client_packets_.count_);
+
+    LOG(LS_INFO) << "Indications: "
+                 << (to_peer * 1000000.0 / count) << " ns/packet to peer, "
+                 << (to_client * 1000000.0 / count) << " ns/packet to client";
+  }
+
+  // Binds |num_channels| channels, each to a peer on its own IP, then relays
+  // |count| packets each way through the last one bound.
+  void MeasureChannelData(int num_channels, int count) {
+    ASSERT_TRUE(Allocate());
+    for (int i = 0; i < num_channels; ++i) {
+      ASSERT_TRUE(BindChannel(kMinChannel + i, PeerAddress(i)));
+    }
+    talk_base::scoped_ptr<talk_base::AsyncUDPSocket> peer(
+        talk_base::AsyncUDPSocket::Create(ss_.get(),
+                                          PeerAddress(num_channels - 1)));
+    PacketCounter peer_packets(peer.get());
+
+    char payload[200] = { 0 };
+    ByteBuffer channel_data;
+    channel_data.WriteUInt16(kMinChannel + num_channels - 1);
+    channel_data.WriteUInt16(sizeof(payload));
+    channel_data.WriteBytes(payload, sizeof(payload));
+
+    uint32 start = talk_base::Time();
+    for (int i = 0; i < count; ++i) {
+      client_->SendTo(channel_data.Data(), channel_data.Length(),
+                      kTurnIntAddr);
+      talk_base::Thread::Current()->ProcessMessages(0);
+    }
+    WaitFor(&peer_packets.count_, count);
+    uint32 to_peer = talk_base::TimeSince(start);
+    EXPECT_EQ(static_cast<size_t>(count), peer_packets.count_);
+    EXPECT_EQ(sizeof(payload), peer_packets.last_.size());
+
+    size_t expected = client_packets_.count_ + count;
+    start = talk_base::Time();
+    for (int i = 0; i < count; ++i) {
+      peer->SendTo(payload, sizeof(payload), relayed_addr_);
+      talk_base::Thread::Current()->ProcessMessages(0);
+    }
+    WaitFor(&client_packets_.count_, expected);
+    uint32 to_client = talk_base::TimeSince(start);
+    EXPECT_EQ(expected, client_packets_.count_);
+    EXPECT_EQ(channel_data.Length(), client_packets_.last_.size());
+
+    LOG(LS_INFO) << num_channels << " permissions: "
+                 << (to_peer * 1000000.0 / count) << " ns/packet to peer, "
+                 << (to_client * 1000000.0 / count) << " ns/packet to client";
+  }
+
+ protected:
+  talk_base::scoped_ptr<talk_base::PhysicalSocketServer> pss_;
+  talk_base::scoped_ptr<talk_base::VirtualSocketServer> ss_;
+  talk_base::SocketServerScope ss_scope_;
+  cricket::TestTurnServer server_;
+  talk_base::scoped_ptr<talk_base::AsyncUDPSocket> client_;
+  PacketCounter client_packets_;
+  std::string realm_;
+  std::string nonce_;
+  std::string key_;
+  SocketAddress relayed_addr_;
+};
+
+// Relay a packet each way through a channel.
+TEST_F(TurnServerTest, TestChannelData) {
+  ASSERT_TRUE(Allocate());
+  ASSERT_TRUE(BindChannel(kMinChannel, PeerAddress(0)));
+  // A channel number can only be bound to one peer.
+  EXPECT_FALSE(BindChannel(kMinChannel, PeerAddress(1)));
+  talk_base::scoped_ptr<talk_base::AsyncUDPSocket> peer(
+      talk_base::AsyncUDPSocket::Create(ss_.get(), PeerAddress(0)));
+  PacketCounter peer_packets(peer.get());
+
+  ByteBuffer channel_data;
+  channel_data.WriteUInt16(kMinChannel);
+  channel_data.WriteUInt16(5);
+  channel_data.WriteBytes("hello", 5);
+  client_->SendTo(channel_data.Data(), channel_data.Length(), kTurnIntAddr);
+  WaitFor(&peer_packets.count_, 1);
+  EXPECT_EQ("hello", peer_packets.last_);
+
+  size_t expected = client_packets_.count_ + 1;
+  peer->SendTo("hello", 5, relayed_addr_);
+  WaitFor(&client_packets_.count_, expected);
+  EXPECT_EQ(std::string(channel_data.Data(), channel_data.Length()),
+            client_packets_.last_);
+}
+
+// Relay a packet each way through Send and Data indications.
+TEST_F(TurnServerTest, TestIndications) {
+  ASSERT_TRUE(Allocate());
+  talk_base::scoped_ptr<talk_base::AsyncUDPSocket> peer(
+      talk_base::AsyncUDPSocket::Create(ss_.get(), PeerAddress(0)));
+  PacketCounter peer_packets(peer.get());
+  ByteBuffer indication;
+  WriteSendIndication(PeerAddress(0), "hello", 5, &indication);
+
+  // Nothing is relayed without a permission.
+  client_->SendTo(indication.Data(), indication.Length(), kTurnIntAddr);
+  peer->SendTo("hello", 5, relayed_addr_);
+  talk_base::Thread::Current()->ProcessMessages(100);
+  EXPECT_EQ(0U, peer_packets.count_);
+
+  ASSERT_TRUE(CreatePermission(PeerAddress(0)));
+  client_->SendTo(indication.Data(), indication.Length(), kTurnIntAddr);
+  WaitFor(&peer_packets.count_, 1);
+  EXPECT_EQ("hello", peer_packets.last_);
+
+  size_t expected = client_packets_.count_ + 1;
+  peer->SendTo("world", 5, relayed_addr_);
+  WaitFor(&client_packets_.count_, expected);
+  ByteBuffer buf(client_packets_.last_.data(), client_packets_.last_.size());
+  TurnMessage msg;
+  ASSERT_TRUE(msg.Read(&buf));
+  EXPECT_EQ(cricket::TURN_DATA_INDICATION, msg.type());
+  EXPECT_EQ(PeerAddress(0), msg.GetAddress(
+      cricket::STUN_ATTR_XOR_PEER_ADDRESS)->GetAddress());
+  EXPECT_EQ("world",
+            msg.GetByteString(cricket::STUN_ATTR_DATA)->GetString());
+  EXPECT_EQ(cricket::kTestSoftware,
+            msg.GetByteString(cricket::STUN_ATTR_SOFTWARE)->GetString());
+}
+
+TEST_F(TurnServerTest, IndicationPerf) {
+  MeasureIndications(10000);
+}
+
+// Channel data costs should not grow with the number of permissions.
+TEST_F(TurnServerTest, ChannelDataPerf1) {
+  MeasureChannelData(1, 10000);
+}
+
+TEST_F(TurnServerTest, ChannelDataPerf100) {
+  MeasureChannelData(100, 10000);
+}
+
+TEST_F(TurnServerTest, ChannelDataPerf1000) {
+  MeasureChannelData(1000, 10000);
+}
@@ -253,6 +253,7 @@ BasicPortAllocator::BasicPortAllocator(
 void BasicPortAllocator::Construct() {
   best_writable_phase_ = -1;
   allow_tcp_listen_ = true;
+  max_parallel_phases_ = 0;
 }
 
 BasicPortAllocator::~BasicPortAllocator() {
@@ -295,7 +296,8 @@ BasicPortAllocatorSession::BasicPortAllocatorSession(
       allocation_started_(false),
       network_manager_started_(false),
       running_(false),
-      allocation_sequences_created_(false) {
+      allocation_sequences_created_(false),
+      done_signaled_since_stop_(false) {
   allocator_->network_manager()->SignalNetworksChanged.connect(
       this, &BasicPortAllocatorSession::OnNetworksChanged);
   allocator_->network_manager()->StartUpdating();
@@ -334,6 +336,8 @@ void BasicPortAllocatorSession::GetInitialPorts() {
 void BasicPortAllocatorSession::StartGetAllPorts() {
   ASSERT(talk_base::Thread::Current() == network_thread_);
   running_ = true;
+  // The candidate target applies to each round of gathering.
+  candidate_types_.clear();
   if (allocation_started_)
     network_thread_->PostDelayed(ALLOCATE_DELAY, this, MSG_ALLOCATE);
   for (uint32 i = 0; i < sequences_.size(); ++i)
@@ -345,6 +349,7 @@ void BasicPortAllocatorSession::StartGetAllPorts() {
 void BasicPortAllocatorSession::StopGetAllPorts() {
   ASSERT(talk_base::Thread::Current() == network_thread_);
   running_ = false;
+  done_signaled_since_stop_ = false;
   network_thread_->Clear(this, MSG_ALLOCATE);
   for (uint32 i = 0; i < sequences_.size(); ++i)
     sequences_[i]->Stop();
@@ -425,9 +430,11 @@ void BasicPortAllocatorSession::OnConfigStop() {
     }
   }
 
-  // Did we stop any running sequences?
+  // Did we stop any running sequences?  A port that finished in the meantime
+  // will have sent the done signal already.
   for (std::vector<AllocationSequence*>::iterator it = sequences_.begin();
-       it != sequences_.end() && !send_signal; ++it) {
+       it != sequences_.end() && !send_signal && !done_signaled_since_stop_;
+       ++it) {
     if ((*it)->state() == AllocationSequence::kStopped) {
       send_signal = true;
     }
@@ -606,6 +613,7 @@ void BasicPortAllocatorSession::OnCandidateReady(
 
   if (!candidates.empty()) {
     SignalCandidatesReady(this, candidates);
+    OnCandidatesSignaled(candidates);
   }
 }
 
@@ -657,6 +665,7 @@ void BasicPortAllocatorSession::OnProtocolEnabled(AllocationSequence* seq,
 
   if (!candidates.empty()) {
     SignalCandidatesReady(this, candidates);
+    OnCandidatesSignaled(candidates);
   }
 }
 
@@ -689,9 +698,35 @@ void BasicPortAllocatorSession::MaybeSignalCandidatesAllocationDone() {
   }
   LOG(LS_INFO) << "All candidates gathered for " << content_name_ << ":"
                << component_ << ":" << generation();
+  done_signaled_since_stop_ = true;
   SignalCandidatesAllocationDone(this);
 }
 
+// Stops gathering if the candidates signaled so far meet the allocator's
+// candidate target.
+void BasicPortAllocatorSession::OnCandidatesSignaled(
+    const std::vector<Candidate>& candidates) {
+  for (size_t i = 0; i < candidates.size(); ++i)
+    candidate_types_.insert(candidates[i].type());
+  if (running_ && CandidateTargetReached()) {
+    LOG(LS_INFO) << "Candidate target reached for " << content_name_ << ":"
+                 << component_ << ":" << generation();
+    StopGetAllPorts();
+  }
+}
+
+bool BasicPortAllocatorSession::CandidateTargetReached() const {
+  const std::set<std::string>& target = allocator_->candidate_target();
+  if (target.empty())
+    return false;
+  for (std::set<std::string>::const_iterator it = target.begin();
+       it != target.end(); ++it) {
+    if (candidate_types_.find(*it) == candidate_types_.end())
+      return false;
+  }
+  return true;
+}
+
 void BasicPortAllocatorSession::OnPortDestroyed(
     PortInterface* port) {
   ASSERT(talk_base::Thread::Current() == network_thread_);
@@ -774,6 +809,17 @@ AllocationSequence::AllocationSequence(BasicPortAllocatorSession* session,
       step_(0),
       flags_(flags),
       udp_socket_(NULL) {
+  if (IsFlagSet(PORTALLOCATOR_ENABLE_PARALLEL_PHASES)) {
+    // The phases run max_parallel_phases() at a time, all in step 0 if there
+    // is no limit.
+    int max_parallel = session->allocator()->max_parallel_phases();
+    if (max_parallel <= 0)
+      max_parallel = kNumPhases;
+    for (int phase = 0; phase < kNumPhases; ++phase)
+      step_of_phase_[phase] = phase / max_parallel;
+    return;
+  }
+
   // All of the phases up until the best-writable phase so far run in step 0.
   // The other phases follow sequentially in the steps after that.  If there is
   // no best-writable so far, then only phase 0 occurs in step 0.
@@ -842,6 +888,9 @@ void AllocationSequence::DisableEquivalentPhases(talk_base::Network* network,
 }
 
 void AllocationSequence::Start() {
+  // Every phase may already have run in step 0.
+  if (state_ == kCompleted)
+    return;
   state_ = kRunning;
   session_->network_thread()->PostDelayed(ALLOCATION_STEP_DELAY,
                                           this,
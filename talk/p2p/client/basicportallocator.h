@@ -28,6 +28,7 @@
 #ifndef TALK_P2P_CLIENT_BASICPORTALLOCATOR_H_
 #define TALK_P2P_CLIENT_BASICPORTALLOCATOR_H_
 
+#include <set>
 #include <string>
 #include <vector>
 
@@ -115,6 +116,26 @@ class BasicPortAllocator : public PortAllocator {
     allow_tcp_listen_ = allow_tcp_listen;
   }
 
+  // With PORTALLOCATOR_ENABLE_PARALLEL_PHASES, each network starts up to this
+  // many allocation phases at once instead of one per step.  Zero, the
+  // default, starts them all at once.
+  int max_parallel_phases() const { return max_parallel_phases_; }
+  void set_max_parallel_phases(int max_parallel_phases) {
+    max_parallel_phases_ = max_parallel_phases;
+  }
+
+  // Candidate types (LOCAL_PORT_TYPE, STUN_PORT_TYPE, RELAY_PORT_TYPE) that
+  // are enough for a session.  Once a running session has produced at least
+  // one candidate of every type here, it stops gathering as if
+  // StopGetAllPorts had been called.  Empty, the default, means gather
+  // everything.
+  const std::set<std::string>& candidate_target() const {
+    return candidate_target_;
+  }
+  void set_candidate_target(const std::set<std::string>& types) {
+    candidate_target_ = types;
+  }
+
  private:
   void Construct();
 
@@ -124,6 +145,8 @@ class BasicPortAllocator : public PortAllocator {
   std::vector<RelayServerConfig> relays_;
   int best_writable_phase_;
   bool allow_tcp_listen_;
+  int max_parallel_phases_;
+  std::set<std::string> candidate_target_;
 };
 
 struct PortConfiguration;
@@ -209,6 +232,8 @@ class BasicPortAllocatorSession : public PortAllocatorSession,
   void OnConnectionStateChange(Connection* conn);
   void OnShake();
   void MaybeSignalCandidatesAllocationDone();
+  void OnCandidatesSignaled(const std::vector<Candidate>& candidates);
+  bool CandidateTargetReached() const;
   void OnPortAllocationComplete(AllocationSequence* seq);
   PortData* FindPort(Port* port);
 
@@ -221,9 +246,12 @@ class BasicPortAllocatorSession : public PortAllocatorSession,
   bool network_manager_started_;
   bool running_;  // set when StartGetAllPorts is called
   bool allocation_sequences_created_;
+  bool done_signaled_since_stop_;
   std::vector<PortConfiguration*> configs_;
   std::vector<AllocationSequence*> sequences_;
   std::vector<PortData> ports_;
+  // Types signaled since gathering last started.
+  std::set<std::string> candidate_types_;
 
   friend class AllocationSequence;
 };
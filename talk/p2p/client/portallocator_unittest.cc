@@ -34,6 +34,7 @@
 #include "talk/base/physicalsocketserver.h"
 #include "talk/base/socketaddress.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/base/virtualsocketserver.h"
 #include "talk/p2p/base/constants.h"
 #include "talk/p2p/base/p2ptransportchannel.h"
@@ -195,6 +196,27 @@ class PortAllocatorTest : public testing::Test, public sigslot::has_slots<> {
     }
   }
 
+  bool HasCandidateOfType(const std::string& type) const {
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+      if (candidates_[i].type() == type)
+        return true;
+    }
+    return false;
+  }
+
+  // Starts gathering on a new session and returns how long it takes for the
+  // first relay candidate to show up, or -1 if none does within |timeout|.
+  int TimeToFirstRelayCandidate(int timeout) {
+    if (!CreateSession(cricket::ICE_CANDIDATE_COMPONENT_RTP))
+      return -1;
+    uint32 start = talk_base::Time();
+    session_->GetInitialPorts();
+    session_->StartGetAllPorts();
+    bool found;
+    WAIT_(HasCandidateOfType("relay"), timeout, found);
+    return found ? talk_base::TimeSince(start) : -1;
+  }
+
   bool HasRelayAddress(const cricket::ProtocolAddress& proto_addr) {
     for (size_t i = 0; i < allocator_->relays().size(); ++i) {
       cricket::RelayServerConfig server_config = allocator_->relays()[i];
@@ -540,6 +562,95 @@ TEST_F(PortAllocatorTest, TestGetAllPortsRestarts) {
   // TODO - Extend this to verify ICE restart.
 }
 
+// Test that with parallel phases every phase starts right away, so the relay
+// candidates don't wait for the UDP phase to finish.
+TEST_F(PortAllocatorTest, TestGetAllPortsParallelPhases) {
+  AddInterface(kClientAddr);
+  int sequential = TimeToFirstRelayCandidate(3000);
+  LOG(LS_INFO) << "First relay candidate, sequential: " << sequential << "ms";
+  EXPECT_GE(sequential, 1000);
+
+  candidates_.clear();
+  ports_.clear();
+  candidate_allocation_done_ = false;
+  allocator().set_flags(allocator().flags() |
+                        cricket::PORTALLOCATOR_ENABLE_PARALLEL_PHASES);
+  int parallel = TimeToFirstRelayCandidate(3000);
+  LOG(LS_INFO) << "First relay candidate, parallel: " << parallel << "ms";
+  ASSERT_NE(-1, parallel);
+  EXPECT_LT(parallel, 500);
+
+  // Everything else comes without waiting for the later steps either.
+  ASSERT_EQ_WAIT(7U, candidates_.size(), 500);
+  EXPECT_EQ(4U, ports_.size());
+  EXPECT_TRUE_WAIT(candidate_allocation_done_, 500);
+  session_->StopGetAllPorts();
+}
+
+// Test that the phases start two at a time when parallel phases are capped
+// at two.
+TEST_F(PortAllocatorTest, TestGetAllPortsParallelPhasesCapped) {
+  AddInterface(kClientAddr);
+  allocator().set_flags(allocator().flags() |
+                        cricket::PORTALLOCATOR_ENABLE_PARALLEL_PHASES);
+  allocator().set_max_parallel_phases(2);
+  EXPECT_TRUE(CreateSession(cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  session_->GetInitialPorts();
+  session_->StartGetAllPorts();
+  // Udp and Relay first.
+  ASSERT_EQ_WAIT(4U, candidates_.size(), 500);
+  EXPECT_EQ(3U, ports_.size());
+  EXPECT_TRUE(HasCandidateOfType("relay"));
+  // Then Tcp and SslTcp, one step later.
+  ASSERT_EQ_WAIT(7U, candidates_.size(), 2000);
+  EXPECT_EQ(4U, ports_.size());
+  EXPECT_TRUE_WAIT(candidate_allocation_done_, 500);
+  session_->StopGetAllPorts();
+}
+
+// Test that gathering stops once the candidate target has been met, without
+// going on to the relay and TCP phases.
+TEST_F(PortAllocatorTest, TestGetAllPortsStopsAtCandidateTarget) {
+  AddInterface(kClientAddr);
+  std::set<std::string> target;
+  target.insert(cricket::LOCAL_PORT_TYPE);
+  target.insert(cricket::STUN_PORT_TYPE);
+  allocator().set_candidate_target(target);
+  EXPECT_TRUE(CreateSession(cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  session_->GetInitialPorts();
+  session_->StartGetAllPorts();
+  EXPECT_TRUE_WAIT(candidate_allocation_done_, 1000);
+  EXPECT_FALSE(session_->IsGettingAllPorts());
+  EXPECT_EQ(2U, candidates_.size());
+  talk_base::Thread::Current()->ProcessMessages(1500);
+  EXPECT_EQ(2U, candidates_.size());
+  EXPECT_EQ(2U, ports_.size());
+}
+
+// Test that the candidates from one round of gathering don't count towards
+// the candidate target of the next.
+TEST_F(PortAllocatorTest, TestCandidateTargetResetOnRestart) {
+  AddInterface(kClientAddr);
+  std::set<std::string> target;
+  target.insert(cricket::LOCAL_PORT_TYPE);
+  target.insert(cricket::STUN_PORT_TYPE);
+  allocator().set_candidate_target(target);
+  EXPECT_TRUE(CreateSession(cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  session_->GetInitialPorts();
+  session_->StartGetAllPorts();
+  EXPECT_TRUE_WAIT(candidate_allocation_done_, 1000);
+  EXPECT_FALSE(session_->IsGettingAllPorts());
+  EXPECT_EQ(2U, candidates_.size());
+
+  // Restarting goes on to the later phases, since no new local or STUN
+  // candidates turn up to meet the target again.
+  session_->StartGetAllPorts();
+  EXPECT_TRUE(session_->IsGettingAllPorts());
+  EXPECT_TRUE_WAIT(HasCandidateOfType(cricket::RELAY_PORT_TYPE), 2000);
+  EXPECT_TRUE(session_->IsGettingAllPorts());
+  session_->StopGetAllPorts();
+}
+
 TEST_F(PortAllocatorTest, TestBasicMuxFeatures) {
   allocator().set_flags(cricket::PORTALLOCATOR_ENABLE_BUNDLE);
   // Session ID - session1.
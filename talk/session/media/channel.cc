@@ -31,11 +31,13 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/rtputils.h"
 #include "talk/p2p/base/transportchannel.h"
 #include "talk/session/media/channelmanager.h"
 #include "talk/session/media/mediamessages.h"
 #include "talk/session/media/rtcpmuxfilter.h"
+#include "talk/session/media/srtpcryptopool.h"
 #include "talk/session/media/typingmonitor.h"
 
 
@@ -78,6 +80,11 @@ enum {
   MSG_SETSCREENCASTFACTORY,
   MSG_FIRSTPACKETRECEIVED,
   MSG_SESSION_ERROR,
+  MSG_SRTPPROTECT,
+  MSG_SRTPUNPROTECT,
+  MSG_SRTPPROTECTED,
+  MSG_SRTPUNPROTECTED,
+  MSG_SRTPFLUSH,
 };
 
 // Value specified in RFC 5764.
@@ -189,6 +196,25 @@ struct PacketMessageData : public talk_base::MessageData {
   talk_base::Buffer packet;
 };
 
+// A packet on its way through a crypto thread and back to the worker thread.
+struct SrtpJobMessageData : public talk_base::MessageData {
+  SrtpJobMessageData(bool rtcp, talk_base::Buffer* in_packet,
+                     SrtpCryptoPool* pool)
+      : rtcp(rtcp),
+        pool(pool),
+        queued_ns(talk_base::TimeNanos()),
+        started_ns(0),
+        result(false) {
+    in_packet->TransferTo(&packet);
+  }
+  bool rtcp;
+  talk_base::Buffer packet;
+  SrtpCryptoPool* pool;
+  uint64 queued_ns;
+  uint64 started_ns;
+  bool result;
+};
+
 struct RenderMessageData : public talk_base::MessageData {
   RenderMessageData(uint32 s, VideoRenderer* r) : ssrc(s), renderer(r) {}
   uint32 ssrc;
@@ -418,6 +444,9 @@ BaseChannel::BaseChannel(talk_base::Thread* thread,
       rtcp_(rtcp),
       transport_channel_(NULL),
       rtcp_transport_channel_(NULL),
+      srtp_crypto_pool_(NULL),
+      send_crypto_thread_(NULL),
+      recv_crypto_thread_(NULL),
       enabled_(false),
       writable_(false),
       optimistic_data_send_(false),
@@ -434,6 +463,10 @@ BaseChannel::BaseChannel(talk_base::Thread* thread,
 BaseChannel::~BaseChannel() {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
   StopConnectionMonitor();
+  // The derived destructors have already detached the crypto pool, so no
+  // crypto thread is still calling into us. Results it posted back are
+  // dropped by Clear() below.
+  ASSERT(srtp_crypto_pool_ == NULL);
   FlushRtcpMessages();  // Send any outstanding RTCP packets.
   Clear();  // eats any outstanding messages or packets
   // We must destroy the media channel before the transport channel, otherwise
@@ -666,34 +699,16 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
 
   // Protect if needed.
   if (srtp_filter_.IsActive()) {
-    bool res;
-    char* data = packet->data();
-    int len = packet->length();
-    if (!rtcp) {
-      res = srtp_filter_.ProtectRtp(data, len, packet->capacity(), &len);
-      if (!res) {
-        int seq_num = -1;
-        uint32 ssrc = 0;
-        GetRtpSeqNum(data, len, &seq_num);
-        GetRtpSsrc(data, len, &ssrc);
-        LOG(LS_ERROR) << "Failed to protect " << content_name_
-                      << " RTP packet: size=" << len
-                      << ", seqnum=" << seq_num << ", SSRC=" << ssrc;
-        return false;
-      }
-    } else {
-      res = srtp_filter_.ProtectRtcp(data, len, packet->capacity(), &len);
-      if (!res) {
-        int type = -1;
-        GetRtcpType(data, len, &type);
-        LOG(LS_ERROR) << "Failed to protect " << content_name_
-                      << " RTCP packet: size=" << len << ", type=" << type;
-        return false;
-      }
+    if (srtp_crypto_pool_) {
+      // Our send session's crypto thread protects the packet and hands it
+      // back in MSG_SRTPPROTECTED.
+      send_crypto_thread_->Post(this, MSG_SRTPPROTECT,
+          new SrtpJobMessageData(rtcp, packet, srtp_crypto_pool_));
+      return true;
+    }
+    if (!ProtectPacket(rtcp, packet)) {
+      return false;
     }
-
-    // Update the length of the packet now that we've added the auth tag.
-    packet->SetLength(len);
   } else if (secure_required_) {
     // This is a double check for something that supposedly can't happen.
     LOG(LS_ERROR) <<
@@ -702,6 +717,50 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
     return false;
   }
 
+  return SendProtectedPacket_w(rtcp, packet);
+}
+
+bool BaseChannel::ProtectPacket(bool rtcp, talk_base::Buffer* packet) {
+  bool res;
+  char* data = packet->data();
+  int len = packet->length();
+  if (!rtcp) {
+    res = srtp_filter_.ProtectRtp(data, len, packet->capacity(), &len);
+    if (!res) {
+      int seq_num = -1;
+      uint32 ssrc = 0;
+      GetRtpSeqNum(data, len, &seq_num);
+      GetRtpSsrc(data, len, &ssrc);
+      LOG(LS_ERROR) << "Failed to protect " << content_name_
+                    << " RTP packet: size=" << len
+                    << ", seqnum=" << seq_num << ", SSRC=" << ssrc;
+      return false;
+    }
+  } else {
+    res = srtp_filter_.ProtectRtcp(data, len, packet->capacity(), &len);
+    if (!res) {
+      int type = -1;
+      GetRtcpType(data, len, &type);
+      LOG(LS_ERROR) << "Failed to protect " << content_name_
+                    << " RTCP packet: size=" << len << ", type=" << type;
+      return false;
+    }
+  }
+
+  // Update the length of the packet now that we've added the auth tag.
+  packet->SetLength(len);
+  return true;
+}
+
+bool BaseChannel::SendProtectedPacket_w(bool rtcp, talk_base::Buffer* packet) {
+  // Look the transport channel up again, as it may have changed while the
+  // packet was with a crypto thread.
+  TransportChannel* channel = (!rtcp || rtcp_mux_filter_.IsActive()) ?
+      transport_channel_ : rtcp_transport_channel_;
+  if (!channel || (!optimistic_data_send_ && !channel->writable())) {
+    return false;
+  }
+
   // Signal to the media sink after protecting the packet.
   {
     talk_base::CritScope cs(&signal_send_packet_cs_);
@@ -744,33 +803,16 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
 
   // Unprotect the packet, if needed.
   if (srtp_filter_.IsActive()) {
-    char* data = packet->data();
-    int len = packet->length();
-    bool res;
-    if (!rtcp) {
-      res = srtp_filter_.UnprotectRtp(data, len, &len);
-      if (!res) {
-        int seq_num = -1;
-        uint32 ssrc = 0;
-        GetRtpSeqNum(data, len, &seq_num);
-        GetRtpSsrc(data, len, &ssrc);
-        LOG(LS_ERROR) << "Failed to unprotect " << content_name_
-                      << " RTP packet: size=" << len
-                      << ", seqnum=" << seq_num << ", SSRC=" << ssrc;
-        return;
-      }
-    } else {
-      res = srtp_filter_.UnprotectRtcp(data, len, &len);
-      if (!res) {
-        int type = -1;
-        GetRtcpType(data, len, &type);
-        LOG(LS_ERROR) << "Failed to unprotect " << content_name_
-                      << " RTCP packet: size=" << len << ", type=" << type;
-        return;
-      }
+    if (srtp_crypto_pool_) {
+      // Our receive session's crypto thread unprotects the packet and hands it
+      // back in MSG_SRTPUNPROTECTED.
+      recv_crypto_thread_->Post(this, MSG_SRTPUNPROTECT,
+          new SrtpJobMessageData(rtcp, packet, srtp_crypto_pool_));
+      return;
+    }
+    if (!UnprotectPacket(rtcp, packet)) {
+      return;
     }
-
-    packet->SetLength(len);
   } else if (secure_required_) {
     // This is a double check for something that supposedly can't happen.
     LOG(LS_ERROR) <<
@@ -779,6 +821,41 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
     return;
   }
 
+  DeliverPacket_w(rtcp, packet);
+}
+
+bool BaseChannel::UnprotectPacket(bool rtcp, talk_base::Buffer* packet) {
+  char* data = packet->data();
+  int len = packet->length();
+  bool res;
+  if (!rtcp) {
+    res = srtp_filter_.UnprotectRtp(data, len, &len);
+    if (!res) {
+      int seq_num = -1;
+      uint32 ssrc = 0;
+      GetRtpSeqNum(data, len, &seq_num);
+      GetRtpSsrc(data, len, &ssrc);
+      LOG(LS_ERROR) << "Failed to unprotect " << content_name_
+                    << " RTP packet: size=" << len
+                    << ", seqnum=" << seq_num << ", SSRC=" << ssrc;
+      return false;
+    }
+  } else {
+    res = srtp_filter_.UnprotectRtcp(data, len, &len);
+    if (!res) {
+      int type = -1;
+      GetRtcpType(data, len, &type);
+      LOG(LS_ERROR) << "Failed to unprotect " << content_name_
+                    << " RTCP packet: size=" << len << ", type=" << type;
+      return false;
+    }
+  }
+
+  packet->SetLength(len);
+  return true;
+}
+
+void BaseChannel::DeliverPacket_w(bool rtcp, talk_base::Buffer* packet) {
   // Signal to the media sink after unprotecting the packet.
   {
     talk_base::CritScope cs(&signal_recv_packet_cs_);
@@ -793,6 +870,24 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
   }
 }
 
+void BaseChannel::SetSrtpCryptoPool(SrtpCryptoPool* pool) {
+  ASSERT(worker_thread_ == talk_base::Thread::Current());
+  FlushSrtpJobs_w();
+  srtp_crypto_pool_ = pool;
+  send_crypto_thread_ = pool ? pool->AssignThread() : NULL;
+  recv_crypto_thread_ = pool ? pool->AssignThread() : NULL;
+}
+
+void BaseChannel::FlushSrtpJobs_w() {
+  // A crypto thread runs its messages in order, so once it has handled this
+  // one, it is done with everything we queued to it before.
+  if (send_crypto_thread_) {
+    send_crypto_thread_->Send(this, MSG_SRTPFLUSH);
+  }
+  if (recv_crypto_thread_) {
+    recv_crypto_thread_->Send(this, MSG_SRTPFLUSH);
+  }
+}
 
 void BaseChannel::OnSessionState(BaseSession* session,
                                  BaseSession::State state) {
@@ -919,6 +1014,7 @@ bool BaseChannel::SetDtlsSrtpCiphers(TransportChannel *tc, bool rtcp) {
 // *or* DTLS-SRTP is successfully set up.
 bool BaseChannel::SetupDtlsSrtp(bool rtcp_channel) {
   bool ret = false;
+  FlushSrtpJobs_w();
 
   TransportChannel *channel = rtcp_channel ?
       rtcp_transport_channel_ : transport_channel_;
@@ -1020,6 +1116,7 @@ bool BaseChannel::SetMaxSendBandwidth_w(int max_bandwidth) {
 bool BaseChannel::SetSrtp_w(const std::vector<CryptoParams>& cryptos,
                             ContentAction action, ContentSource src) {
   bool ret = false;
+  FlushSrtpJobs_w();
   switch (action) {
     case CA_OFFER:
       ret = srtp_filter_.SetOffer(cryptos, src);
@@ -1339,6 +1436,40 @@ void BaseChannel::OnMessage(talk_base::Message *pmsg) {
       session_->SetError(data->error_);
       break;
     }
+    // These two run on a crypto thread.
+    case MSG_SRTPPROTECT:
+    case MSG_SRTPUNPROTECT: {
+      SrtpJobMessageData* data = static_cast<SrtpJobMessageData*>(pmsg->pdata);
+      data->started_ns = talk_base::TimeNanos();
+      if (pmsg->message_id == MSG_SRTPPROTECT) {
+        data->result = ProtectPacket(data->rtcp, &data->packet);
+        worker_thread_->Post(this, MSG_SRTPPROTECTED, data);
+      } else {
+        data->result = UnprotectPacket(data->rtcp, &data->packet);
+        worker_thread_->Post(this, MSG_SRTPUNPROTECTED, data);
+      }
+      break;
+    }
+    case MSG_SRTPPROTECTED:
+    case MSG_SRTPUNPROTECTED: {
+      SrtpJobMessageData* data = static_cast<SrtpJobMessageData*>(pmsg->pdata);
+      uint64 turnaround_ns = talk_base::TimeNanos() - data->queued_ns;
+      bool succeeded = data->result;
+      if (succeeded) {
+        if (pmsg->message_id == MSG_SRTPPROTECTED) {
+          // Nobody is waiting for the result, so the pool counts failures.
+          succeeded = SendProtectedPacket_w(data->rtcp, &data->packet);
+        } else {
+          DeliverPacket_w(data->rtcp, &data->packet);
+        }
+      }
+      data->pool->AddJob(data->started_ns - data->queued_ns,
+                         turnaround_ns, succeeded);
+      delete data;  // because it is Posted
+      break;
+    }
+    case MSG_SRTPFLUSH:
+      break;
   }
 }
 
@@ -1383,6 +1514,9 @@ VoiceChannel::VoiceChannel(talk_base::Thread* thread,
 }
 
 VoiceChannel::~VoiceChannel() {
+  // Finish the SRTP jobs on the crypto threads first; they call our virtual
+  // OnMessage and may fire SignalSrtpError.
+  SetSrtpCryptoPool(NULL);
   StopAudioMonitor();
   StopMediaMonitor();
   // this can't be done in the base class, since it calls a virtual
@@ -1842,6 +1976,9 @@ void VoiceChannel::SendLastMediaError() {
 }
 
 VideoChannel::~VideoChannel() {
+  // Finish the SRTP jobs on the crypto threads first; they call our virtual
+  // OnMessage and may fire SignalSrtpError.
+  SetSrtpCryptoPool(NULL);
   std::vector<uint32> screencast_ssrcs;
   ScreencastMap::iterator iter;
   while (!screencast_capturers_.empty()) {
@@ -2335,6 +2472,9 @@ DataChannel::DataChannel(talk_base::Thread* thread,
 }
 
 DataChannel::~DataChannel() {
+  // Finish the SRTP jobs on the crypto threads first; they call our virtual
+  // OnMessage and may fire SignalSrtpError.
+  SetSrtpCryptoPool(NULL);
   StopMediaMonitor();
   // this can't be done in the base class, since it calls a virtual
   DisableMedia_w();
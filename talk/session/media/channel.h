@@ -54,6 +54,7 @@ namespace cricket {
 
 struct CryptoParams;
 class MediaContentDescription;
+class SrtpCryptoPool;
 struct TypingMonitorOptions;
 class TypingMonitor;
 struct ViewRequest;
@@ -128,6 +129,17 @@ class BaseChannel
     srtp_filter_.set_signal_silent_time(silent_time);
   }
 
+  // Hands SRTP protection and unprotection of this channel's packets to the
+  // threads of |pool| rather than doing it on the worker thread. The send and
+  // receive sessions are each pinned to one crypto thread, so packets stay in
+  // order. NULL, the default, does the crypto inline again. Must be called on
+  // the worker thread; |pool| must outlive the channel. Subclasses must set it
+  // back to NULL first thing in their destructor.
+  // With a pool, SendPacket returns true once an SRTP packet is queued for
+  // protection; failures to protect or send it later show up only in the
+  // pool's Stats::failed_jobs (and the log, for SRTP errors).
+  void SetSrtpCryptoPool(SrtpCryptoPool* pool);
+
   void set_content_name(const std::string& content_name) {
     ASSERT(signaling_thread()->IsCurrent());
     ASSERT(!writable_);
@@ -259,6 +271,17 @@ class BaseChannel
                     size_t len);
   bool SendPacket(bool rtcp, talk_base::Buffer* packet);
   void HandlePacket(bool rtcp, talk_base::Buffer* packet);
+  // SRTP stage of SendPacket and HandlePacket. These run on the worker thread,
+  // or on a crypto thread when a SrtpCryptoPool is set.
+  bool ProtectPacket(bool rtcp, talk_base::Buffer* packet);
+  bool UnprotectPacket(bool rtcp, talk_base::Buffer* packet);
+  // What SendPacket and HandlePacket do with a packet once it went through
+  // SRTP.
+  bool SendProtectedPacket_w(bool rtcp, talk_base::Buffer* packet);
+  void DeliverPacket_w(bool rtcp, talk_base::Buffer* packet);
+  // Waits until the crypto threads are done with the packets queued to them
+  // so far, so that |srtp_filter_| can be changed.
+  void FlushSrtpJobs_w();
 
   // Setting the send codec based on the remote description.
   void OnSessionState(BaseSession* session, BaseSession::State state);
@@ -330,6 +353,9 @@ class BaseChannel
   TransportChannel* transport_channel_;
   TransportChannel* rtcp_transport_channel_;
   SrtpFilter srtp_filter_;
+  SrtpCryptoPool* srtp_crypto_pool_;
+  talk_base::Thread* send_crypto_thread_;
+  talk_base::Thread* recv_crypto_thread_;
   RtcpMuxFilter rtcp_mux_filter_;
   SsrcMuxFilter ssrc_filter_;
   talk_base::scoped_ptr<SocketMonitor> socket_monitor_;
@@ -44,6 +44,7 @@
 #include "talk/session/media/mediamessages.h"
 #include "talk/session/media/mediarecorder.h"
 #include "talk/session/media/mediasessionclient.h"
+#include "talk/session/media/srtpcryptopool.h"
 #include "talk/session/media/typingmonitor.h"
 
 #define MAYBE_SKIP_TEST(feature)                    \
@@ -1329,6 +1330,43 @@ class ChannelTest : public testing::Test, public sigslot::has_slots<> {
     EXPECT_TRUE(CheckNoRtcp2());
   }
 
+  // Test that we properly send SRTP with the crypto done by a SrtpCryptoPool,
+  // and that packets come out in the order they were sent.
+  void SendSrtpToSrtpWithCryptoPool() {
+    static const int kNumPackets = 20;
+    cricket::SrtpCryptoPool pool(2);
+    CreateChannels(RTCP | SECURE, RTCP | SECURE);
+    channel1_->SetSrtpCryptoPool(&pool);
+    channel2_->SetSrtpCryptoPool(&pool);
+    EXPECT_TRUE(SendInitiate());
+    EXPECT_TRUE(SendAccept());
+    EXPECT_TRUE(channel1_->secure());
+    EXPECT_TRUE(channel2_->secure());
+    for (int i = 0; i < kNumPackets; ++i) {
+      std::string data(rtp_packet_);
+      talk_base::SetBE16(const_cast<char*>(data.c_str()) + 2, i);
+      EXPECT_TRUE(media_channel1_->SendRtp(data.c_str(), data.size()));
+    }
+    EXPECT_TRUE(SendRtcp2());
+    EXPECT_EQ_WAIT(static_cast<size_t>(kNumPackets),
+                   media_channel2_->rtp_packets().size(), kEventTimeout);
+    for (int i = 0; i < kNumPackets; ++i) {
+      std::string data(rtp_packet_);
+      talk_base::SetBE16(const_cast<char*>(data.c_str()) + 2, i);
+      EXPECT_TRUE(media_channel2_->CheckRtp(data.c_str(), data.size()));
+    }
+    EXPECT_TRUE_WAIT(CheckRtcp1(), kEventTimeout);
+    EXPECT_TRUE(CheckNoRtp2());
+    EXPECT_TRUE(CheckNoRtcp1());
+    // Each packet was protected and unprotected.
+    EXPECT_EQ(static_cast<uint32>(2 * (kNumPackets + 1)),
+              pool.GetStats().jobs);
+    EXPECT_EQ(0U, pool.GetStats().failed_jobs);
+    // The channels must go before the pool does.
+    channel1_.reset();
+    channel2_.reset();
+  }
+
   // Test that the mediachannel retains its sending state after the transport
   // becomes non-writable.
   void SendWithWritabilityLoss() {
@@ -2075,6 +2113,10 @@ TEST_F(VoiceChannelTest, SendSrtpToSrtpOnThread) {
   Base::SendSrtpToSrtpOnThread();
 }
 
+TEST_F(VoiceChannelTest, SendSrtpToSrtpWithCryptoPool) {
+  Base::SendSrtpToSrtpWithCryptoPool();
+}
+
 TEST_F(VoiceChannelTest, SendWithWritabilityLoss) {
   Base::SendWithWritabilityLoss();
 }
@@ -2478,6 +2520,10 @@ TEST_F(VideoChannelTest, SendSrtpToSrtpOnThread) {
   Base::SendSrtpToSrtpOnThread();
 }
 
+TEST_F(VideoChannelTest, SendSrtpToSrtpWithCryptoPool) {
+  Base::SendSrtpToSrtpWithCryptoPool();
+}
+
 TEST_F(VideoChannelTest, SendWithWritabilityLoss) {
   Base::SendWithWritabilityLoss();
 }
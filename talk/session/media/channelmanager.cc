@@ -41,6 +41,7 @@
 #include "talk/media/base/rtpdataengine.h"
 #include "talk/media/base/videocapturer.h"
 #include "talk/session/media/soundclip.h"
+#include "talk/session/media/srtpcryptopool.h"
 
 namespace cricket {
 
@@ -244,6 +245,7 @@ void ChannelManager::Construct(MediaEngineInterface* me,
   initialized_ = false;
   main_thread_ = talk_base::Thread::Current();
   worker_thread_ = worker_thread;
+  srtp_crypto_threads_ = 0;
   audio_in_device_ = DeviceManagerInterface::kDefaultDeviceName;
   audio_out_device_ = DeviceManagerInterface::kDefaultDeviceName;
   audio_options_ = MediaEngineInterface::DEFAULT_AUDIO_OPTIONS;
@@ -311,6 +313,9 @@ bool ChannelManager::Init() {
   if (worker_thread_ && worker_thread_->started()) {
     if (media_engine_->Init()) {
       initialized_ = true;
+      if (srtp_crypto_threads_ > 0 && !srtp_crypto_pool_) {
+        srtp_crypto_pool_.reset(new SrtpCryptoPool(srtp_crypto_threads_));
+      }
 
       // Now that we're initialized, apply any stored preferences. A preferred
       // device might have been unplugged. In this case, we fallback to the
@@ -421,6 +426,9 @@ VoiceChannel* ChannelManager::CreateVoiceChannel_w(
   VoiceChannel* voice_channel = new VoiceChannel(
       worker_thread_, media_engine_.get(), media_channel,
       session, content_name, rtcp);
+  if (srtp_crypto_pool_) {
+    voice_channel->SetSrtpCryptoPool(srtp_crypto_pool_.get());
+  }
   if (!voice_channel->Init()) {
     delete voice_channel;
     return NULL;
@@ -471,6 +479,9 @@ VideoChannel* ChannelManager::CreateVideoChannel_w(
   VideoChannel* video_channel = new VideoChannel(
       worker_thread_, media_engine_.get(), media_channel,
       session, content_name, rtcp, voice_channel);
+  if (srtp_crypto_pool_) {
+    video_channel->SetSrtpCryptoPool(srtp_crypto_pool_.get());
+  }
   if (!video_channel->Init()) {
     delete video_channel;
     return NULL;
@@ -513,6 +524,9 @@ DataChannel* ChannelManager::CreateDataChannel_w(
   DataChannel* data_channel = new DataChannel(
       worker_thread_, media_channel,
       session, content_name, rtcp);
+  if (srtp_crypto_pool_) {
+    data_channel->SetSrtpCryptoPool(srtp_crypto_pool_.get());
+  }
   if (!data_channel->Init()) {
     LOG(LS_WARNING) << "Failed to init data channel.";
     delete data_channel;
@@ -42,6 +42,7 @@ namespace cricket {
 
 class CaptureManager;
 class Soundclip;
+class SrtpCryptoPool;
 class VideoProcessor;
 class VoiceChannel;
 class VoiceProcessor;
@@ -81,6 +82,13 @@ class ChannelManager : public talk_base::MessageHandler,
     worker_thread_ = thread;
     return true;
   }
+  // Sets how many threads the channels hand their SRTP crypto to. 0, the
+  // default, keeps it on the worker thread. Returns false if called after Init.
+  bool set_srtp_crypto_threads(int num_threads) {
+    if (initialized_) return false;
+    srtp_crypto_threads_ = num_threads;
+    return true;
+  }
 
   // Gets capabilities. Can be called prior to starting the media engine.
   int GetCapabilities();
@@ -282,6 +290,8 @@ class ChannelManager : public talk_base::MessageHandler,
   bool initialized_;
   talk_base::Thread* main_thread_;
   talk_base::Thread* worker_thread_;
+  int srtp_crypto_threads_;
+  talk_base::scoped_ptr<SrtpCryptoPool> srtp_crypto_pool_;
 
   VoiceChannels voice_channels_;
   VideoChannels video_channels_;
@@ -153,6 +153,25 @@ TEST_F(ChannelManagerTest, CreateDestroyChannelsOnThread) {
   cm_->Terminate();
 }
 
+// Test that we can create and destroy channels that use SRTP crypto threads.
+TEST_F(ChannelManagerTest, CreateDestroyChannelsWithSrtpCryptoThreads) {
+  worker_.Start();
+  EXPECT_TRUE(cm_->set_worker_thread(&worker_));
+  EXPECT_TRUE(cm_->set_srtp_crypto_threads(2));
+  EXPECT_TRUE(cm_->Init());
+  EXPECT_FALSE(cm_->set_srtp_crypto_threads(4));
+  cricket::VoiceChannel* voice_channel = cm_->CreateVoiceChannel(
+      session_, cricket::CN_AUDIO, false);
+  EXPECT_TRUE(voice_channel != NULL);
+  cricket::VideoChannel* video_channel =
+      cm_->CreateVideoChannel(session_, cricket::CN_VIDEO,
+                              false, voice_channel);
+  EXPECT_TRUE(video_channel != NULL);
+  cm_->DestroyVideoChannel(video_channel);
+  cm_->DestroyVoiceChannel(voice_channel);
+  cm_->Terminate();
+}
+
 // Test that we fail to create a voice/video channel if the session is unable
 // to create a cricket::TransportChannel
 TEST_F(ChannelManagerTest, NoTransportChannelTest) {
@@ -0,0 +1,98 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "talk/session/media/srtpcryptopool.h"
+
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+#include "talk/base/thread.h"
+
+namespace cricket {
+
+SrtpCryptoPool::Stats::Stats()
+    : jobs(0),
+      total_queue_time_ns(0),
+      max_queue_time_ns(0),
+      total_turnaround_time_ns(0),
+      max_turnaround_time_ns(0),
+      failed_jobs(0) {
+}
+
+SrtpCryptoPool::SrtpCryptoPool(int num_threads)
+    : next_thread_(0) {
+  ASSERT(num_threads > 0);
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    talk_base::Thread* thread = new talk_base::Thread();
+    thread->SetName("SrtpCryptoThread", this);
+    thread->Start();
+    threads_.push_back(thread);
+  }
+  LOG(LS_INFO) << "Started " << num_threads << " SRTP crypto threads";
+}
+
+SrtpCryptoPool::~SrtpCryptoPool() {
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i]->Stop();
+    delete threads_[i];
+  }
+}
+
+talk_base::Thread* SrtpCryptoPool::AssignThread() {
+  talk_base::CritScope cs(&crit_);
+  talk_base::Thread* thread = threads_[next_thread_];
+  next_thread_ = (next_thread_ + 1) % threads_.size();
+  return thread;
+}
+
+void SrtpCryptoPool::AddJob(uint64 queue_time_ns, uint64 turnaround_time_ns,
+                            bool succeeded) {
+  talk_base::CritScope cs(&crit_);
+  ++stats_.jobs;
+  if (!succeeded) {
+    ++stats_.failed_jobs;
+  }
+  stats_.total_queue_time_ns += queue_time_ns;
+  stats_.total_turnaround_time_ns += turnaround_time_ns;
+  if (queue_time_ns > stats_.max_queue_time_ns) {
+    stats_.max_queue_time_ns = queue_time_ns;
+  }
+  if (turnaround_time_ns > stats_.max_turnaround_time_ns) {
+    stats_.max_turnaround_time_ns = turnaround_time_ns;
+  }
+}
+
+SrtpCryptoPool::Stats SrtpCryptoPool::GetStats() const {
+  talk_base::CritScope cs(&crit_);
+  return stats_;
+}
+
+}  // namespace cricket
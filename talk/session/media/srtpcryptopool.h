@@ -0,0 +1,95 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef TALK_SESSION_MEDIA_SRTPCRYPTOPOOL_H_
+#define TALK_SESSION_MEDIA_SRTPCRYPTOPOOL_H_
+
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+
+namespace talk_base {
+class Thread;
+}
+
+namespace cricket {
+
+// A set of threads that BaseChannels hand SRTP protect/unprotect work to, so
+// that a worker thread hosting many channels is not bound by the cipher
+// throughput of a single core. Each SRTP session is pinned to one of the
+// threads, which serializes access to its libsrtp state and keeps its packets
+// in order; see BaseChannel::SetSrtpCryptoPool.
+class SrtpCryptoPool {
+ public:
+  struct Stats {
+    Stats();
+    uint32 jobs;
+    // Time from a packet being queued by the worker thread until a crypto
+    // thread picked it up.
+    uint64 total_queue_time_ns;
+    uint64 max_queue_time_ns;
+    // Time from a packet being queued until its result was back on the worker
+    // thread.
+    uint64 total_turnaround_time_ns;
+    uint64 max_turnaround_time_ns;
+    // Packets that failed to protect or unprotect, or to send once protected.
+    // A channel using the pool can't return these errors from SendPacket.
+    uint32 failed_jobs;
+  };
+
+  // Starts |num_threads| crypto threads, at least one.
+  explicit SrtpCryptoPool(int num_threads);
+  // Stops the crypto threads; all channels using the pool must be gone.
+  ~SrtpCryptoPool();
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+  // Returns the thread the next SRTP session should be pinned to. Sessions are
+  // spread over the threads round-robin. Can be called from any thread.
+  talk_base::Thread* AssignThread();
+
+  // Records the latencies of one packet and whether it made it through. Can
+  // be called from any thread.
+  void AddJob(uint64 queue_time_ns, uint64 turnaround_time_ns, bool succeeded);
+  Stats GetStats() const;
+
+ private:
+  std::vector<talk_base::Thread*> threads_;
+  mutable talk_base::CriticalSection crit_;
+  size_t next_thread_;
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SrtpCryptoPool);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_SESSION_MEDIA_SRTPCRYPTOPOOL_H_
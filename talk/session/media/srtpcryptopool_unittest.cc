@@ -0,0 +1,93 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "talk/session/media/srtpcryptopool.h"
+
+#include <set>
+
+#include "talk/base/gunit.h"
+#include "talk/base/thread.h"
+
+namespace {
+
+class CountingHandler : public talk_base::MessageHandler {
+ public:
+  CountingHandler() : count_(0) {}
+  virtual void OnMessage(talk_base::Message* msg) { ++count_; }
+  int count() const { return count_; }
+
+ private:
+  int count_;
+};
+
+}  // namespace
+
+// Test that sessions are spread over all the threads, round-robin.
+TEST(SrtpCryptoPoolTest, TestAssignThread) {
+  cricket::SrtpCryptoPool pool(3);
+  EXPECT_EQ(3, pool.num_threads());
+  std::set<talk_base::Thread*> threads;
+  talk_base::Thread* first = pool.AssignThread();
+  threads.insert(first);
+  threads.insert(pool.AssignThread());
+  threads.insert(pool.AssignThread());
+  EXPECT_EQ(3U, threads.size());
+  EXPECT_EQ(first, pool.AssignThread());
+  EXPECT_TRUE(threads.find(talk_base::Thread::Current()) == threads.end());
+}
+
+// Test that the pool's threads are running and run their work in order.
+TEST(SrtpCryptoPoolTest, TestThreadsRun) {
+  cricket::SrtpCryptoPool pool(2);
+  talk_base::Thread* thread = pool.AssignThread();
+  CountingHandler handler;
+  for (int i = 0; i < 10; ++i) {
+    thread->Post(&handler);
+  }
+  // Send runs after everything posted before it.
+  thread->Send(&handler);
+  EXPECT_EQ(11, handler.count());
+}
+
+TEST(SrtpCryptoPoolTest, TestStats) {
+  cricket::SrtpCryptoPool pool(1);
+  cricket::SrtpCryptoPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(0U, stats.jobs);
+  EXPECT_EQ(0U, stats.max_queue_time_ns);
+  EXPECT_EQ(0U, stats.failed_jobs);
+  pool.AddJob(100, 300, true);
+  pool.AddJob(200, 250, false);
+  stats = pool.GetStats();
+  EXPECT_EQ(2U, stats.jobs);
+  EXPECT_EQ(1U, stats.failed_jobs);
+  EXPECT_EQ(300U, stats.total_queue_time_ns);
+  EXPECT_EQ(200U, stats.max_queue_time_ns);
+  EXPECT_EQ(550U, stats.total_turnaround_time_ns);
+  EXPECT_EQ(300U, stats.max_turnaround_time_ns);
+}
@@ -231,6 +231,28 @@ bool SrtpFilter::UnprotectRtcp(void* p, int in_len, int* out_len) {
   }
 }
 
+int SrtpFilter::ProtectRtpBatch(SrtpPacket* packets, int count) {
+  if (!IsActive()) {
+    LOG(LS_WARNING) << "Failed to ProtectRtpBatch: SRTP not active";
+    for (int i = 0; i < count; ++i) {
+      packets[i].ok = false;
+    }
+    return 0;
+  }
+  return send_session_->ProtectRtpBatch(packets, count);
+}
+
+int SrtpFilter::UnprotectRtpBatch(SrtpPacket* packets, int count) {
+  if (!IsActive()) {
+    LOG(LS_WARNING) << "Failed to UnprotectRtpBatch: SRTP not active";
+    for (int i = 0; i < count; ++i) {
+      packets[i].ok = false;
+    }
+    return 0;
+  }
+  return recv_session_->UnprotectRtpBatch(packets, count);
+}
+
 void SrtpFilter::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   signal_silent_time_in_ms_ = signal_silent_time_in_ms;
   if (state_ == ST_ACTIVE) {
@@ -420,11 +442,13 @@ SrtpSession::SrtpSession()
       rtcp_auth_tag_len_(0),
       srtp_stat_(new SrtpStat()),
       last_send_seq_num_(-1) {
+  talk_base::CritScope cs(sessions_crit());
   sessions()->push_back(this);
   SignalSrtpError.repeat(srtp_stat_->SignalSrtpError);
 }
 
 SrtpSession::~SrtpSession() {
+  talk_base::CritScope cs(sessions_crit());
   sessions()->erase(std::find(sessions()->begin(), sessions()->end(), this));
   if (session_) {
     srtp_dealloc(session_);
@@ -528,6 +552,98 @@ bool SrtpSession::UnprotectRtcp(void* p, int in_len, int* out_len) {
   return true;
 }
 
+// Successful packets aren't reported to |srtp_stat_|, which only acts on
+// errors, and failures are logged once per batch.
+int SrtpSession::ProtectRtpBatch(SrtpPacket* packets, int count) {
+  for (int i = 0; i < count; ++i) {
+    packets[i].ok = false;
+  }
+  if (!session_) {
+    LOG(LS_WARNING) << "Failed to protect SRTP packets: no SRTP Session";
+    return 0;
+  }
+
+  int protected_count = 0;
+  int short_buffers = 0;
+  int failures = 0;
+  int last_err = err_status_ok;
+  const SrtpPacket* last_protected = NULL;
+  for (int i = 0; i < count; ++i) {
+    SrtpPacket* packet = &packets[i];
+    if (packet->max_len < packet->len + rtp_auth_tag_len_) {
+      ++short_buffers;
+      continue;
+    }
+    int in_len = packet->len;
+    int err = srtp_protect(session_, packet->data, &packet->len);
+    if (err != err_status_ok) {
+      uint32 ssrc;
+      if (GetRtpSsrc(packet->data, in_len, &ssrc)) {
+        srtp_stat_->AddProtectRtpResult(ssrc, err);
+      }
+      packet->len = in_len;
+      ++failures;
+      last_err = err;
+      continue;
+    }
+    packet->ok = true;
+    ++protected_count;
+    last_protected = packet;
+  }
+
+  if (short_buffers > 0) {
+    LOG(LS_WARNING) << "Failed to protect " << short_buffers << " of "
+                    << count << " SRTP packets: buffer too short";
+  }
+  if (failures > 0) {
+    LOG(LS_WARNING) << "Failed to protect " << failures << " of " << count
+                    << " SRTP packets, last err=" << last_err
+                    << ", last seqnum=" << last_send_seq_num_;
+  }
+  if (last_protected) {
+    GetRtpSeqNum(last_protected->data, last_protected->len,
+                 &last_send_seq_num_);
+  }
+  return protected_count;
+}
+
+int SrtpSession::UnprotectRtpBatch(SrtpPacket* packets, int count) {
+  for (int i = 0; i < count; ++i) {
+    packets[i].ok = false;
+  }
+  if (!session_) {
+    LOG(LS_WARNING) << "Failed to unprotect SRTP packets: no SRTP Session";
+    return 0;
+  }
+
+  int unprotected_count = 0;
+  int failures = 0;
+  int last_err = err_status_ok;
+  for (int i = 0; i < count; ++i) {
+    SrtpPacket* packet = &packets[i];
+    int in_len = packet->len;
+    int err = srtp_unprotect(session_, packet->data, &packet->len);
+    if (err != err_status_ok) {
+      uint32 ssrc;
+      if (GetRtpSsrc(packet->data, in_len, &ssrc)) {
+        srtp_stat_->AddUnprotectRtpResult(ssrc, err);
+      }
+      packet->len = in_len;
+      ++failures;
+      last_err = err;
+      continue;
+    }
+    packet->ok = true;
+    ++unprotected_count;
+  }
+
+  if (failures > 0) {
+    LOG(LS_WARNING) << "Failed to unprotect " << failures << " of " << count
+                    << " SRTP packets, last err=" << last_err;
+  }
+  return unprotected_count;
+}
+
 void SrtpSession::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   srtp_stat_->set_signal_silent_time(signal_silent_time_in_ms);
 }
@@ -625,6 +741,9 @@ void SrtpSession::HandleEvent(const srtp_event_data_t* ev) {
 }
 
 void SrtpSession::HandleEventThunk(srtp_event_data_t* ev) {
+  // Events come from whichever thread is running libsrtp, which need not be
+  // the one creating and destroying sessions.
+  talk_base::CritScope cs(sessions_crit());
   for (std::list<SrtpSession*>::iterator it = sessions()->begin();
        it != sessions()->end(); ++it) {
     if ((*it)->session_ == ev->session) {
@@ -639,6 +758,11 @@ std::list<SrtpSession*>* SrtpSession::sessions() {
   return &sessions;
 }
 
+talk_base::CriticalSection* SrtpSession::sessions_crit() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(talk_base::CriticalSection, crit, ());
+  return &crit;
+}
+
 #else   // !HAVE_SRTP
 
 // On some systems, SRTP is not (yet) available.
@@ -676,6 +800,22 @@ bool SrtpSession::UnprotectRtcp(void* data, int in_len, int* out_len) {
   return SrtpNotAvailable(__FUNCTION__);
 }
 
+int SrtpSession::ProtectRtpBatch(SrtpPacket* packets, int count) {
+  SrtpNotAvailable(__FUNCTION__);
+  for (int i = 0; i < count; ++i) {
+    packets[i].ok = false;
+  }
+  return 0;
+}
+
+int SrtpSession::UnprotectRtpBatch(SrtpPacket* packets, int count) {
+  SrtpNotAvailable(__FUNCTION__);
+  for (int i = 0; i < count; ++i) {
+    packets[i].ok = false;
+  }
+  return 0;
+}
+
 void SrtpSession::set_signal_silent_time(uint32 signal_silent_time) {
   // Do nothing.
 }
@@ -34,6 +34,7 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/criticalsection.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/sigslotrepeater.h"
 #include "talk/media/base/cryptoparams.h"
@@ -64,6 +65,18 @@ extern const int SRTP_MASTER_KEY_SALT_LEN;
 class SrtpSession;
 class SrtpStat;
 
+// An RTP packet to be protected or unprotected in-place as part of a batch.
+struct SrtpPacket {
+  SrtpPacket() : data(NULL), len(0), max_len(0), ok(false) {}
+  SrtpPacket(void* in_data, int in_len, int in_max_len)
+      : data(in_data), len(in_len), max_len(in_max_len), ok(false) {}
+
+  void* data;
+  int len;      // Packet length; updated when the packet is processed.
+  int max_len;  // Size of the buffer at |data|; only used when protecting.
+  bool ok;      // Set to whether the packet was processed successfully.
+};
+
 void EnableSrtpDebugging();
 
 // Class to transform SRTP to/from RTP.
@@ -126,6 +139,11 @@ class SrtpFilter {
   // If an HMAC is used, this will decrease the packet size.
   bool UnprotectRtp(void* data, int in_len, int* out_len);
   bool UnprotectRtcp(void* data, int in_len, int* out_len);
+  // Protects/unprotects |count| RTP packets in one call, sharing the state
+  // checks, error logging and statistics among them. Each packet's |ok| tells
+  // whether it succeeded; returns the number of packets that did.
+  int ProtectRtpBatch(SrtpPacket* packets, int count);
+  int UnprotectRtpBatch(SrtpPacket* packets, int count);
 
   // Update the silent threshold (in ms) for signaling errors.
   void set_signal_silent_time(uint32 signal_silent_time_in_ms);
@@ -202,6 +220,9 @@ class SrtpSession {
   // If an HMAC is used, this will decrease the packet size.
   bool UnprotectRtp(void* data, int in_len, int* out_len);
   bool UnprotectRtcp(void* data, int in_len, int* out_len);
+  // Protects/unprotects a batch of RTP packets; see SrtpFilter.
+  int ProtectRtpBatch(SrtpPacket* packets, int count);
+  int UnprotectRtpBatch(SrtpPacket* packets, int count);
 
   // Update the silent threshold (in ms) for signaling errors.
   void set_signal_silent_time(uint32 signal_silent_time_in_ms);
@@ -215,6 +236,7 @@ class SrtpSession {
   void HandleEvent(const srtp_event_data_t* ev);
   static void HandleEventThunk(srtp_event_data_t* ev);
   static std::list<SrtpSession*>* sessions();
+  static talk_base::CriticalSection* sessions_crit();
 
   srtp_t session_;
   int rtp_auth_tag_len_;
@@ -265,7 +287,11 @@ class SrtpStat {
           error(in_error) {
     }
     bool operator <(const FailureKey& key) const {
-      return ssrc < key.ssrc || mode < key.mode || error < key.error;
+      if (ssrc != key.ssrc)
+        return ssrc < key.ssrc;
+      if (mode != key.mode)
+        return mode < key.mode;
+      return error < key.error;
     }
     uint32 ssrc;
     SrtpFilter::Mode mode;
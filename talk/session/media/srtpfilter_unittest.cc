@@ -28,6 +28,7 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/gunit.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/cryptoparams.h"
 #include "talk/media/base/fakertp.h"
 #include "talk/p2p/base/sessiondescription.h"
@@ -542,6 +543,103 @@ class SrtpSessionTest : public testing::Test {
     EXPECT_EQ(expected_len, out_len);
     EXPECT_EQ(0, memcmp(rtcp_packet_, kRtcpReport, out_len));
   }
+  // Protects and then unprotects a batch of packets with consecutive
+  // sequence numbers, one of which has no room for the auth tag.
+  void TestProtectUnprotectBatch(const std::string& cs) {
+    static const int kCount = 8;
+    static const int kShortPacket = 5;
+    char packets[kCount][sizeof(kPcmuFrame) + 10];
+    cricket::SrtpPacket batch[kCount];
+    for (int i = 0; i < kCount; ++i) {
+      memcpy(packets[i], kPcmuFrame, sizeof(kPcmuFrame));
+      talk_base::SetBE16(reinterpret_cast<uint8*>(packets[i]) + 2, 100 + i);
+      batch[i] = cricket::SrtpPacket(packets[i], sizeof(kPcmuFrame),
+                                     sizeof(packets[i]));
+    }
+    batch[kShortPacket].max_len = sizeof(kPcmuFrame);
+
+    EXPECT_EQ(kCount - 1, s1_.ProtectRtpBatch(batch, kCount));
+    for (int i = 0; i < kCount; ++i) {
+      if (i == kShortPacket) {
+        EXPECT_FALSE(batch[i].ok);
+        EXPECT_EQ(static_cast<int>(sizeof(kPcmuFrame)), batch[i].len);
+      } else {
+        EXPECT_TRUE(batch[i].ok);
+        EXPECT_EQ(static_cast<int>(sizeof(kPcmuFrame)) + rtp_auth_tag_len(cs),
+                  batch[i].len);
+      }
+    }
+
+    // Drop the packet that failed, and tamper with another one.
+    batch[kShortPacket] = batch[kCount - 1];
+    packets[0][sizeof(kPcmuFrame) - 1] ^= 1;
+    EXPECT_EQ(kCount - 2, s2_.UnprotectRtpBatch(batch, kCount - 1));
+    EXPECT_FALSE(batch[0].ok);
+    for (int i = 1; i < kCount - 1; ++i) {
+      EXPECT_TRUE(batch[i].ok);
+      EXPECT_EQ(static_cast<int>(sizeof(kPcmuFrame)), batch[i].len);
+      // Only the sequence number differs from the original frame.
+      EXPECT_EQ(0, memcmp(static_cast<char*>(batch[i].data) + 4,
+                          kPcmuFrame + 4, sizeof(kPcmuFrame) - 4));
+    }
+  }
+  // Logs the per-packet cost of protecting and unprotecting one packet per
+  // call against batches of |kBatchSize|.
+  void MeasureBatchPerf(const std::string& cs) {
+    static const int kPackets = 32768;
+    static const int kBatchSize = 32;
+    EXPECT_TRUE(s1_.SetSend(cs, kTestKey1, kTestKeyLen));
+    EXPECT_TRUE(s2_.SetRecv(cs, kTestKey1, kTestKeyLen));
+    cricket::SrtpSession s3, s4;
+    EXPECT_TRUE(s3.SetSend(cs, kTestKey2, kTestKeyLen));
+    EXPECT_TRUE(s4.SetRecv(cs, kTestKey2, kTestKeyLen));
+
+    std::vector<std::string> buffers(kPackets);
+    std::vector<cricket::SrtpPacket> packets(kPackets);
+    for (int i = 0; i < kPackets; ++i) {
+      buffers[i].assign(reinterpret_cast<const char*>(kPcmuFrame),
+                        sizeof(kPcmuFrame));
+      buffers[i].resize(sizeof(kPcmuFrame) + 10);
+      talk_base::SetBE16(reinterpret_cast<uint8*>(&buffers[i][0]) + 2,
+                         static_cast<uint16>(i));
+      packets[i] = cricket::SrtpPacket(&buffers[i][0], sizeof(kPcmuFrame),
+                                       buffers[i].size());
+    }
+    std::vector<cricket::SrtpPacket> batched(packets);
+
+    uint32 start = talk_base::Time();
+    for (int i = 0; i < kPackets; ++i) {
+      ASSERT_TRUE(s1_.ProtectRtp(packets[i].data, packets[i].len,
+                                 packets[i].max_len, &packets[i].len));
+    }
+    int protect_time = talk_base::TimeSince(start);
+    start = talk_base::Time();
+    for (int i = 0; i < kPackets; ++i) {
+      ASSERT_TRUE(s2_.UnprotectRtp(packets[i].data, packets[i].len,
+                                   &packets[i].len));
+    }
+    int unprotect_time = talk_base::TimeSince(start);
+
+    start = talk_base::Time();
+    for (int i = 0; i < kPackets; i += kBatchSize) {
+      ASSERT_EQ(kBatchSize, s3.ProtectRtpBatch(&batched[i], kBatchSize));
+    }
+    int protect_batch_time = talk_base::TimeSince(start);
+    start = talk_base::Time();
+    for (int i = 0; i < kPackets; i += kBatchSize) {
+      ASSERT_EQ(kBatchSize, s4.UnprotectRtpBatch(&batched[i], kBatchSize));
+    }
+    int unprotect_batch_time = talk_base::TimeSince(start);
+
+    LOG(LS_INFO) << cs << " per packet: "
+                 << (protect_time * 1000000.0 / kPackets) << " ns to protect, "
+                 << (unprotect_time * 1000000.0 / kPackets)
+                 << " ns to unprotect; in batches of " << kBatchSize << ": "
+                 << (protect_batch_time * 1000000.0 / kPackets)
+                 << " ns to protect, "
+                 << (unprotect_batch_time * 1000000.0 / kPackets)
+                 << " ns to unprotect";
+  }
   cricket::SrtpSession s1_;
   cricket::SrtpSession s2_;
   char rtp_packet_[sizeof(kPcmuFrame) + 10];
@@ -678,6 +776,36 @@ TEST_F(SrtpSessionTest, TestReplay) {
                              &out_len));
 }
 
+// Test that batches of packets are protected and unprotected individually.
+TEST_F(SrtpSessionTest, TestProtectBatch_AES_CM_128_HMAC_SHA1_80) {
+  EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(s2_.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  TestProtectUnprotectBatch(CS_AES_CM_128_HMAC_SHA1_80);
+}
+
+TEST_F(SrtpSessionTest, TestProtectBatch_AES_CM_128_HMAC_SHA1_32) {
+  EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_32, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(s2_.SetRecv(CS_AES_CM_128_HMAC_SHA1_32, kTestKey1, kTestKeyLen));
+  TestProtectUnprotectBatch(CS_AES_CM_128_HMAC_SHA1_32);
+}
+
+// Test that batches fail as a whole when there is no session.
+TEST_F(SrtpSessionTest, TestProtectBatchNoSession) {
+  cricket::SrtpPacket packet(rtp_packet_, rtp_len_, sizeof(rtp_packet_));
+  packet.ok = true;
+  EXPECT_EQ(0, s1_.ProtectRtpBatch(&packet, 1));
+  EXPECT_FALSE(packet.ok);
+  EXPECT_EQ(rtp_len_, packet.len);
+}
+
+TEST_F(SrtpSessionTest, TestBatchPerf_AES_CM_128_HMAC_SHA1_80) {
+  MeasureBatchPerf(CS_AES_CM_128_HMAC_SHA1_80);
+}
+
+TEST_F(SrtpSessionTest, TestBatchPerf_AES_CM_128_HMAC_SHA1_32) {
+  MeasureBatchPerf(CS_AES_CM_128_HMAC_SHA1_32);
+}
+
 class SrtpStatTest
     : public testing::Test,
       public sigslot::has_slots<> {
@@ -29,6 +29,7 @@
 
 #include <algorithm>
 
+#include "talk/base/common.h"
 #include "talk/base/logging.h"
 #include "talk/media/base/rtputils.h"
 
@@ -53,38 +54,78 @@ bool SsrcMuxFilter::DemuxPacket(const char* data, size_t len, bool rtcp) {
   } else {
     int pl_type = 0;
     if (!GetRtcpType(data, len, &pl_type)) return false;
-    if (pl_type == kRtcpTypeSDES) {
-      // SDES packet parsing not supported.
-      LOG(LS_INFO) << "SDES packet received for demux.";
-      return true;
-    } else {
-      if (!GetRtcpSsrc(data, len, &ssrc)) return false;
-      if (ssrc == kSsrc01) {
-        // SSRC 1 has a special meaning and indicates generic feedback on
-        // some systems and should never be dropped.  If it is forwarded
-        // incorrectly it will be ignored by lower layers anyway.
+    // Look past any leading SDES to the sub-packet naming its sender.
+    if (!GetCompoundRtcpSsrc(data, len, &ssrc)) {
+      if (pl_type == kRtcpTypeSDES) {
+        // SDES packet parsing not supported.
+        LOG(LS_INFO) << "SDES packet received for demux.";
         return true;
       }
+      return false;
+    }
+    if (ssrc == kSsrc01) {
+      // SSRC 1 has a special meaning and indicates generic feedback on
+      // some systems and should never be dropped.  If it is forwarded
+      // incorrectly it will be ignored by lower layers anyway.
+      return true;
     }
   }
-  return FindStream(ssrc);
+  return ssrcs_.Find(ssrc) != NULL;
 }
 
 bool SsrcMuxFilter::AddStream(const StreamParams& stream) {
-  if (GetStreamBySsrc(streams_, stream.first_ssrc(), NULL)) {
+  std::vector<uint32> ssrcs;
+  GetStreamSsrcs(stream, &ssrcs);
+  for (size_t i = 0; i < ssrcs.size(); ++i) {
+    if (ssrcs_.Find(ssrcs[i]) != NULL) {
       LOG(LS_WARNING) << "Stream already added to filter";
       return false;
+    }
   }
   streams_.push_back(stream);
+  for (size_t i = 0; i < ssrcs.size(); ++i) {
+    ssrcs_.Insert(ssrcs[i], true);
+  }
   return true;
 }
 
 bool SsrcMuxFilter::RemoveStream(uint32 ssrc) {
-  return RemoveStreamBySsrc(&streams_, ssrc);
+  if (ssrcs_.Find(ssrc) == NULL) {
+    return false;
+  }
+  std::vector<uint32> ssrcs;
+  for (std::vector<StreamParams>::iterator it = streams_.begin();
+       it != streams_.end(); ++it) {
+    GetStreamSsrcs(*it, &ssrcs);
+    if (std::find(ssrcs.begin(), ssrcs.end(), ssrc) != ssrcs.end()) {
+      for (size_t i = 0; i < ssrcs.size(); ++i) {
+        ssrcs_.Erase(ssrcs[i]);
+      }
+      streams_.erase(it);
+      return true;
+    }
+  }
+  ASSERT(false);
+  return false;
 }
 
 bool SsrcMuxFilter::FindStream(uint32 ssrc) const {
-  return (GetStreamBySsrc(streams_, ssrc, NULL));
+  return ssrcs_.Find(ssrc) != NULL;
+}
+
+void SsrcMuxFilter::GetStreamSsrcs(const StreamParams& stream,
+                                   std::vector<uint32>* ssrcs) {
+  ssrcs->clear();
+  std::vector<uint32> all(stream.ssrcs);
+  for (size_t i = 0; i < stream.ssrc_groups.size(); ++i) {
+    const std::vector<uint32>& group = stream.ssrc_groups[i].ssrcs;
+    all.insert(all.end(), group.begin(), group.end());
+  }
+  for (size_t i = 0; i < all.size(); ++i) {
+    if (std::find(ssrcs->begin(), ssrcs->end(), all[i]) == ssrcs->end()) {
+      ssrcs->push_back(all[i]);
+    }
+  }
 }
 
 }  // namespace cricket
@@ -31,6 +31,7 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/flathashmap.h"
 #include "talk/media/base/streamparams.h"
 
 namespace cricket {
@@ -59,7 +60,18 @@ class SsrcMuxFilter {
   bool FindStream(uint32 ssrc) const;
 
  private:
+  // The SSRCs of |streams_|, so that demuxing a packet doesn't scan every
+  // stream. The values are unused.
+  typedef talk_base::FlatHashMap<uint32, bool, talk_base::IntegerHasher>
+      SsrcSet;
+
+  // Gets every SSRC of |stream|, including those only named in its SSRC
+  // groups (e.g. FEC or RTX).
+  static void GetStreamSsrcs(const StreamParams& stream,
+                             std::vector<uint32>* ssrcs);
+
   std::vector<StreamParams> streams_;
+  SsrcSet ssrcs_;
 };
 
 }  // namespace cricket
@@ -26,7 +26,9 @@
  */
 
 
+#include "talk/base/byteorder.h"
 #include "talk/base/gunit.h"
+#include "talk/base/timeutils.h"
 #include "talk/session/media/ssrcmuxfilter.h"
 
 static const int kSsrc1 = 0x1111;
@@ -105,6 +107,13 @@ static const unsigned char kRtcpPacketNonCompoundRtcpPliFeedback[] = {
     0x81, 0xCE, 0x00, 0x0C, 0x00, 0x00, 0x11, 0x11, 0x00, 0x00, 0x11, 0x11,
 };
 
+// SDES = PT = 202, count = 1, SSRC = 0x3333, no items, followed by
+// RR = PT = 201, count = 0, SSRC of sender = 0x2222
+static const unsigned char kRtcpPacketCompoundSdesRrSsrc2[] = {
+    0x81, 0xCA, 0x00, 0x01, 0x00, 0x00, 0x33, 0x33,
+    0x80, 0xC9, 0x00, 0x01, 0x00, 0x00, 0x22, 0x22,
+};
+
 TEST(SsrcMuxFilterTest, AddRemoveStreamTest) {
   cricket::SsrcMuxFilter ssrc_filter;
   EXPECT_FALSE(ssrc_filter.IsActive());
@@ -182,3 +191,110 @@ TEST(SsrcMuxFilterTest, RtcpPacketTest) {
       reinterpret_cast<const char*>(kRtcpPacketNonCompoundRtcpPliFeedback),
       sizeof(kRtcpPacketNonCompoundRtcpPliFeedback), true));
 }
+
+// Test that SSRCs named only in a stream's SSRC groups are demuxed too, and
+// that removing the stream by any of its SSRCs removes all of them.
+TEST(SsrcMuxFilterTest, SsrcGroupTest) {
+  cricket::SsrcMuxFilter ssrc_filter;
+  StreamParams stream;
+  stream.ssrcs.push_back(kSsrc1);
+  std::vector<uint32> fec_ssrcs;
+  fec_ssrcs.push_back(kSsrc1);
+  fec_ssrcs.push_back(kSsrc2);
+  stream.ssrc_groups.push_back(cricket::SsrcGroup("FEC", fec_ssrcs));
+  EXPECT_TRUE(ssrc_filter.AddStream(stream));
+  EXPECT_TRUE(ssrc_filter.FindStream(kSsrc1));
+  EXPECT_TRUE(ssrc_filter.FindStream(kSsrc2));
+  EXPECT_TRUE(ssrc_filter.DemuxPacket(
+      reinterpret_cast<const char*>(kRtpPacketSsrc2),
+      sizeof(kRtpPacketSsrc2), false));
+  // A stream sharing an SSRC with one already added is refused.
+  EXPECT_FALSE(ssrc_filter.AddStream(StreamParams::CreateLegacy(kSsrc2)));
+  EXPECT_TRUE(ssrc_filter.RemoveStream(kSsrc2));
+  EXPECT_FALSE(ssrc_filter.FindStream(kSsrc1));
+  EXPECT_FALSE(ssrc_filter.FindStream(kSsrc2));
+  EXPECT_FALSE(ssrc_filter.IsActive());
+}
+
+// Test that a compound RTCP packet starting with SDES is demuxed by the SSRC
+// of the sub-packet that follows.
+TEST(SsrcMuxFilterTest, RtcpCompoundSdesFirstTest) {
+  cricket::SsrcMuxFilter ssrc_filter;
+  EXPECT_TRUE(ssrc_filter.AddStream(StreamParams::CreateLegacy(kSsrc1)));
+  EXPECT_FALSE(ssrc_filter.DemuxPacket(
+      reinterpret_cast<const char*>(kRtcpPacketCompoundSdesRrSsrc2),
+      sizeof(kRtcpPacketCompoundSdesRrSsrc2), true));
+  EXPECT_TRUE(ssrc_filter.AddStream(StreamParams::CreateLegacy(kSsrc2)));
+  EXPECT_TRUE(ssrc_filter.DemuxPacket(
+      reinterpret_cast<const char*>(kRtcpPacketCompoundSdesRrSsrc2),
+      sizeof(kRtcpPacketCompoundSdesRrSsrc2), true));
+}
+
+// Test adding and removing many streams in mixed order.
+TEST(SsrcMuxFilterTest, ManyStreamsTest) {
+  static const int kNumStreams = 1000;
+  cricket::SsrcMuxFilter ssrc_filter;
+  for (int i = 0; i < kNumStreams; ++i) {
+    EXPECT_TRUE(ssrc_filter.AddStream(StreamParams::CreateLegacy(i + 2)));
+  }
+  for (int i = 0; i < kNumStreams; i += 2) {
+    EXPECT_TRUE(ssrc_filter.RemoveStream(i + 2));
+  }
+  for (int i = 0; i < kNumStreams; ++i) {
+    EXPECT_EQ(i % 2 == 1, ssrc_filter.FindStream(i + 2));
+  }
+  for (int i = 1; i < kNumStreams; i += 2) {
+    EXPECT_TRUE(ssrc_filter.RemoveStream(i + 2));
+  }
+  EXPECT_FALSE(ssrc_filter.IsActive());
+  EXPECT_FALSE(ssrc_filter.FindStream(3));
+}
+
+// Logs the cost of demuxing RTP packets with 1, 16 and 256 streams, against
+// scanning the streams for each packet.
+TEST(SsrcMuxFilterTest, DemuxPerf) {
+  static const int kNumPackets = 200000;
+  static const int kStreamCounts[] = { 1, 16, 256 };
+  for (size_t n = 0; n < ARRAY_SIZE(kStreamCounts); ++n) {
+    int num_streams = kStreamCounts[n];
+    cricket::SsrcMuxFilter ssrc_filter;
+    cricket::StreamParamsVec streams;
+    for (int i = 0; i < num_streams; ++i) {
+      StreamParams stream = StreamParams::CreateLegacy(0x10000 + i * 7919);
+      EXPECT_TRUE(ssrc_filter.AddStream(stream));
+      streams.push_back(stream);
+    }
+
+    unsigned char packet[sizeof(kRtpPacketSsrc1)];
+    memcpy(packet, kRtpPacketSsrc1, sizeof(packet));
+    int found = 0;
+    uint64 start = talk_base::TimeNanos();
+    for (int i = 0; i < kNumPackets; ++i) {
+      // Every other packet is for the last stream, the rest for no stream.
+      talk_base::SetBE32(packet + 8, (i & 1) ?
+          0x10000 + (num_streams - 1) * 7919 : 0x20000000 + i);
+      if (ssrc_filter.DemuxPacket(reinterpret_cast<const char*>(packet),
+                                  sizeof(packet), false)) {
+        ++found;
+      }
+    }
+    uint64 index_time = talk_base::TimeNanos() - start;
+    EXPECT_EQ(kNumPackets / 2, found);
+
+    found = 0;
+    start = talk_base::TimeNanos();
+    for (int i = 0; i < kNumPackets; ++i) {
+      uint32 ssrc = (i & 1) ?
+          0x10000 + (num_streams - 1) * 7919 : 0x20000000 + i;
+      if (cricket::GetStreamBySsrc(streams, ssrc, NULL)) {
+        ++found;
+      }
+    }
+    uint64 scan_time = talk_base::TimeNanos() - start;
+    EXPECT_EQ(kNumPackets / 2, found);
+
+    LOG(LS_INFO) << num_streams << " streams: "
+                 << index_time / kNumPackets << " ns per packet demuxed, "
+                 << scan_time / kNumPackets << " ns per packet to scan";
+  }
+}
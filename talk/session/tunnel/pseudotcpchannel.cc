@@ -48,11 +48,21 @@ extern const talk_base::ConstantLabel SESSION_STATES[];
 enum {
   MSG_WK_CLOCK = 1,
   MSG_WK_PURGE,
+  MSG_WK_SEND,
+  MSG_WK_RECV,
   MSG_ST_EVENT,
   MSG_SI_DESTROYCHANNEL,
   MSG_SI_DESTROY,
 };
 
+// Size of each of the rings between the stream and the PseudoTcp.
+const size_t kStreamBufferSize = 64 * 1024;
+
+// Largest size the PseudoTcp buffers may auto-tune to. Slow start also runs
+// up to this size, so it is kept near the usual UDP socket receive buffer;
+// bursts beyond that are dropped by the kernel on fast paths.
+const int kAutotuneMaxBufferSize = 256 * 1024;
+
 struct EventData : public MessageData {
   int event, error;
   EventData(int ev, int err = 0) : event(ev), error(err) { }
@@ -104,8 +114,10 @@ PseudoTcpChannel::PseudoTcpChannel(Thread* stream_thread, Session* session)
     worker_thread_(NULL),
     stream_thread_(stream_thread),
     session_(session), channel_(NULL), tcp_(NULL), stream_(NULL),
-    stream_readable_(false), pending_read_event_(false),
-    ready_to_connect_(false) {
+    ready_to_connect_(false), close_pending_(false),
+    send_buffer_(kStreamBufferSize), recv_buffer_(kStreamBufferSize),
+    read_event_pending_(0), send_pending_(0), recv_pending_(0),
+    write_blocked_(0), stream_error_(0) {
   ASSERT(signal_thread_->IsCurrent());
   ASSERT(NULL != session_);
 }
@@ -147,6 +159,8 @@ bool PseudoTcpChannel::Connect(const std::string& content_name,
 
   ASSERT(tcp_ == NULL);
   tcp_ = new PseudoTcp(this, 0);
+  // Let the buffers grow with the bandwidth-delay product of the path.
+  tcp_->SetOption(PseudoTcp::OPT_AUTOTUNE_MAX, kAutotuneMaxBufferSize);
   if (session_->initiator()) {
     // Since we may try several protocols and network adapters that won't work,
     // waiting until we get our first writable notification before initiating
@@ -200,6 +214,11 @@ void PseudoTcpChannel::OnSessionTerminate(Session* session) {
     session_ = NULL;
     if (stream_ != NULL)
       stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_CLOSE, -1));
+    if (close_pending_) {
+      // The stream closed while waiting to send; it never will.
+      close_pending_ = false;
+      CheckDestroy();
+    }
   }
 
   // Even though session_ is being destroyed, we mustn't clear the pointer,
@@ -250,54 +269,50 @@ StreamState PseudoTcpChannel::GetState() const {
 StreamResult PseudoTcpChannel::Read(void* buffer, size_t buffer_len,
                                     size_t* read, int* error) {
   ASSERT(stream_ != NULL && stream_thread_->IsCurrent());
-  CritScope lock(&cs_);
-  if (!tcp_)
-    return SR_BLOCK;
-
-  stream_readable_ = false;
-  int result = tcp_->Recv(static_cast<char*>(buffer), buffer_len);
-  //LOG_F(LS_VERBOSE) << "Recv returned: " << result;
-  if (result > 0) {
-    if (read)
-      *read = result;
-    // PseudoTcp doesn't currently support repeated Readable signals.  Simulate
-    // them here.
-    stream_readable_ = true;
-    if (!pending_read_event_) {
-      pending_read_event_ = true;
-      stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ), true);
-    }
-    return SR_SUCCESS;
-  } else if (IsBlockingError(tcp_->GetError())) {
-    return SR_BLOCK;
-  } else {
+  size_t result = recv_buffer_.Read(buffer, buffer_len);
+  if (result == 0) {
+    int tcp_error = AtomicOps::AcquireLoad(&stream_error_);
+    if (!tcp_error)
+      return SR_BLOCK;
     if (error)
-      *error = tcp_->GetError();
+      *error = tcp_error;
     return SR_ERROR;
   }
-  // This spot is never reached.
+  if (read)
+    *read = result;
+  // There's room for more now.
+  WakeWorker(MSG_WK_RECV, &recv_pending_);
+  // PseudoTcp doesn't currently support repeated Readable signals.  Simulate
+  // them here.
+  if ((recv_buffer_.GetBuffered() > 0)
+      && (AtomicOps::CompareAndSwap(&read_event_pending_, 0, 1) == 0)) {
+    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ), true);
+  }
+  return SR_SUCCESS;
 }
 
 StreamResult PseudoTcpChannel::Write(const void* data, size_t data_len,
                                      size_t* written, int* error) {
   ASSERT(stream_ != NULL && stream_thread_->IsCurrent());
-  CritScope lock(&cs_);
-  if (!tcp_)
-    return SR_BLOCK;
-  int result = tcp_->Send(static_cast<const char*>(data), data_len);
-  //LOG_F(LS_VERBOSE) << "Send returned: " << result;
-  if (result > 0) {
-    if (written)
-      *written = result;
-    return SR_SUCCESS;
-  } else if (IsBlockingError(tcp_->GetError())) {
-    return SR_BLOCK;
-  } else {
+  int tcp_error = AtomicOps::AcquireLoad(&stream_error_);
+  if (tcp_error) {
     if (error)
-      *error = tcp_->GetError();
+      *error = tcp_error;
     return SR_ERROR;
   }
-  // This spot is never reached.
+  size_t result = send_buffer_.Write(data, data_len);
+  if (result == 0) {
+    // Ask for SE_WRITE once the worker thread makes room, then look again in
+    // case it made room before it could see the request.
+    AtomicOps::CompareAndSwap(&write_blocked_, 0, 1);
+    result = send_buffer_.Write(data, data_len);
+    if (result == 0)
+      return SR_BLOCK;
+  }
+  if (written)
+    *written = result;
+  WakeWorker(MSG_WK_SEND, &send_pending_);
+  return SR_SUCCESS;
 }
 
 void PseudoTcpChannel::Close() {
@@ -307,8 +322,14 @@ void PseudoTcpChannel::Close() {
   // Clear out any pending event notifications
   stream_thread_->Clear(this, MSG_ST_EVENT);
   if (tcp_) {
-    tcp_->Close(false);
+    // Send what the stream has written before closing.
+    close_pending_ = true;
+    FlushSendBuffer();
     AdjustClock();
+  } else if (session_ && !channel_ && (send_buffer_.GetBuffered() > 0)) {
+    // Not connected yet. The close waits for the connection, like it does
+    // above, so that the data isn't lost.
+    close_pending_ = true;
   } else {
     CheckDestroy();
   }
@@ -392,17 +413,83 @@ void PseudoTcpChannel::OnChannelConnectionChanged(TransportChannel* channel,
   AdjustClock();
 }
 
+void PseudoTcpChannel::FlushSendBuffer() {
+  ASSERT(cs_.CurrentThreadIsOwner());
+  ASSERT(NULL != tcp_);
+  PseudoTcp::TcpState state = tcp_->State();
+  if (state != PseudoTcp::TCP_ESTABLISHED) {
+    // Nothing can be sent yet, or ever again. A close waits for OnTcpOpen to
+    // send what the stream wrote, unless there's nothing to lose.
+    if (close_pending_
+        && ((state == PseudoTcp::TCP_CLOSED)
+            || (send_buffer_.GetBuffered() == 0))) {
+      close_pending_ = false;
+      tcp_->Close(false);
+    }
+    return;
+  }
+
+  bool freed = false;
+  size_t len = 0;
+  const char* data = static_cast<const char*>(send_buffer_.GetReadData(&len));
+  while (len > 0) {
+    int sent = tcp_->Send(data, len);
+    if (sent <= 0) {
+      if (!IsBlockingError(tcp_->GetError()))
+        AtomicOps::CompareAndSwap(&stream_error_, 0, tcp_->GetError());
+      break;
+    }
+    send_buffer_.ConsumeReadData(sent);
+    freed = true;
+    data = static_cast<const char*>(send_buffer_.GetReadData(&len));
+  }
+  if (freed && stream_
+      && (AtomicOps::CompareAndSwap(&write_blocked_, 1, 0) == 1)) {
+    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_WRITE));
+  }
+  if (close_pending_ && (send_buffer_.GetBuffered() == 0)) {
+    close_pending_ = false;
+    tcp_->Close(false);
+  }
+}
+
+void PseudoTcpChannel::FillReceiveBuffer() {
+  ASSERT(cs_.CurrentThreadIsOwner());
+  ASSERT(NULL != tcp_);
+  if (!stream_ || (tcp_->State() != PseudoTcp::TCP_ESTABLISHED))
+    return;
+
+  bool filled = false;
+  size_t len = 0;
+  char* buffer = static_cast<char*>(recv_buffer_.GetWriteBuffer(&len));
+  // When the ring is full, the stream thread asks for more after reading.
+  while (len > 0) {
+    int received = tcp_->Recv(buffer, len);
+    if (received <= 0) {
+      if (!IsBlockingError(tcp_->GetError()))
+        AtomicOps::CompareAndSwap(&stream_error_, 0, tcp_->GetError());
+      break;
+    }
+    recv_buffer_.ConsumeWriteBuffer(received);
+    filled = true;
+    buffer = static_cast<char*>(recv_buffer_.GetWriteBuffer(&len));
+  }
+  if (filled && (AtomicOps::CompareAndSwap(&read_event_pending_, 0, 1) == 0))
+    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ));
+}
+
 void PseudoTcpChannel::OnTcpOpen(PseudoTcp* tcp) {
   LOG_F(LS_VERBOSE) << "[" << channel_name_ << "]";
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
   if (stream_) {
-    stream_readable_ = true;
-    pending_read_event_ = true;
+    AtomicOps::CompareAndSwap(&read_event_pending_, 0, 1);
     stream_thread_->Post(this, MSG_ST_EVENT,
                          new EventData(SE_OPEN | SE_READ | SE_WRITE));
   }
+  // The stream may have written before the connection was up.
+  FlushSendBuffer();
 }
 
 void PseudoTcpChannel::OnTcpReadable(PseudoTcp* tcp) {
@@ -410,13 +497,7 @@ void PseudoTcpChannel::OnTcpReadable(PseudoTcp* tcp) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
-  if (stream_) {
-    stream_readable_ = true;
-    if (!pending_read_event_) {
-      pending_read_event_ = true;
-      stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ));
-    }
-  }
+  FillReceiveBuffer();
 }
 
 void PseudoTcpChannel::OnTcpWriteable(PseudoTcp* tcp) {
@@ -424,8 +505,7 @@ void PseudoTcpChannel::OnTcpWriteable(PseudoTcp* tcp) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
-  if (stream_)
-    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_WRITE));
+  FlushSendBuffer();
 }
 
 void PseudoTcpChannel::OnTcpClosed(PseudoTcp* tcp, uint32 nError) {
@@ -433,8 +513,11 @@ void PseudoTcpChannel::OnTcpClosed(PseudoTcp* tcp, uint32 nError) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
+  AtomicOps::CompareAndSwap(&stream_error_, 0, nError ? nError : ENOTCONN);
   if (stream_)
     stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_CLOSE, nError));
+  // A close that was waiting for the connection can finish now.
+  FlushSendBuffer();
 }
 
 //
@@ -452,6 +535,31 @@ void PseudoTcpChannel::OnMessage(Message* pmsg) {
       AdjustClock(false);
     }
 
+  } else if (pmsg->message_id == MSG_WK_SEND) {
+
+    CritScope lock(&cs_);
+    if (!worker_thread_)
+      return;  // Already purged.
+    ASSERT(worker_thread_->IsCurrent());
+    // Clear the flag first, so that a Write() from here on posts again.
+    AtomicOps::CompareAndSwap(&send_pending_, 1, 0);
+    if (tcp_) {
+      FlushSendBuffer();
+      AdjustClock();
+    }
+
+  } else if (pmsg->message_id == MSG_WK_RECV) {
+
+    CritScope lock(&cs_);
+    if (!worker_thread_)
+      return;  // Already purged.
+    ASSERT(worker_thread_->IsCurrent());
+    AtomicOps::CompareAndSwap(&recv_pending_, 1, 0);
+    if (tcp_) {
+      FillReceiveBuffer();
+      AdjustClock();
+    }
+
   } else if (pmsg->message_id == MSG_WK_PURGE) {
 
     ASSERT(worker_thread_->IsCurrent());
@@ -471,8 +579,7 @@ void PseudoTcpChannel::OnMessage(Message* pmsg) {
     ASSERT(stream_ != NULL);
     EventData* data = static_cast<EventData*>(pmsg->pdata);
     if (data->event & SE_READ) {
-      CritScope lock(&cs_);
-      pending_read_event_ = false;
+      AtomicOps::CompareAndSwap(&read_event_pending_, 1, 0);
     }
     stream_->SignalEvent(stream_, data->event, data->error);
     delete data;
@@ -536,6 +643,8 @@ void PseudoTcpChannel::AdjustClock(bool clear) {
   delete tcp_;
   tcp_ = NULL;
   ready_to_connect_ = false;
+  close_pending_ = false;
+  AtomicOps::CompareAndSwap(&stream_error_, 0, ENOTCONN);
 
   if (channel_) {
     // If TCP has failed, no need for channel_ anymore
@@ -543,6 +652,20 @@ void PseudoTcpChannel::AdjustClock(bool clear) {
   }
 }
 
+void PseudoTcpChannel::WakeWorker(uint32 message_id, volatile int* pending) {
+  if (AtomicOps::CompareAndSwap(pending, 0, 1) != 0)
+    return;
+  CritScope lock(&cs_);
+  // channel_ is cleared when MSG_WK_PURGE is posted, and nothing may follow
+  // the purge.
+  if (channel_) {
+    worker_thread_->Post(this, message_id);
+  } else {
+    // Nothing to wake, yet or any more; let the next call try again.
+    AtomicOps::ReleaseStore(pending, 0);
+  }
+}
+
 void PseudoTcpChannel::CheckDestroy() {
   ASSERT(cs_.CurrentThreadIsOwner());
   if ((worker_thread_ != NULL) || (stream_ != NULL))
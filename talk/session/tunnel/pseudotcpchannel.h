@@ -30,6 +30,7 @@
 
 #include "talk/base/criticalsection.h"
 #include "talk/base/messagequeue.h"
+#include "talk/base/spscringbuffer.h"
 #include "talk/base/stream.h"
 #include "talk/p2p/base/pseudotcp.h"
 #include "talk/p2p/base/session.h"
@@ -55,6 +56,13 @@ class TransportChannel;
 // These indicators are checked by CheckDestroy, invoked whenever one of them
 // changes.
 ///////////////////////////////////////////////////////////////////////////////
+// PseudoTcpChannel data flow
+// The stream thread doesn't touch the PseudoTcp to read or write. It copies
+// data into send_buffer_ and out of recv_buffer_, which are lock-free rings,
+// and the worker thread moves data between them and the PseudoTcp. So bulk
+// transfers don't make the two threads wait on cs_ for each other; the stream
+// thread only takes it to wake the worker thread, at most once per pass.
+///////////////////////////////////////////////////////////////////////////////
 // PseudoTcpChannel::GetStream
 // Note: The stream pointer returned by GetStream is owned by the caller.
 // They can close & immediately delete the stream while PseudoTcpChannel still
@@ -104,6 +112,9 @@ class PseudoTcpChannel
   void OnMessage(talk_base::Message* pmsg);
   void AdjustClock(bool clear = true);
   void CheckDestroy();
+  // Posts |message_id| to the worker thread unless |*pending| shows it's
+  // already on its way. Does nothing once the channel is gone.
+  void WakeWorker(uint32 message_id, volatile int* pending);
 
   // Signal thread methods
   void OnChannelDestroyed(TransportChannel* channel);
@@ -115,6 +126,13 @@ class PseudoTcpChannel
   void OnChannelConnectionChanged(TransportChannel* channel,
                                   const Candidate& candidate);
 
+  // Moves data from send_buffer_ into tcp_, and closes tcp_ once it's
+  // empty if the stream has been closed. Before the connection opens, the
+  // close waits unless send_buffer_ is already empty.
+  void FlushSendBuffer();
+  // Moves data from tcp_ into recv_buffer_.
+  void FillReceiveBuffer();
+
   virtual void OnTcpOpen(PseudoTcp* ptcp);
   virtual void OnTcpReadable(PseudoTcp* ptcp);
   virtual void OnTcpWriteable(PseudoTcp* ptcp);
@@ -130,9 +148,19 @@ class PseudoTcpChannel
   std::string channel_name_;
   PseudoTcp* tcp_;
   InternalStream* stream_;
-  bool stream_readable_, pending_read_event_;
-  bool ready_to_connect_;
+  bool ready_to_connect_, close_pending_;
   mutable talk_base::CriticalSection cs_;
+
+  // The stream thread writes send_buffer_ and reads recv_buffer_ without
+  // holding cs_; the other side of each is only used with cs_ held.
+  talk_base::SpscRingBuffer send_buffer_, recv_buffer_;
+  // Changed with AtomicOps only. Each *_pending_ flag is set while its message
+  // is posted, so that there's only one at a time. write_blocked_ is set when
+  // the stream wants SE_WRITE because send_buffer_ filled up. stream_error_ is
+  // the error tcp_ reported, if any.
+  volatile int read_event_pending_, send_pending_, recv_pending_;
+  volatile int write_blocked_;
+  volatile int stream_error_;
 };
 
 }  // namespace cricket
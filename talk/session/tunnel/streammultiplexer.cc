@@ -0,0 +1,480 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/session/tunnel/streammultiplexer.h"
+
+#include "talk/base/byteorder.h"
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+#include "talk/base/socket.h"
+#include "talk/base/spscringbuffer.h"
+
+using namespace talk_base;
+
+namespace cricket {
+
+// The longest frame, header included.
+const size_t kMaxFrameLength =
+    StreamMultiplexer::kHeaderSize + StreamMultiplexer::kMaxFrameSize;
+
+// Error reported when the peer breaks the protocol.
+const int kProtocolError = -1;
+
+///////////////////////////////////////////////////////////////////////////////
+// StreamMultiplexer::StreamContext
+///////////////////////////////////////////////////////////////////////////////
+
+struct StreamMultiplexer::StreamContext {
+  explicit StreamContext(uint32 stream_id)
+      : id(stream_id), stream(NULL), send_buffer(kStreamBufferSize),
+        recv_buffer(kStreamBufferSize), send_window(kStreamBufferSize),
+        recv_credit(0), close_sent(false), remote_closed(false),
+        write_blocked(false) {
+  }
+
+  uint32 id;
+  // NULL once the application has closed the stream.
+  MuxStream* stream;
+  SpscRingBuffer send_buffer, recv_buffer;
+  // How much more data the peer has room for.
+  size_t send_window;
+  // How much data has been consumed since the peer was last told.
+  size_t recv_credit;
+  bool close_sent, remote_closed;
+  // Set when a write blocked, so that SE_WRITE is signalled once there's room.
+  bool write_blocked;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// StreamMultiplexer::MuxStream
+///////////////////////////////////////////////////////////////////////////////
+
+class StreamMultiplexer::MuxStream : public StreamInterface {
+ public:
+  MuxStream(StreamMultiplexer* parent, StreamContext* context)
+      : parent_(parent), context_(context) {
+  }
+  virtual ~MuxStream() {
+    Close();
+  }
+
+  virtual talk_base::StreamState GetState() const {
+    if (!parent_)
+      return SS_CLOSED;
+    return parent_->GetStreamState(context_);
+  }
+  virtual StreamResult Read(void* buffer, size_t buffer_len,
+                            size_t* read, int* error) {
+    if (!parent_)
+      return SR_EOS;
+    return parent_->ReadStream(context_, buffer, buffer_len, read, error);
+  }
+  virtual StreamResult Write(const void* data, size_t data_len,
+                             size_t* written, int* error) {
+    if (!parent_) {
+      if (error)
+        *error = ENOTCONN;
+      return SR_ERROR;
+    }
+    return parent_->WriteStream(context_, data, data_len, written, error);
+  }
+  virtual void Close() {
+    if (!parent_)
+      return;
+    StreamMultiplexer* parent = parent_;
+    parent_ = NULL;
+    parent->CloseStream(context_);
+    context_ = NULL;
+  }
+
+  // Called when the multiplexer goes away first.
+  void Detach() {
+    parent_ = NULL;
+    context_ = NULL;
+  }
+
+ private:
+  StreamMultiplexer* parent_;
+  StreamContext* context_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// StreamMultiplexer
+// Member object lifetime summaries:
+//   stream_ - passed in constructor, destroyed with this.
+//   StreamContext - created when a stream is opened on either side, destroyed
+//     when the application has closed the stream and CLOSE has gone both
+//     ways, or when stream_ has closed and the application has closed the
+//     stream.
+//   MuxStream - created with its StreamContext, destroyed by the application
+//     at an arbitrary time.
+///////////////////////////////////////////////////////////////////////////////
+
+StreamMultiplexer::StreamMultiplexer(StreamInterface* stream, bool initiator)
+    : stream_(stream),
+      initiator_(initiator),
+      next_id_(initiator ? 1 : 2),
+      last_scheduled_id_(0),
+      out_buffer_(new SpscRingBuffer(2 * kMaxFrameLength)),
+      in_buffer_(new char[kMaxFrameLength]),
+      in_len_(0),
+      closed_(stream->GetState() == SS_CLOSED),
+      error_(0) {
+  stream_->SignalEvent.connect(this, &StreamMultiplexer::OnEvent);
+}
+
+StreamMultiplexer::~StreamMultiplexer() {
+  for (StreamMap::iterator it = streams_.begin(); it != streams_.end(); ++it) {
+    if (it->second->stream)
+      it->second->stream->Detach();
+    delete it->second;
+  }
+}
+
+StreamInterface* StreamMultiplexer::OpenStream() {
+  if (closed_ || next_id_ > kMaxStreamId)
+    return NULL;
+  StreamContext* context = AddStream(next_id_);
+  next_id_ += 2;
+  QueueFrame(FRAME_OPEN, context->id, 0);
+  Pump();
+  return context->stream;
+}
+
+StreamMultiplexer::StreamContext* StreamMultiplexer::AddStream(uint32 id) {
+  StreamContext* context = new StreamContext(id);
+  context->stream = new MuxStream(this, context);
+  streams_[id] = context;
+  return context;
+}
+
+talk_base::StreamState StreamMultiplexer::GetStreamState(
+    StreamContext* context) const {
+  if ((closed_ || context->remote_closed) &&
+      context->recv_buffer.GetBuffered() == 0)
+    return SS_CLOSED;
+  return (stream_->GetState() == SS_OPENING) ? SS_OPENING : SS_OPEN;
+}
+
+StreamResult StreamMultiplexer::ReadStream(StreamContext* context,
+                                           void* buffer, size_t buffer_len,
+                                           size_t* read, int* error) {
+  size_t count = context->recv_buffer.Read(buffer, buffer_len);
+  if (count == 0) {
+    if (closed_ && !context->remote_closed && error_ != 0) {
+      if (error)
+        *error = error_;
+      return SR_ERROR;
+    }
+    return (closed_ || context->remote_closed) ? SR_EOS : SR_BLOCK;
+  }
+  if (read)
+    *read = count;
+
+  if (context->remote_closed) {
+    if (context->recv_buffer.GetBuffered() == 0)
+      context->stream->PostEvent(SE_CLOSE, 0);
+  } else if (!closed_) {
+    // Give the window back in large chunks, so that WINDOW frames stay rare.
+    context->recv_credit += count;
+    if (context->recv_credit >= kStreamBufferSize / 2) {
+      QueueFrame(FRAME_WINDOW, context->id, context->recv_credit);
+      context->recv_credit = 0;
+      Pump();
+    }
+  }
+  return SR_SUCCESS;
+}
+
+StreamResult StreamMultiplexer::WriteStream(StreamContext* context,
+                                            const void* data, size_t data_len,
+                                            size_t* written, int* error) {
+  if (closed_) {
+    if (error)
+      *error = error_ ? error_ : ENOTCONN;
+    return SR_ERROR;
+  }
+  size_t count = context->send_buffer.Write(data, data_len);
+  if (count == 0) {
+    context->write_blocked = true;
+    return SR_BLOCK;
+  }
+  if (written)
+    *written = count;
+  Pump();
+  return SR_SUCCESS;
+}
+
+void StreamMultiplexer::CloseStream(StreamContext* context) {
+  context->stream = NULL;
+  // Nobody will read this stream any more. Data that arrives for it from now
+  // on is dropped, and so is what's buffered; the peer gets the window back.
+  size_t unread = context->recv_buffer.GetBuffered();
+  context->recv_buffer.ConsumeReadData(unread);
+  if (!closed_ && !context->remote_closed && unread > 0) {
+    QueueFrame(FRAME_WINDOW, context->id, unread);
+  }
+  if (closed_) {
+    MaybeDestroyStream(context);
+  } else {
+    // CLOSE goes out after the data written to the stream, and the stream is
+    // destroyed from there.
+    Pump();
+  }
+}
+
+void StreamMultiplexer::OnEvent(StreamInterface* stream, int events,
+                                int error) {
+  if (events & SE_OPEN) {
+    for (StreamMap::iterator it = streams_.begin(); it != streams_.end();
+         ++it) {
+      if (it->second->stream)
+        it->second->stream->PostEvent(SE_OPEN | SE_WRITE, 0);
+    }
+  }
+  if (events & SE_READ)
+    ReadFrames();
+  if (events & (SE_OPEN | SE_WRITE))
+    Pump();
+  if (events & SE_CLOSE)
+    Fail(error);
+}
+
+void StreamMultiplexer::ReadFrames() {
+  while (!closed_) {
+    size_t read;
+    int error = 0;
+    StreamResult result = stream_->Read(in_buffer_.get() + in_len_,
+                                        kMaxFrameLength - in_len_,
+                                        &read, &error);
+    if (result == SR_BLOCK)
+      break;
+    if (result != SR_SUCCESS) {
+      Fail((result == SR_EOS) ? 0 : error);
+      return;
+    }
+    in_len_ += read;
+
+    size_t pos = 0;
+    while (in_len_ - pos >= kHeaderSize) {
+      const char* header = in_buffer_.get() + pos;
+      uint8 type = static_cast<uint8>(header[0]);
+      uint32 id = GetBE32(header) & kMaxStreamId;
+      uint32 value = GetBE32(header + 4);
+      size_t length = kHeaderSize;
+      if (type == FRAME_DATA) {
+        if (value > kMaxFrameSize) {
+          LOG(LS_WARNING) << "Oversized frame on stream " << id;
+          Fail(kProtocolError);
+          return;
+        }
+        if (in_len_ - pos < kHeaderSize + value)
+          break;
+        length += value;
+      }
+      if (!HandleFrame(type, id, header + kHeaderSize, value)) {
+        LOG(LS_WARNING) << "Unexpected frame of type " << static_cast<int>(type)
+                        << " on stream " << id;
+        Fail(kProtocolError);
+        return;
+      }
+      pos += length;
+    }
+    memmove(in_buffer_.get(), in_buffer_.get() + pos, in_len_ - pos);
+    in_len_ -= pos;
+  }
+  // WINDOW frames may have let streams send again.
+  Pump();
+}
+
+bool StreamMultiplexer::HandleFrame(uint8 type, uint32 id, const char* data,
+                                    uint32 value) {
+  StreamMap::iterator it = streams_.find(id);
+  StreamContext* context = (it != streams_.end()) ? it->second : NULL;
+  switch (type) {
+    case FRAME_OPEN: {
+      // Odd ids belong to the initiator.
+      bool initiator_id = (id % 2) == 1;
+      if (id == 0 || initiator_id == initiator_ || context)
+        return false;
+      context = AddStream(id);
+      SignalStreamOpened(this, context->stream);
+      return true;
+    }
+    case FRAME_DATA: {
+      // The stream may be gone already if both sides have closed it.
+      if (!context)
+        return true;
+      if (context->remote_closed ||
+          value > context->recv_buffer.GetWriteRemaining())
+        return false;
+      if (!context->stream) {
+        QueueFrame(FRAME_WINDOW, id, value);
+        return true;
+      }
+      bool was_empty = context->recv_buffer.GetBuffered() == 0;
+      context->recv_buffer.Write(data, value);
+      if (was_empty && value > 0)
+        context->stream->PostEvent(SE_READ, 0);
+      return true;
+    }
+    case FRAME_WINDOW:
+      if (context)
+        context->send_window += value;
+      return true;
+    case FRAME_CLOSE:
+      if (!context)
+        return true;
+      if (context->remote_closed)
+        return false;
+      context->remote_closed = true;
+      if (context->stream) {
+        bool empty = context->recv_buffer.GetBuffered() == 0;
+        context->stream->PostEvent(empty ? SE_CLOSE : SE_READ, 0);
+      }
+      MaybeDestroyStream(context);
+      return true;
+    default:
+      return false;
+  }
+}
+
+void StreamMultiplexer::Pump() {
+  while (!closed_ && stream_->GetState() == SS_OPEN) {
+    while (!control_.empty() &&
+           out_buffer_->GetWriteRemaining() >= kHeaderSize) {
+      out_buffer_->Write(control_.data(), kHeaderSize);
+      control_.erase(0, kHeaderSize);
+    }
+    if (control_.empty()) {
+      while (out_buffer_->GetWriteRemaining() > kHeaderSize &&
+             ScheduleFrame()) {
+      }
+    }
+
+    size_t len;
+    const void* data = out_buffer_->GetReadData(&len);
+    if (len == 0)
+      return;
+    size_t written;
+    int error = 0;
+    StreamResult result = stream_->Write(data, len, &written, &error);
+    if (result == SR_BLOCK)
+      return;
+    if (result != SR_SUCCESS) {
+      Fail(error);
+      return;
+    }
+    out_buffer_->ConsumeReadData(written);
+  }
+}
+
+bool StreamMultiplexer::ScheduleFrame() {
+  // Start after the stream that went last, so that busy streams take turns.
+  StreamMap::iterator it = streams_.upper_bound(last_scheduled_id_);
+  for (size_t i = 0; i < streams_.size(); ++i, ++it) {
+    if (it == streams_.end())
+      it = streams_.begin();
+    StreamContext* context = it->second;
+    size_t buffered = context->send_buffer.GetBuffered();
+    if (buffered > 0 && context->send_window > 0) {
+      size_t len = _min(_min(buffered, context->send_window),
+                        _min(static_cast<size_t>(kMaxFrameSize),
+                             out_buffer_->GetWriteRemaining() - kHeaderSize));
+      WriteHeader(FRAME_DATA, context->id, len);
+      context->send_window -= len;
+      while (len > 0) {
+        size_t chunk;
+        const void* data = context->send_buffer.GetReadData(&chunk);
+        chunk = _min(chunk, len);
+        out_buffer_->Write(data, chunk);
+        context->send_buffer.ConsumeReadData(chunk);
+        len -= chunk;
+      }
+      last_scheduled_id_ = context->id;
+      if (context->write_blocked && context->stream) {
+        context->write_blocked = false;
+        context->stream->PostEvent(SE_WRITE, 0);
+      }
+      return true;
+    }
+    if (buffered == 0 && !context->stream && !context->close_sent) {
+      WriteHeader(FRAME_CLOSE, context->id, 0);
+      context->close_sent = true;
+      last_scheduled_id_ = context->id;
+      MaybeDestroyStream(context);
+      return true;
+    }
+  }
+  return false;
+}
+
+void StreamMultiplexer::QueueFrame(uint8 type, uint32 id, uint32 value) {
+  char header[kHeaderSize];
+  SetBE32(header, (type << 24) | id);
+  SetBE32(header + 4, value);
+  control_.append(header, kHeaderSize);
+}
+
+void StreamMultiplexer::WriteHeader(uint8 type, uint32 id, uint32 value) {
+  char header[kHeaderSize];
+  SetBE32(header, (type << 24) | id);
+  SetBE32(header + 4, value);
+  out_buffer_->Write(header, kHeaderSize);
+}
+
+void StreamMultiplexer::Fail(int error) {
+  if (closed_)
+    return;
+  closed_ = true;
+  error_ = error;
+  control_.clear();
+  stream_->Close();
+  for (StreamMap::iterator it = streams_.begin(); it != streams_.end();) {
+    StreamContext* context = it->second;
+    if (context->stream) {
+      context->stream->PostEvent(SE_CLOSE, error);
+      ++it;
+    } else {
+      streams_.erase(it++);
+      delete context;
+    }
+  }
+  SignalClosed(this, error);
+}
+
+void StreamMultiplexer::MaybeDestroyStream(StreamContext* context) {
+  if (context->stream)
+    return;
+  if (!closed_ && !(context->close_sent && context->remote_closed))
+    return;
+  streams_.erase(context->id);
+  delete context;
+}
+
+}  // namespace cricket
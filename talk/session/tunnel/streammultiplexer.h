@@ -0,0 +1,163 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_SESSION_TUNNEL_STREAMMULTIPLEXER_H_
+#define TALK_SESSION_TUNNEL_STREAMMULTIPLEXER_H_
+
+#include <map>
+#include <string>
+
+#include "talk/base/constructormagic.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/sigslot.h"
+#include "talk/base/stream.h"
+
+namespace talk_base {
+class SpscRingBuffer;
+}
+
+namespace cricket {
+
+///////////////////////////////////////////////////////////////////////////////
+// StreamMultiplexer
+// Carries any number of independent streams over one reliable, ordered
+// stream, such as a tunnel from TunnelSessionClient. Opening a stream costs
+// no round trip: OpenStream returns a stream that can be written to at once,
+// and the peer learns about it from the frame that precedes its first data.
+//
+// Every frame starts with an 8 byte header:
+//   type (1 byte) | stream id (3 bytes) | value (4 bytes)
+// OPEN and CLOSE frames have no payload; CLOSE means the sender won't write
+// to the stream any more. DATA frames are followed by |value| bytes of data.
+// WINDOW frames let the peer send |value| more bytes on the stream. Streams
+// opened by the initiator have odd ids, the others even ids.
+//
+// Each stream has kStreamBufferSize bytes of send and receive buffer, and the
+// sender never has more data outstanding than the receiver has room for. So
+// a stream nobody reads from doesn't hold up the others. Streams with data to
+// send take turns, each sending at most kMaxFrameSize bytes at a time.
+//
+// The multiplexer and its streams are not thread-safe. They must be used on
+// the thread the underlying stream signals its events on.
+///////////////////////////////////////////////////////////////////////////////
+// StreamMultiplexer streams
+// The streams handed out by the multiplexer are owned by the application,
+// which may delete them at any time. Closing a stream sends the data written
+// to it before it sends CLOSE. If the multiplexer goes away first, its streams
+// are closed.
+///////////////////////////////////////////////////////////////////////////////
+
+class StreamMultiplexer : public sigslot::has_slots<> {
+ public:
+  enum {
+    kHeaderSize = 8,
+    kMaxFrameSize = 8 * 1024,
+    kStreamBufferSize = 32 * 1024,
+    kMaxStreamId = 0xFFFFFF
+  };
+
+  // Takes ownership of |stream|, which should be wrapped before any data
+  // arrives on it, e.g. right after CreateTunnel or AcceptTunnel. The sides
+  // of a connection must disagree on |initiator|.
+  StreamMultiplexer(talk_base::StreamInterface* stream, bool initiator);
+  virtual ~StreamMultiplexer();
+
+  // Returns a new stream, owned by the caller, or NULL if the underlying
+  // stream has closed or the stream ids have run out.
+  talk_base::StreamInterface* OpenStream();
+
+  // Number of streams that still have data or a CLOSE to exchange, including
+  // ones the application has closed already.
+  size_t stream_count() const { return streams_.size(); }
+
+  // Signalled when the peer opens a stream. The receiver takes ownership of
+  // the stream.
+  sigslot::signal2<StreamMultiplexer*, talk_base::StreamInterface*>
+      SignalStreamOpened;
+  // Signalled when the underlying stream closes, with its error, or when the
+  // peer breaks the protocol. All the streams are closed too.
+  sigslot::signal2<StreamMultiplexer*, int> SignalClosed;
+
+ private:
+  class MuxStream;
+  friend class MuxStream;
+  struct StreamContext;
+  typedef std::map<uint32, StreamContext*> StreamMap;
+
+  enum FrameType { FRAME_OPEN = 1, FRAME_DATA, FRAME_WINDOW, FRAME_CLOSE };
+
+  // Called by MuxStream.
+  talk_base::StreamState GetStreamState(StreamContext* context) const;
+  talk_base::StreamResult ReadStream(StreamContext* context,
+                                     void* buffer, size_t buffer_len,
+                                     size_t* read, int* error);
+  talk_base::StreamResult WriteStream(StreamContext* context,
+                                      const void* data, size_t data_len,
+                                      size_t* written, int* error);
+  void CloseStream(StreamContext* context);
+
+  void OnEvent(talk_base::StreamInterface* stream, int events, int error);
+  // Reads and handles whatever frames have arrived.
+  void ReadFrames();
+  // Returns false if the frame breaks the protocol.
+  bool HandleFrame(uint8 type, uint32 id, const char* data, uint32 value);
+  // Sends as much as the underlying stream takes: control frames first, then
+  // stream data in turn.
+  void Pump();
+  // Moves the next frame of stream data, or a CLOSE, into |out_buffer_|.
+  // Returns false if no stream has anything to send.
+  bool ScheduleFrame();
+  void QueueFrame(uint8 type, uint32 id, uint32 value);
+  void WriteHeader(uint8 type, uint32 id, uint32 value);
+  void Fail(int error);
+  StreamContext* AddStream(uint32 id);
+  // Deletes |context| if there's nothing left to do for it.
+  void MaybeDestroyStream(StreamContext* context);
+
+  talk_base::scoped_ptr<talk_base::StreamInterface> stream_;
+  bool initiator_;
+  uint32 next_id_;
+  StreamMap streams_;
+  // Id of the stream that sent the last frame; the next one goes after it.
+  uint32 last_scheduled_id_;
+  // Control frames waiting for room in |out_buffer_|.
+  std::string control_;
+  // Frames ready for |stream_|.
+  talk_base::scoped_ptr<talk_base::SpscRingBuffer> out_buffer_;
+  // Partial frame read from |stream_|.
+  talk_base::scoped_array<char> in_buffer_;
+  size_t in_len_;
+  bool closed_;
+  int error_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(StreamMultiplexer);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_SESSION_TUNNEL_STREAMMULTIPLEXER_H_
@@ -0,0 +1,361 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string>
+#include <vector>
+
+#include "talk/base/gunit.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/stream.h"
+#include "talk/base/thread.h"
+#include "talk/session/tunnel/streammultiplexer.h"
+
+using talk_base::StreamInterface;
+using cricket::StreamMultiplexer;
+
+static const int kTimeoutMs = 10000;
+static const size_t kPipeSize = 16 * 1024;
+
+// One end of an in-memory pipe: reads from one FifoBuffer and writes to the
+// other. It stays SS_OPENING until Open() is called.
+class PipeEnd : public StreamInterface, public sigslot::has_slots<> {
+ public:
+  PipeEnd(talk_base::FifoBuffer* in, talk_base::FifoBuffer* out)
+      : in_(in), out_(out), state_(talk_base::SS_OPENING) {
+    in_->SignalEvent.connect(this, &PipeEnd::OnBufferEvent);
+    out_->SignalEvent.connect(this, &PipeEnd::OnBufferEvent);
+  }
+
+  void Open() {
+    state_ = talk_base::SS_OPEN;
+    PostEvent(talk_base::SE_OPEN | talk_base::SE_READ | talk_base::SE_WRITE,
+              0);
+  }
+  // Closes the pipe as if the connection had failed.
+  void Fail(int error) {
+    state_ = talk_base::SS_CLOSED;
+    PostEvent(talk_base::SE_CLOSE, error);
+  }
+
+  virtual talk_base::StreamState GetState() const { return state_; }
+  virtual talk_base::StreamResult Read(void* buffer, size_t buffer_len,
+                                       size_t* read, int* error) {
+    if (state_ != talk_base::SS_OPEN)
+      return talk_base::SR_BLOCK;
+    return in_->Read(buffer, buffer_len, read, error);
+  }
+  virtual talk_base::StreamResult Write(const void* data, size_t data_len,
+                                        size_t* written, int* error) {
+    if (state_ != talk_base::SS_OPEN)
+      return talk_base::SR_BLOCK;
+    return out_->Write(data, data_len, written, error);
+  }
+  virtual void Close() {
+    state_ = talk_base::SS_CLOSED;
+  }
+
+ private:
+  void OnBufferEvent(StreamInterface* buffer, int events, int error) {
+    if (buffer == in_)
+      events &= talk_base::SE_READ;
+    else
+      events &= talk_base::SE_WRITE;
+    if (events && state_ == talk_base::SS_OPEN)
+      SignalEvent(this, events, error);
+  }
+
+  talk_base::FifoBuffer* in_;
+  talk_base::FifoBuffer* out_;
+  talk_base::StreamState state_;
+};
+
+// Writes |data| to a stream as fast as it takes it, then optionally closes it.
+class StreamWriter : public sigslot::has_slots<> {
+ public:
+  StreamWriter(StreamInterface* stream, const std::string& data, bool close)
+      : stream_(stream), data_(data), pos_(0), close_(close) {
+    stream_->SignalEvent.connect(this, &StreamWriter::OnEvent);
+    WriteData();
+  }
+
+  StreamInterface* stream() { return stream_.get(); }
+  size_t written() const { return pos_; }
+
+ private:
+  void OnEvent(StreamInterface* stream, int events, int error) {
+    if (events & talk_base::SE_WRITE)
+      WriteData();
+  }
+  void WriteData() {
+    size_t written;
+    while (pos_ < data_.size() &&
+           stream_->Write(data_.data() + pos_, data_.size() - pos_,
+                          &written, NULL) == talk_base::SR_SUCCESS) {
+      pos_ += written;
+    }
+    if (pos_ == data_.size() && close_) {
+      stream_->Close();
+      close_ = false;
+    }
+  }
+
+  talk_base::scoped_ptr<StreamInterface> stream_;
+  std::string data_;
+  size_t pos_;
+  bool close_;
+};
+
+// Reads everything from a stream, until it ends, unless it's paused.
+class StreamReader : public sigslot::has_slots<> {
+ public:
+  StreamReader(StreamInterface* stream, bool paused)
+      : stream_(stream), paused_(paused), done_(false), closed_(false),
+        error_(0) {
+    stream_->SignalEvent.connect(this, &StreamReader::OnEvent);
+    ReadData();
+  }
+
+  StreamInterface* stream() { return stream_.get(); }
+  const std::string& data() const { return data_; }
+  // Set once Read has returned SR_EOS or SR_ERROR.
+  bool done() const { return done_; }
+  // Set once SE_CLOSE has been signalled.
+  bool closed() const { return closed_; }
+  int error() const { return error_; }
+
+ private:
+  void OnEvent(StreamInterface* stream, int events, int error) {
+    if (events & talk_base::SE_READ)
+      ReadData();
+    if (events & talk_base::SE_CLOSE) {
+      ReadData();
+      closed_ = true;
+      error_ = error;
+    }
+  }
+  void ReadData() {
+    if (paused_)
+      return;
+    char buffer[4096];
+    size_t read;
+    talk_base::StreamResult result;
+    while ((result = stream_->Read(buffer, sizeof(buffer), &read, NULL)) ==
+           talk_base::SR_SUCCESS) {
+      data_.append(buffer, read);
+    }
+    if (result == talk_base::SR_EOS || result == talk_base::SR_ERROR)
+      done_ = true;
+  }
+
+  talk_base::scoped_ptr<StreamInterface> stream_;
+  std::string data_;
+  bool paused_, done_, closed_;
+  int error_;
+};
+
+class StreamMultiplexerTest : public testing::Test,
+                              public sigslot::has_slots<> {
+ public:
+  StreamMultiplexerTest()
+      : a_to_b_(kPipeSize), b_to_a_(kPipeSize),
+        pipe_a_(new PipeEnd(&b_to_a_, &a_to_b_)),
+        pipe_b_(new PipeEnd(&a_to_b_, &b_to_a_)),
+        mux_a_(pipe_a_, true),
+        mux_b_(pipe_b_, false),
+        pause_readers_(false), b_closed_(false), b_error_(0) {
+    mux_a_.SignalStreamOpened.connect(
+        this, &StreamMultiplexerTest::OnStreamOpened);
+    mux_b_.SignalStreamOpened.connect(
+        this, &StreamMultiplexerTest::OnStreamOpened);
+    mux_b_.SignalClosed.connect(this, &StreamMultiplexerTest::OnClosed);
+  }
+  ~StreamMultiplexerTest() {
+    for (size_t i = 0; i < writers_.size(); ++i)
+      delete writers_[i];
+    for (size_t i = 0; i < readers_.size(); ++i)
+      delete readers_[i];
+  }
+
+  void Open() {
+    pipe_a_->Open();
+    pipe_b_->Open();
+  }
+
+  // Data that tells the streams apart, so that mixing them up shows.
+  static std::string MakeData(size_t size, int seed) {
+    std::string data(size, 0);
+    for (size_t i = 0; i < size; ++i)
+      data[i] = static_cast<char>((i * (seed + 1)) % 251);
+    return data;
+  }
+
+ protected:
+  // Streams opened by the peer are read until they end, unless
+  // |pause_readers_| is set.
+  void OnStreamOpened(StreamMultiplexer* mux, StreamInterface* stream) {
+    readers_.push_back(new StreamReader(stream, pause_readers_));
+  }
+  void OnClosed(StreamMultiplexer* mux, int error) {
+    b_closed_ = true;
+    b_error_ = error;
+  }
+
+  talk_base::FifoBuffer a_to_b_, b_to_a_;
+  PipeEnd* pipe_a_;
+  PipeEnd* pipe_b_;
+  StreamMultiplexer mux_a_, mux_b_;
+  std::vector<StreamWriter*> writers_;
+  std::vector<StreamReader*> readers_;
+  bool pause_readers_;
+  bool b_closed_;
+  int b_error_;
+};
+
+// Data written before the underlying stream opens is sent once it does,
+// without waiting for the peer to acknowledge the new stream.
+TEST_F(StreamMultiplexerTest, OpenWriteAndClose) {
+  StreamInterface* stream = mux_a_.OpenStream();
+  ASSERT_TRUE(stream != NULL);
+  EXPECT_EQ(talk_base::SS_OPENING, stream->GetState());
+  writers_.push_back(new StreamWriter(stream, "hello", true));
+  EXPECT_EQ(5U, writers_[0]->written());
+  Open();
+
+  ASSERT_EQ_WAIT(1U, readers_.size(), kTimeoutMs);
+  EXPECT_TRUE_WAIT(readers_[0]->closed(), kTimeoutMs);
+  EXPECT_TRUE(readers_[0]->done());
+  EXPECT_EQ(0, readers_[0]->error());
+  EXPECT_EQ("hello", readers_[0]->data());
+  EXPECT_EQ(talk_base::SS_CLOSED, readers_[0]->stream()->GetState());
+
+  // Once both sides have closed the stream, neither remembers it.
+  readers_[0]->stream()->Close();
+  EXPECT_EQ_WAIT(0U, mux_a_.stream_count(), kTimeoutMs);
+  EXPECT_EQ_WAIT(0U, mux_b_.stream_count(), kTimeoutMs);
+}
+
+// Streams go both ways, and each side numbers its own.
+TEST_F(StreamMultiplexerTest, OpenFromBothSides) {
+  Open();
+  StreamInterface* stream = mux_a_.OpenStream();
+  writers_.push_back(new StreamWriter(stream, "from a", true));
+  ASSERT_EQ_WAIT(1U, readers_.size(), kTimeoutMs);
+
+  StreamInterface* b_stream = mux_b_.OpenStream();
+  writers_.push_back(new StreamWriter(b_stream, "from b", true));
+  ASSERT_EQ_WAIT(2U, readers_.size(), kTimeoutMs);
+
+  EXPECT_TRUE_WAIT(readers_[0]->done() && readers_[1]->done(), kTimeoutMs);
+  EXPECT_EQ("from a", readers_[0]->data());
+  EXPECT_EQ("from b", readers_[1]->data());
+}
+
+// Many streams carrying more than a window's worth of data each all arrive
+// intact.
+TEST_F(StreamMultiplexerTest, ManyStreams) {
+  const int kStreams = 10;
+  const size_t kSize = 3 * StreamMultiplexer::kStreamBufferSize + 123;
+  Open();
+  for (int i = 0; i < kStreams; ++i) {
+    writers_.push_back(new StreamWriter(mux_a_.OpenStream(),
+                                        MakeData(kSize, i), true));
+  }
+  ASSERT_EQ_WAIT(static_cast<size_t>(kStreams), readers_.size(), kTimeoutMs);
+  for (int i = 0; i < kStreams; ++i) {
+    EXPECT_TRUE_WAIT(readers_[i]->done(), kTimeoutMs);
+    EXPECT_TRUE(readers_[i]->data() == MakeData(kSize, i)) << "stream " << i;
+  }
+}
+
+// A stream that isn't read fills its window and stops, but doesn't hold up
+// the others.
+TEST_F(StreamMultiplexerTest, UnreadStreamDoesNotBlockOthers) {
+  const size_t kSize = 4 * StreamMultiplexer::kStreamBufferSize;
+  Open();
+  pause_readers_ = true;
+  writers_.push_back(new StreamWriter(mux_a_.OpenStream(),
+                                      MakeData(kSize, 0), false));
+  ASSERT_EQ_WAIT(1U, readers_.size(), kTimeoutMs);
+
+  pause_readers_ = false;
+  writers_.push_back(new StreamWriter(mux_a_.OpenStream(),
+                                      MakeData(kSize, 1), true));
+  ASSERT_EQ_WAIT(2U, readers_.size(), kTimeoutMs);
+  EXPECT_TRUE_WAIT(readers_[1]->done(), kTimeoutMs);
+  EXPECT_TRUE(readers_[1]->data() == MakeData(kSize, 1));
+
+  // The first stream got no further than its send buffer plus the window.
+  EXPECT_EQ(2U * StreamMultiplexer::kStreamBufferSize,
+            writers_[0]->written());
+}
+
+// Busy streams take turns instead of one running ahead of the others.
+TEST_F(StreamMultiplexerTest, StreamsShareFairly) {
+  const size_t kSize = 8 * StreamMultiplexer::kStreamBufferSize;
+  Open();
+  for (int i = 0; i < 2; ++i) {
+    writers_.push_back(new StreamWriter(mux_a_.OpenStream(),
+                                        MakeData(kSize, i), true));
+  }
+  ASSERT_EQ_WAIT(2U, readers_.size(), kTimeoutMs);
+  // When either stream is half done, the other one is well under way.
+  EXPECT_TRUE_WAIT(readers_[0]->data().size() >= kSize / 2 ||
+                   readers_[1]->data().size() >= kSize / 2, kTimeoutMs);
+  EXPECT_GT(readers_[0]->data().size(), kSize / 4);
+  EXPECT_GT(readers_[1]->data().size(), kSize / 4);
+  EXPECT_TRUE_WAIT(readers_[0]->done() && readers_[1]->done(), kTimeoutMs);
+}
+
+// When the underlying stream fails, so do the streams on it.
+TEST_F(StreamMultiplexerTest, UnderlyingStreamFails) {
+  Open();
+  writers_.push_back(new StreamWriter(mux_a_.OpenStream(), "data", false));
+  ASSERT_EQ_WAIT(1U, readers_.size(), kTimeoutMs);
+  EXPECT_EQ_WAIT("data", readers_[0]->data(), kTimeoutMs);
+
+  pipe_b_->Fail(ECONNRESET);
+  EXPECT_TRUE_WAIT(b_closed_, kTimeoutMs);
+  EXPECT_EQ(ECONNRESET, b_error_);
+  EXPECT_TRUE_WAIT(readers_[0]->closed(), kTimeoutMs);
+  EXPECT_EQ(ECONNRESET, readers_[0]->error());
+  EXPECT_TRUE(readers_[0]->done());
+  EXPECT_EQ(talk_base::SS_CLOSED, readers_[0]->stream()->GetState());
+  EXPECT_TRUE(mux_b_.OpenStream() == NULL);
+}
+
+// Streams outliving their multiplexer are closed.
+TEST_F(StreamMultiplexerTest, StreamOutlivesMultiplexer) {
+  talk_base::scoped_ptr<StreamMultiplexer> mux(
+      new StreamMultiplexer(new PipeEnd(&a_to_b_, &b_to_a_), true));
+  talk_base::scoped_ptr<StreamInterface> stream(mux->OpenStream());
+  mux.reset();
+  EXPECT_EQ(talk_base::SS_CLOSED, stream->GetState());
+  size_t written;
+  int error;
+  EXPECT_EQ(talk_base::SR_ERROR, stream->Write("x", 1, &written, &error));
+}
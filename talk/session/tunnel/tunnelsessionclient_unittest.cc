@@ -69,6 +69,7 @@ class TunnelSessionClientTest : public testing::Test,
   }
 
   // Transfer the desired amount of data from the local to the remote client.
+  // The transfer rate is logged, for use as a throughput benchmark.
   void TestTransfer(int size) {
     // Create some dummy data to send.
     send_stream_.ReserveSize(size);
@@ -80,13 +81,45 @@ class TunnelSessionClientTest : public testing::Test,
     // Prepare the receive stream.
     recv_stream_.ReserveSize(size);
     // Create the tunnel and set things in motion.
+    uint32 start = talk_base::Time();
     local_tunnel_.reset(local_client_.CreateTunnel(kRemoteJid, "test"));
     local_tunnel_->SignalEvent.connect(this,
         &TunnelSessionClientTest::OnStreamEvent);
     EXPECT_TRUE_WAIT(done_, kTimeoutMs);
+    uint32 elapsed = talk_base::TimeSince(start);
     // Make sure we received the right data.
+    size_t received = 0;
+    recv_stream_.GetPosition(&received);
+    EXPECT_EQ(static_cast<size_t>(size), received);
     EXPECT_EQ(0, memcmp(send_stream_.GetBuffer(),
                         recv_stream_.GetBuffer(), size));
+    LOG(LS_INFO) << "Transferred " << received << " bytes in " << elapsed
+                 << " ms (" << size * 8 / talk_base::_max<uint32>(elapsed, 1)
+                 << " Kbps)";
+  }
+
+  // Write the data and close the local stream before the tunnel is open.
+  // The data must still arrive in full. If |signal| is set, the signaling
+  // runs first, so that the close happens once the PseudoTcp exists.
+  void TestCloseBeforeOpen(int size, bool signal) {
+    std::string data(size, 0);
+    for (int i = 0; i < size; ++i)
+      data[i] = static_cast<char>(i);
+    recv_stream_.ReserveSize(size);
+    local_tunnel_.reset(local_client_.CreateTunnel(kRemoteJid, "test"));
+    if (signal)
+      talk_base::Thread::Current()->ProcessMessages(0);
+    EXPECT_EQ(talk_base::SS_OPENING, local_tunnel_->GetState());
+    size_t written = 0;
+    EXPECT_EQ(talk_base::SR_SUCCESS,
+              local_tunnel_->Write(data.data(), size, &written, NULL));
+    EXPECT_EQ(static_cast<size_t>(size), written);
+    local_tunnel_->Close();
+    EXPECT_TRUE_WAIT(done_, kTimeoutMs);
+    size_t received = 0;
+    recv_stream_.GetPosition(&received);
+    EXPECT_EQ(static_cast<size_t>(size), received);
+    EXPECT_EQ(0, memcmp(data.data(), recv_stream_.GetBuffer(), received));
   }
 
  private:
@@ -224,3 +257,19 @@ class TunnelSessionClientTest : public testing::Test,
 TEST_F(TunnelSessionClientTest, TestTransfer) {
   TestTransfer(1000000);
 }
+
+// Throughput benchmark: a bulk transfer through the stream buffers, with the
+// rate logged.
+TEST_F(TunnelSessionClientTest, TestTransferThroughput) {
+  TestTransfer(10000000);
+}
+
+// Data written before the tunnel opens is sent even if the stream is closed
+// right away.
+TEST_F(TunnelSessionClientTest, TestCloseBeforeConnect) {
+  TestCloseBeforeOpen(10000, false);
+}
+
+TEST_F(TunnelSessionClientTest, TestCloseBeforeEstablished) {
+  TestCloseBeforeOpen(10000, true);
+}